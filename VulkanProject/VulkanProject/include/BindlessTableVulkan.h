@@ -0,0 +1,80 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include <vector>
+#include <mutex>
+
+namespace vk { struct LayoutConstruct; }
+
+/* Bindless image table, a single descriptor set holding large arrays of textures and storage images.
+Scoped to the image resources of the compute passes (ComputeExperiment BINDLESS mode): per draw buffers keep their own sets
+and are not part of the table. The set is bound once per command buffer and shaders select resources through indices passed as push constants, indexing the
+arrays with dynamically uniform values (shader*ArrayDynamicIndexing device features). Vulkan 1.0 sets can not be updated once
+bound: resources are registered while initializing and the table is sealed before the first frame is recorded. Array slots never
+registered are filled with the first resource of the type so the whole array holds valid descriptors.
+Array sizes depend on the device limits, shaders size their arrays with specialization constants 0-1 (one per binding, see
+getSpecialization).
+*/
+class BindlessTableVulkan
+{
+public:
+	/* Bindings of the table set, shaders declare the arrays at these bindings.
+	*/
+	enum Binding
+	{
+		TEXTURE = 0,			// sampler2D textures[]
+		STORAGE_IMAGE = 1,		// image2D images[]
+		COUNT = 2
+	};
+
+	BindlessTableVulkan();
+
+	/* Create the table layout and set. Array sizes are clamped to the per stage limits of the device.
+	limits			<<	Limits of the physical device.
+	maxTextures		<<	Size of the combined image sampler array.
+	maxImages		<<	Size of the storage image array.
+	*/
+	void init(VkDevice device, const VkPhysicalDeviceLimits &limits, uint32_t maxTextures = 1024, uint32_t maxImages = 64);
+	void destroy();
+
+	/* Register a resource in the table.
+	return	>>	Index of the resource in the array of its binding.
+	*/
+	uint32_t addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t addStorageImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+
+	/* Write the registered resources to the set, no resources can be added after the table is sealed.
+	*/
+	void seal();
+	bool isSealed() { return _sealed; }
+
+	/* Construct the pipeline layout with the table as set 0, the index blocks are declared on the construct beforehand (definePushConstant).
+	The caller owns the pipeline layout (vkDestroyPipelineLayout, not LayoutConstruct::destroy), the table set layout is owned by the table.
+	layout	<<	Construct without set layouts of its own holding the push constant blocks, receives the pipeline layout.
+	*/
+	void createPipelineLayout(vk::LayoutConstruct &layout);
+	/* Bind the table set to set 0, the table must be sealed.
+	*/
+	void bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+	/* Specialization constants 0-1 holding the array size of each binding (uint32).
+	*/
+	const VkSpecializationInfo* getSpecialization() { return &_specialization; }
+	VkDescriptorSetLayout getLayout() { return _layout; }
+	/* Number of resources registered and array size of the binding. */
+	uint32_t getCount(Binding binding) { return (uint32_t)_slots[binding].size(); }
+	uint32_t getCapacity(Binding binding) { return _capacity[binding]; }
+
+private:
+	VkDevice _device;
+	VkDescriptorSetLayout _layout;
+	VkDescriptorPool _pool;
+	VkDescriptorSet _set;
+	uint32_t _capacity[COUNT];
+	VkSpecializationMapEntry _specEntries[COUNT];
+	VkSpecializationInfo _specialization;
+	std::vector<VkDescriptorImageInfo> _slots[COUNT];
+	bool _sealed;
+	std::mutex _lock;
+
+	uint32_t add(Binding binding, const VkDescriptorImageInfo &slot);
+};
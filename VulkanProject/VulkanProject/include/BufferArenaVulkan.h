@@ -0,0 +1,77 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "Stuff\TLSFAllocator.h"
+#include <vector>
+#include <mutex>
+
+class VulkanRenderer;
+
+/* Hands out (buffer, offset, size) views of a few large buffers of one usage.
+Objects share the VkBuffer and its memory partition and bind through offsets, the arena creates blocks on demand with doubling size.
+Views larger than half a block get a dedicated buffer, they can be imported into the frame graph without covering other views.
+*/
+class BufferArenaVulkan
+{
+public:
+	enum Usage
+	{
+		UNIFORM = 0,
+		STORAGE = 1,
+		VERTEX = 2,
+		INDEX = 3,
+		COUNT
+	};
+	/* Range of an arena buffer.
+	*/
+	struct View
+	{
+		VkBuffer _buffer;
+		VkDeviceSize _offset, _size;
+
+		bool valid() const { return _buffer != VK_NULL_HANDLE; }
+	};
+	struct Stats
+	{
+		uint32_t _blocks, _dedicated, _views;
+		VkDeviceSize _reserved;		// Bytes of the block buffers
+		VkDeviceSize _used;			// Bytes of the views, including alignment padding
+	};
+
+	BufferArenaVulkan();
+
+	/* Set up the arena, no buffer is created until the first view is allocated.
+	blockSize	<<	Size of the first block.
+	*/
+	void init(VulkanRenderer *renderer, Usage usage, VkDeviceSize blockSize);
+	/* Destroy the blocks, the views must no longer be in use by the device. */
+	void destroy();
+
+	/* Allocate a view aligned to the offset alignment of the usage. */
+	View allocate(VkDeviceSize size);
+	void free(const View &view);
+
+	/* Minimum offset alignment of the views (descriptor offset alignment of the usage). */
+	VkDeviceSize getAlignment() { return _alignment; }
+	Stats getStats();
+
+private:
+	struct Block
+	{
+		VkBuffer _buffer;
+		size_t _poolOffset;				// Partition of the renderer memory pool
+		bool _dedicated;				// Single view, not sub-allocated
+		mf::TLSFAllocator _allocator;
+	};
+
+	VulkanRenderer *_renderHandle;
+	Usage _usage;
+	VkBufferUsageFlags _flags;
+	uint32_t _pool;						// MemoryPool of the blocks
+	VkDeviceSize _blockSize, _alignment;
+	std::vector<Block> _blocks;
+	uint32_t _views;
+	std::mutex _lock;
+
+	Block& createBlock(VkDeviceSize size, bool dedicated);
+	void destroyBlock(Block &block);
+};
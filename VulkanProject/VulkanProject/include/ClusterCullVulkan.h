@@ -0,0 +1,107 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanConstruct.h"
+#include "BufferArenaVulkan.h"
+#include "glm\glm.hpp"
+#include <vector>
+
+class VulkanRenderer;
+class ShaderVulkan;
+class TechniqueVulkan;
+class TechniqueBuilderVulkan;
+class ConstantDoubleBufferVulkan;
+class DepthPyramidVulkan;
+
+/* GPU frustum, normal cone and occlusion culling of geometry clusters writing the indirect draws of each view.
+A compute pass tests the bounding sphere of every cluster against the frustum planes of the culled views, and the normal cone against
+the viewer (back facing clusters, see mf::Meshlet), and writes a draw command per cluster. The camera view is also tested against the
+depth pyramid of the previous frame (DepthPyramidVulkan): the sphere is projected with the previous camera matrix and culled if it is
+behind the depth drawn there. The previous depth is an estimate of the occluders, a cluster uncovered by the camera motion is
+drawn a frame late. Compacted, the visible clusters append their command and the draw reads the count from a buffer (VK_AMD_draw_indirect_count).
+Otherwise each cluster writes its own command slot with zero instances when culled, so draws can cover any range of the clusters.
+*/
+class ClusterCullVulkan
+{
+public:
+	enum View
+	{
+		CAMERA = 0,
+		LIGHT = 1,
+		VIEW_COUNT
+	};
+	/* Range of the geometry drawn by a cluster, matches the shader struct (std430).
+	*/
+	struct Cluster
+	{
+		glm::vec4 _sphere;		// Bounding sphere in object space, xyz center and w radius
+		glm::vec4 _cone;		// Normal cone, xyz axis and w cutoff (mf::Meshlet), (0, 0, 0, 1) is never back facing
+		uint32_t _first;		// First index, or first vertex if not indexed
+		uint32_t _count;		// Number of indices (vertices)
+		int32_t _vertexOffset;	// Added to the indices
+		uint32_t _pad;
+	};
+
+	ClusterCullVulkan(VulkanRenderer *renderer);
+	virtual ~ClusterCullVulkan();
+
+	/* Upload the clusters and request the culling and depth pyramid techniques from the builder.
+	indexed	<<	If the clusters are drawn with indexed draws.
+	compact	<<	Compact the visible draws, ignored if the device can't read the draw count from a buffer.
+	*/
+	void init(const std::vector<Cluster> &clusters, bool indexed, bool compact, TechniqueBuilderVulkan &builder);
+	/* Set the frustum and the viewer of a view from the object to clip space matrix of the view.
+	*/
+	void setFrustum(View view, const glm::mat4 &objectToClip);
+	/* Test a cluster against the view set on the CPU, the frustum and cone tests of the compute pass (not the occlusion). */
+	bool isVisible(View view, const Cluster &cluster);
+	/* Write the frustum planes of the next frame. */
+	void transfer();
+	/* Cull the clusters for the views [firstView, firstView + numViews), recorded outside of render passes.
+	Culling the camera view first builds the depth pyramid from the depth left by the previous frame, it must be recorded before the
+	frame pass of the frame. The commands are made visible to the indirect draws following in the queue.
+	*/
+	void cull(VkCommandBuffer cmdBuf, uint32_t firstView, uint32_t numViews);
+	/* Draw the visible clusters of the view, the geometry buffers must be bound. */
+	void draw(VkCommandBuffer cmdBuf, View view);
+	/* Draw the visible clusters in a range of the clusters, not available when compacted. */
+	void draw(VkCommandBuffer cmdBuf, View view, uint32_t firstCluster, uint32_t numClusters);
+
+	bool isCompact() { return _compact; }
+	uint32_t getClusterCount() { return _numClusters; }
+
+private:
+	struct Frustum
+	{
+		glm::vec4 _planes[VIEW_COUNT][6];	// Normalized, inside if dot(plane.xyz, p) + plane.w >= 0
+		glm::vec4 _eye[VIEW_COUNT];			// Viewer position (w = 1), or view direction of parallel projections (w = 0)
+		glm::mat4 _occlusionClip;			// Object to clip space of the camera the depth pyramid was drawn with
+	};
+	struct CullParams
+	{
+		uint32_t _numClusters, _firstView;
+		uint32_t _occlusion;				// If the depth pyramid holds a drawn frame
+	};
+
+	VulkanRenderer *_renderHandle;
+	ShaderVulkan *_shader;
+	TechniqueVulkan *_technique;
+	vk::LayoutConstruct _layout;		// Set 0 frustum uniforms, set 1 clusters, commands and counts, set 2 depth pyramid
+	vk::PushConstant<CullParams> _params;
+	ConstantDoubleBufferVulkan *_frustumBuffer;
+	Frustum _frustum;
+	glm::mat4 _cameraClip;				// Camera matrix of the frame, the occlusion matrix of the next
+	VkDescriptorSet _storage, _pyramidSet;
+	DepthPyramidVulkan *_pyramid;
+	bool _depthDrawn;					// If a frame pass has drawn the depth since the camera was first culled
+
+	BufferArenaVulkan::View _clusters, _draws, _counts;
+	uint32_t _numClusters, _stride;
+	bool _indexed, _compact;
+
+	// Specialization of the shader, referenced until the technique is built
+	uint32_t _constants[2];
+	VkSpecializationMapEntry _constantEntries[2];
+	VkSpecializationInfo _specialization;
+
+	void drawRange(VkCommandBuffer cmdBuf, VkDeviceSize offset, uint32_t count);
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanRenderer.h"
+#include <vector>
+#include <functional>
+
+/* Records jobs in parallel into secondary command buffers which are then executed in a primary buffer.
+Each worker thread owns one command pool per frame in flight, pools of a frame are reset the first time the recorder
+is used in a frame (after the frame fence is waited on by beginCommandBuffer/beginCompute).
+Secondary buffers do not inherit pipeline or descriptor state, each job must bind the state it uses.
+*/
+class CommandRecorderVulkan
+{
+public:
+	/* Job recording commands into the secondary command buffer. Jobs are called concurrently from the worker threads.
+	*/
+	typedef std::function<void(VkCommandBuffer cmdBuf)> Job;
+
+	/* Create the per thread command pools.
+	renderer	<<	Renderer providing the device and worker threads.
+	queue		<<	Queue the primary buffer executing the jobs is submitted to.
+	*/
+	CommandRecorderVulkan(VulkanRenderer *renderer, QueueType queue);
+	~CommandRecorderVulkan();
+
+	/* Begin a new set of jobs.
+	renderPass	<<	Render pass the jobs continue, VK_NULL_HANDLE if recorded outside a render pass.
+				The pass must be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+	frameBuffer	<<	Frame buffer of the render pass (optional).
+	subpass		<<	Index of the subpass the jobs are executed in.
+	*/
+	void begin(VkRenderPass renderPass = VK_NULL_HANDLE, VkFramebuffer frameBuffer = VK_NULL_HANDLE, uint32_t subpass = 0);
+	/* Add a job to the current set. Jobs are executed in the order they are added.
+	*/
+	void addJob(const Job &job);
+	/* Record the jobs over the worker threads and execute the recorded buffers in the primary buffer. Blocks until recording is complete.
+	primary	<<	Primary command buffer executing the jobs.
+	*/
+	void execute(VkCommandBuffer primary);
+
+	uint32_t numJobs() { return (uint32_t)_jobs.size(); }
+
+private:
+	/* Command pool owned by a single worker.
+	*/
+	struct WorkerPool
+	{
+		VkCommandPool _pool;
+		std::vector<VkCommandBuffer> _buffers;	// Secondary buffers allocated from the pool
+		uint32_t _used;							// Number of buffers used since the pool was reset
+
+		VkCommandBuffer acquire(VkDevice device);
+	};
+
+	VulkanRenderer *_renderHandle;
+	QueueType _queue;
+	std::vector<std::vector<WorkerPool>> _pools;	// Pools per [frame][worker]
+	uint64_t _frameNumber;							// Frame the pools were last reset in
+	VkCommandBufferInheritanceInfo _inheritance;
+	std::vector<Job> _jobs;
+	std::vector<VkCommandBuffer> _recorded;
+};
@@ -1,10 +1,11 @@
 #pragma once
 #include "VulkanRenderer.h"
+#include "UniformRingVulkan.h"
 #include "vulkan\vulkan.h"
 
 class ShaderVulkan;
 
-/* Single buffered Uniform buffer
+/* Single buffered Uniform buffer, a view of the uniform (or storage) buffer arena.
 */
 class ConstantBufferVulkan
 {
@@ -14,7 +15,9 @@ public:
 	void setData(const void* data, size_t byteSize, uint32_t setBindIndex, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 	void setData(const void * data, size_t byteSize, uint32_t setBindIndex, VkDescriptorSetLayout layout, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 	void bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout, VkPipelineBindPoint bindPoint= VK_PIPELINE_BIND_POINT_GRAPHICS);
+	/* Arena buffer holding the data at getOffset(). */
 	VkBuffer getBuffer();
+	size_t getOffset() { return (size_t)view._offset; }
 	void setUseCustomDescriptor(bool useCustomDescriptor);
 
 private:
@@ -22,19 +25,24 @@ private:
 
 	void transferData(const void* data, size_t byteSize, VkBufferUsageFlags usage);
 	VkDescriptorSet descriptor;
-	VkBuffer buffer;
+	VkDescriptorSetLayout descLayout;
+	BufferArenaVulkan::View view;
+	uint32_t arena;		// BufferArenaVulkan::Usage of the view
 
 	VulkanRenderer* _renderHandle;
 
 	uint32_t location;
-	size_t poolOffset, memSize;
+	size_t memSize;
 
 	// True if user handles descriptors and binding on their own
 	// Makes the constant buffer ignore its own descriptor handling
 	bool customDescriptor = false;
 };
 
-/* Double buffered Uniform buffer
+/* Uniform buffer with a copy for each frame, bound as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC (the set layout binding must be dynamic).
+Data up to UNIFORM_RING_MAX_UPDATE is a slot of the renderer uniform ring written directly by the CPU. Larger data falls back to
+consecutive aligned slices of a uniform arena view updated through the staging transfers. The frame copy is selected by the dynamic
+offset, update the data every frame as the copies are not kept in sync.
 */
 class ConstantDoubleBufferVulkan
 {
@@ -46,16 +54,17 @@ public:
 	void bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
 
 private:
-	// Double buffered:
+	// Buffered per frame:
 
-
-	VkDescriptorSet descriptor[2];
-	VkBuffer buffer[2];
+	VkDescriptorSet descriptor;
+	UniformRingVulkan::Slot slot;	// Slot of the uniform ring, invalid if the data did not fit
+	BufferArenaVulkan::View view;	// Staged fallback, a slice per frame in flight
+	size_t stride;					// Distance between the staged frame copies
 
 	VulkanRenderer* _renderHandle;
 
 	uint32_t location;
-	size_t poolOffset, memSize, bufSize;
+	size_t memSize, bufSize;
 
 };
 
@@ -0,0 +1,52 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanConstruct.h"
+#include <vector>
+
+class VulkanRenderer;
+class ShaderVulkan;
+class TechniqueVulkan;
+class TechniqueBuilderVulkan;
+
+/* Hierarchical depth (HiZ) of the frame depth buffer, used for occlusion culling.
+A compute pass reduces the depth buffer into an R32F mip chain where each texel keeps the farthest depth of the area it covers. A screen
+rectangle fitting in a texel of a level overlaps at most 2x2 texels of it, and is occluded if its nearest depth is farther than theirs.
+The first level is the depth buffer size rounded down to a power of two. The pyramid is built from the depth left by the previous frame
+before the frame pass clears it, so it is only valid for the camera matrix of the previous frame.
+*/
+class DepthPyramidVulkan
+{
+public:
+	DepthPyramidVulkan(VulkanRenderer *renderer);
+	virtual ~DepthPyramidVulkan();
+
+	/* Create the pyramid for the frame depth buffer and request the reduction technique from the builder.
+	*/
+	void init(TechniqueBuilderVulkan &builder);
+	/* Reduce the depth buffer into the pyramid, recorded outside of render passes. The depth buffer is read after the frame pass of the
+	previous frame and returned to the attachment layout, the pyramid is made visible to the compute shaders following in the queue.
+	*/
+	void build(VkCommandBuffer cmdBuf);
+
+	/* View of all the levels, sampled in the general layout with the nearest sampler. */
+	VkImageView getView() { return _view; }
+	VkSampler getSampler() { return _sampler; }
+
+private:
+	struct Level
+	{
+		VkImageView _view;		// Written by the reduction, sampled by the reduction of the next level
+		VkDescriptorSet _set;	// Previous level (or the depth buffer) and the level
+		uint32_t _width, _height;
+	};
+
+	VulkanRenderer *_renderHandle;
+	ShaderVulkan *_shader;
+	TechniqueVulkan *_technique;
+	vk::LayoutConstruct _layout;		// Set 0 source and destination of a reduction
+	VkImage _image;
+	size_t _poolOffset;
+	VkImageView _view;
+	VkSampler _sampler;
+	std::vector<Level> _levels;
+};
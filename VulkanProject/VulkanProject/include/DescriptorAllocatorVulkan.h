@@ -0,0 +1,63 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include <vector>
+#include <mutex>
+
+/* Descriptor set allocator growing by chaining descriptor pools.
+Sets are allocated from a persistent arena living until the allocator is destroyed, or from the transient arena of a frame in
+flight. A transient arena is reset as a whole (vkResetDescriptorPool) when the frame context is re-used, its pools are kept for
+the next frame. Allocation is thread safe.
+*/
+class DescriptorAllocatorVulkan
+{
+public:
+	/* Allocation counts of an arena.
+	*/
+	struct Stats
+	{
+		uint32_t _sets;			// Sets allocated since the arena was reset (persistent: since creation)
+		uint32_t _pools;		// Pools chained in the arena
+		uint32_t _resets;		// Number of times the arena was reset
+	};
+
+	DescriptorAllocatorVulkan();
+
+	/* Create the arenas.
+	device		<<	Device the pools are created on.
+	numFrames	<<	Number of frames in flight, a transient arena is created per frame.
+	setsPerPool	<<	Number of sets (and descriptors of each type) a pool in the chain can hold.
+	*/
+	void init(VkDevice device, uint32_t numFrames, uint32_t setsPerPool = 512);
+	void destroy();
+
+	/* Allocate a set from the persistent arena.
+	*/
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	/* Allocate a set valid for the frame in flight, released when the frame is reset.
+	*/
+	VkDescriptorSet allocateFrame(uint32_t frame, VkDescriptorSetLayout layout);
+	/* Reset the transient arena of the frame, the frame's previous submissions must be complete.
+	*/
+	void resetFrame(uint32_t frame);
+
+	Stats getPersistentStats();
+	Stats getFrameStats(uint32_t frame);
+
+private:
+	struct Arena
+	{
+		std::vector<VkDescriptorPool> _pools;
+		uint32_t _current;		// Pool allocated from, pools before it are full
+		Stats _stats;
+	};
+
+	VkDevice _device;
+	uint32_t _setsPerPool;
+	Arena _persistent;
+	std::vector<Arena> _frames;
+	std::mutex _lock;
+
+	VkDescriptorSet allocate(Arena &arena, VkDescriptorSetLayout layout);
+	VkDescriptorPool createPool();
+	void destroy(Arena &arena);
+};
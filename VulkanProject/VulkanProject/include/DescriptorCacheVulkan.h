@@ -0,0 +1,76 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+class DescriptorAllocatorVulkan;
+
+/* Cache of written descriptor sets keyed by the set layout and the bound resources.
+Objects binding identical resources with the same layout share a single set. Sets written on a cache miss are updated through a
+descriptor update template per layout and binding signature (VK_KHR_descriptor_update_template), or with vkUpdateDescriptorSets if
+the extension is not available. Cached sets are allocated from the persistent arena, resources referenced by the cache are
+invalidated when destroyed and their sets are re-written for later requests with the same layout.
+*/
+class DescriptorCacheVulkan
+{
+public:
+	/* Resource bound to a single descriptor binding. Use the constructor functions, padding must be zeroed for the hash.
+	*/
+	struct Binding
+	{
+		uint32_t _binding;
+		VkDescriptorType _type;
+		union
+		{
+			VkDescriptorBufferInfo _buffer;
+			VkDescriptorImageInfo _image;
+		};
+
+		static Binding buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+		static Binding image(uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout, VkSampler sampler = VK_NULL_HANDLE);
+	};
+
+	struct Stats
+	{
+		uint32_t _hits, _misses;
+		uint32_t _templates;
+	};
+
+	DescriptorCacheVulkan();
+
+	/* Initialize the cache, fetches the template functions if the extension is enabled on the device.
+	*/
+	void init(VkDevice device, DescriptorAllocatorVulkan *allocator, bool useTemplates);
+	void destroy();
+
+	/* Get a set with the resources bound, written on the first request.
+	layout		<<	Layout of the set.
+	bindings	<<	Resources bound, one per binding of the layout.
+	*/
+	VkDescriptorSet get(VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings);
+	VkDescriptorSet get(VkDescriptorSetLayout layout, const Binding &binding) { return get(layout, &binding, 1); }
+	/* Drop the sets referencing a destroyed resource, the sets must no longer be in use by the device.
+	handle		<<	Buffer, image view or sampler handle.
+	*/
+	void invalidate(uint64_t handle);
+
+	Stats getStats();
+
+private:
+	VkDevice _device;
+	DescriptorAllocatorVulkan *_allocator;
+	std::unordered_map<std::string, VkDescriptorSet> _sets;
+	std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> _free;	// Invalidated sets re-used for misses
+	std::unordered_map<std::string, VkDescriptorUpdateTemplateKHR> _templates;
+	std::mutex _lock;
+	Stats _stats;
+
+	PFN_vkCreateDescriptorUpdateTemplateKHR _createTemplate;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR _destroyTemplate;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR _updateWithTemplate;
+
+	VkDescriptorUpdateTemplateKHR getTemplate(VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings);
+	void write(VkDescriptorSet set, VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings);
+};
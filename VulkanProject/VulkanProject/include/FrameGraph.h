@@ -0,0 +1,188 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanRenderer.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+/* Frame graph declaring the passes of a frame and the resources they access.
+Compiling the graph assigns the passes to queues, infers the barriers (layout transitions, memory dependencies and queue family
+ownership transfers) and the semaphore waits between the queue submissions, and aliases the memory of transient images with
+disjoint lifetimes. Executing the graph records and submits the passes for the current frame, presenting is left to the caller.
+
+Passes on the same queue are recorded into one command buffer (one submission per queue and frame), the graph must contain a
+graphics pass as it consumes the frame image acquisition.
+*/
+class FrameGraph
+{
+public:
+	typedef uint32_t Resource;
+	/* Pass function recording the pass commands into the command buffer of the queue it is assigned to.
+	*/
+	typedef std::function<void(const VulkanRenderer::FrameInfo &info)> PassFunc;
+
+	/* How passes without dependencies between them are scheduled.
+	*/
+	enum Overlap
+	{
+		ASYNC,			// Only the inferred barriers are recorded, independent passes on a queue can overlap.
+		SEQUENTIAL,		// Passes on the same queue are serialized by a full pipeline barrier.
+		MULTI_QUEUE		// Independent compute passes are distributed over the compute queues.
+	};
+
+	/* Pipeline stage, access and image layout of a resource access.
+	*/
+	struct Access
+	{
+		VkPipelineStageFlags _stage;
+		VkAccessFlags _access;
+		VkImageLayout _layout;		// Layout required by the pass, VK_IMAGE_LAYOUT_UNDEFINED if the content is discarded (cleared render pass attachment).
+		VkImageLayout _finalLayout;	// Layout the image is left in by the pass (render pass final layout).
+
+		Access();
+		Access(VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+		Access(VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, VkImageLayout finalLayout);
+		bool isWrite() const;
+	};
+	/* Access presets */
+	static Access colorAttachment(VkImageLayout finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	static Access depthAttachment(VkImageLayout finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	static Access sampled(VkPipelineStageFlags stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	static Access storageImage(bool write, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	static Access storageBuffer(bool write, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	static Access transferSrc();
+	static Access transferDst();
+	static Access present(VkImageLayout layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	/* Description of an image owned by the graph.
+	*/
+	struct ImageDesc
+	{
+		uint32_t _width, _height;
+		VkFormat _format;
+		VkImageUsageFlags _usage;
+		VkImageAspectFlags _aspect;
+	};
+
+	/* Pass declaration, resource accesses are declared in the order they are used.
+	*/
+	class Pass
+	{
+	public:
+		Pass& read(Resource resource, const Access &access);
+		Pass& write(Resource resource, const Access &access);
+	private:
+		friend class FrameGraph;
+		struct Use
+		{
+			Resource _resource;
+			Access _access;
+		};
+		std::string _name;
+		QueueType _queue;			// Queue requested, COMPUTE passes can be moved to COMPUTE2 by the MULTI_QUEUE policy.
+		PassFunc _func;
+		std::vector<Use> _uses;
+	};
+
+	FrameGraph(VulkanRenderer *renderer);
+	~FrameGraph();
+
+	/* Import an image owned outside the graph, the image is set each frame with setImage.
+	aspect		<<	Image aspect.
+	initial		<<	State of the image at the beginning of the frame (VK_IMAGE_LAYOUT_UNDEFINED if the content is not preserved).
+	initialQueue<<	Queue owning the image at the beginning of the frame.
+	final		<<	State the image is transitioned to at the end of the frame.
+	finalQueue	<<	Queue the image is released to at the end of the frame.
+	*/
+	Resource importImage(VkImageAspectFlags aspect, const Access &initial, QueueType initialQueue, const Access &final, QueueType finalQueue);
+	/* Import a buffer owned outside the graph.
+	owner		<<	Queue owning the buffer at the beginning and end of the frame. Uses on another queue family acquire the buffer from
+					the owner submission (which must be submitted earlier) and the buffer is returned to the owner at the end of the graph.
+	*/
+	Resource importBuffer(VkBuffer buffer, QueueType owner);
+	/* Create an image owned by the graph, an image is created for each frame in flight. The content is not preserved between frames
+	and the memory is aliased with other transient images not used over the same passes.
+	*/
+	Resource createImage(const ImageDesc &desc);
+	/* Set the imported image handles used for the current frame.
+	*/
+	void setImage(Resource resource, VkImage image, VkImageView view = VK_NULL_HANDLE);
+
+	Pass& addPass(const char *name, QueueType queue, const PassFunc &func);
+	void setOverlap(Overlap overlap);
+
+	/* Compile the graph and allocate the transient resources. Must be called after the passes are added and before execute.
+	*/
+	void compile();
+	/* Record and submit the passes for the current frame.
+	*/
+	void execute();
+
+	VkImage getImage(Resource resource);
+	VkImageView getView(Resource resource);
+	/* Number of bytes allocated for the transient images of a frame (after aliasing) and the size required without aliasing.
+	*/
+	void getTransientMemory(VkDeviceSize &allocated, VkDeviceSize &required);
+
+private:
+	enum ResourceType
+	{
+		IMPORTED_IMAGE,
+		IMPORTED_BUFFER,
+		TRANSIENT_IMAGE
+	};
+	struct ResourceInfo
+	{
+		ResourceType _type;
+		VkImageAspectFlags _aspect;
+		Access _initial, _final;
+		QueueType _initialQueue, _finalQueue;
+		VkImage _image;
+		VkImageView _view;
+		VkBuffer _buffer;
+		ImageDesc _desc;
+		std::vector<VkImage> _frameImages;			// Transient images per frame in flight
+		std::vector<VkImageView> _frameViews;
+		VkDeviceSize _memOffset;					// Offset of the aliased memory slot in the frame allocation
+		int _aliasPredecessor;						// Transient resource previously occupying the memory, -1 if none
+	};
+	/* Barrier recorded for a resource.
+	*/
+	struct Barrier
+	{
+		Resource _resource;
+		VkPipelineStageFlags _srcStage, _dstStage;
+		VkAccessFlags _srcAccess, _dstAccess;
+		VkImageLayout _oldLayout, _newLayout;
+		uint32_t _srcFamily, _dstFamily;
+	};
+	/* Passes recorded into a single submission on a queue.
+	*/
+	struct Batch
+	{
+		QueueType _queue;
+		std::vector<uint32_t> _passes;
+		std::vector<uint32_t> _waits;			// Batches waited on before execution
+		std::vector<Barrier> _release;			// Ownership releases/acquires and final transitions recorded at the end of the batch
+		vk::Ticket _ticket;
+	};
+
+	VulkanRenderer *_renderHandle;
+	Overlap _overlap;
+	bool _compiled;
+	std::vector<ResourceInfo> _resources;
+	std::vector<Pass> _passes;
+	std::vector<QueueType> _passQueue;					// Queue assigned to each pass
+	std::vector<std::vector<Barrier>> _passBarriers;	// Barriers recorded before each pass
+	std::vector<Batch> _batches;						// In submission order
+	std::vector<VkDeviceMemory> _transientMemory;		// Memory backing the transient images per frame in flight
+	VkDeviceSize _transientSize, _transientRequired;
+
+	void assignQueues();
+	void inferBarriers();
+	void allocateTransients();
+	void destroyTransients();
+	void recordBarrier(VkCommandBuffer cmdBuf, const Barrier &barrier);
+	uint32_t batchOf(QueueType queue);
+	uint32_t family(QueueType queue);
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include<vulkan/vulkan.h>
+#include "BufferArenaVulkan.h"
+
+
+class VulkanRenderer;
+
+/* Index data held in a view of the index buffer arena (INDEX_BUFFER pool).
+*/
+class IndexBufferVulkan
+{
+public:
+	/* Binding used to bind index buffers, a range of indices of a single type.
+	*/
+	struct Binding {
+		VkIndexType type;
+		uint32_t numIndices, offset;
+		IndexBufferVulkan* buffer;
+		void bind(VkCommandBuffer cmdBuf);
+
+		Binding();
+		Binding(IndexBufferVulkan* buffer, VkIndexType type, uint32_t numIndices, uint32_t offset);
+		uint32_t sizeElement() { return type == VK_INDEX_TYPE_UINT16 ? 2 : 4; }
+		size_t byteSize() { return sizeElement() * numIndices; }
+	};
+
+	IndexBufferVulkan(VulkanRenderer *renderHandle, size_t size);
+	~IndexBufferVulkan();
+
+	void setData(const void* data, size_t size, size_t offset);
+	/* Upload 32 bit indices into the binding range, narrowed to 16 bits if the binding type is VK_INDEX_TYPE_UINT16. */
+	void setData(const uint32_t* indices, Binding& binding);
+	void bind(VkCommandBuffer cmdBuf, size_t offset, VkIndexType type);
+	size_t getSize();
+	/* Smallest index type able to address the number of vertices. */
+	static VkIndexType fitIndexType(size_t numVertices);
+	VkBuffer _bufferHandle;
+private:
+
+	VulkanRenderer* _renderHandle;
+	size_t memSize;
+	BufferArenaVulkan::View _view;	// Range of the index arena holding the data
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include <string>
+#include <mutex>
+
+/* Pipeline cache shared by the techniques of a renderer and persisted to disk between runs.
+The cache data on disk is prefixed with the driver version, data created by another device (pipelineCacheUUID, vendor or device ID)
+or driver version is discarded and the cache starts empty. The header also keeps the cold time per pipeline measured on the run
+that filled the cache, used as the baseline for the estimated hits/misses.
+*/
+class PipelineCacheVulkan
+{
+public:
+	struct Stats
+	{
+		uint32_t _created;				// Pipelines created through the cache.
+		double _createTime;				// Time spent creating pipelines (ms).
+		uint32_t _estimatedHits, _estimatedMisses;	// Estimate only: Vulkan 1.0 does not report if a pipeline was found in the cache.
+										// Each create call is classified by its time per pipeline against the cold baseline,
+										// a call with several pipelines counts as all hits or all misses.
+		double _baselineTime;			// Cold (miss) time per pipeline the calls are compared against (ms), 0 if none is known yet.
+		double _loadTime, _saveTime;	// Time spent reading/validating and writing the cache file (ms).
+		size_t _loadedBytes, _savedBytes;
+		bool _loaded;					// If valid cache data was loaded from disk.
+	};
+
+	PipelineCacheVulkan();
+	~PipelineCacheVulkan();
+
+	/* Create the cache, initialized from the file if it holds valid data for the device.
+	device		<<	Device the cache is created on.
+	properties	<<	Properties of the physical device, identifying the cache data.
+	path		<<	File the cache is loaded from and saved to.
+	*/
+	void load(VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &path);
+	/* Write the cache data to the file it was loaded from.
+	*/
+	void save();
+	void destroy();
+
+	/* Create pipelines through the cache, thread safe.
+	*/
+	VkResult createGraphicsPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo *info, VkPipeline *pipelines);
+	VkResult createComputePipelines(uint32_t count, const VkComputePipelineCreateInfo *info, VkPipeline *pipelines);
+
+	VkPipelineCache getCache() { return _cache; }
+	Stats getStats();
+
+private:
+	/* Header prefixing the cache data in the file.
+	*/
+	struct FileHeader
+	{
+		uint32_t _magic;
+		uint32_t _driverVersion;
+		uint64_t _dataSize;
+		double _baselineTime;			// Cold time per pipeline (ms).
+	};
+
+	VkDevice _device;
+	VkPipelineCache _cache;
+	VkPhysicalDeviceProperties _properties;
+	std::string _path;
+	std::mutex _statLock;
+	Stats _stats;
+	double _missTime;					// Time spent in the calls estimated as misses (ms).
+
+	bool validate(const char *data, size_t size);
+	size_t dataSize();
+	void record(uint32_t count, double time);
+};
@@ -14,6 +14,10 @@ public:
 
 	virtual void defineDescriptorLayout(VkDevice device, std::vector<VkDescriptorSetLayout> &layout) = 0;
 	virtual VkRenderPass defineRenderPass(VkDevice device, VkFormat swapchainFormat, VkFormat depthFormat, std::vector<VkImageView>& additionalAttatchments) = 0;
+	/* Size the first device allocation of the memory pools, the pools grow when full. The staging pool is a fixed size ring.
+	chunkSizes	<<	Byte sizes indexed by MemoryPool, initialized to POOL_CHUNK_SIZE.
+	*/
+	virtual void defineMemoryPools(std::vector<size_t> &chunkSizes) {};
 
 	virtual void initialize(VulkanRenderer *handle) { _renderHandle = handle; };
 	virtual void frame(float dt) = 0;
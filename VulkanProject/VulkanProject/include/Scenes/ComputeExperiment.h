@@ -7,6 +7,8 @@
 #include "ShaderVulkan.h"
 #include "Texture2DVulkan.h"
 #include "Sampler2DVulkan.h"
+#include "CommandRecorderVulkan.h"
+#include "FrameGraph.h"
 
 
 class ComputeExperiment :
@@ -19,7 +21,8 @@ public:
 		ASYNC,
 		SEQUENTIAL,
 		MULTI_QUEUE,
-		MULTI_DISPATCH
+		MULTI_DISPATCH,
+		MULTI_THREAD		// MULTI_DISPATCH recorded over the worker threads into secondary command buffers
 	};
 
 	enum ShaderModeBit
@@ -31,7 +34,9 @@ public:
 		MEM_25 = 16,
 		MEM_50 = 32,
 		MEM_75 = 64,
-		MEM_100 = 128
+		MEM_100 = 128,
+		BINDLESS = 256,		// MEM_LIMITED post pass indexing the renderer bindless table (requires the BINDLESS render flag)
+		BLIT_CHAIN = 512	// Frame is blitted down and back up through graph transient images before the post pass (aliased memory)
 	};
 	
 	ComputeExperiment(Mode mode = ASYNC, uint32_t shader = REG_LIMITED, uint32_t num_particles = 1024 * 512, float locality = 8);
@@ -42,14 +47,28 @@ public:
 	virtual void initialize(VulkanRenderer *handle);
 	virtual void defineDescriptorLayout(VkDevice device, std::vector<VkDescriptorSetLayout> &layout);
 	virtual VkRenderPass defineRenderPass(VkDevice device, VkFormat swapchainFormat, VkFormat depthFormat, std::vector<VkImageView>& additionalAttatchments);
+	virtual void defineMemoryPools(std::vector<size_t> &chunkSizes);
 
 private:
+	struct Particle
+	{
+		float x; glm::vec2 pos, vel;
+	};
+
 	Mode mode;
 	uint32_t shaderMode;
 	uint32_t NUM_PARTICLE;
 	float locality;
 
 	void makeTechnique();
+	/* Declare the frame passes, the mode selects the overlap policy of the graph. */
+	void buildGraph();
+	/* Declare the blit chain passes, the frame is blitted down through half and quarter sized transients and back up. */
+	void addBlitChain();
+	/* Bind the post pass pipeline and resources. */
+	void bindPost(VkCommandBuffer cmdBuf, uint32_t swapChainIndex);
+	/* Register the post pass resources in the bindless table. */
+	void makeBindless();
 
 	// Render pass
 	ShaderVulkan *triShader;
@@ -62,11 +81,34 @@ private:
 	vk::LayoutConstruct postLayout, smallOpLayout;
 	ShaderVulkan *compShader, *compSmallOp;
 	ConstantBufferVulkan *smallOpBuf;
-	ConstantDoubleBufferVulkan *postParams;
+
+	// Post pass parameters, pushed when the pass is recorded
+	struct PostParams
+	{
+		float _locality;
+	};
+	vk::PushConstant<PostParams> postParams;
+	float postLocality;
 	
 	Sampler2DVulkan *readSampler;
 	Texture2DVulkan *readImg;
 
-	std::vector<VkDescriptorSet> swapChainImgDesc;
+	VkDescriptorSet frameImgDesc = VK_NULL_HANDLE;	// Frame image set of the current frame, allocated from the frame arena
+
+	// Bindless post pass, resources are indexed from the table through push constants
+	struct BindlessIndices
+	{
+		uint32_t _image, _texture;
+		float _locality;
+	};
+	BindlessTableVulkan *bindless = nullptr;
+	vk::LayoutConstruct bindlessLayout;	// Push constant blocks only, set 0 is the table
+	uint32_t swapChainImgIndex = 0, readImgIndex = 0;	// Index of the first swapchain image and the read texture in the table
+	vk::PushConstant<BindlessIndices> bindlessParams;
+
+	CommandRecorderVulkan *recorder = nullptr;	// Parallel recording in MULTI_THREAD mode
+
+	FrameGraph *graph = nullptr;
+	FrameGraph::Resource swapChainImg, particles;
 };
 
@@ -7,6 +7,7 @@
 #include "ShaderVulkan.h"
 #include "Texture2DVulkan.h"
 #include "Sampler2DVulkan.h"
+#include "TechniqueBuilderVulkan.h"
 
 
 class ComputeScene :
@@ -46,6 +47,7 @@ private:
 
 	// Post pass
 	TechniqueVulkan * techniquePost, *techniqueBlurHorizontal, *techniqueBlurVertical;
+	TechniqueBuilderVulkan *blurBuilder;	// Blur pipelines compile while the first frames are rendered, the copy pass is bound meanwhile
 	vk::LayoutConstruct postLayout;
 	ShaderVulkan *compShader, *blurHorizontal, *blurVertical;
 	Sampler2DVulkan *readSampler;
@@ -4,11 +4,17 @@
 #include "vulkan\vulkan.h"
 #include "glm\glm.hpp"
 #include "VertexBufferVulkan.h"
+#include "IndexBufferVulkan.h"
 #include "ConstantBufferVulkan.h"
 #include "ShaderVulkan.h"
 #include "Sampler2DVulkan.h"
 #include "Texture2DVulkan.h"
 #include "TechniqueVulkan.h"
+#include "VertexLayoutVulkan.h"
+#include "ClusterCullVulkan.h"
+#include "CommandRecorderVulkan.h"
+#include "Stuff\FrustumCull.h"
+#include "Stuff/Clusters.h"
 
 class ShadowScene :
 	public Scene
@@ -16,14 +22,36 @@ class ShadowScene :
 public:
 	enum FrameType
 	{
-		STANDARD, SINGLE_COMMAND_BUFFER, ASYNC
+		STANDARD, SINGLE_COMMAND_BUFFER, ASYNC,
+		MULTI_THREADED	// STANDARD with the draws split over worker threads recording secondary command buffers
 	};
 
-	ShadowScene(FrameType frameType = STANDARD);
+	/* packedVertices	<<	Render compressed vertices, unorm16 positions within the bounding box and octahedral normals (12 bytes instead of 28).
+	*/
+	ShadowScene(FrameType frameType = STANDARD, bool packedVertices = false);
+	enum Culling
+	{
+		NO_CULLING,
+		GPU_CULLING,	// Clusters culled by a compute pass, the camera view also against the depth of the previous frame, drawn indirectly
+		CPU_CULLING,	// Bounding boxes culled on the worker threads, the visible ranges drawn directly
+		MESHLET_CULLING	// Meshlets culled by a compute pass against the frustums and their normal cones, drawn with back face culling
+	};
+	enum Geometry
+	{
+		GENERATED,		// Random triangles distributed in a sphere
+		OBJ_MESH		// resource/cowparty.obj baked and drawn indexed
+	};
+	/* culling	<<	Cull the geometry against the camera and light frustums. The generated triangles are split into clusters,
+	*				the obj mesh is culled per cluster on the GPU and per part (object) on the CPU. Meshlets are built from
+	*				triangles sorted by facing (generated) or in the vertex cache order (obj mesh).
+	geometry	<<	Geometry drawn.
+	*/
+	ShadowScene(FrameType frameType, bool packedVertices, Culling culling, Geometry geometry = GENERATED);
 	virtual ~ShadowScene();
 
 	virtual void frame(float dt);
 	void frame_standard(float dt);
+	void frame_multithreaded(float dt);
 	void post_standard();
 	void frame_single_cmdbuf(float dt);
 	void frame_async(float dt);
@@ -45,14 +73,39 @@ private:
 	void createCameraMatrix(float time);
 
 	void createBuffers();
+	/* Create the vertex buffers, either the generated triangles or the baked obj mesh. */
+	void createGeometry();
+	/* Split the draw over the recorder jobs. The bind function records the pipeline state in each secondary buffer. */
+	void addDrawJobs(ClusterCullVulkan::View view, TechniqueVulkan *technique, const std::function<void(VkCommandBuffer)> &bindState);
+	/* Bind the vertex streams consumed by the technique (views of the vertex arena), and the index buffer if the geometry is indexed. */
+	void bindVertexStreams(VkCommandBuffer cmdBuf, TechniqueVulkan *technique);
+	/* Draw a range of the geometry, indices if the geometry is indexed otherwise vertices. */
+	void drawGeometry(VkCommandBuffer cmdBuf, uint32_t first, uint32_t count);
+	/* Number of indices (or vertices if not indexed) drawn. */
+	uint32_t geometrySize();
+	/* Draw the geometry seen by the view, the clusters (or ranges) not culled if culling is enabled. */
+	void drawView(VkCommandBuffer cmdBuf, ClusterCullVulkan::View view);
+	/* Cull the views [firstView, firstView + numViews) before their draws are recorded, outside of render passes. */
+	void cullViews(VkCommandBuffer cmdBuf, uint32_t firstView, uint32_t numViews);
+	/* Split the drawn range into clusters of consecutive triangles.
+	position	<<	Position of the n:th drawn vertex (index or vertex).
+	*/
+	void createClusters(uint32_t numDrawn, const std::function<glm::vec3(uint32_t)> &position);
+	/* Cull the meshlets as the clusters. */
+	void createClusters(const std::vector<mf::Meshlet> &meshlets);
 
 	bool firstFrame;
+	float cameraTime;	// Time of the camera path, per scene so consecutive runs follow the same path
 
 	FrameType frameType;
+	bool packedVertices;
+	Culling culling;
+	Geometry geometry;
 
-	VkCommandBuffer depthCommandBuf[2];
-	VkFence depthFence[2];
+	std::vector<VkCommandBuffer> depthCommandBuf;	// Per frame in flight
+	std::vector<VkFence> depthFence;
 	VkSemaphore colorPassCompleteSemaphore;
+	CommandRecorderVulkan *recorder = nullptr;
 
 	const uint32_t shadowMappingMatrixBindingSlot = 0;
 
@@ -67,6 +120,15 @@ private:
 
 
 	glm::mat4 transformMatrix;				// Contains all transformations done on the geometry in the rendering pass
+
+	// Transform uniforms of both passes, with the decode of the packed positions (pos * scale + offset)
+	struct VertexTransform
+	{
+		glm::mat4 _transform;
+		glm::vec4 _decodeScale, _decodeOffset;
+	};
+	VertexTransform vertexTransform(const glm::mat4 &transform);
+	glm::vec4 decodeScale = glm::vec4(1.f), decodeOffset = glm::vec4(0.f);
 	ConstantDoubleBufferVulkan* transformMatrixBuffer;
 
 	struct LightInfo
@@ -82,6 +144,24 @@ private:
 	VertexBufferVulkan::Binding positionBufferBinding;
 	VertexBufferVulkan* normalBuffer;
 	VertexBufferVulkan::Binding normalBufferBinding;
+	// Indices of the shared vertices, null if the triangles are drawn as an array
+	IndexBufferVulkan* indexBuffer = nullptr;
+	IndexBufferVulkan::Binding indexBufferBinding;
+	// Position stream and shading (normal) stream, the depth pass only consumes the positions
+	VertexLayoutVulkan vertexLayout;
+	// Clusters of the drawn geometry, culled per view when culling is enabled
+	static const uint32_t CLUSTER_TRIANGLES = 256;
+	std::vector<ClusterCullVulkan::Cluster> clusters;
+	ClusterCullVulkan *culler = nullptr;
+	// CPU culling, ranges of the drawn geometry with their boxes and the merged visible ranges of each view
+	struct DrawRange
+	{
+		uint32_t _first, _count;
+	};
+	std::vector<DrawRange> cullRanges;
+	mf::AABBSoA cullBounds;
+	std::vector<uint32_t> visibleRanges;
+	std::vector<DrawRange> drawList[ClusterCullVulkan::VIEW_COUNT];
 
 	VkFramebuffer shadowMapFrameBuffer;
 	Sampler2DVulkan* shadowMapSampler;
@@ -0,0 +1,88 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanConstruct.h"
+#include <deque>
+#include <mutex>
+
+/* Ring allocator over the persistently mapped staging buffer.
+The staging memory is mapped once and writers fill their allocation in place. Allocations made since the last submission form an
+open region, closing the region with the ticket of the submission reading it tags the region. Space is reclaimed only when the
+ticket of the oldest region is complete, an allocation not fitting the free space blocks on the oldest regions.
+Staging memory must be host coherent, no flushes are performed.
+*/
+class StagingRingVulkan
+{
+public:
+	/* Staging space handed to a writer.
+	*/
+	struct Allocation
+	{
+		void *_data;				// Mapped pointer to the allocation
+		VkBuffer _buffer;			// Staging buffer
+		VkDeviceSize _offset;		// Offset of the allocation in the buffer
+		VkDeviceSize _size;
+	};
+	struct Stats
+	{
+		VkDeviceSize _allocated;	// Bytes allocated since creation
+		uint32_t _allocations;
+		uint32_t _wraps;			// Times the ring wrapped around
+		uint32_t _waits;			// Allocations blocked on the GPU retiring a region
+	};
+
+	StagingRingVulkan();
+
+	/* Map the staging memory.
+	queues		<<	Queues the region tickets are polled and waited on.
+	buffer		<<	Staging buffer covering the memory.
+	memory		<<	Host visible and coherent memory bound to the buffer at offset 0.
+	size		<<	Byte size of the ring.
+	alignment	<<	Minimum alignment of the allocations.
+	*/
+	void init(VkDevice device, vk::QueueConstruct *queues, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize size, VkDeviceSize alignment);
+	void destroy();
+
+	/* Allocate staging space in the open region, blocks until the GPU retired enough space.
+	*/
+	Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+	/* Allocate staging space if it is free without waiting on the GPU.
+	return	>>	False if the space is still in use, the allocation is left untouched.
+	*/
+	bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, Allocation &allocation);
+	/* Tag the open region with the submission reading it, the region is reclaimed once the ticket is complete.
+	*/
+	void close(const vk::Ticket &ticket);
+	/* Return the space of an allocation the GPU is done reading (a copy submitted and waited on) without closing the region.
+	Only the latest allocation of the open region is reclaimed, the space of earlier allocations is released when the region closes.
+	*/
+	void release(const Allocation &allocation);
+	/* Reclaim the regions completed by the GPU (never blocks).
+	*/
+	void retire();
+
+	VkBuffer getBuffer() { return _buffer; }
+	Stats getStats();
+
+private:
+	struct Region
+	{
+		VkDeviceSize _bytes;		// Bytes of the ring used by the region (including wrap and alignment padding)
+		vk::Ticket _ticket;
+	};
+
+	VkDevice _device;
+	vk::QueueConstruct *_queues;
+	VkBuffer _buffer;
+	VkDeviceMemory _memory;
+	uint8_t *_mapped;
+	VkDeviceSize _size, _alignment;
+	VkDeviceSize _head;				// Next free byte
+	VkDeviceSize _used;				// Bytes in use by the closed and open regions
+	VkDeviceSize _open;				// Bytes of the open region
+	std::deque<Region> _regions;	// Closed regions in submission order
+	Stats _stats;
+	std::mutex _lock;
+
+	void retireLocked();
+	bool place(VkDeviceSize size, VkDeviceSize alignment, Allocation &allocation);
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace mf
+{
+	/* Helpers splitting triangle lists into clusters of consecutive triangles.
+	Positions are read through a function returning the position of a triangle corner (index into the list), so the data can be
+	indexed or compressed.
+	*/
+
+	/* Spread the 10 lower bits so there are two zero bits between each. */
+	inline uint32_t mortonSpread(uint32_t v)
+	{
+		v &= 0x3FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	/* Order the triangles along a Morton curve of their centroids, consecutive triangles are then spatially close.
+	numTris		<<	Number of triangles in the list.
+	position	<<	Function returning the glm::vec3 position of a corner, position(tri * 3 + corner).
+	return		>>	Triangle index of each new position.
+	*/
+	template<typename PositionFn>
+	std::vector<uint32_t> mortonTriangleOrder(uint32_t numTris, PositionFn position)
+	{
+		std::vector<glm::vec3> centroids(numTris);
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < numTris; i++)
+		{
+			centroids[i] = (position(i * 3) + position(i * 3 + 1) + position(i * 3 + 2)) / 3.f;
+			lo = glm::min(lo, centroids[i]);
+			hi = glm::max(hi, centroids[i]);
+		}
+		glm::vec3 extent = glm::max(hi - lo, glm::vec3(1e-6f));
+		std::vector<uint32_t> codes(numTris);
+		for (uint32_t i = 0; i < numTris; i++)
+		{
+			glm::uvec3 q = glm::uvec3((centroids[i] - lo) / extent * 1023.f);
+			codes[i] = mortonSpread(q.x) | (mortonSpread(q.y) << 1) | (mortonSpread(q.z) << 2);
+		}
+		std::vector<uint32_t> order(numTris);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+		return order;
+	}
+
+	/* Reorder the per vertex data of a triangle list (3 vertices per triangle).
+	elementsPerVertex	<<	Number of T of each vertex.
+	order				<<	Triangle index of each new position (mortonTriangleOrder).
+	*/
+	template<typename T>
+	void permuteTriangles(T *data, uint32_t elementsPerVertex, const std::vector<uint32_t> &order)
+	{
+		uint32_t triSize = elementsPerVertex * 3;
+		std::vector<T> copy(data, data + order.size() * triSize);
+		for (size_t i = 0; i < order.size(); i++)
+			std::copy(copy.begin() + order[i] * triSize, copy.begin() + (order[i] + 1) * triSize, data + i * triSize);
+	}
+
+	/* Bounding sphere of a range of corners, centered on the bounding box.
+	return	>>	xyz center, w radius.
+	*/
+	template<typename PositionFn>
+	glm::vec4 boundingSphere(uint32_t firstCorner, uint32_t numCorners, PositionFn position)
+	{
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+		for (uint32_t i = firstCorner; i < firstCorner + numCorners; i++)
+		{
+			glm::vec3 p = position(i);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		glm::vec3 center = (lo + hi) * 0.5f;
+		float radius2 = 0.f;
+		for (uint32_t i = firstCorner; i < firstCorner + numCorners; i++)
+		{
+			glm::vec3 d = position(i) - center;
+			radius2 = std::max(radius2, glm::dot(d, d));
+		}
+		return glm::vec4(center, std::sqrt(radius2));
+	}
+
+	/* Cluster of consecutive triangles with the bounds used to cull it.
+	*/
+	struct Meshlet
+	{
+		uint32_t _first;		// First corner (index, or vertex if not indexed)
+		uint32_t _count;		// Number of corners
+		uint32_t _numVertices;	// Unique vertices referenced
+		glm::vec4 _sphere;		// xyz center, w radius
+		glm::vec4 _cone;		// Normal cone, xyz axis and w cutoff. Every triangle faces away from a direction d (normalized, towards the
+								// meshlet) with dot(d, axis) >= cutoff. (0, 0, 0, 1) for meshlets facing every direction.
+	};
+
+	/* Order the triangles by the octahedral cell of their face normal, then along a Morton curve of their centroids within a cell.
+	Consecutive triangles then face the same way, which narrows the normal cones of meshlets built from triangles facing random directions.
+	cells	<<	Cells along each octahedral axis, cells * cells directions.
+	return	>>	Triangle index of each new position.
+	*/
+	template<typename PositionFn>
+	std::vector<uint32_t> normalTriangleOrder(uint32_t numTris, PositionFn position, uint32_t cells = 8)
+	{
+		std::vector<uint32_t> morton = mortonTriangleOrder(numTris, position);
+		std::vector<uint32_t> cell(numTris);
+		for (uint32_t i = 0; i < numTris; i++)
+		{
+			glm::vec3 p0 = position(i * 3);
+			glm::vec3 n = glm::cross(position(i * 3 + 1) - p0, position(i * 3 + 2) - p0);
+			n /= std::max(std::abs(n.x) + std::abs(n.y) + std::abs(n.z), 1e-20f);
+			// Octahedral projection of the direction to [0, 1]^2
+			glm::vec2 o(n.x, n.y);
+			if (n.z < 0.f)
+				o = (1.f - glm::abs(glm::vec2(o.y, o.x))) * glm::vec2(o.x >= 0.f ? 1.f : -1.f, o.y >= 0.f ? 1.f : -1.f);
+			glm::uvec2 c = glm::min(glm::uvec2((o * 0.5f + 0.5f) * (float)cells), glm::uvec2(cells - 1));
+			cell[i] = c.y * cells + c.x;
+		}
+		// Stable, the Morton order is kept within a cell
+		std::stable_sort(morton.begin(), morton.end(), [&cell](uint32_t a, uint32_t b) { return cell[a] < cell[b]; });
+		return morton;
+	}
+
+	/* Compute the bounding sphere and normal cone of a meshlet from its corner range.
+	*/
+	template<typename PositionFn>
+	void meshletBounds(Meshlet &meshlet, PositionFn position)
+	{
+		meshlet._sphere = boundingSphere(meshlet._first, meshlet._count, position);
+		// Axis from the average facing of the triangles, the cutoff from the normal furthest from it
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet._count / 3);
+		glm::vec3 axis(0.f);
+		for (uint32_t i = meshlet._first; i + 2 < meshlet._first + meshlet._count; i += 3)
+		{
+			glm::vec3 p0 = position(i);
+			glm::vec3 n = glm::cross(position(i + 1) - p0, position(i + 2) - p0);
+			float len = glm::length(n);
+			if (len <= 0.f)
+				continue;	// Degenerate triangles are never rasterized
+			normals.push_back(n / len);
+			axis += normals.back();
+		}
+		float axisLen = glm::length(axis);
+		meshlet._cone = glm::vec4(0.f, 0.f, 0.f, 1.f);
+		if (axisLen < 1e-6f)
+			return;
+		axis /= axisLen;
+		float minDot = 1.f;
+		for (const glm::vec3 &n : normals)
+			minDot = std::min(minDot, glm::dot(axis, n));
+		// Cone wider than a hemisphere is back facing from no direction
+		if (minDot <= 0.f)
+			return;
+		meshlet._cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+	}
+
+	/* Partition a triangle list into meshlets of consecutive triangles, closing a meshlet when the next triangle would exceed a limit.
+	The triangles should already be ordered for locality (vertex cache order, mortonTriangleOrder or normalTriangleOrder).
+	vertex		<<	Function returning the vertex referenced by a corner, vertex(tri * 3 + corner) (the index, or the corner if not indexed).
+	position	<<	Function returning the glm::vec3 position of a corner.
+	*/
+	template<typename VertexFn, typename PositionFn>
+	std::vector<Meshlet> buildMeshlets(uint32_t numTris, VertexFn vertex, PositionFn position, uint32_t maxVertices = 64, uint32_t maxTriangles = 124)
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> verts;
+		verts.reserve(maxVertices);
+		Meshlet current = {};
+		for (uint32_t t = 0; t < numTris; t++)
+		{
+			// Vertices of the triangle not yet in the meshlet
+			uint32_t added[3], numAdded = 0;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				uint32_t v = vertex(t * 3 + c);
+				if (std::find(verts.begin(), verts.end(), v) == verts.end() && std::find(added, added + numAdded, v) == added + numAdded)
+					added[numAdded++] = v;
+			}
+			if (current._count > 0 && (verts.size() + numAdded > maxVertices || current._count / 3 >= maxTriangles))
+			{
+				current._numVertices = (uint32_t)verts.size();
+				meshlets.push_back(current);
+				current = {};
+				current._first = t * 3;
+				verts.clear();
+				// All vertices of the triangle are new to the next meshlet
+				numAdded = 0;
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					uint32_t v = vertex(t * 3 + c);
+					if (std::find(added, added + numAdded, v) == added + numAdded)
+						added[numAdded++] = v;
+				}
+			}
+			verts.insert(verts.end(), added, added + numAdded);
+			current._count += 3;
+		}
+		if (current._count > 0)
+		{
+			current._numVertices = (uint32_t)verts.size();
+			meshlets.push_back(current);
+		}
+		for (Meshlet &m : meshlets)
+			meshletBounds(m, position);
+		return meshlets;
+	}
+
+	/* If any triangle of the meshlet can face the viewer, the conservative normal cone test.
+	eye	<<	Position of the viewer (w = 1), or the normalized view direction of a parallel projection (w = 0).
+	*/
+	inline bool coneVisible(const glm::vec4 &sphere, const glm::vec4 &cone, const glm::vec4 &eye)
+	{
+		glm::vec3 axis(cone);
+		if (eye.w == 0.f)
+			return glm::dot(glm::vec3(eye), axis) < cone.w;
+		glm::vec3 d = glm::vec3(sphere) - glm::vec3(eye);
+		return glm::dot(d, axis) < cone.w * glm::length(d) + sphere.w;
+	}
+}
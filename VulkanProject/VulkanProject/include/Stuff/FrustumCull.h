@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// File: FrustumCull.h
+// Project: Function library
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include<cstdint>
+#include<vector>
+#include<ostream>
+
+namespace mf{
+
+	class ThreadPool;
+
+	/*	Axis aligned boxes in structure of arrays layout, a component array per min/max axis.
+	*	Arrays are padded to a multiple of AABBSoA::WIDTH boxes with empty boxes (min > max) which are never visible, so the
+	*	SIMD tests run over whole registers without a scalar tail.
+	*/
+	struct AABBSoA
+	{
+		static const uint32_t WIDTH = 8;	// Boxes per padded block (AVX width)
+
+		std::vector<float> _minX, _minY, _minZ, _maxX, _maxY, _maxZ;
+		uint32_t _count = 0;				// Boxes pushed, excluding the padding
+
+		void clear();
+		/* Append a box.
+		bb	<<	Min/max interleaved per axis (SimpleMesh::_bb layout).
+		*/
+		void push(const float *bb);
+		void push(float minX, float minY, float minZ, float maxX, float maxY, float maxZ);
+		uint32_t size() const { return _count; }
+		/* Number of boxes including the padding. */
+		uint32_t paddedSize() const { return (uint32_t)_minX.size(); }
+	};
+
+	/*	Six planes of a view volume, a point is inside if dot(plane.xyz, p) + plane.w >= 0 for every plane.
+	*/
+	struct Frustum
+	{
+		float _planes[6][4];
+
+		/* Extract the normalized planes of the clip volume from a column major object to clip space matrix (Gribb & Hartmann).
+		*  The near plane is z >= -w, which contains the z >= 0 volume of Vulkan/D3D projections.
+		*/
+		static Frustum fromMatrix(const float *objectToClip);
+	};
+
+	enum class CullPath
+	{
+		SCALAR,
+		SSE,		// 4 boxes per instruction, also used for NEON on ARM
+		AVX,		// 8 boxes per instruction, if the CPU supports it (checked at run time)
+		BEST		// SSE/NEON, measured faster than AVX
+	};
+
+	/*	Test the boxes [begin, end) against the frustum and append the indices of the intersecting boxes.
+	*	begin and end must be multiples of AABBSoA::WIDTH (or end the padded size).
+	*	Boxes are tested against the plane with their vertex furthest along the plane normal (conservative, boxes outside near the
+	*	frustum corners are kept).
+	visible	>>	Receives the visible indices in increasing order, must fit end - begin indices.
+	return	>>	Number of visible boxes written.
+	*/
+	uint32_t cullBoxes(const AABBSoA &boxes, const Frustum &frustum, uint32_t begin, uint32_t end, uint32_t *visible, CullPath path = CullPath::BEST);
+
+	/*	Cull the boxes split into chunks over the pool workers, the visible indices are compacted in increasing order.
+	*	Must not be called from a task executing on the pool.
+	grain	<<	Boxes per chunk, rounded up to a multiple of AABBSoA::WIDTH.
+	visible	>>	Visible box indices.
+	return	>>	Number of visible boxes.
+	*/
+	uint32_t cullBoxesParallel(ThreadPool &pool, const AABBSoA &boxes, const Frustum &frustum, std::vector<uint32_t> &visible, uint32_t grain = 4096, CullPath path = CullPath::BEST);
+
+	/*	Time the culling of random boxes with each path compiled in and supported by the CPU, single threaded and over the pool. Runs without a device.
+	numBoxes	<<	Boxes culled per run.
+	iterations	<<	Runs averaged per measurement.
+	*/
+	void benchmarkCull(std::ostream &out, ThreadPool &pool, uint32_t numBoxes = 1 << 20, uint32_t iterations = 20);
+}
@@ -6,6 +6,11 @@
 #include <sstream>
 #include <assert.h>
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include "VertexPacking.h"
+#include "FrustumCull.h"
+#include "Clusters.h"
 
 /* The simple mesh read from 
 */
@@ -16,7 +21,19 @@ struct SimpleMesh
 		NORMAL_BIT = 1,
 		UV_BIT = 2,
 		TRIANGLE_ARRAY = 4,		// Triangle draw array, no indices
-		POS_4_COMPONENT = 8		// 4 floats per position component initiated with 1.
+		POS_4_COMPONENT = 8,	// 4 floats per position component initiated with 1.
+		COMPRESS_BIT = 16		// Also output compressed vertices (see compress)
+	};
+
+	/* Vertex cache efficiency of the indexed triangles, simulated with a FIFO post-transform cache. */
+	struct CacheStats
+	{
+		float _acmr;	// Average cache miss ratio, vertices transformed per triangle (0.5 - 3)
+		float _atvr;	// Average transformed vertex ratio, vertices transformed per referenced vertex (1 is optimal)
+	};
+	struct OptimizeStats
+	{
+		CacheStats _before, _after;
 	};
 
 	/* Part separator. */
@@ -32,10 +49,15 @@ struct SimpleMesh
 	std::vector<uint32_t> _face_nor;
 	std::vector<uint32_t> _face_uv;
 	std::vector<Part> _part;			//Part separator
+	mf::AABBSoA _part_bb;				//Bounding boxes of the parts (baked meshes), culled with mf::cullBoxes
+	std::vector<mf::Meshlet> _meshlet;	//Meshlets of the drawn triangles (see buildMeshlets)
 	//Vertex data:
 	std::vector<float> _position;
 	std::vector<float> _normal;
 	std::vector<float> _uv;
+	//Compressed vertex data:
+	std::vector<uint16_t> _position_packed;	// 4 unorm16 per vertex relative to _bb (mf::quantizePosition)
+	std::vector<int16_t> _normal_packed;	// 2 snorm16 per vertex, octahedral encoded (mf::octEncode)
 	//Other:
 	std::vector<unsigned int> _edges;
 
@@ -46,8 +68,36 @@ struct SimpleMesh
 	/* Append a mesh, concatening the data into this. */
 	void append(SimpleMesh& other);
 
-	/* Bake the mesh into a format suitable for graphics cards. Splitting vertex data into a triangle list. */
+	/* Bake the mesh into a format suitable for graphics cards. Splitting vertex data into a triangle list.
+	The baked parts cover the whole list (geometry before the first object is an unnamed part) and get their bounding boxes.
+	*/
 	void bake(unsigned int FLAG, SimpleMesh &bakeOutput);
+	/* Optimize the order of a baked (indexed) mesh for rendering, triangles are kept within their part:
+	1. Triangles are reordered for post-transform vertex cache hits (Forsyth).
+	2. The ordered triangles are split into clusters sorted by how far they face out from the bounding box center, reducing overdraw.
+	Clusters are only split where the cache miss ratio grows less than the threshold.
+	3. Vertices are remapped in the order they are fetched, unreferenced vertices are removed.
+	cacheSize	<<	Entries of the FIFO cache simulated for the statistics and the cluster splits.
+	threshold	<<	Allowed growth of the cache miss ratio traded for overdraw (1.05 is 5%).
+	return		>>	Cache statistics before and after the optimization.
+	*/
+	OptimizeStats optimize(uint32_t cacheSize = 16, float threshold = 1.05f);
+	/* Compress the baked vertices into the packed lists, positions are quantized within _bb and normals octahedral encoded. */
+	void compress();
+	/* Simulate the FIFO post-transform cache over the indices. */
+	CacheStats analyzeCache(uint32_t cacheSize = 16);
+	/* Fit the bounding box of each part over its drawn vertices. */
+	void computePartBounds();
+	/* Range of the indices (or vertices if not indexed) drawn by a part. */
+	void partRange(uint32_t part, uint32_t &first, uint32_t &count);
+	/* Partition the triangles of each part of a baked mesh into meshlets with bounding spheres and normal cones (mf::buildMeshlets).
+	Build after optimize, the meshlets are ranges of the final triangle order.
+	maxVertices		<<	Unique vertices referenced by a meshlet.
+	maxTriangles	<<	Triangles of a meshlet.
+	normalCells		<<	If not 0 the indexed triangles of each part are first sorted by facing (mf::normalTriangleOrder) for narrower cones,
+						which replaces the vertex cache order. Otherwise meshlets follow the current order.
+	*/
+	void buildMeshlets(uint32_t maxVertices = 64, uint32_t maxTriangles = 124, uint32_t normalCells = 0);
 
 	uint32_t size();
 };
@@ -153,7 +203,13 @@ struct VerticeInd
 {
 	uint32_t _pInd, _nInd, _uvInd;
 
-	bool operator<(const VerticeInd &o) const { return _pInd + _nInd + _uvInd < o._pInd + o._nInd + o._uvInd; }
+	bool operator<(const VerticeInd &o) const
+	{
+		// Lexicographic, distinct attribute combinations must not compare equal or they are merged into one vertex
+		if (_pInd != o._pInd) return _pInd < o._pInd;
+		if (_nInd != o._nInd) return _nInd < o._nInd;
+		return _uvInd < o._uvInd;
+	}
 };
 
 /* Bake the mesh into a format suitable for graphics cards. Splitting vertex data into a triangle list. */
@@ -172,7 +228,7 @@ void SimpleMesh::bake(unsigned int FLAG, SimpleMesh &bakeOutput)
 	bool NO_IND = hasFlag(FLAG, BitFlag::TRIANGLE_ARRAY);
 	bool COMP_4 = hasFlag(FLAG, BitFlag::POS_4_COMPONENT);
 	float COMP = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
-	if (COMP)
+	if (COMP_4)
 		bakeOutput._mesh_flags |= BitFlag::POS_4_COMPONENT;
 
 	// Clear/Reserve
@@ -200,7 +256,7 @@ void SimpleMesh::bake(unsigned int FLAG, SimpleMesh &bakeOutput)
 		else
 		{
 			// New vertice
-			ind = (uint32_t)pos.size();
+			ind = (uint32_t)pos.size() / (COMP_4 ? 4 : 3);
 			if (!NO_IND)
 				existMap[indID] = ind;
 			// Append data
@@ -222,9 +278,9 @@ void SimpleMesh::bake(unsigned int FLAG, SimpleMesh &bakeOutput)
 			}
 		}
 		//Split objects
-		if (sepInd < _part.size() && i == _part[sepInd]._ind)
+		while (sepInd < _part.size() && i == _part[sepInd]._ind)
 		{
-			bakeOutput._part.push_back({ (uint32_t)indices.size(), _part[sepInd]._name });
+			bakeOutput._part.push_back({ (uint32_t)i, _part[sepInd]._name });
 			sepInd++;
 		}
 		// Add indice
@@ -238,8 +294,395 @@ void SimpleMesh::bake(unsigned int FLAG, SimpleMesh &bakeOutput)
 	// Clear the invalid lists
 	bakeOutput._face_nor.clear();
 	bakeOutput._face_uv.clear();
+	bakeOutput._position_packed.clear();
+	bakeOutput._normal_packed.clear();
+	if (hasFlag(FLAG, BitFlag::COMPRESS_BIT))
+		bakeOutput.compress();
+	// Parts cover the list
+	if (bakeOutput._part.empty() || bakeOutput._part[0]._ind > 0)
+		bakeOutput._part.insert(bakeOutput._part.begin(), { 0u, std::string() });
+	bakeOutput.computePartBounds();
+}
+
+void SimpleMesh::partRange(uint32_t part, uint32_t &first, uint32_t &count)
+{
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	uint32_t numDrawn = _face_ind.size() > 0 ? size() : (uint32_t)(_position.size() / stride);
+	first = std::min(_part[part]._ind, numDrawn);
+	uint32_t end = part + 1 < _part.size() ? std::min(_part[part + 1]._ind, numDrawn) : numDrawn;
+	count = end > first ? end - first : 0;
+}
+
+void SimpleMesh::computePartBounds()
+{
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	bool indexed = _face_ind.size() > 0;
+	_part_bb.clear();
+	for (uint32_t p = 0; p < _part.size(); p++)
+	{
+		uint32_t first, count;
+		partRange(p, first, count);
+		// Empty parts keep an inverted box, outside of every frustum
+		float bb[6] = { FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX };
+		for (uint32_t i = first; i < first + count; i++)
+			fitBB(bb, &_position[(indexed ? _face_ind[i] : i) * stride]);
+		_part_bb.push(bb);
+	}
+}
+
+void SimpleMesh::buildMeshlets(uint32_t maxVertices, uint32_t maxTriangles, uint32_t normalCells)
+{
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	bool indexed = _face_ind.size() > 0;
+	_meshlet.clear();
+	// Meshlets don't cross the parts, so they can be culled with the part
+	for (uint32_t p = 0; p < _part.size(); p++)
+	{
+		uint32_t first, count;
+		partRange(p, first, count);
+		auto vertex = [&](uint32_t i) { return indexed ? _face_ind[first + i] : first + i; };
+		auto position = [&](uint32_t i)
+		{
+			const float *v = &_position[vertex(i) * stride];
+			return glm::vec3(v[0], v[1], v[2]);
+		};
+		if (normalCells > 0 && indexed)
+			mf::permuteTriangles(_face_ind.data() + first, 1, mf::normalTriangleOrder(count / 3, position, normalCells));
+		std::vector<mf::Meshlet> meshlets = mf::buildMeshlets(count / 3, vertex, position, maxVertices, maxTriangles);
+		for (mf::Meshlet &m : meshlets)
+		{
+			m._first += first;
+			_meshlet.push_back(m);
+		}
+	}
+}
+
+void SimpleMesh::compress()
+{
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	size_t numVerts = _position.size() / stride;
+	_position_packed.resize(numVerts * 4);
+	for (size_t v = 0; v < numVerts; v++)
+		mf::quantizePosition(&_position[v * stride], _bb, &_position_packed[v * 4]);
+	_normal_packed.resize(_normal.size() / 3 * 2);
+	for (size_t v = 0; v < _normal.size() / 3; v++)
+		mf::octEncode(&_normal[v * 3], &_normal_packed[v * 2]);
+}
+
+#pragma region Mesh optimization
+
+const int FORSYTH_CACHE_SIZE = 32;
+
+/* Vertex score of the Forsyth ordering, favors vertices recently used and vertices with few triangles left. */
+inline float forsythScore(int cachePos, uint32_t liveTris)
+{
+	if (liveTris == 0)
+		return -1.f;
+	float score = 0.f;
+	if (cachePos >= 0)
+	{
+		if (cachePos < 3)
+			score = 0.75f;	// Used by the last triangle, fixed to not favor strips
+		else
+			score = std::pow(1.f - (cachePos - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+	}
+	return score + 2.f * std::pow((float)liveTris, -0.5f);
+}
+
+/* Reorder triangles for vertex cache hits (Forsyth, Linear-Speed Vertex Cache Optimisation).
+ind			<<>>	Indices of the triangles, reordered in place.
+numVerts	<<		Number of vertices addressed by the indices.
+*/
+inline void forsythOrder(uint32_t *ind, size_t numTris, size_t numVerts)
+{
+	// Triangles adjacent to each vertex
+	std::vector<uint32_t> live(numVerts, 0), adjOffset(numVerts + 1, 0), adj(numTris * 3);
+	for (size_t i = 0; i < numTris * 3; i++)
+		live[ind[i]]++;
+	for (size_t v = 0; v < numVerts; v++)
+		adjOffset[v + 1] = adjOffset[v] + live[v];
+	std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+	for (uint32_t t = 0; t < numTris; t++)
+		for (int k = 0; k < 3; k++)
+			adj[fill[ind[t * 3 + k]]++] = t;
+
+	std::vector<int> cachePos(numVerts, -1);
+	std::vector<float> vertScore(numVerts);
+	for (size_t v = 0; v < numVerts; v++)
+		vertScore[v] = forsythScore(-1, live[v]);
+	std::vector<bool> emitted(numTris, false);
+	std::vector<uint32_t> out;
+	out.reserve(numTris * 3);
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3], newCache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0, cursor = 0;
+	int best = -1;
+	for (size_t n = 0; n < numTris; n++)
+	{
+		if (best < 0)
+		{
+			// No candidate adjacent to the cache, continue with the first remaining triangle
+			while (emitted[cursor])
+				cursor++;
+			best = (int)cursor;
+		}
+		const uint32_t *tri = ind + best * 3;
+		emitted[best] = true;
+		uint32_t newCount = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = tri[k];
+			out.push_back(v);
+			// Remove the triangle from the vertex adjacency
+			uint32_t *list = &adj[adjOffset[v]];
+			for (uint32_t i = 0; i < live[v]; i++)
+			{
+				if (list[i] == (uint32_t)best)
+				{
+					list[i] = list[live[v] - 1];
+					break;
+				}
+			}
+			live[v]--;
+			newCache[newCount++] = v;
+		}
+		// Move the vertices to the front of the cache, vertices pushed out are evicted
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+		for (uint32_t i = FORSYTH_CACHE_SIZE; i < newCount; i++)
+		{
+			cachePos[newCache[i]] = -1;
+			vertScore[newCache[i]] = forsythScore(-1, live[newCache[i]]);
+		}
+		cacheCount = std::min(newCount, (uint32_t)FORSYTH_CACHE_SIZE);
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+			cachePos[cache[i]] = (int)i;
+			vertScore[cache[i]] = forsythScore((int)i, live[cache[i]]);
+		}
+		// Next triangle is the best scoring triangle adjacent to the cache
+		best = -1;
+		float bestScore = -1.f;
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			for (uint32_t a = 0; a < live[v]; a++)
+			{
+				uint32_t t = adj[adjOffset[v] + a];
+				float score = vertScore[ind[t * 3]] + vertScore[ind[t * 3 + 1]] + vertScore[ind[t * 3 + 2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = (int)t;
+				}
+			}
+		}
+	}
+	std::copy(out.begin(), out.end(), ind);
+}
+
+/* FIFO cache simulation, vertices are in the cache while less than cacheSize misses occurred since they were loaded.
+*/
+struct FifoCache
+{
+	std::vector<uint32_t> _stamp;
+	uint32_t _size, _time;
+
+	FifoCache(size_t numVerts, uint32_t size) : _stamp(numVerts, 0), _size(size), _time(size + 1) {}
+	/* Reference the vertex, returns 1 if it was transformed. */
+	uint32_t fetch(uint32_t v)
+	{
+		if (_time - _stamp[v] <= _size)
+			return 0;
+		_stamp[v] = _time++;
+		return 1;
+	}
+	/* Evict all vertices. */
+	void clear() { _time += _size + 1; }
+};
+
+/* Split the ordered triangles into clusters and sort them by how much they face out from the center, clusters facing outward
+far from the center are drawn first as they are likely to occlude the rest.
+ind			<<>>	Indices of the triangles, reordered in place.
+pos			<<		Vertex positions.
+stride		<<		Floats per position.
+center		<<		Center of the mesh.
+*/
+inline void overdrawOrder(uint32_t *ind, size_t numTris, size_t numVerts, const float *pos, uint32_t stride, const float *center, uint32_t cacheSize, float threshold)
+{
+	// Hard boundaries, triangles transforming all vertices (the cache is no longer shared with the previous triangles)
+	FifoCache cache(numVerts, cacheSize);
+	std::vector<uint32_t> hard, clusters;
+	for (uint32_t t = 0; t < numTris; t++)
+	{
+		uint32_t misses = cache.fetch(ind[t * 3]) + cache.fetch(ind[t * 3 + 1]) + cache.fetch(ind[t * 3 + 2]);
+		if (t == 0 || misses == 3)
+			hard.push_back(t);
+	}
+	hard.push_back((uint32_t)numTris);
+	// Soft boundaries, split the clusters while the miss ratio stays below the threshold of the cluster ratio
+	for (size_t c = 0; c + 1 < hard.size(); c++)
+	{
+		uint32_t first = hard[c], last = hard[c + 1];
+		cache.clear();
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = first; t < last; t++)
+			clusterMisses += cache.fetch(ind[t * 3]) + cache.fetch(ind[t * 3 + 1]) + cache.fetch(ind[t * 3 + 2]);
+		float limit = clusterMisses / (float)(last - first) * threshold;
+
+		cache.clear();
+		clusters.push_back(first);
+		uint32_t start = first, misses = 0;
+		for (uint32_t t = first; t + 1 < last; t++)
+		{
+			misses += cache.fetch(ind[t * 3]) + cache.fetch(ind[t * 3 + 1]) + cache.fetch(ind[t * 3 + 2]);
+			if (misses / (float)(t + 1 - start) <= limit)
+			{
+				clusters.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				cache.clear();
+			}
+		}
+	}
+	clusters.push_back((uint32_t)numTris);
+
+	// Sort key, area weighted centroid projected on the average normal of the cluster
+	size_t numClusters = clusters.size() - 1;
+	std::vector<float> key(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		float area = 0.f, centroid[3] = { 0.f, 0.f, 0.f }, normal[3] = { 0.f, 0.f, 0.f };
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const float *a = pos + ind[t * 3] * stride, *b = pos + ind[t * 3 + 1] * stride, *d = pos + ind[t * 3 + 2] * stride;
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e1[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+			float w = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int i = 0; i < 3; i++)
+			{
+				centroid[i] += (a[i] + b[i] + d[i]) / 3.f * w;
+				normal[i] += n[i];
+			}
+			area += w;
+		}
+		float len = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		key[c] = 0.f;
+		if (area > 0.f && len > 0.f)
+			for (int i = 0; i < 3; i++)
+				key[c] += (centroid[i] / area - center[i]) * normal[i] / len;
+	}
+	std::vector<uint32_t> order(numClusters);
+	for (uint32_t c = 0; c < numClusters; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&key](uint32_t a, uint32_t b) { return key[a] > key[b]; });
+
+	std::vector<uint32_t> out;
+	out.reserve(numTris * 3);
+	for (uint32_t c : order)
+		out.insert(out.end(), ind + clusters[c] * 3, ind + clusters[c + 1] * 3);
+	std::copy(out.begin(), out.end(), ind);
+}
+
+SimpleMesh::CacheStats SimpleMesh::analyzeCache(uint32_t cacheSize)
+{
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	size_t numVerts = _position.size() / stride;
+	FifoCache cache(numVerts, cacheSize);
+	std::vector<bool> used(numVerts, false);
+	uint32_t misses = 0, unique = 0;
+	for (uint32_t v : _face_ind)
+	{
+		misses += cache.fetch(v);
+		if (!used[v])
+		{
+			used[v] = true;
+			unique++;
+		}
+	}
+	CacheStats stats;
+	stats._acmr = size() ? misses / (float)(size() / 3) : 0.f;
+	stats._atvr = unique ? misses / (float)unique : 0.f;
+	return stats;
+}
+
+SimpleMesh::OptimizeStats SimpleMesh::optimize(uint32_t cacheSize, float threshold)
+{
+	OptimizeStats stats;
+	stats._before = analyzeCache(cacheSize);
+	uint32_t stride = hasFlag(_mesh_flags, BitFlag::POS_4_COMPONENT) ? 4 : 3;
+	size_t numVerts = _position.size() / stride;
+
+	// Center of the bounding box, or of the vertices if the box is not set
+	float center[3] = { 0.f, 0.f, 0.f };
+	for (int i = 0; i < 3; i++)
+	{
+		if (_bb[i * 2] <= _bb[i * 2 + 1])
+			center[i] = (_bb[i * 2] + _bb[i * 2 + 1]) * 0.5f;
+		else if (numVerts > 0)
+		{
+			for (size_t v = 0; v < numVerts; v++)
+				center[i] += _position[v * stride + i];
+			center[i] /= numVerts;
+		}
+	}
+	// Triangles are reordered within the parts
+	std::vector<uint32_t> bounds(1, 0);
+	for (Part &part : _part)
+		if (part._ind > bounds.back() && part._ind < size())
+			bounds.push_back(part._ind);
+	bounds.push_back(size());
+	for (size_t p = 0; p + 1 < bounds.size(); p++)
+	{
+		size_t numTris = (bounds[p + 1] - bounds[p]) / 3;
+		if (numTris == 0)
+			continue;
+		forsythOrder(&_face_ind[bounds[p]], numTris, numVerts);
+		overdrawOrder(&_face_ind[bounds[p]], numTris, numVerts, _position.data(), stride, center, cacheSize, threshold);
+	}
+
+	// Vertices in fetch order
+	const uint32_t UNUSED = ~0u;
+	std::vector<uint32_t> remap(numVerts, UNUSED);
+	uint32_t next = 0;
+	for (uint32_t &v : _face_ind)
+	{
+		if (remap[v] == UNUSED)
+			remap[v] = next++;
+		v = remap[v];
+	}
+	bool NOR = _normal.size() / 3 == numVerts, UV = _uv.size() / 2 == numVerts;
+	std::vector<float> pos(next * stride), nor(NOR ? next * 3 : 0), uv(UV ? next * 2 : 0);
+	for (size_t v = 0; v < numVerts; v++)
+	{
+		if (remap[v] == UNUSED)
+			continue;
+		std::copy(&_position[v * stride], &_position[v * stride] + stride, &pos[remap[v] * stride]);
+		if (NOR)
+			std::copy(&_normal[v * 3], &_normal[v * 3] + 3, &nor[remap[v] * 3]);
+		if (UV)
+			std::copy(&_uv[v * 2], &_uv[v * 2] + 2, &uv[remap[v] * 2]);
+	}
+	_position = std::move(pos);
+	if (NOR)
+		_normal = std::move(nor);
+	if (UV)
+		_uv = std::move(uv);
+	// Packed vertices follow the new order
+	if (_position_packed.size() > 0)
+		compress();
+
+	stats._after = analyzeCache(cacheSize);
+	return stats;
 }
 
+#pragma endregion
+
 void consumeWhiteSpace(std::stringstream& ss)
 {
 	char c;
@@ -148,7 +148,14 @@ namespace mf{
 	*/
 	std::vector<std::random_device::result_type> generateSeedSeq(unsigned int seedCount);
 
-	/* Generate a set of separated triangles.
+	/* Generate a set of separated triangles, wound clockwise around their normal.
+	counterClockwise	<<	Wind the triangles counter clockwise instead, front facing to back face culling with the flipped projections.
 	*/
-	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, glm::vec4 *posBuf, glm::vec3 *norBuf);
+	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, glm::vec4 *posBuf, glm::vec3 *norBuf, bool counterClockwise = false);
+	/* Generate a set of separated triangles with compressed vertices (see VertexPacking.h).
+	posBuf	>>	4 unorm16 per vertex quantized within the bounding box.
+	norBuf	>>	2 snorm16 per vertex, octahedral encoded (optional).
+	bb		>>	Bounding box of the quantization (min/max interleaved per axis), bounds the sphere and the triangle size.
+	*/
+	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, uint16_t *posBuf, int16_t *norBuf, float *bb, bool counterClockwise = false);
 }
@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// File: TLSFAllocator.h
+// Project: Function library
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include<cstdint>
+#include<vector>
+#include<unordered_map>
+#include<ostream>
+
+namespace mf{
+
+	/*	Two-level segregated fit allocator over an abstract address range [0, size).
+	*	Only the bookkeeping is handled, the range is never accessed. Free blocks are binned by size in first level (power of two) and
+	*	second level (linear subdivision) lists, allocation and free are constant time. Adjacent free blocks are merged on free.
+	*	The alignment padding in front of an allocation is kept in its block and returned with it.
+	*	Allocations are tagged linear or optimal, neighbours of different kind are kept on separate pages of the granularity
+	*	(Vulkan bufferImageGranularity).
+	*	Not thread-safe.
+	*/
+	class TLSFAllocator {
+	public:
+		enum Kind
+		{
+			LINEAR = 0,		// Buffers and linear tiled images
+			OPTIMAL = 1		// Optimal tiled images
+		};
+		struct Stats
+		{
+			uint64_t _size;				// Bytes managed
+			uint64_t _used;				// Bytes allocated (including alignment padding merged into the allocations)
+			uint64_t _padding;			// Alignment padding in the allocations
+			uint64_t _largestFree;		// Largest free block
+			uint32_t _allocations;
+			uint32_t _freeBlocks;
+			uint32_t _failed;			// Allocations that did not fit
+			/* Fraction of the free space not usable by a single allocation of all free bytes (0 when the free space is contiguous). */
+			float fragmentation() const { return _size == _used ? 0.f : 1.f - (float)_largestFree / (float)(_size - _used); }
+		};
+
+		static const uint64_t INVALID_OFFSET = ~0ull;
+
+		TLSFAllocator();
+		/* Create the allocator covering the range.
+		size		<<	Bytes managed.
+		granularity	<<	Page size separating linear and optimal neighbours, must be a power of two.
+		*/
+		TLSFAllocator(uint64_t size, uint64_t granularity = 1);
+
+		/* Reset the allocator to the empty range, existing allocations are forgotten.
+		*/
+		void init(uint64_t size, uint64_t granularity = 1);
+
+		/* Allocate a range.
+		alignment	<<	Required alignment of the offset, must be a power of two.
+		return		>>	Offset of the allocation or INVALID_OFFSET if no free block fits.
+		*/
+		uint64_t allocate(uint64_t size, uint64_t alignment, Kind kind = LINEAR);
+		/* Free the allocation at the offset, throws if the offset is not allocated.
+		*/
+		void free(uint64_t offset);
+
+		/* Requested size of the allocation at the offset. */
+		uint64_t allocationSize(uint64_t offset) const;
+		uint64_t size() const { return _size; }
+		Stats getStats() const;
+
+	private:
+		static const uint32_t NONE = ~0u;
+		static const uint32_t SL_BITS = 4;						// Second level subdivisions (log2)
+		static const uint32_t SL_COUNT = 1u << SL_BITS;
+		static const uint32_t SMALL_BITS = 8;					// Sizes below 2^SMALL_BITS share the first list
+		static const uint32_t FL_COUNT = 64 - SMALL_BITS + 1;
+
+		struct Block
+		{
+			uint64_t _offset, _size;
+			uint64_t _padding;					// Alignment padding before the allocated offset
+			uint32_t _prevPhys, _nextPhys;		// Neighbouring blocks in the address range
+			uint32_t _prevFree, _nextFree;		// Links in the free list of the size class
+			bool _free;
+			Kind _kind;
+		};
+
+		uint64_t _size, _granularity;
+		std::vector<Block> _blocks;
+		std::vector<uint32_t> _unusedBlocks;					// Recycled block nodes
+		uint64_t _flBitmap;
+		uint32_t _slBitmap[FL_COUNT];
+		uint32_t _heads[FL_COUNT][SL_COUNT];
+		std::unordered_map<uint64_t, uint32_t> _allocated;		// Offset -> block
+		uint32_t _kindCount[2];									// Allocations of each kind
+		uint64_t _used, _padding;
+		uint32_t _failed;
+
+		static void mapping(uint64_t size, uint32_t &fl, uint32_t &sl);
+		uint32_t findFree(uint64_t size) const;
+		void insertFree(uint32_t block);
+		void removeFree(uint32_t block);
+		uint32_t newBlock();
+		/* Split the tail of the block at the size into a new block, returns NONE if the block is not larger. */
+		uint32_t splitTail(uint32_t block, uint64_t size);
+		/* Merge the block with its free neighbours, returns the merged block. */
+		uint32_t merge(uint32_t block);
+		bool conflict(uint32_t neighbour, Kind kind) const;
+	};
+
+	/*	Run a random allocate/free workload over the allocator. The allocations are checked for alignment, overlap and the page
+	*	separation of the kinds, and freeing everything must merge the range back into a single block (throws on a violation).
+	*	The same workload is then timed without the checks. Runs without a device.
+	*	operations	<<	Allocations and frees performed per run.
+	*/
+	void benchmarkTLSF(std::ostream &out, uint32_t operations = 1 << 20);
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// File: ThreadPool.h
+// Project: Function library
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include<cstdint>
+#include<vector>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<future>
+#include<memory>
+
+namespace mf{
+
+	/*	Fixed set of worker threads consuming a shared task queue.
+	*	Tasks are handed the index of the executing worker [0, size()) which can be used to access per-thread resources.
+	*/
+	class ThreadPool {
+	public:
+		typedef std::function<void(uint32_t worker)> Task;
+		typedef std::function<void(uint32_t begin, uint32_t end, uint32_t worker)> RangeTask;
+
+		/* Create the worker threads.
+		numThreads	<<	Number of workers, 0 spawns one worker per hardware thread.
+		*/
+		ThreadPool(uint32_t numThreads = 0);
+		/* Finishes the queued tasks and joins the workers.
+		*/
+		~ThreadPool();
+
+		/* Number of worker threads.
+		*/
+		uint32_t size() const { return (uint32_t)_workers.size(); }
+
+		/*	Queue a task for execution on a worker.
+		func	<<	Callable taking the worker index (uint32_t).
+		return	>>	Future holding the result of the task.
+		*/
+		template<typename Func>
+		auto submit(Func&& func) -> std::future<decltype(func(0u))>;
+
+		/*	Split the range [0, count) into chunks of grain size and distribute them over the workers. Blocks until all chunks are complete.
+		*	Must not be called from a task executing on the pool.
+		count	<<	Number of elements in the range.
+		grain	<<	Number of elements in each chunk, 0 splits the range evenly over the workers.
+		func	<<	Function called for each chunk with the range [begin, end) and the executing worker.
+		*/
+		void parallelFor(uint32_t count, uint32_t grain, const RangeTask &func);
+
+	private:
+		std::vector<std::thread> _workers;
+		std::deque<Task> _tasks;
+		std::mutex _lock;
+		std::condition_variable _signal;
+		bool _stop;
+
+		void enqueue(Task &&task);
+		void run(uint32_t worker);
+	};
+
+	template<typename Func>
+	auto ThreadPool::submit(Func&& func) -> std::future<decltype(func(0u))>
+	{
+		typedef decltype(func(0u)) Result;
+		auto task = std::make_shared<std::packaged_task<Result(uint32_t)>>(std::forward<Func>(func));
+		std::future<Result> result = task->get_future();
+		enqueue([task](uint32_t worker) { (*task)(worker); });
+		return result;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+namespace mf
+{
+	/* Compressed vertex attributes:
+	Positions are quantized to 4 unorm16 relative to a bounding box (w is stored as 1), decoded as pos * scale + offset.
+	Normals are octahedral encoded into 2 snorm16.
+	Bounding boxes are min/max interleaved per axis (as SimpleMesh::_bb).
+	*/
+
+	/* Quantize a position within the bounding box.
+	pos	<<	3 floats.
+	out	>>	4 unorm16.
+	*/
+	inline void quantizePosition(const float *pos, const float *bb, uint16_t *out)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			float extent = bb[i * 2 + 1] - bb[i * 2];
+			float t = extent > 0.f ? (pos[i] - bb[i * 2]) / extent : 0.f;
+			out[i] = (uint16_t)(std::min(std::max(t, 0.f), 1.f) * 65535.f + 0.5f);
+		}
+		out[3] = 65535;
+	}
+	/* Scale and offset decoding the quantized positions of the bounding box (xyz, w is 0).
+	*/
+	inline void positionDecode(const float *bb, float *scale, float *offset)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			scale[i] = bb[i * 2 + 1] - bb[i * 2];
+			offset[i] = bb[i * 2];
+		}
+		scale[3] = offset[3] = 0.f;
+	}
+	/* Octahedral encoding of a unit normal.
+	nor	<<	3 floats.
+	out	>>	2 snorm16.
+	*/
+	inline void octEncode(const float *nor, int16_t *out)
+	{
+		float l1 = std::abs(nor[0]) + std::abs(nor[1]) + std::abs(nor[2]);
+		float x = l1 > 0.f ? nor[0] / l1 : 0.f, y = l1 > 0.f ? nor[1] / l1 : 0.f;
+		if (nor[2] < 0.f)
+		{
+			// Fold the lower hemisphere over the diagonals
+			float fx = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+			float fy = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = fx;
+			y = fy;
+		}
+		out[0] = (int16_t)std::round(std::min(std::max(x, -1.f), 1.f) * 32767.f);
+		out[1] = (int16_t)std::round(std::min(std::max(y, -1.f), 1.f) * 32767.f);
+	}
+	/* Decode an octahedral normal (reference of the shader decode).
+	*/
+	inline void octDecode(const int16_t *enc, float *nor)
+	{
+		float x = std::max(enc[0] / 32767.f, -1.f), y = std::max(enc[1] / 32767.f, -1.f);
+		float z = 1.f - std::abs(x) - std::abs(y);
+		float t = std::max(-z, 0.f);
+		x += x >= 0.f ? -t : t;
+		y += y >= 0.f ? -t : t;
+		float len = std::sqrt(x * x + y * y + z * z);
+		nor[0] = x / len;
+		nor[1] = y / len;
+		nor[2] = z / len;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "TechniqueVulkan.h"
+#include "VertexLayoutVulkan.h"
+#include <vector>
+#include <memory>
+#include <future>
+
+class ShaderVulkan;
+class VulkanRenderer;
+
+/* Compiles technique pipelines asynchronously on the renderer worker threads.
+Techniques are returned immediately and their pipelines are created when build is called. The requests are split evenly over
+the workers and each worker creates its share with a single batched call per pipeline type. A technique blocks when bound before
+its pipeline is ready unless it has a fallback technique set.
+*/
+class TechniqueBuilderVulkan
+{
+public:
+	TechniqueBuilderVulkan(VulkanRenderer *renderer);
+	/* Waits for the pipelines in compilation. */
+	~TechniqueBuilderVulkan();
+
+	/* Request a compute pipeline technique, the technique is owned by the caller.
+	specialization	<<	Optional specialization constants of the shader, must remain valid until the pipeline is built.
+	*/
+	TechniqueVulkan* compute(ShaderVulkan* sHandle, VkPipelineLayout layout, const VkSpecializationInfo *specialization = nullptr);
+	/* Request a graphics pipeline technique, the vertex input state is copied.
+	*/
+	TechniqueVulkan* graphics(ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, const VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex = 0);
+	/* Request a graphics pipeline technique consuming a subset of the vertex streams.
+	streams	<<	VertexLayoutVulkan::StreamBit mask of the streams read by the vertex shader.
+	*/
+	TechniqueVulkan* graphics(ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VertexLayoutVulkan &vertexLayout, uint32_t streams, uint32_t subpassIndex = 0);
+	/* Face culling of the graphics techniques requested after the call, none by default.
+	*/
+	void setCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE);
+
+	/* Start compiling the requested pipelines on the workers.
+	*/
+	void build();
+	/* Start compiling the requested pipelines and block until all pipelines built are ready. Rethrows compilation errors.
+	*/
+	void wait();
+
+private:
+	struct Request
+	{
+		std::unique_ptr<GraphicsPipelineDesc> _graphics;	// Null for compute requests
+		VkComputePipelineCreateInfo _compute;
+		std::promise<VkPipeline> _promise;
+	};
+	typedef std::vector<std::unique_ptr<Request>> RequestList;
+
+	VulkanRenderer *_renderHandle;
+	RequestList _requests;							// Requests not yet built
+	std::vector<std::future<void>> _jobs;			// Jobs in compilation
+	std::vector<TechniqueVulkan*> _techniques;		// Techniques built, checked when waiting
+	VkCullModeFlags _cullMode = VK_CULL_MODE_NONE;
+	VkFrontFace _frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	static void compile(VulkanRenderer *renderer, RequestList &requests, size_t begin, size_t end);
+	TechniqueVulkan* request(std::unique_ptr<Request> &&req, ShaderVulkan *sHandle, VkPipelineLayout layout);
+};
@@ -1,11 +1,47 @@
 #pragma once
-#pragma once
 #include "vulkan\vulkan.h"
+#include "VulkanConstruct.h"
 #include <map>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <atomic>
 
 class ShaderVulkan;
 class VulkanRenderer;
 
+/* Graphics pipeline state of a technique. Owns the structures referenced by the create info (including a copy of the vertex
+input state) so the pipeline can be created after the caller returns.
+*/
+struct GraphicsPipelineDesc
+{
+	GraphicsPipelineDesc(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, const VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex);
+	GraphicsPipelineDesc(const GraphicsPipelineDesc&) = delete;
+	GraphicsPipelineDesc& operator=(const GraphicsPipelineDesc&) = delete;
+
+	/* Face culling of the rasterizer, none by default. */
+	void setCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace);
+
+	VkGraphicsPipelineCreateInfo _info;
+
+private:
+	VkPipelineShaderStageCreateInfo _stages[2];
+	std::vector<VkVertexInputBindingDescription> _vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> _vertexAttributes;
+	VkPipelineVertexInputStateCreateInfo _vertexInputState;
+	VkPipelineInputAssemblyStateCreateInfo _inputAssembly;
+	VkViewport _viewport;
+	VkRect2D _scissor;
+	VkPipelineViewportStateCreateInfo _viewportState;
+	VkPipelineRasterizationStateCreateInfo _rasterization;
+	VkPipelineMultisampleStateCreateInfo _multisample;
+	VkPipelineColorBlendAttachmentState _blendAttachment;
+	VkPipelineColorBlendStateCreateInfo _blend;
+	VkPipelineDepthStencilStateCreateInfo _depthStencil;
+	VkDynamicState _dynamicStates[2];
+	VkPipelineDynamicStateCreateInfo _dynamicState;
+};
+
 class TechniqueVulkan
 {
 public:
@@ -17,21 +53,49 @@ public:
 	*/
 	TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState);
 	TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex);
+	/* Technique with a pipeline compiled asynchronously (see TechniqueBuilderVulkan).
+	*/
+	TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkPipelineLayout layout, std::shared_future<VkPipeline> pending);
 
 	virtual ~TechniqueVulkan();
+	/* Bind the pipeline. If the pipeline is still compiling the fallback technique is bound, without a fallback the call blocks until the pipeline is ready.
+	*/
 	virtual void bind(VkCommandBuffer cmdBuf, VkPipelineBindPoint bindPoint);
 
+	/* If the pipeline is compiled, never blocks (returns false while another thread resolves the pipeline). Thread safe. */
+	bool isReady();
+	/* Block until the pipeline is compiled, rethrows compilation errors. Thread safe. */
+	void wait();
+	/* Technique bound in place of this one while its pipeline is compiling. */
+	void setFallback(TechniqueVulkan *fallback) { _fallback = fallback; }
+
+	/* Push a block declared in the technique's pipeline layout, the technique should be bound.
+	*/
+	template<typename T>
+	void push(VkCommandBuffer cmdBuf, const vk::PushConstant<T> &block, const T &value) { block.push(cmdBuf, _layout, value); }
+	VkPipelineLayout getLayout() { return _layout; }
+	/* Vertex streams consumed by the technique (VertexLayoutVulkan::StreamBit mask), only these are bound when drawing. */
+	uint32_t getVertexStreams() { return _vertexStreams; }
+	void setVertexStreams(uint32_t streams) { _vertexStreams = streams; }
+
 	VkPipeline pipeline;
 
 private:
 
 	void createGraphicsPipeline(VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex);
 	void createComputePipeline(VkPipelineLayout layout);
+	/* Take the pipeline from the pending compilation, _pendingLock must be held. */
+	void resolve();
 
 	VulkanRenderer *_renderHandle;
 	ShaderVulkan *_sHandle;
 	VkRenderPass _passHandle;
-	
+	VkPipelineLayout _layout;
+	std::shared_future<VkPipeline> _pending;
+	std::mutex _pendingLock;				// Guards _pending and the write of pipeline
+	std::atomic<bool> _ready;				// Set once pipeline is written, read without the lock
+	TechniqueVulkan *_fallback = nullptr;
+	uint32_t _vertexStreams = ~0u;
 	
 };
 
@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 #include <string>
+#include <vector>
+#include <utility>
 
 class Sampler2DVulkan;
 class VulkanRenderer;
@@ -11,14 +13,31 @@ const int MAX_TEX_BINDINGS = 6;
 class Texture2DVulkan 
 {
 private:
+	friend class TextureStreamerVulkan;
+
 	void destroyImg();
+	/* Create the image in the RGBA8 pool and its view. */
+	void createImage(uint32_t width, uint32_t height, VkFormat format);
+	/* Called by the streamer when the image is owned by the consumer queue, generates the pending descriptors. */
+	void setResident();
 	VkDescriptorSet slotBindings[MAX_TEX_BINDINGS];	// Set of descriptors associated with the image.
+	std::vector<std::pair<uint32_t, VkDescriptorSetLayout>> pendingBindPoints;	// Bind points attached while streaming
+	bool resident, streaming;
+	uint32_t imagePool;		// MemoryPool the image is bound in
+	size_t poolOffset;
 
 public:
 	Texture2DVulkan(VulkanRenderer *renderer, Sampler2DVulkan *sampler);
 	~Texture2DVulkan();
 
 	int loadFromFile(std::string filename);
+	/* Stream the texture, decoded on a worker and uploaded on the transfer queue (see TextureStreamerVulkan). The texture is resident
+	a few frames later, it must not be bound before.
+	consumerQueue	<<	QueueType of the queue sampling the texture, image ownership is transferred to its family.
+	*/
+	void loadFromFileAsync(std::string filename, uint32_t consumerQueue);
+	/* If the image data is uploaded and the texture can be bound. */
+	bool isResident() { return resident; }
 	/* Bind an attached texture descriptor to the certain set slot.
 	combinedIndex	<<	Both the set binding the descriptor is bound to and the index for the attached descriptor bound.
 	*/
@@ -28,7 +47,7 @@ public:
 	setIndex		<<	The set binding the descriptor is bound to.
 	*/
 	void bind(VkCommandBuffer cmdBuf, uint32_t attachmentIndex, uint32_t setIndex, VkPipelineLayout layout, VkPipelineBindPoint pipeBinding = VK_PIPELINE_BIND_POINT_GRAPHICS);
-	/* Generate a descriptor at the specific attachment index.
+	/* Generate a descriptor at the specific attachment index. A streaming texture generates the descriptor when it becomes resident.
 	*/
 	void attachBindPoint(uint32_t attachmentIndex, VkDescriptorSetLayout layout);
 	void createShadowMap(uint32_t height, uint32_t width, VkFormat shadowMapFormat);
@@ -0,0 +1,91 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VulkanConstruct.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+
+class VulkanRenderer;
+class Texture2DVulkan;
+
+/* Streams textures to the device without stalling the render loop.
+Files are decoded on the renderer workers. Decoded textures are copied from the staging ring with the frame transfer commands on the
+MEM queue, which release the image to the queue family sampling it. Once the transfer is complete the consumer queue acquires the
+image and the texture becomes resident, a few frames after the request.
+All functions except the decode jobs run on the render thread.
+*/
+class TextureStreamerVulkan
+{
+public:
+	struct Stats
+	{
+		uint32_t _requested, _resident, _failed;
+		uint32_t _deferred;			// Uploads postponed to a later frame as the staging ring was full
+		size_t _bytes;				// Bytes uploaded
+	};
+
+	TextureStreamerVulkan();
+
+	void init(VulkanRenderer *renderer);
+	/* Wait for the decodes in flight and release the acquire commands, the device must be idle.
+	*/
+	void destroy();
+
+	/* Queue the texture for streaming.
+	consumer	<<	Queue type the texture is sampled on, receives the image ownership.
+	*/
+	void request(Texture2DVulkan *texture, const std::string &filename, uint32_t consumer);
+	/* Remove the pending request of the texture (the texture is destroyed), blocks on the work in flight for it.
+	*/
+	void cancel(Texture2DVulkan *texture);
+
+	/* Record the uploads of the decoded textures into the frame transfer commands.
+	*/
+	void record(VkCommandBuffer transferCmd);
+	/* Tag the recorded uploads with the transfer submission.
+	*/
+	void submitted(const vk::Ticket &ticket);
+	/* Acquire the textures with completed uploads on their consumer queues and make them resident (never blocks).
+	*/
+	void acquire();
+
+	Stats getStats() { return _stats; }
+
+private:
+	enum State
+	{
+		DECODING,
+		RECORDED,		// Upload recorded into the transfer commands, not yet submitted
+		UPLOADING
+	};
+	struct Request
+	{
+		Texture2DVulkan *_texture;
+		std::string _file;
+		uint32_t _consumer;
+		State _state;
+		std::future<void> _decode;
+		// Written by the decode job
+		unsigned char *_pixels;
+		int _width, _height;
+		vk::Ticket _ticket;
+		// Image taken over from a texture destroyed while its upload is in flight
+		VkImage _orphanImage;
+		VkImageView _orphanView;
+		size_t _orphanOffset;			// Memory of the image in the RGBA8 pool
+	};
+	struct AcquireBatch
+	{
+		uint32_t _queue;
+		VkCommandBuffer _cmdBuf;
+		vk::Ticket _ticket;
+	};
+
+	VulkanRenderer *_renderHandle;
+	std::vector<std::shared_ptr<Request>> _requests;
+	std::vector<AcquireBatch> _acquires;	// Acquire submissions in flight
+	Stats _stats;
+
+	void releaseAcquires(bool wait);
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "Stuff\TLSFAllocator.h"
+#include <mutex>
+
+/* Persistently mapped, host visible uniform buffer split into a region per frame.
+Every region holds the same slots, a slot is allocated once and the CPU writes the copy read by the next frame in place. Descriptors
+reference the slot in the first region (VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) and the region of the frame is selected by the
+dynamic offset when the set is bound. Regions cycle with the frame number, two more regions than frames in flight are needed for the
+region written to never be read by the device (frames older than the frames in flight are complete when the next frame is written).
+Memory must be host coherent, no flushes are performed.
+*/
+class UniformRingVulkan
+{
+public:
+	/* Range of each region owned by an object.
+	*/
+	struct Slot
+	{
+		VkDeviceSize _offset;		// Offset of the slot within a region
+		VkDeviceSize _size;
+
+		bool valid() const { return _size > 0; }
+	};
+	struct Stats
+	{
+		VkDeviceSize _regionSize, _used;	// Bytes of a region and bytes of the region used by the slots
+		uint32_t _regions, _slots;
+		uint64_t _writes;
+	};
+
+	UniformRingVulkan();
+
+	/* Map the ring memory.
+	buffer		<<	Uniform buffer covering the memory.
+	memory		<<	Host visible and coherent memory bound to the buffer at offset 0.
+	regionSize	<<	Bytes of each region, a multiple of the alignment.
+	numRegions	<<	Number of regions (frames in flight + 2).
+	alignment	<<	Uniform buffer offset alignment.
+	*/
+	void init(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize regionSize, uint32_t numRegions, VkDeviceSize alignment);
+	void destroy();
+
+	/* Allocate a slot in every region.
+	return	>>	Invalid slot if the regions are full.
+	*/
+	Slot allocate(VkDeviceSize size);
+	void free(const Slot &slot);
+
+	/* Write the copy of the slot read by the next frame. */
+	void write(const Slot &slot, const void *data, VkDeviceSize size);
+	/* Write every copy of the slot (initial data). */
+	void writeAll(const Slot &slot, const void *data, VkDeviceSize size);
+	/* Cycle the regions, called when the renderer moves to the next frame. */
+	void nextFrame() { _frame++; }
+
+	/* Dynamic offset selecting the region read by the current frame. */
+	uint32_t getFrameOffset() { return (uint32_t)((_frame % _numRegions) * _regionSize); }
+	VkBuffer getBuffer() { return _buffer; }
+	Stats getStats();
+
+private:
+	VkDevice _device;
+	VkBuffer _buffer;
+	VkDeviceMemory _memory;
+	uint8_t *_mapped;
+	VkDeviceSize _regionSize, _alignment;
+	uint32_t _numRegions;
+	uint64_t _frame;				// Frame number, the current frame reads region _frame % _numRegions
+	uint32_t _slots;
+	uint64_t _writes;
+	mf::TLSFAllocator _allocator;	// Slots of a region
+	std::mutex _lock;
+};
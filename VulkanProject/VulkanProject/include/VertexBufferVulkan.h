@@ -1,5 +1,6 @@
 #pragma once
 #include<vulkan/vulkan.h>
+#include "BufferArenaVulkan.h"
 
 
 class VulkanRenderer;
@@ -14,6 +15,8 @@ public:
 		uint32_t sizeElement, numElements, offset;
 		VertexBufferVulkan* buffer;
 		void bind(VkCommandBuffer cmdBuf, uint32_t location);
+		/* Bind the bindings to consecutive locations with a single call. */
+		static void bind(VkCommandBuffer cmdBuf, Binding* const* bindings, uint32_t count, uint32_t firstLocation = 0);
 	
 		Binding();
 		Binding(VertexBufferVulkan* buffer, uint32_t sizeElement, uint32_t numElements, uint32_t offset);
@@ -34,5 +37,6 @@ private:
 
 	VulkanRenderer* _renderHandle;
 	size_t memSize;
+	BufferArenaVulkan::View _view;	// Range of the vertex arena holding the data
 };
 
@@ -0,0 +1,60 @@
+#pragma once
+#include "vulkan\vulkan.h"
+#include "VertexBufferVulkan.h"
+#include <initializer_list>
+#include <vector>
+
+/* Vertex streams of a mesh. Each stream is a vertex buffer binding holding one attribute or several interleaved attributes.
+Techniques declare the streams they consume as a StreamBit mask, the vertex input state and the bound buffers are generated for
+that subset only. A stream always uses the binding slot of its index so passes consuming different subsets share the bindings.
+*/
+class VertexLayoutVulkan
+{
+public:
+	enum Stream : uint32_t
+	{
+		POSITION = 0,		// Attributes needed to rasterize, the only stream read by depth passes
+		SHADING = 1,		// Attributes read by the shading passes (normals, ...)
+		STREAM_COUNT = 2
+	};
+	enum StreamBit : uint32_t
+	{
+		POSITION_BIT = 1 << POSITION,
+		SHADING_BIT = 1 << SHADING,
+		ALL_STREAMS = (1 << STREAM_COUNT) - 1
+	};
+	/* Attribute within the element of a stream.
+	*/
+	struct Attribute
+	{
+		uint32_t _location;
+		VkFormat _format;
+		uint32_t _offset;
+	};
+
+	VertexLayoutVulkan();
+
+	/* Set the binding of a stream and the attributes it holds.
+	binding		<<	Binding of the stream data, must remain valid while the layout is used.
+	attributes	<<	Attributes of the stream element, several attributes are interleaved in the element.
+	*/
+	void setStream(Stream stream, VertexBufferVulkan::Binding *binding, std::initializer_list<Attribute> attributes);
+	bool hasStream(Stream stream) { return _bindings[stream] != nullptr; }
+	/* Generate the vertex input state of the streams in the mask. The state references the layout and is valid until the next
+	call, techniques copy it when created.
+	*/
+	VkPipelineVertexInputStateCreateInfo vertexInput(uint32_t streams);
+	/* Bind the streams in the mask, consecutive slots are bound with a single call.
+	*/
+	void bind(VkCommandBuffer cmdBuf, uint32_t streams);
+	/* Bytes fetched per vertex when consuming the streams. */
+	uint32_t vertexSize(uint32_t streams);
+
+private:
+	VertexBufferVulkan::Binding *_bindings[STREAM_COUNT];
+	std::vector<Attribute> _attributes[STREAM_COUNT];
+
+	// Storage of the last generated vertex input state
+	std::vector<VkVertexInputBindingDescription> _inputBindings;
+	std::vector<VkVertexInputAttributeDescription> _inputAttributes;
+};
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -51,6 +52,19 @@ inline T rmvFlag(T property, uint32_t rmv)
 #pragma region Structs
 namespace vk
 {
+	/* Reference to a point on a queue timeline (a queue submission). Emulates a timeline semaphore value as timeline semaphores are not available,
+	each submission increments the queue value and completion is tracked by a fence owned by the queue. Value 0 is always complete.
+	*/
+	struct Ticket
+	{
+		uint32_t queue;			// Index of the queue in the QueueConstruct
+		uint64_t value;			// Submission value on the queue timeline
+		VkSemaphore signal;		// Binary semaphore signaled by the submission used for GPU waits (optional). Can only be waited on once.
+
+		Ticket() : queue(0), value(0), signal(VK_NULL_HANDLE) {}
+		Ticket(uint32_t queue, uint64_t value, VkSemaphore signal = VK_NULL_HANDLE) : queue(queue), value(value), signal(signal) {}
+	};
+
 	struct QueueRef
 	{
 		int family;
@@ -59,16 +73,33 @@ namespace vk
 		VkCommandPool pool;
 		VkQueue queue;
 
+		// Timeline
+		uint64_t submitted;		// Value of the last submission
+		uint64_t completed;		// Value of the last submission known to be complete
+		std::deque<std::pair<uint64_t, VkFence>> pending;	// Submissions in flight
+		std::vector<VkFence> freeFences;					// Unsignaled fences for re-use
+
 		QueueRef();
 		QueueRef(int family, float priority);
 
-		/* Destroy the queue related resources (the VkCommandPool)
+		/* Destroy the queue related resources (the VkCommandPool and timeline fences)
 		*/
 		void destroyQueue(VkDevice dev);
 		/* Acquire the queue from device.
 		*/
 		void getDeviceQueue(VkDevice dev);
 		int createCommandPool(VkDevice dev, VkCommandPoolCreateFlags flag);
+
+		/* Submit the batches to the queue advancing the timeline.
+		return	>>	Timeline value of the submission.
+		*/
+		uint64_t submit(VkDevice dev, const VkSubmitInfo *submits, uint32_t numSubmits);
+		/* Poll the fences in flight and advance the completed value.
+		*/
+		void retire(VkDevice dev);
+		/* Get the fence signaled when the timeline reaches the value, VK_NULL_HANDLE if the value is already complete.
+		*/
+		VkFence getFence(uint64_t value);
 	};
 	/* Vulkan queue container for generating, storing and destroying VkQueues and the related command pool.
 	*/
@@ -88,11 +119,43 @@ namespace vk
 		void fetchDeviceQueues(VkDevice device);
 		void createCommandPool(VkDevice device, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
+		/* Submit a batch to the queue.
+		queue		<<	Index of the queue.
+		submitInfo	<<	The batch to submit.
+		signal		<<	Semaphore signaled by the batch (must be in the submitInfo signal list) stored in the ticket for GPU waits.
+		return		>>	Ticket completed when the batch finished executing.
+		*/
+		Ticket submit(uint32_t queue, const VkSubmitInfo &submitInfo, VkSemaphore signal = VK_NULL_HANDLE);
+		/* Poll if the submission referenced by the ticket is complete.
+		*/
+		bool isComplete(const Ticket &ticket);
+		/* Block until all the tickets are complete using a single wait.
+		*/
+		void wait(const Ticket *tickets, uint32_t numTickets);
+		void wait(const Ticket &ticket) { wait(&ticket, 1); }
+
 		void push_queue(VkPhysicalDevice physDev, float priority, VkQueueFlags* prefFlags, uint32_t numFlags);
 		QueueRef& operator[](uint32_t index);
 		size_t size();
 	};
 
+	/* Typed push constant block of a pipeline layout, declared with LayoutConstruct::definePushConstant.
+	*/
+	template<typename T>
+	struct PushConstant
+	{
+		uint32_t _offset;			// Byte offset of the block in the layout push constant range
+		VkShaderStageFlags _stages;	// Stages the block is visible to
+
+		/* Record the block values into the command buffer.
+		layout	<<	Pipeline layout the block was declared in (or a layout compatible for push constants).
+		*/
+		void push(VkCommandBuffer cmdBuf, VkPipelineLayout layout, const T &value) const
+		{
+			vkCmdPushConstants(cmdBuf, layout, _stages, _offset, sizeof(T), &value);
+		}
+	};
+
 	/* Layout array for pipeline layouts.
 	*/
 	struct LayoutConstruct
@@ -101,6 +164,8 @@ namespace vk
 		VkPipelineLayout _layout;
 		VkDescriptorSetLayout * _desc;
 		uint32_t _numLayouts;
+		std::vector<VkPushConstantRange> _pushRanges;	// Push constant blocks declared, one range each
+		uint32_t _pushSize;								// Total byte size of the blocks
 
 		LayoutConstruct();
 		LayoutConstruct(uint32_t numDescriptions);
@@ -108,6 +173,24 @@ namespace vk
 		void construct(VkDevice dev);
 		void destroy(VkDevice dev);
 		VkDescriptorSetLayout& operator[](uint32_t index);
+
+		/* Declare a push constant block placed after the previously declared blocks, must be called before construct.
+		The total size of the blocks is limited by maxPushConstantsSize (at least 128 bytes on every device).
+		stages	<<	Shader stages the block is visible to.
+		*/
+		template<typename T>
+		PushConstant<T> definePushConstant(VkShaderStageFlags stages)
+		{
+			static_assert(sizeof(T) % 4 == 0, "Push constant blocks are sized in multiples of 4 bytes.");
+			PushConstant<T> block = { _pushSize, stages };
+			_pushRanges.push_back({ stages, _pushSize, (uint32_t)sizeof(T) });
+			_pushSize += (uint32_t)sizeof(T);
+			return block;
+		}
+		/* Record the block values into the command buffer.
+		*/
+		template<typename T>
+		void push(VkCommandBuffer cmdBuf, const PushConstant<T> &block, const T &value) { block.push(cmdBuf, _layout, value); }
 	};
 
 	class QueryPool;
@@ -211,6 +294,8 @@ namespace vk
 int choosePhysicalDevice(VkInstance &instance, VkSurfaceKHR &surface, vk::isDeviceSuitable deviceSpec, VkQueueFlags queueSupportReq, VkPhysicalDevice &result);
 
 std::vector<const char*> checkValidationLayerSupport(const char** validationLayers, size_t num_layer);
+/* Check if the physical device supports the device extension. */
+bool checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension);
 void checkValidImageFormats(VkPhysicalDevice device);
 
 /* Swap chain */
@@ -219,11 +304,13 @@ VkPresentModeKHR chooseSwapPresentMode(VkPhysicalDevice &device, VkSurfaceKHR &s
 VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass pass, VkExtent2D frameDim, VkImageView *attachments, uint32_t num_attachment);
 
 
-VkAttachmentDescription defineFramebufColor(VkFormat swapChainImgFormat);
+/* finalLayout	<<	Layout of the frame image after the pass, PRESENT_SRC requires VK_KHR_swapchain (see VulkanRenderer::getPresentLayout).
+*/
+VkAttachmentDescription defineFramebufColor(VkFormat swapChainImgFormat, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 VkAttachmentDescription defineFramebufDepth(VkFormat depthImgFormat);
 VkAttachmentDescription defineFramebufShadowMap(VkFormat shadowMapFormat);
-VkRenderPass createRenderPass_SingleColor(VkDevice device, VkFormat swapChainImgFormat);
-VkRenderPass createRenderPass_SingleColorDepth(VkDevice device, VkFormat swapChainImgFormat, VkFormat depthFormat);
+VkRenderPass createRenderPass_SingleColor(VkDevice device, VkFormat swapChainImgFormat, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+VkRenderPass createRenderPass_SingleColorDepth(VkDevice device, VkFormat swapChainImgFormat, VkFormat depthFormat, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
 VkFormat findSupportedFormat(VkPhysicalDevice physDevice, const VkFormat* candidates, size_t num_cand, VkImageTiling tiling, VkFormatFeatureFlags features);
 VkFormat findDepthFormat(VkPhysicalDevice physDevice);
@@ -239,15 +326,17 @@ VkVertexInputAttributeDescription defineVertexAttribute(uint32_t bind_index, uin
 /* Image */
 
 VkImage createTexture2D(VkDevice device, uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL);
-VkImage createDepthBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL);
+VkImage createDepthBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL,
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+VkImage createColorBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL);
 VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
 
 VkSampler createSampler(VkDevice device, VkFilter magFilter = VK_FILTER_LINEAR, VkFilter minFilter = VK_FILTER_LINEAR, 
 	VkSamplerAddressMode wrap_s = VK_SAMPLER_ADDRESS_MODE_REPEAT, VkSamplerAddressMode wrap_t = VK_SAMPLER_ADDRESS_MODE_REPEAT);
 
 //Transitions, should prob. be moved.
-void transition_PostToPresent(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
-void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+void transition_PostToPresent(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED, VkImageLayout presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED, VkImageLayout presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 void transition_DepthRead(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
 void transition_DepthWrite(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, int dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
 
@@ -257,14 +346,17 @@ VkShaderModule createShaderModule(VkDevice dev, uint32_t *spv_code, size_t codeB
 
 /* Memory */
 
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 VkDeviceMemory allocPhysicalMemory(VkDevice device, VkPhysicalDevice physicalDevice, VkBuffer buffer, VkMemoryPropertyFlags properties, bool bindToBuffer = false);
 VkDeviceMemory allocPhysicalMemory(VkDevice device, VkPhysicalDevice physicalDevice, VkImage image, VkMemoryPropertyFlags properties, bool bindToImage = false);
 VkDeviceMemory allocPhysicalMemory(VkDevice device, VkPhysicalDevice physicalDevice, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties);
 
 /* Commands */
 
-VkCommandBuffer allocateCmdBuf(VkDevice device, VkCommandPool commandPool);
+VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamily, VkCommandPoolCreateFlags flags = 0);
+VkCommandBuffer allocateCmdBuf(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 void beginCmdBuf(VkCommandBuffer cmdBuf, VkFlags flag = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+void beginSecondaryCmdBuf(VkCommandBuffer cmdBuf, const VkCommandBufferInheritanceInfo &inheritance, VkFlags flag = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 VkCommandBuffer beginSingleCommand(VkDevice device, VkCommandPool commandPool);
 void endSingleCommand(VkDevice device, VkQueue queue, VkCommandBuffer commandBuf, VkFence fence = VK_NULL_HANDLE);
 void endSingleCommand_Wait(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkCommandBuffer commandBuf);
@@ -321,7 +413,8 @@ VkPipelineColorBlendStateCreateInfo defineBlendState_LogicOp(VkPipelineColorBlen
 VkPipelineColorBlendStateCreateInfo defineBlendState(VkPipelineColorBlendAttachmentState *blendStateAttachments, uint32_t num_attachments, glm::vec4 blendConstants = glm::vec4(0));
 /* Define a simple uniform layout using uniform buffers (no push constants).
 */
-VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *descriptorSet, uint32_t num_descriptors);
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *descriptorSet, uint32_t num_descriptors,
+	const VkPushConstantRange *pushConstants = nullptr, uint32_t num_pushConstants = 0);
 
 
 typedef enum RasterizationFlagBits
@@ -346,6 +439,7 @@ VkPipelineVertexInputStateCreateInfo defineVertexBufferBindings(
 #ifdef VULKAN_DEVICE_IMPLEMENTATION
 #include <iostream>
 #include <map>
+#include <limits>
 
 #pragma region Structs
 namespace vk
@@ -353,16 +447,22 @@ namespace vk
 #pragma region Command Queue
 
 	QueueRef::QueueRef()
-		: index(0), priority(1.f)
+		: index(0), priority(1.f), submitted(0), completed(0)
 	{}
 	QueueRef::QueueRef(int family, float priority)
-		: family(family), index(0), priority(priority)
+		: family(family), index(0), priority(priority), submitted(0), completed(0)
 	{}
-	/* Destroy the queue related resources (the VkCommandPool)
+	/* Destroy the queue related resources (the VkCommandPool and timeline fences)
 	*/
 	void QueueRef::destroyQueue(VkDevice dev)
 	{
 		vkDestroyCommandPool(dev, pool, nullptr);
+		for (auto &p : pending)
+			vkDestroyFence(dev, p.second, nullptr);
+		for (VkFence fence : freeFences)
+			vkDestroyFence(dev, fence, nullptr);
+		pending.clear();
+		freeFences.clear();
 	}
 	/* Acquire the queue from device.
 	*/
@@ -382,6 +482,48 @@ namespace vk
 			return -1;
 		return 0;
 	}
+	uint64_t QueueRef::submit(VkDevice dev, const VkSubmitInfo *submits, uint32_t numSubmits)
+	{
+		VkFence fence;
+		if (freeFences.empty())
+			fence = createFence(dev);
+		else
+		{
+			fence = freeFences.back();
+			freeFences.pop_back();
+		}
+		if (vkQueueSubmit(queue, numSubmits, submits, fence) != VK_SUCCESS)
+		{
+			freeFences.push_back(fence);
+			throw std::runtime_error("Failed to submit to queue.");
+		}
+		pending.push_back(std::make_pair(++submitted, fence));
+		return submitted;
+	}
+	void QueueRef::retire(VkDevice dev)
+	{
+		// A signaled fence covers all previous submissions on the queue, retire in submission order.
+		while (!pending.empty() && vkGetFenceStatus(dev, pending.front().second) == VK_SUCCESS)
+		{
+			completed = pending.front().first;
+			vkResetFences(dev, 1, &pending.front().second);
+			freeFences.push_back(pending.front().second);
+			pending.pop_front();
+		}
+	}
+	VkFence QueueRef::getFence(uint64_t value)
+	{
+		if (value <= completed)
+			return VK_NULL_HANDLE;
+		if (value > submitted)
+			throw std::runtime_error("Queue timeline value is not submitted.");
+		for (auto &p : pending)
+		{
+			if (p.first >= value)
+				return p.second;
+		}
+		return VK_NULL_HANDLE;
+	}
 
 	QueueConstruct::QueueConstruct()
 		: _queues()
@@ -431,6 +573,7 @@ namespace vk
 	}
 	void QueueConstruct::fetchDeviceQueues(VkDevice device)
 	{
+		_device = device;
 		for (int i = 0; i < _queues.size(); i++)
 			_queues[i].getDeviceQueue(device);
 	}
@@ -448,6 +591,33 @@ namespace vk
 		int family = pickQueueFamily(physDev, prefFlags, numFlags);
 		_queues.push_back(QueueRef(family, priority));
 	}
+	Ticket QueueConstruct::submit(uint32_t queue, const VkSubmitInfo &submitInfo, VkSemaphore signal)
+	{
+		return Ticket(queue, _queues[queue].submit(_device, &submitInfo, 1), signal);
+	}
+	bool QueueConstruct::isComplete(const Ticket &ticket)
+	{
+		QueueRef &ref = _queues[ticket.queue];
+		ref.retire(_device);
+		return ticket.value <= ref.completed;
+	}
+	void QueueConstruct::wait(const Ticket *tickets, uint32_t numTickets)
+	{
+		std::vector<VkFence> fences;
+		fences.reserve(numTickets);
+		for (uint32_t i = 0; i < numTickets; i++)
+		{
+			VkFence fence = _queues[tickets[i].queue].getFence(tickets[i].value);
+			if (fence != VK_NULL_HANDLE)
+				fences.push_back(fence);
+		}
+		if (fences.empty())
+			return;
+		if (vkWaitForFences(_device, (uint32_t)fences.size(), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+			throw std::runtime_error("Failed waiting for queue tickets.");
+		for (uint32_t i = 0; i < numTickets; i++)
+			_queues[tickets[i].queue].retire(_device);
+	}
 	QueueRef& QueueConstruct::operator[](uint32_t index)
 	{
 		return _queues[index];
@@ -457,15 +627,15 @@ namespace vk
 
 
 	LayoutConstruct::LayoutConstruct()
-		: _desc(NULL), _numLayouts(0)
+		: _desc(NULL), _numLayouts(0), _pushSize(0)
 	{	}
 	LayoutConstruct::LayoutConstruct(uint32_t numDescriptions)
-		: _desc(new VkDescriptorSetLayout[numDescriptions]), _numLayouts(numDescriptions)
+		: _desc(new VkDescriptorSetLayout[numDescriptions]), _numLayouts(numDescriptions), _pushSize(0)
 	{
 	}
 	void LayoutConstruct::construct(VkDevice dev)
 	{
-		_layout = createPipelineLayout(dev, _desc, _numLayouts);
+		_layout = createPipelineLayout(dev, _desc, _numLayouts, _pushRanges.data(), (uint32_t)_pushRanges.size());
 	}
 	void LayoutConstruct::destroy(VkDevice dev)
 	{
@@ -725,6 +895,7 @@ namespace vk
 
 /* Abstract device selection function using a ranking function to select device. 
 instance		<<	Vulkan instance
+surface			<<	Surface the device should present to, VK_NULL_HANDLE if no presentation is required.
 deviceSpec		<<	Ranking function of available physical devices used to determine a suitable device.
 queueSupportReq	<<	Flag verifying that (to be) ranked devices supports a set of queue families.  
 result			>>	Selected device
@@ -764,11 +935,15 @@ int choosePhysicalDevice(VkInstance &instance, VkSurfaceKHR &surface, vk::isDevi
 			continue;
 
 		// Ensure the device can present on the specific surface (it is physically connected to the screen?).
-		VkBool32 presentSupport = false;
-		VkResult err = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], i, surface, &presentSupport);
-		assert(err == VK_SUCCESS);
-		if(!presentSupport)
-			continue;
+		// A null surface skips the check (headless rendering).
+		if (surface != VK_NULL_HANDLE)
+		{
+			VkBool32 presentSupport = false;
+			VkResult err = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], i, surface, &presentSupport);
+			assert(err == VK_SUCCESS);
+			if (!presentSupport)
+				continue;
+		}
 
 		// Find suitable device
 		int rank = deviceSpec(physicalDevices[i], properties, feature, familyProperty.data(), familyProperty.size());
@@ -820,6 +995,20 @@ std::vector<const char*> checkValidationLayerSupport(const char** validationLaye
 	return available;
 }
 
+bool checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension)
+{
+	uint32_t count;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+	std::vector<VkExtensionProperties> available(count);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, available.data());
+	for (const VkExtensionProperties &prop : available)
+	{
+		if (strcmp(extension, prop.extensionName) == 0)
+			return true;
+	}
+	return false;
+}
+
 #pragma endregion
 
 #pragma region Synchronization
@@ -1014,7 +1203,7 @@ VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass pass, VkExtent2D f
 	return frameBuffer;
 }
 
-VkAttachmentDescription defineFramebufColor(VkFormat swapChainImgFormat)
+VkAttachmentDescription defineFramebufColor(VkFormat swapChainImgFormat, VkImageLayout finalLayout)
 {
 	VkAttachmentDescription colAttach = {};
 	colAttach.format = swapChainImgFormat;
@@ -1024,7 +1213,7 @@ VkAttachmentDescription defineFramebufColor(VkFormat swapChainImgFormat)
 	colAttach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colAttach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colAttach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colAttach.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colAttach.finalLayout = finalLayout;
 	return colAttach;
 }
 VkAttachmentDescription defineFramebufDepth(VkFormat depthImgFormat)
@@ -1057,9 +1246,9 @@ VkAttachmentDescription defineFramebufShadowMap(VkFormat shadowMapFormat)
 
 /* Create a simple single render pass with attached color buffer.
 */
-VkRenderPass createRenderPass_SingleColor(VkDevice device, VkFormat swapChainImgFormat) {
+VkRenderPass createRenderPass_SingleColor(VkDevice device, VkFormat swapChainImgFormat, VkImageLayout finalLayout) {
 
-	VkAttachmentDescription colAttach = defineFramebufColor(swapChainImgFormat);
+	VkAttachmentDescription colAttach = defineFramebufColor(swapChainImgFormat, finalLayout);
 	// Referenced renderbuffer target
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -1098,10 +1287,10 @@ VkRenderPass createRenderPass_SingleColor(VkDevice device, VkFormat swapChainImg
 
 /* Create a simple single render pass with attached color buffer and depth buffer.
 */
-VkRenderPass createRenderPass_SingleColorDepth(VkDevice device, VkFormat swapChainImgFormat, VkFormat depthFormat) {
+VkRenderPass createRenderPass_SingleColorDepth(VkDevice device, VkFormat swapChainImgFormat, VkFormat depthFormat, VkImageLayout finalLayout) {
 	const int num_attach = 2;
 	VkAttachmentDescription attach[num_attach] = {
-		defineFramebufColor(swapChainImgFormat),
+		defineFramebufColor(swapChainImgFormat, finalLayout),
 		defineFramebufDepth(depthFormat)
 	};
 
@@ -1175,7 +1364,7 @@ VkFormat findDepthFormat(VkPhysicalDevice physDevice) {
 	return findSupportedFormat(
 		physDevice, 
 		list, num_cand,
-		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
 	);
 
 }
@@ -1284,7 +1473,7 @@ VkImage createTexture2D(VkDevice device, uint32_t width, uint32_t height, VkForm
 	}
 	return texture;
 }
-VkImage createDepthBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling)
+VkImage createDepthBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1298,8 +1487,38 @@ VkImage createDepthBuffer(VkDevice device, uint32_t width, uint32_t height, VkFo
 
 	imageInfo.tiling = tiling;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	// This image is used for sampling!...
-	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.flags = 0; // Optional
+	imageInfo.queueFamilyIndexCount = 0;
+	imageInfo.pQueueFamilyIndices = nullptr;
+
+	VkImage texture;
+	VkResult result = vkCreateImage(device, &imageInfo, nullptr, &texture);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
+	}
+	return texture;
+}
+/* Create an image used as color attachment in place of a swapchain image (offscreen rendering).
+*/
+VkImage createColorBuffer(VkDevice device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling)
+{
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.format = format;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+
+	imageInfo.tiling = tiling;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// Same usage as the swapchain images (render, post process in compute, blits) and readback.
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.flags = 0; // Optional
@@ -1376,7 +1595,7 @@ VkSampler createSampler(VkDevice device, VkFilter magFilter, VkFilter minFilter,
 	return sampler;
 }
 
-void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily, int dstQueueFamily)
+void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily, int dstQueueFamily, VkImageLayout presentLayout)
 {
 	VkPipelineStageFlags sourceStage
 		= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;	// Src. stage was dependent during the output stage of the hardware pipe.
@@ -1384,7 +1603,7 @@ void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFa
 		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;		// Memory access req. synchronization during compute execution.
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier.oldLayout = presentLayout;
 	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
 	barrier.srcAccessMask = 0;
 	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
@@ -1399,7 +1618,7 @@ void transition_RenderToPost(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFa
 
 	cmdImageTransition(cmdBuf, sourceStage, destinationStage, barrier);
 }
-void transition_PostToPresent(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily, int dstQueueFamily)
+void transition_PostToPresent(VkCommandBuffer cmdBuf, VkImage img, int srcQueueFamily, int dstQueueFamily, VkImageLayout presentLayout)
 {
 	VkPipelineStageFlags sourceStage
 		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
@@ -1408,7 +1627,7 @@ void transition_PostToPresent(VkCommandBuffer cmdBuf, VkImage img, int srcQueueF
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier.newLayout = presentLayout;
 	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 	barrier.dstAccessMask = 0;
 	barrier.srcQueueFamilyIndex = srcQueueFamily;
@@ -1609,19 +1828,38 @@ VkDeviceMemory allocPhysicalMemory(VkDevice device, VkPhysicalDevice physicalDev
 
 
 #pragma region Command
+/* Create a command pool not bound to any of the device queues (such as a pool owned by a recording thread).
+device		<<	The device
+queueFamily	<<	Queue family the allocated command buffers are submitted to.
+flags		<<	Pool creation flags.
+return		>>	The created command pool.
+*/
+VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamily, VkCommandPoolCreateFlags flags)
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = flags;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create command pool.");
+	return pool;
+}
 /* Create a command buffer for re-use.
 device		<<	The device
 commandPool <<	Pool to allocate command buffer from.
-bufferSize	<<	Max number of commands possible in the buffer.
+level		<<	Primary or secondary command buffer.
 return		>>	The created command buffer.
 */
-VkCommandBuffer allocateCmdBuf(VkDevice device, VkCommandPool commandPool)
+VkCommandBuffer allocateCmdBuf(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level)
 {
 	// Create command buffer
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocateInfo.pNext = nullptr;
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.level = level;
 	commandBufferAllocateInfo.commandPool = commandPool;
 	commandBufferAllocateInfo.commandBufferCount = 1;
 
@@ -1646,6 +1884,25 @@ void beginCmdBuf(VkCommandBuffer cmdBuf, VkFlags flag)
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to begin command buffer.");
 }
+/* Call vkBeginCommandBuffer on a secondary command buffer.
+cmdBuf		<<	Secondary command buffer to begin.
+inheritance	<<	State inherited from the primary buffer. If a render pass is set the buffer is recorded to continue the pass.
+flag		<<	Usage flags.
+*/
+void beginSecondaryCmdBuf(VkCommandBuffer cmdBuf, const VkCommandBufferInheritanceInfo &inheritance, VkFlags flag)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = flag;
+	if (inheritance.renderPass != VK_NULL_HANDLE)
+		commandBufferBeginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritance;
+
+	VkResult result = vkBeginCommandBuffer(cmdBuf, &commandBufferBeginInfo);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin secondary command buffer.");
+}
 /* Create a command buffer for single time use.
 device		<<	The device
 commandPool <<	Pool to allocate command buffer from.
@@ -2080,9 +2337,10 @@ VkPipelineColorBlendStateCreateInfo defineBlendState_LogicOp(VkPipelineColorBlen
 }
 
 
-/* Define a simple uniform layout using uniform buffers (no push constants).
+/* Define a pipeline layout from the descriptor set layouts and push constant ranges.
 */
-VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *descriptorSet, uint32_t num_descriptors)
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *descriptorSet, uint32_t num_descriptors,
+	const VkPushConstantRange *pushConstants, uint32_t num_pushConstants)
 {
 	VkPipelineLayoutCreateInfo layout = {};
 	layout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -2090,8 +2348,8 @@ VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *de
 	layout.flags = 0;
 	layout.setLayoutCount = num_descriptors;
 	layout.pSetLayouts = descriptorSet;
-	layout.pushConstantRangeCount = 0;
-	layout.pPushConstantRanges = nullptr;
+	layout.pushConstantRangeCount = num_pushConstants;
+	layout.pPushConstantRanges = pushConstants;
 
 	VkPipelineLayout pipelineLayout;
 	VkResult result = vkCreatePipelineLayout(device, &layout, nullptr, &pipelineLayout);
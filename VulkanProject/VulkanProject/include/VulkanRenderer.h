@@ -1,11 +1,15 @@
 #pragma once
 
+#if defined(_WIN32) && !defined(VK_USE_PLATFORM_WIN32_KHR)
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include "vulkan\vulkan.h"
 
 #include "SDL/SDL.h"
 #include "glm/glm.hpp"
 #include <memory>
+#include <ostream>
+#include <string>
 
 #pragma comment(lib, "vulkan-1.lib")
 #pragma comment(lib,"SDL2.lib")
@@ -15,15 +19,36 @@
 #include "VertexBufferVulkan.h"
 #include "ShaderVulkan.h"
 #include "TechniqueVulkan.h"
-
+#include "PipelineCacheVulkan.h"
+#include "DescriptorAllocatorVulkan.h"
+#include "DescriptorCacheVulkan.h"
+#include "BindlessTableVulkan.h"
+#include "StagingRingVulkan.h"
+#include "TextureStreamerVulkan.h"
+#include "BufferArenaVulkan.h"
+#include "UniformRingVulkan.h"
+#include "Stuff\ThreadPool.h"
+#include "Stuff\TLSFAllocator.h"
+
+/* Device memory allocation of a pool.
+*/
+struct DevMemoryChunk
+{
+	VkDeviceMemory handle;			// The device memory handle
+	uint32_t memoryType;			// Memory type index of the allocation
+	size_t base;					// Start of the chunk in the address range of the pool
+	mf::TLSFAllocator allocator;	// Sub-allocates the chunk, resources free their range when destroyed
+};
 /* Remember!!! number of device allocations is limited (very).
+Pools allocate device memory the first time a partition is requested and grow by chunks doubling in size.
 */
 struct DevMemoryAllocation
 {
-	VkDeviceMemory handle;	// The device memory handle
-	size_t freeOffset;	// Offset to the next free area in the storage memory
+	std::vector<DevMemoryChunk> chunks;
+	size_t chunkSize;	// Size of the first chunk
+	size_t size;		// Bytes allocated by the chunks, the address range of the pool
 
-	DevMemoryAllocation() : handle(NULL), freeOffset(0) {}
+	DevMemoryAllocation() : chunkSize(0), size(0) {}
 };
 enum MemoryPool
 {
@@ -36,14 +61,49 @@ enum MemoryPool
 	Count = 6
 };
 
+/* Memory use of a pool (see VulkanRenderer::getMemoryStats).
+*/
+struct MemoryPoolStats
+{
+	size_t _allocated;		// Device memory allocated by the pool
+	size_t _used;			// Bytes bound to resources, including the alignment padding
+	size_t _padding;		// Alignment padding wasted in front of the resources
+	size_t _largestFree;	// Largest free range of the chunks
+	uint32_t _chunks, _allocations, _freeBlocks;
+	float _fragmentation;	// Fraction of the free bytes outside the largest free range
+};
+/* Memory use of a device heap.
+*/
+struct MemoryHeapStats
+{
+	VkDeviceSize _size;
+	VkDeviceSize _budget;	// Bytes available to the renderer, the heap size (VK_EXT_memory_budget is not available)
+	VkDeviceSize _usage;	// Bytes allocated from the heap by the renderer
+	bool _deviceLocal;
+};
+struct MemoryStats
+{
+	MemoryPoolStats _pools[MemoryPool::Count];
+	std::vector<MemoryHeapStats> _heaps;
+	uint32_t _deviceAllocations, _maxDeviceAllocations;
+};
+
 enum RenderFlagBits
 {
-	TRIPLE_BUFFERED = 0x00000001
+	TRIPLE_BUFFERED = 0x00000001,
+	HEADLESS = 0x00000002,			// Render into a ring of offscreen images, no window, surface or swapchain is created.
+	BINDLESS = 0x00000004			// Create the bindless image table, textures and storage images are indexed through push constants.
 };
 
-const int MAX_DESCRIPTOR_POOLS = 12;
-// Size in bytes of the memory types used
-const uint32_t STORAGE_SIZE[(int)MemoryPool::Count] = { 2048 * 2048*64, 2048 * 2048*64, 2048 * 2048*4, 2048 * 2048 * 64, 1024 * 1024 * 64, 4096 * 4096 * 2 };
+// Size in bytes of the first allocation of the memory pools (see Scene::defineMemoryPools). The staging pool is a fixed size ring.
+const size_t POOL_CHUNK_SIZE[(int)MemoryPool::Count] = { 1024 * 1024 * 64, 1024 * 1024 * 16, 1024 * 1024 * 16, 1024 * 1024 * 16, 1024 * 1024 * 16, 1024 * 1024 * 16 };
+// File the pipeline cache is persisted in between runs
+const char* const PIPELINE_CACHE_FILE = "Pipeline.cache";
+// Size in bytes of the first buffer of the buffer arenas
+const VkDeviceSize ARENA_BLOCK_SIZE = 1024 * 1024 * 4;
+// Size in bytes of each frame region of the uniform ring, and the largest per frame update written through it (larger go through staging)
+const VkDeviceSize UNIFORM_RING_REGION_SIZE = 1024 * 256;
+const VkDeviceSize UNIFORM_RING_MAX_UPDATE = 1024 * 64;
 
 
 class Scene;
@@ -57,6 +117,17 @@ enum QueueType {
 };
 // Set constant values for now
 
+/* Resources owned by a single frame in flight. The renderer cycles a ring of contexts sized to the swapchain length.
+*/
+struct FrameContext
+{
+	VkCommandBuffer _frameCmdBuf, _computeCmdBuf[2];		// Compute buffer per compute queue (COMPUTE, COMPUTE2)
+	VkCommandBuffer _transferCmd;							// Transfer commands consumed by this frame
+	vk::Ticket _renderTicket, _computeTicket[2], _transferTicket;	// Last submissions using the context
+	VkSemaphore _imageAvailable, _renderFinished, _computeFinished[2];
+	vk::QueryFrame _timeStamps;
+};
+
 class VulkanRenderer
 {
 public:
@@ -81,7 +152,10 @@ public:
 
 	// These two functions are used instead of beginFramePass when their functionality needs to be separated
 	FrameInfo beginCommandBuffer();
-	void beginRenderPass(VkCommandBuffer cmdBuf, VkFramebuffer* frameBuffer = NULL);
+	// Begin the frame command buffer and its timestamps without beginning the render pass.
+	FrameInfo beginFrameCommands();
+	// Pass VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS as contents when the pass is recorded with vkCmdExecuteCommands
+	void beginRenderPass(VkCommandBuffer cmdBuf, VkFramebuffer* frameBuffer = NULL, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 	void endRenderPass();
 
 	FrameInfo beginGraphicsAndComputeCommandBuffer();
@@ -89,9 +163,17 @@ public:
 
 
 	FrameInfo beginCompute(uint32_t computeQueueIndex = 0);
-	void submitFramePass(VkSemaphore additionalSignalSemaphore = VK_NULL_HANDLE);
-	void submitCompute(uint32_t computeQueueIndex = 0, bool syncPrevious = true, VkSemaphore additionalWaitSemaphore = VK_NULL_HANDLE);
-	void submitGraphicsAndCompute();
+	/* Submissions return a ticket referencing the submission on the queue timeline. Signals of the frame submissions not waited on by
+	another submission are waited on when the frame is presented.
+	*/
+	vk::Ticket submitFramePass(VkSemaphore additionalSignalSemaphore = VK_NULL_HANDLE);
+	// Submit the frame pass waiting on the specified submissions of the frame.
+	vk::Ticket submitFramePass(const vk::Ticket *waitTickets, uint32_t numWaitTickets, VkSemaphore additionalSignalSemaphore = VK_NULL_HANDLE);
+	// Submit compute, if syncPrevious is set the previous submission in the frame is waited on.
+	vk::Ticket submitCompute(uint32_t computeQueueIndex = 0, bool syncPrevious = true, VkSemaphore additionalWaitSemaphore = VK_NULL_HANDLE);
+	// Submit compute waiting on the specified submissions of the frame.
+	vk::Ticket submitCompute(uint32_t computeQueueIndex, const vk::Ticket *waitTickets, uint32_t numWaitTickets, VkSemaphore additionalWaitSemaphore = VK_NULL_HANDLE);
+	vk::Ticket submitGraphicsAndCompute();
 
 	virtual int beginShutdown();
 	int shutdown();
@@ -104,15 +186,57 @@ public:
 
 	const VkViewport& getViewport();
 
-	/* Bind a physical memory partition on the device to the buffer from the specific memory pool. */
+	/* Bind a physical memory partition on the device to the buffer from the specific memory pool, the pool grows if it is full.
+	return	>>	Address of the partition in the pool, released with freePhysicalMemory.
+	*/
 	size_t bindPhysicalMemory(VkBuffer buffer, MemoryPool memPool);
+	/* Bind a partition to the image, images are assumed optimal tiled (separated from buffers by the bufferImageGranularity). */
 	size_t bindPhysicalMemory(VkImage img, MemoryPool pool);
-
-	VkDescriptorSet generateDescriptor(VkDescriptorType type, VkDescriptorSetLayout *layout);
-	VkDescriptorSet generateDescriptor(VkDescriptorType type, uint32_t set_binding);
+	/* Return the partition at the address to the pool, the resource bound to it must be destroyed and no longer in use by the device. */
+	void freePhysicalMemory(MemoryPool pool, size_t offset);
+	/* Current memory use of the pools and device heaps. Allocations made outside the pools (frame graph transients) are not included. */
+	MemoryStats getMemoryStats();
+	void printMemoryStats(std::ostream &stream);
+	/* Write the memory statistics as a JSON object on a single line.
+	run		<<	Label of the run stored with the statistics.
+	*/
+	void writeMemoryStatsJSON(std::ostream &stream, const std::string &run);
+
+	/* Allocate a descriptor set living until shutdown (persistent arena). The pools hold all descriptor types. */
+	VkDescriptorSet generateDescriptor(VkDescriptorSetLayout *layout);
+	VkDescriptorSet generateDescriptor(uint32_t set_binding);
+	/* Allocate a descriptor set valid for the current frame only, released when the frame context is re-used. */
+	VkDescriptorSet generateFrameDescriptor(VkDescriptorSetLayout layout);
+	DescriptorAllocatorVulkan& getDescriptorAllocator() { return descriptors; }
+	/* Written descriptor sets shared by objects binding the same resources. */
+	DescriptorCacheVulkan& getDescriptorCache() { return descriptorCache; }
+	/* Bindless resource table, NULL unless initialized with the BINDLESS flag. Sealed after the scene is initialized. */
+	BindlessTableVulkan* getBindlessTable() { return bindless ? &bindlessTable : nullptr; }
 
 	/* Transfer data to the specific buffer. */
 	void transferBufferData(VkBuffer buffer, const void* data, size_t byteSize, size_t offset);
+	/* Allocate mapped staging memory for the next transfer, the data is written in place and copied with transferBufferStaged.
+	The allocation is valid until the frame transfer commands are submitted. */
+	StagingRingVulkan::Allocation allocateStaging(size_t byteSize) { return staging.allocate(byteSize); }
+	/* Record the copy of a staging allocation into the buffer with the next transfer. */
+	void transferBufferStaged(VkBuffer buffer, const StagingRingVulkan::Allocation &src, size_t offset);
+	StagingRingVulkan& getStagingRing() { return staging; }
+	/* Textures streamed with the frame transfers. */
+	TextureStreamerVulkan& getTextureStreamer() { return streamer; }
+	/* Shared buffers handing out views for the usage (BufferArenaVulkan::Usage). */
+	BufferArenaVulkan& getBufferArena(uint32_t usage) { return arenas[usage]; }
+	const VkPhysicalDeviceLimits& getLimits() { return deviceProperties.limits; }
+	/* If draws can read their count from a buffer (VK_AMD_draw_indirect_count). */
+	bool hasDrawIndirectCount() { return drawIndirectCountFn != nullptr; }
+	/* If indirect draws can issue more than one draw (multiDrawIndirect feature). */
+	bool hasMultiDrawIndirect() { return multiDrawIndirect; }
+	/* Record indirect draws with the number of draws read from the count buffer, requires hasDrawIndirectCount.
+	indexed		<<	If the commands are VkDrawIndexedIndirectCommand, otherwise VkDrawIndirectCommand.
+	maxDrawCount	<<	Upper bound of the count read.
+	*/
+	void drawIndirectCount(VkCommandBuffer cmdBuf, bool indexed, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride);
+	/* Mapped uniform buffer written directly by the CPU each frame, regions are selected with dynamic offsets. */
+	UniformRingVulkan& getUniformRing() { return uniformRing; }
 	void transferBufferInitial(VkBuffer buffer, const void* data, size_t byteSize, size_t offset);
 	void transferImageData(VkImage image, const void* data, glm::uvec3 img_size, uint32_t pixel_bytes, glm::ivec3 offset = glm::ivec3(0));
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout fromLayout, VkImageLayout toLayout);
@@ -122,22 +246,43 @@ public:
 	VkRenderPass getFramePass();
 	VkPipelineLayout getFramePassLayout();
 	int getQueueFamily(QueueType queue) { return queues[queue].family; };
+	/* Index of the frame context currently rendered. */
 	uint32_t getFrameIndex() { return frameCycle; }
-	uint32_t getTransferIndex() { return !frameCycle; }
+	/* Index of the frame context transfers are recorded for (the next frame). */
+	uint32_t getTransferIndex() { return (frameCycle + 1) % (uint32_t)_frames.size(); }
+	/* Number of frames in flight (size of the frame context ring). */
+	uint32_t getFrameCount() { return (uint32_t)_frames.size(); }
+	/* Number of frames completed since initialization. */
+	uint64_t getFrameNumber() { return frameNumber; }
 	size_t getSwapChainLength() { return swapchainImages.size(); }
+	/* Index of the swapchain image acquired for the current frame. */
+	uint32_t getSwapChainIndex() { return swapChainImgIndex; }
 
 	VkSurfaceFormatKHR getSwapchainFormat();
+	/* Layout the frame images are handed to the presentation in. PRESENT_SRC requires VK_KHR_swapchain which is not enabled headless,
+	offscreen frames are left in the general layout.
+	*/
+	VkImageLayout getPresentLayout() { return headless ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; }
 	VkImageView getSwapChainView(uint32_t index);
 	VkImage getSwapChainImg(uint32_t index);
+	/* Depth buffer of the frame pass, in the depth attachment layout outside of the pass. Holds the depth of the previous frame until
+	the frame pass clears it. */
+	VkImage getDepthImage() { return depthImage; }
+	VkImageView getDepthView() { return depthImageView; }
+	VkFormat getDepthFormat() { return depthFormat; }
 
 	unsigned int getWidth();
 	unsigned int getHeight();
 
 	VkDescriptorSetLayout getDescriptorSetLayout(uint32_t index);
 
+	/* Worker threads shared by the renderer components (command recording). */
+	mf::ThreadPool& getWorkers() { return *workers; }
+	/* Pipeline cache used when creating the techniques. */
+	PipelineCacheVulkan& getPipelineCache() { return pipelineCache; }
+
 	vk::QueueConstruct queues;
 	vk::QueryPool _queries;
-	vk::QueryFrame _timeStamps[2];
 
 private:
 	Scene * scene;
@@ -147,17 +292,27 @@ private:
 	int chosenPhysicalDevice;
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceProperties deviceProperties;
+	PFN_vkCmdDrawIndirectCountAMD drawIndirectCountFn = nullptr;				// Null if VK_AMD_draw_indirect_count is not enabled
+	PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCountFn = nullptr;
+	bool multiDrawIndirect = false;
 	std::vector<DevMemoryAllocation> memPool;// Memory pool of device memory. Remember!!! number of device allocations is limited (very).
+	std::mutex memPoolLock;					// Guards the pool allocators
+	uint32_t deviceAllocations = 0;			// Device memory allocations made by the renderer, bounded by maxMemoryAllocationCount
+	VkPhysicalDeviceMemoryProperties memProperties;
+	VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS] = {};	// Bytes allocated by the renderer from each heap
 
 	bool globalWireframeMode = false;
 
-	SDL_Window* window;
-	VkSurfaceKHR windowSurface;
-	VkSwapchainKHR swapchain;
+	SDL_Window* window = nullptr;
+	VkSurfaceKHR windowSurface = VK_NULL_HANDLE;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	bool headless = false;								// If rendering offscreen without a presentation engine.
+	bool bindless = false;								// If the bindless resource table is created.
 
 	std::vector<VkImage> swapchainImages;				// Array of images in the swapchain, use vkAquireNextImageKHR(...) to aquire image for drawing to
 	std::vector<VkImageView> swapchainImageViews;		// Image views for the swap chain images
 	std::vector<VkFramebuffer> swapChainFramebuffers;	// Combined sets of images that make up each frame buffer.
+	std::vector<VkDeviceMemory> offscreenMemory;		// Memory owned by the offscreen images replacing the swapchain when headless.
 
 	VkFormat depthFormat;								// Depth image format.
 	VkImage depthImage;									// Frame buffer depth image
@@ -177,24 +332,29 @@ private:
 
 	VkViewport viewport;
 
-	VkSemaphore imageAvailable;
-	VkSemaphore renderFinished[2], computeFinished[2];		// Multiple render signals as it could be useful to overlap frame buffers.
-	VkFence renderFence[2], computeFence[2];
-	uint32_t waitQueueLen;
-	VkSemaphore waitQueue[QueueType::COUNT];
-
-	VkCommandBuffer _frameCmdBuf[2], _computeCmdBuf[2];
-	VkCommandBuffer _transferCmd[2];
+	std::vector<vk::Ticket> frameSignals;					// Submissions of the current frame with signals not yet waited on
 
-	VkFence			_transferFences[2];
+	std::vector<FrameContext> _frames;						// Ring of frames in flight
 	uint32_t swapChainImgIndex;								// Tracks frame buffer index for current frame
-	uint32_t frameCycle = 0, stagingCycleOffset = 0;	// Tracks transfer cycle
+	uint32_t frameCycle = 0;							// Tracks frame context in the ring
+	uint64_t frameNumber = 0;							// Number of frames completed
 	bool firstFrame = 1;
+	std::unique_ptr<mf::ThreadPool> workers;
+	PipelineCacheVulkan pipelineCache;
 	/*
 	*/
-	VkDescriptorPool descriptorPools[MAX_DESCRIPTOR_POOLS];
+	DescriptorAllocatorVulkan descriptors;
+	DescriptorCacheVulkan descriptorCache;
+	BindlessTableVulkan bindlessTable;
 	
 	VkBuffer stagingBuffer;			// Buffer to temporarily hold data being transferred to GPU
+	VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+	StagingRingVulkan staging;		// Persistently mapped ring over the staging buffer, regions are reclaimed by transfer tickets
+	TextureStreamerVulkan streamer;
+	BufferArenaVulkan arenas[BufferArenaVulkan::COUNT];
+	VkBuffer uniformRingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory uniformRingMemory = VK_NULL_HANDLE;
+	UniformRingVulkan uniformRing;	// Host visible uniform regions cycled per frame
 
 	VkSurfaceFormatKHR swapchainFormat;
 	VkExtent2D swapchainExtent;
@@ -203,12 +363,21 @@ private:
 	uint32_t NUM_FRAME_ATTACH = 0;
 
 	void createStagingBuffer();
-	uint32_t updateStagingBuffer(const void* data, size_t size);								// Writes memory from data into the staging buffer
-	void allocateBufferMemory(MemoryPool type, size_t size, VkFlags usage);					// Allocates memory pool buffer data
-	void allocateImageMemory(MemoryPool type, size_t size, VkFormat imgFormat);				// Allocates memory pool image data
-	void allocateImageMemory(MemoryPool type, VkImage &image, VkFormat imgFormat);
-
+	void createUniformRing(uint32_t numFrames);
+	// Sub-allocates a partition of the pool, returns the pool address and the memory and offset to bind
+	size_t allocatePhysicalMemory(MemoryPool pool, const VkMemoryRequirements &memReq, mf::TLSFAllocator::Kind kind, VkDeviceMemory &memory, VkDeviceSize &memOffset);
+	DevMemoryChunk& growMemoryPool(MemoryPool pool, const VkMemoryRequirements &memReq);		// Allocates the next chunk of the pool fitting the requirements
+	void trackDeviceAllocation(uint32_t memoryType, VkDeviceSize size);							// Counts a device allocation made by the renderer
+
+	void createWindow(unsigned int width, unsigned int height);	// Window and its surface, not created headless
+	void createSwapchain(uint32_t BIT_FLAGS);
+	void createOffscreenTargets(uint32_t BIT_FLAGS);
+	void acquireOffscreenImage();
 	void nextFrame();
+	VkSemaphore consumeFrameSignal(const vk::Ticket &ticket);		// Remove the ticket from the frame signals, returns the semaphore to wait on
+	std::vector<VkSemaphore> getFrameSignals();
+	void createFrameContexts(uint32_t numFrames);
+	void destroyFrameContexts();
 
 	void createDepthComponents();
 };
\ No newline at end of file
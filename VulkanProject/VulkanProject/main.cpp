@@ -7,6 +7,9 @@
 #include "Scenes/ComputeScene.h"
 #include "Scenes/ComputeExperiment.h"
 #include "Scenes/ShadowScene.h"
+#include "Stuff/FrustumCull.h"
+#include "Stuff/TLSFAllocator.h"
+#include "Stuff/ThreadPool.h"
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -17,6 +20,7 @@
 void updateWinTitle(VulkanRenderer *rend);
 void resetTime();
 void outPerfCounters(std::string params);
+void outMemoryStats(VulkanRenderer *rend, std::string params);
 
 static std::vector<double>	perfCounter, graphQueue, compQueue1, compQueue2;
 static double elapsedTime = 0.0;
@@ -24,6 +28,7 @@ static double lastElapsedTime = 0.0;
 const double INIT_WAIT_TIMER = 100;
 const int MIN_SAMPLES = 0;								// = 0 if inf runtime, sampling: 500
 const double RUN_DURATION = INIT_WAIT_TIMER + 1000.f;	//ms
+const uint32_t RENDER_FLAGS = TRIPLE_BUFFERED;			// Default flags, pass -headless for unattended runs (offscreen, terminates after RUN_DURATION)
 
 inline double square(double val) { return val * val; }
 inline uint32_t square(uint32_t val) { return val * val; }
@@ -32,11 +37,38 @@ const std::string MODE_STR[] = {
 	"ASYNC",
 	"SEQ",
 	"MQUEUE",
-	"MULTI_DISPATCH"
+	"MULTI_DISPATCH",
+	"MULTI_THREAD"
 };
+const std::string CULLING_STR[] = {
+	"NO_CULLING",
+	"GPU_CULLING",
+	"CPU_CULLING",
+	"MESHLET_CULLING"
+};
+// Shadow scene runs of -cullbench, timed one after the other and written to Perf.log with the culling in the label
+const ShadowScene::Culling CULL_BENCH[] = { ShadowScene::NO_CULLING, ShadowScene::MESHLET_CULLING };
 
-int main(int argc, const char* argv)
+int main(int argc, const char* argv[])
 {
+	uint32_t renderFlags = RENDER_FLAGS;
+	bool cullBench = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "-headless")
+			renderFlags |= HEADLESS;
+		if (std::string(argv[i]) == "-cullbench")
+			cullBench = true;
+		// CPU side benchmarks, no device is created
+		if (std::string(argv[i]) == "-benchmark")
+		{
+			mf::ThreadPool pool;
+			mf::benchmarkCull(std::cout, pool);
+			mf::benchmarkTLSF(std::cout);
+			return 0;
+		}
+	}
+
 	perfCounter.reserve(10000);
 	graphQueue.reserve(10000);
 	compQueue1.reserve(10000);
@@ -46,7 +78,8 @@ int main(int argc, const char* argv)
 
 	uint32_t ITERS = 16;
 
-	for (uint32_t i = 0; i < (MIN_SAMPLES == 0 ? 1 : ITERS); i++)
+	uint32_t runs = cullBench ? (uint32_t)std::size(CULL_BENCH) : MIN_SAMPLES == 0 ? 1 : ITERS;
+	for (uint32_t i = 0; i < runs; i++)
 	{
 		resetTime();
 		elapsedTime = 0.0;
@@ -62,13 +95,27 @@ int main(int argc, const char* argv)
 		uint32_t pixels = dimW * dimH;
 		float locality = 8.f; // 0.25f * (std::pow(2.f, i*0.4f));
 		uint32_t mode = ComputeExperiment::Mode::MULTI_QUEUE;
-		uint32_t shader = ComputeExperiment::MEM_LIMITED;
+		uint32_t shader = ComputeExperiment::MEM_LIMITED;	// | ComputeExperiment::BLIT_CHAIN to exercise the transient aliasing
 		std::stringstream outString;
-		outString << "MEM_" << MODE_STR[mode] << ", " << pixels << ", " << particles << ", " << locality;
-		renderer.initialize(new ComputeExperiment((ComputeExperiment::Mode)mode, shader, particles, locality), dimW, dimH, TRIPLE_BUFFERED); // 256, 256
+		outString << "MEM_" << MODE_STR[mode];
+		if (shader & ComputeExperiment::BLIT_CHAIN)
+			outString << "_BLIT";
+		outString << ", " << pixels << ", " << particles << ", " << locality;
+		if (cullBench)
+		{
+			// Same generated triangles and camera path for each culling, the full draw against the meshlets
+			dimW = 800, dimH = 600;
+			outString.str("");
+			outString << "SHADOW_" << CULLING_STR[CULL_BENCH[i]] << ", " << dimW * dimH;
+			renderer.initialize(new ShadowScene(ShadowScene::STANDARD, false, CULL_BENCH[i]), dimW, dimH, renderFlags);
+		}
+		else
+			renderer.initialize(new ComputeExperiment((ComputeExperiment::Mode)mode, shader, particles, locality), dimW, dimH, renderFlags); // 256, 256
 		//renderer.initialize(new ComputeScene(ComputeScene::Mode::Blur), 1024, 1024, 0);
 		//renderer.initialize(new TriangleScene(), 512, 512, 0);
 		//renderer.initialize(new ShadowScene(), 800, 600, TRIPLE_BUFFERED);
+		//renderer.initialize(new ShadowScene(ShadowScene::MULTI_THREADED, false, ShadowScene::CPU_CULLING), 800, 600, TRIPLE_BUFFERED);
+		//renderer.initialize(new ShadowScene(ShadowScene::STANDARD, true, ShadowScene::GPU_CULLING, ShadowScene::OBJ_MESH), 800, 600, renderFlags);	// Baked cowparty.obj
 
 		SDL_Event windowEvent;
 		while (true)
@@ -81,9 +128,11 @@ int main(int argc, const char* argv)
 			renderer.frame(static_cast<float>(elapsedTime - lastElapsedTime) / 1000.0f);
 			lastElapsedTime = elapsedTime;
 			updateWinTitle(&renderer);
-			if (MIN_SAMPLES != 0 && MIN_SAMPLES < perfCounter.size() && elapsedTime > RUN_DURATION)	break;
+			bool timedRun = MIN_SAMPLES != 0 || (renderFlags & HEADLESS) || cullBench;
+			if (timedRun && MIN_SAMPLES < perfCounter.size() && elapsedTime > RUN_DURATION)	break;
 		}
 		outPerfCounters(outString.str());
+		outMemoryStats(&renderer, outString.str());
 		renderer.beginShutdown();
 		renderer.shutdown();
 	}
@@ -210,4 +259,12 @@ void outPerfCounters(std::string params)
 		}
 		stream.close();
 	}
-}
\ No newline at end of file
+}
+
+void outMemoryStats(VulkanRenderer *rend, std::string params)
+{
+	// One JSON object per line and run (JSON Lines), next to the perf counters
+	std::ofstream stream("Memory.jsonl", std::ios::app | std::ios::out);
+	if (stream.is_open())
+		rend->writeMemoryStatsJSON(stream, params);
+}
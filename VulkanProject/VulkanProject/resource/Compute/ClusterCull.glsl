@@ -0,0 +1,122 @@
+#version 450
+// Frustum culling of the cluster bounding spheres and back face culling of their normal cones, writes the indirect draw commands of each view.
+// The camera view also culls the spheres behind the depth of the previous frame (depth pyramid)
+layout(local_size_x = 64) in;
+
+layout(constant_id = 0) const uint INDEXED = 0;	// VkDrawIndexedIndirectCommand (5 uints), otherwise VkDrawIndirectCommand (4 uints)
+layout(constant_id = 1) const uint COMPACT = 0;	// Append the visible commands and count them, otherwise a command slot per cluster
+
+struct Cluster
+{
+	vec4 sphere;
+	vec4 cone;		// xyz axis, w cutoff
+	uint first;
+	uint count;
+	int vertexOffset;
+	uint pad;
+};
+
+layout(set=0, binding=0) uniform Frustum
+{
+	vec4 planes[2 * 6];
+	vec4 eye[2];	// Viewer position (w = 1), or view direction of parallel projections (w = 0)
+	mat4 occlusionClip;	// Camera the depth pyramid was drawn with
+} frustum;
+
+layout(set=1, binding=0) readonly buffer Clusters
+{
+	Cluster clusters[];
+};
+layout(set=1, binding=1) writeonly buffer Draws
+{
+	uint draws[];
+};
+layout(set=1, binding=2) buffer Counts
+{
+	uint counts[];
+};
+// Farthest depth of the texels covered by each level texel
+layout(set=2, binding=0) uniform sampler2D pyramid;
+
+layout(push_constant) uniform CullParams
+{
+	uint numClusters;
+	uint firstView;
+	uint occlusion;
+} params;
+
+// If the sphere is behind the depth drawn by the previous frame
+bool occluded(vec4 sphere)
+{
+	// Screen rectangle and nearest depth of the box around the sphere
+	vec2 lo = vec2(1), hi = vec2(-1);
+	float depth = 1;
+	for (uint i = 0; i < 8; i++)
+	{
+		vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1 : -1, (i & 2) != 0 ? 1 : -1, (i & 4) != 0 ? 1 : -1);
+		vec4 clip = frustum.occlusionClip * vec4(corner, 1);
+		// Crosses the plane of the viewer
+		if (clip.w <= 0)
+			return false;
+		vec3 ndc = clip.xyz / clip.w;
+		lo = min(lo, ndc.xy);
+		hi = max(hi, ndc.xy);
+		depth = min(depth, ndc.z);
+	}
+	lo = clamp(lo * 0.5 + 0.5, 0, 1);
+	hi = clamp(hi * 0.5 + 0.5, 0, 1);
+
+	// Level where the rectangle is at most a texel wide, it overlaps the 2x2 texels at its corners
+	vec2 extent = (hi - lo) * vec2(textureSize(pyramid, 0));
+	float level = min(ceil(log2(max(max(extent.x, extent.y), 1))), float(textureQueryLevels(pyramid) - 1));
+	float farthest = max(max(textureLod(pyramid, lo, level).r, textureLod(pyramid, vec2(hi.x, lo.y), level).r),
+		max(textureLod(pyramid, vec2(lo.x, hi.y), level).r, textureLod(pyramid, hi, level).r));
+	return depth > farthest;
+}
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= params.numClusters)
+		return;
+	uint view = params.firstView + gl_WorkGroupID.y;
+	Cluster c = clusters[id];
+
+	bool visible = true;
+	for (uint i = 0; i < 6; i++)
+	{
+		vec4 plane = frustum.planes[view * 6 + i];
+		visible = visible && dot(plane.xyz, c.sphere.xyz) + plane.w >= -c.sphere.w;
+	}
+	// Every triangle faces away from a viewer within the cone around the axis (mf::coneVisible)
+	vec4 eye = frustum.eye[view];
+	if (eye.w == 0)
+		visible = visible && dot(eye.xyz, c.cone.xyz) < c.cone.w;
+	else
+	{
+		vec3 d = c.sphere.xyz - eye.xyz;
+		visible = visible && dot(d, c.cone.xyz) < c.cone.w * length(d) + c.sphere.w;
+	}
+	if (visible && view == 0 && params.occlusion != 0)
+		visible = !occluded(c.sphere);
+
+	uint slot = id;
+	if (COMPACT != 0)
+	{
+		if (!visible)
+			return;
+		slot = atomicAdd(counts[view], 1);
+	}
+	uint stride = INDEXED != 0 ? 5 : 4;
+	uint base = (view * params.numClusters + slot) * stride;
+	draws[base + 0] = c.count;
+	draws[base + 1] = visible ? 1 : 0;
+	draws[base + 2] = c.first;
+	if (INDEXED != 0)
+	{
+		draws[base + 3] = uint(c.vertexOffset);
+		draws[base + 4] = 0;
+	}
+	else
+		draws[base + 3] = 0;
+}
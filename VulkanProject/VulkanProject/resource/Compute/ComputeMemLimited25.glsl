@@ -1,11 +1,11 @@
 #version 450
 layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
 layout(Rgba8, set=0, binding = 0) uniform image2D img_output;
-layout(set=1, binding = 0) uniform UniformBufferObject 
+layout(push_constant) uniform Params
 {
   float locality;
 } params;
-layout(set=2, binding=0) uniform sampler2D myTex;
+layout(set=1, binding=0) uniform sampler2D myTex;
 
 const int TOT_REG = 110; // Roughly it seems they are aligned.
 const int N = TOT_REG - 13;
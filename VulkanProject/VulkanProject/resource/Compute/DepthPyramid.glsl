@@ -0,0 +1,25 @@
+#version 450
+// Reduces a level of the depth pyramid (or the depth buffer) into the next, each texel keeps the farthest depth of the source texels it overlaps
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set=0, binding=0) uniform sampler2D src;
+layout(set=0, binding=1, r32f) uniform writeonly image2D dst;
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 dstSize = imageSize(dst);
+	if (any(greaterThanEqual(p, dstSize)))
+		return;
+	// Up to 3x3 texels, the first level rounds the depth buffer size down to a power of two
+	ivec2 srcSize = textureSize(src, 0);
+	ivec2 lo = p * srcSize / dstSize;
+	ivec2 hi = min(((p + 1) * srcSize + dstSize - 1) / dstSize, srcSize) - 1;
+	float depth = 0;
+	for (int y = lo.y; y <= hi.y; y++)
+	{
+		for (int x = lo.x; x <= hi.x; x++)
+			depth = max(depth, texelFetch(src, ivec2(x, y), 0).r);
+	}
+	imageStore(dst, p, vec4(depth));
+}
@@ -2,8 +2,20 @@
 "../glslangValidator.exe" -V -S comp -o ../tmp/ComputeMemLimited25.spv ComputeMemLimited25.glsl
 "../glslangValidator.exe" -V -S comp -o ../tmp/ComputeMemLimited100.spv ComputeMemLimited100.glsl
 "../glslangValidator.exe" -V -S comp -o ../tmp/ComputeMemLimited75.spv ComputeMemLimited75.glsl
+"../glslangValidator.exe" -V -S comp -o ../tmp/ComputeMemLimitedBindless.spv ComputeMemLimitedBindless.glsl
 "../glslangValidator.exe" -V -S comp -o ../tmp/ComputeRegLimited.spv ComputeRegLimited.glsl
 "../glslangValidator.exe" -V -S comp -o ../tmp/GaussianHorizontal.spv GaussianHorizontal.glsl
 "../glslangValidator.exe" -V -S comp -o ../tmp/GaussianVertical.spv GaussianVertical.glsl
+"../glslangValidator.exe" -V -S comp -o ../tmp/ClusterCull.spv ClusterCull.glsl
+"../glslangValidator.exe" -V -S comp -o ../tmp/DepthPyramid.spv DepthPyramid.glsl
+
+REM Validate the generated SPIR-V, spirv-val is part of the Vulkan SDK
+spirv-val --target-env vulkan1.0 ../tmp/ComputeMemLimited.spv
+spirv-val --target-env vulkan1.0 ../tmp/ComputeMemLimited25.spv
+spirv-val --target-env vulkan1.0 ../tmp/ComputeMemLimited75.spv
+spirv-val --target-env vulkan1.0 ../tmp/ComputeMemLimited100.spv
+spirv-val --target-env vulkan1.0 ../tmp/ComputeMemLimitedBindless.spv
+spirv-val --target-env vulkan1.0 ../tmp/ClusterCull.spv
+spirv-val --target-env vulkan1.0 ../tmp/DepthPyramid.spv
 
 PAUSE
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 450
+// Compressed vertices: unorm16 positions within the mesh bounding box, octahedral normals
+layout(location=0) in vec4 position;
+
+layout(set=0,binding=0) uniform shadowTransform
+{
+	mat4 transform;
+	vec4 decodeScale;
+	vec4 decodeOffset;
+} st;
+
+void main()
+{
+	gl_Position = st.transform * vec4(position.xyz * st.decodeScale.xyz + st.decodeOffset.xyz, 1.0);
+}
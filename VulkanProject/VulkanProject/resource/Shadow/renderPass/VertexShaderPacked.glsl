@@ -0,0 +1,31 @@
+#version 450
+// Compressed vertices: unorm16 positions within the mesh bounding box, octahedral normals
+layout(location=0) in vec4 position;
+layout(location=1) in vec2 normal;
+
+layout(set=0,binding=0) uniform Transform
+{
+	mat4 transform;
+	vec4 decodeScale;
+	vec4 decodeOffset;
+} t;
+
+layout(location = 0) out vec3 out_normal;
+layout(location = 1) out vec4 worldPos;
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float f = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -f : f;
+	n.y += n.y >= 0.0 ? -f : f;
+	return normalize(n);
+}
+
+void main()
+{
+	vec4 pos = vec4(position.xyz * t.decodeScale.xyz + t.decodeOffset.xyz, 1.0);
+	gl_Position = t.transform * pos;
+	out_normal = (t.transform * vec4(octDecode(normal), 0.0)).xyz;
+	worldPos = pos;
+}
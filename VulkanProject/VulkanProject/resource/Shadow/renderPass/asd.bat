@@ -1,4 +1,12 @@
 "../../glslangValidator.exe" -V -S vert -o ../../tmp/VertexShader.spv VertexShader.glsl
 "../../glslangValidator.exe" -V -S frag -o ../../tmp/FragmentShader.spv FragmentShader.glsl
+"../../glslangValidator.exe" -V -S vert -o ../../tmp/VertexShaderPacked.spv VertexShaderPacked.glsl
+"../../glslangValidator.exe" -V -S vert -o ../../tmp/ShadowPassVertexShader.spv ../depthPass/ShadowPassVertexShader.glsl
+"../../glslangValidator.exe" -V -S vert -o ../../tmp/ShadowPassVertexShaderPacked.spv ../depthPass/ShadowPassVertexShaderPacked.glsl
+
+REM Validate the generated SPIR-V, spirv-val is part of the Vulkan SDK
+spirv-val --target-env vulkan1.0 ../../tmp/VertexShaderPacked.spv
+spirv-val --target-env vulkan1.0 ../../tmp/ShadowPassVertexShader.spv
+spirv-val --target-env vulkan1.0 ../../tmp/ShadowPassVertexShaderPacked.spv
 
 PAUSE
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "BindlessTableVulkan.h"
+#include "VulkanConstruct.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace
+{
+	const VkDescriptorType TABLE_TYPES[BindlessTableVulkan::COUNT] =
+	{
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+	};
+}
+
+BindlessTableVulkan::BindlessTableVulkan()
+	: _device(VK_NULL_HANDLE), _layout(VK_NULL_HANDLE), _pool(VK_NULL_HANDLE), _set(VK_NULL_HANDLE), _capacity(), _specEntries(), _specialization(), _sealed(false)
+{
+}
+
+void BindlessTableVulkan::init(VkDevice device, const VkPhysicalDeviceLimits &limits, uint32_t maxTextures, uint32_t maxImages)
+{
+	_device = device;
+	// Combined image samplers count against both the sampler and sampled image limits
+	_capacity[TEXTURE] = std::min({ maxTextures, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+		limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages });
+	_capacity[STORAGE_IMAGE] = std::min({ maxImages, limits.maxPerStageDescriptorStorageImages, limits.maxDescriptorSetStorageImages });
+	// Leave the remaining stage resources to the textures
+	if (limits.maxPerStageResources > _capacity[STORAGE_IMAGE])
+		_capacity[TEXTURE] = std::min(_capacity[TEXTURE], limits.maxPerStageResources - _capacity[STORAGE_IMAGE]);
+
+	VkDescriptorSetLayoutBinding bindings[COUNT];
+	VkDescriptorPoolSize sizes[COUNT];
+	for (uint32_t i = 0; i < COUNT; i++)
+	{
+		writeLayoutBinding(bindings[i], i, TABLE_TYPES[i], VK_SHADER_STAGE_ALL);
+		bindings[i].descriptorCount = _capacity[i];
+		sizes[i].type = TABLE_TYPES[i];
+		sizes[i].descriptorCount = _capacity[i];
+		_slots[i].clear();
+		_specEntries[i].constantID = i;
+		_specEntries[i].offset = sizeof(uint32_t) * i;
+		_specEntries[i].size = sizeof(uint32_t);
+	}
+	_specialization.mapEntryCount = COUNT;
+	_specialization.pMapEntries = _specEntries;
+	_specialization.dataSize = sizeof(_capacity);
+	_specialization.pData = _capacity;
+	_layout = createDescriptorLayout(device, bindings, COUNT);
+	_pool = createDescriptorPool(device, sizes, COUNT, 1);
+	_set = createDescriptorSet(device, _pool, &_layout);
+	_sealed = false;
+}
+
+void BindlessTableVulkan::destroy()
+{
+	if (_device == VK_NULL_HANDLE)
+		return;
+	vkDestroyDescriptorPool(_device, _pool, nullptr);
+	vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+	_device = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTableVulkan::addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+	return add(TEXTURE, { sampler, view, layout });
+}
+uint32_t BindlessTableVulkan::addStorageImage(VkImageView view, VkImageLayout layout)
+{
+	return add(STORAGE_IMAGE, { VK_NULL_HANDLE, view, layout });
+}
+
+uint32_t BindlessTableVulkan::add(Binding binding, const VkDescriptorImageInfo &slot)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	if (_sealed)
+		throw std::runtime_error("Bindless table is sealed, resources must be registered before the first frame.");
+	if (_slots[binding].size() == _capacity[binding])
+		throw std::runtime_error("Bindless table array is full.");
+	_slots[binding].push_back(slot);
+	return (uint32_t)_slots[binding].size() - 1;
+}
+
+void BindlessTableVulkan::seal()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	if (_sealed)
+		return;
+	_sealed = true;
+
+	// Write each array in full, slots not registered repeat the first resource
+	std::vector<VkDescriptorImageInfo> imageInfo[COUNT];
+	std::vector<VkWriteDescriptorSet> writes;
+	for (uint32_t i = 0; i < COUNT; i++)
+	{
+		// Arrays without resources are left unwritten, shaders must not access them
+		if (_slots[i].empty())
+			continue;
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = _set;
+		write.dstBinding = i;
+		write.dstArrayElement = 0;
+		write.descriptorCount = _capacity[i];
+		write.descriptorType = TABLE_TYPES[i];
+		for (uint32_t slot = 0; slot < _capacity[i]; slot++)
+			imageInfo[i].push_back(_slots[i][slot < _slots[i].size() ? slot : 0]);
+		write.pImageInfo = imageInfo[i].data();
+		writes.push_back(write);
+	}
+	if (!writes.empty())
+		vkUpdateDescriptorSets(_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+}
+
+void BindlessTableVulkan::createPipelineLayout(vk::LayoutConstruct &layout)
+{
+	assert(layout._numLayouts == 0);
+	layout._layout = ::createPipelineLayout(_device, &_layout, 1, layout._pushRanges.data(), (uint32_t)layout._pushRanges.size());
+}
+
+void BindlessTableVulkan::bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout, VkPipelineBindPoint bindPoint)
+{
+	assert(_sealed);
+	vkCmdBindDescriptorSets(cmdBuf, bindPoint, layout, 0, 1, &_set, 0, nullptr);
+}
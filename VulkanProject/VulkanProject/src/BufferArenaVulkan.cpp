@@ -0,0 +1,140 @@
+#include "BufferArenaVulkan.h"
+#include "VulkanRenderer.h"
+#include <algorithm>
+#include <stdexcept>
+
+BufferArenaVulkan::BufferArenaVulkan()
+	: _renderHandle(nullptr), _usage(UNIFORM), _flags(0), _pool(0), _blockSize(0), _alignment(1), _views(0)
+{
+}
+
+void BufferArenaVulkan::init(VulkanRenderer *renderer, Usage usage, VkDeviceSize blockSize)
+{
+	_renderHandle = renderer;
+	_usage = usage;
+	_blockSize = blockSize;
+	_views = 0;
+	const VkPhysicalDeviceLimits &limits = renderer->getLimits();
+	switch (usage)
+	{
+	case UNIFORM:
+		_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		_pool = MemoryPool::UNIFORM_BUFFER;
+		_alignment = limits.minUniformBufferOffsetAlignment;
+		break;
+	case STORAGE:
+		// Also holds the indirect commands written by compute passes
+		_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		_pool = MemoryPool::UNIFORM_BUFFER;
+		_alignment = limits.minStorageBufferOffsetAlignment;
+		break;
+	case VERTEX:
+		_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		_pool = MemoryPool::VERTEX_BUFFER;
+		_alignment = 16;
+		break;
+	case INDEX:
+		_flags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		_pool = MemoryPool::INDEX_BUFFER;
+		_alignment = 16;
+		break;
+	default:
+		throw std::runtime_error("Invalid buffer arena usage.");
+	}
+	// Views are written by transfers
+	_flags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	_alignment = std::max<VkDeviceSize>(_alignment, 4);
+}
+
+void BufferArenaVulkan::destroy()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	for (Block &block : _blocks)
+		destroyBlock(block);
+	_blocks.clear();
+	_views = 0;
+}
+
+BufferArenaVulkan::View BufferArenaVulkan::allocate(VkDeviceSize size)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	_views++;
+	if (size > _blockSize / 2)
+	{
+		Block &block = createBlock(size, true);
+		return { block._buffer, 0, size };
+	}
+	for (Block &block : _blocks)
+	{
+		if (block._dedicated)
+			continue;
+		uint64_t offset = block._allocator.allocate(size, _alignment);
+		if (offset != mf::TLSFAllocator::INVALID_OFFSET)
+			return { block._buffer, offset, size };
+	}
+	// Double the size of the last shared block
+	VkDeviceSize blockSize = _blockSize;
+	for (Block &block : _blocks)
+		if (!block._dedicated)
+			blockSize = block._allocator.size() * 2;
+	Block &block = createBlock(blockSize, false);
+	return { block._buffer, block._allocator.allocate(size, _alignment), size };
+}
+
+void BufferArenaVulkan::free(const View &view)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	for (auto it = _blocks.begin(); it != _blocks.end(); it++)
+	{
+		if (it->_buffer != view._buffer)
+			continue;
+		_views--;
+		if (it->_dedicated)
+		{
+			destroyBlock(*it);
+			_blocks.erase(it);
+		}
+		else
+			it->_allocator.free(view._offset);
+		return;
+	}
+	throw std::runtime_error("Freeing a view not allocated by the arena.");
+}
+
+BufferArenaVulkan::Stats BufferArenaVulkan::getStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	Stats stats = {};
+	stats._views = _views;
+	for (Block &block : _blocks)
+	{
+		stats._blocks++;
+		stats._reserved += block._allocator.size();
+		if (block._dedicated)
+		{
+			stats._dedicated++;
+			stats._used += block._allocator.size();
+		}
+		else
+			stats._used += block._allocator.getStats()._used;
+	}
+	return stats;
+}
+
+BufferArenaVulkan::Block& BufferArenaVulkan::createBlock(VkDeviceSize size, bool dedicated)
+{
+	Block block;
+	block._buffer = createBuffer(_renderHandle->getDevice(), (size_t)size, _flags);
+	block._poolOffset = _renderHandle->bindPhysicalMemory(block._buffer, (MemoryPool)_pool);
+	block._dedicated = dedicated;
+	block._allocator.init(size);
+	_blocks.push_back(std::move(block));
+	return _blocks.back();
+}
+
+void BufferArenaVulkan::destroyBlock(Block &block)
+{
+	_renderHandle->getDescriptorCache().invalidate((uint64_t)block._buffer);
+	vkDestroyBuffer(_renderHandle->getDevice(), block._buffer, nullptr);
+	_renderHandle->freePhysicalMemory((MemoryPool)_pool, block._poolOffset);
+}
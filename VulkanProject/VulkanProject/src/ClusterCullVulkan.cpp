@@ -0,0 +1,213 @@
+#include "ClusterCullVulkan.h"
+#include "VulkanRenderer.h"
+#include "ShaderVulkan.h"
+#include "TechniqueVulkan.h"
+#include "TechniqueBuilderVulkan.h"
+#include "ConstantBufferVulkan.h"
+#include "DepthPyramidVulkan.h"
+#include "Stuff/Clusters.h"
+#include <algorithm>
+#include <stdexcept>
+
+ClusterCullVulkan::ClusterCullVulkan(VulkanRenderer *renderer)
+	: _renderHandle(renderer), _shader(nullptr), _technique(nullptr), _frustumBuffer(nullptr), _frustum(), _cameraClip(1.f), _storage(VK_NULL_HANDLE),
+	_pyramidSet(VK_NULL_HANDLE), _pyramid(nullptr), _depthDrawn(false), _clusters(), _draws(), _counts(), _numClusters(0), _stride(0), _indexed(false), _compact(false)
+{
+}
+
+ClusterCullVulkan::~ClusterCullVulkan()
+{
+	delete _technique;
+	delete _shader;
+	delete _frustumBuffer;
+	delete _pyramid;
+	BufferArenaVulkan &arena = _renderHandle->getBufferArena(BufferArenaVulkan::STORAGE);
+	if (_clusters.valid())
+		arena.free(_clusters);
+	if (_draws.valid())
+		arena.free(_draws);
+	if (_counts.valid())
+		arena.free(_counts);
+	if (_numClusters > 0)
+		_layout.destroy(_renderHandle->getDevice());
+}
+
+void ClusterCullVulkan::init(const std::vector<Cluster> &clusters, bool indexed, bool compact, TechniqueBuilderVulkan &builder)
+{
+	if (clusters.empty())
+		throw std::runtime_error("No clusters to cull.");
+	VkDevice device = _renderHandle->getDevice();
+	_numClusters = (uint32_t)clusters.size();
+	_indexed = indexed;
+	_compact = compact && _renderHandle->hasDrawIndirectCount();
+	_stride = indexed ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+
+	// Layout
+	_layout = vk::LayoutConstruct(3);
+	VkDescriptorSetLayoutBinding bindings[3];
+	writeLayoutBinding(bindings[0], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT);
+	_layout[0] = createDescriptorLayout(device, bindings, 1);
+	for (uint32_t i = 0; i < 3; i++)
+		writeLayoutBinding(bindings[i], i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+	_layout[1] = createDescriptorLayout(device, bindings, 3);
+	writeLayoutBinding(bindings[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+	_layout[2] = createDescriptorLayout(device, bindings, 1);
+	_params = _layout.definePushConstant<CullParams>(VK_SHADER_STAGE_COMPUTE_BIT);
+	_layout.construct(device);
+
+	// Buffers, the commands of each view follow each other
+	BufferArenaVulkan &arena = _renderHandle->getBufferArena(BufferArenaVulkan::STORAGE);
+	_clusters = arena.allocate(_numClusters * sizeof(Cluster));
+	_draws = arena.allocate(VIEW_COUNT * _numClusters * _stride);
+	_counts = arena.allocate(VIEW_COUNT * sizeof(uint32_t));
+	_renderHandle->transferBufferInitial(_clusters._buffer, clusters.data(), _numClusters * sizeof(Cluster), (size_t)_clusters._offset);
+
+	DescriptorCacheVulkan::Binding storage[3] =
+	{
+		DescriptorCacheVulkan::Binding::buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _clusters._buffer, _clusters._offset, _clusters._size),
+		DescriptorCacheVulkan::Binding::buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _draws._buffer, _draws._offset, _draws._size),
+		DescriptorCacheVulkan::Binding::buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _counts._buffer, _counts._offset, _counts._size)
+	};
+	_storage = _renderHandle->getDescriptorCache().get(_layout[1], storage, 3);
+
+	// Depth pyramid of the camera view
+	_pyramid = new DepthPyramidVulkan(_renderHandle);
+	_pyramid->init(builder);
+	_pyramidSet = _renderHandle->getDescriptorCache().get(_layout[2],
+		DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _pyramid->getView(), VK_IMAGE_LAYOUT_GENERAL, _pyramid->getSampler()));
+
+	// Frustum planes written each frame
+	_frustumBuffer = new ConstantDoubleBufferVulkan(_renderHandle);
+	_frustumBuffer->setData(&_frustum, sizeof(Frustum), 0, _layout[0]);
+
+	// Technique
+	_shader = new ShaderVulkan("ClusterCull", _renderHandle);
+	// Ships no SPIR-V, always compiled from the GLSL
+	_shader->setShader("resource/Compute/ClusterCull.glsl", ShaderVulkan::ShaderType::CS);
+	std::string err;
+	_shader->compileMaterial(err);
+
+	_constants[0] = indexed ? 1 : 0;
+	_constants[1] = _compact ? 1 : 0;
+	for (uint32_t i = 0; i < 2; i++)
+		_constantEntries[i] = { i, i * (uint32_t)sizeof(uint32_t), sizeof(uint32_t) };
+	_specialization.mapEntryCount = 2;
+	_specialization.pMapEntries = _constantEntries;
+	_specialization.dataSize = sizeof(_constants);
+	_specialization.pData = _constants;
+	_technique = builder.compute(_shader, _layout._layout, &_specialization);
+}
+
+void ClusterCullVulkan::setFrustum(View view, const glm::mat4 &objectToClip)
+{
+	// Planes of the clip volume in object space (Gribb & Hartmann). The near plane is z >= -w, which contains the z >= 0 volume.
+	// The depth pyramid holds the depth drawn with the previous camera matrix
+	if (view == CAMERA)
+	{
+		_frustum._occlusionClip = _cameraClip;
+		_cameraClip = objectToClip;
+	}
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(objectToClip[0][i], objectToClip[1][i], objectToClip[2][i], objectToClip[3][i]);
+	glm::vec4 *planes = _frustum._planes[view];
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	// The projection center maps to clip (0, 0, z, 0), a point at infinity for parallel projections
+	glm::vec4 eye = glm::inverse(objectToClip) * glm::vec4(0.f, 0.f, 1.f, 0.f);
+	if (std::abs(eye.w) > 1e-6f * glm::length(glm::vec3(eye)))
+		_frustum._eye[view] = glm::vec4(glm::vec3(eye) / eye.w, 1.f);
+	else
+		_frustum._eye[view] = glm::vec4(glm::normalize(glm::vec3(eye)), 0.f);
+}
+
+bool ClusterCullVulkan::isVisible(View view, const Cluster &cluster)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4 &plane = _frustum._planes[view][i];
+		if (glm::dot(glm::vec3(plane), glm::vec3(cluster._sphere)) + plane.w < -cluster._sphere.w)
+			return false;
+	}
+	return mf::coneVisible(cluster._sphere, cluster._cone, _frustum._eye[view]);
+}
+
+void ClusterCullVulkan::transfer()
+{
+	_frustumBuffer->transferData(&_frustum, sizeof(Frustum));
+}
+
+void ClusterCullVulkan::cull(VkCommandBuffer cmdBuf, uint32_t firstView, uint32_t numViews)
+{
+	// Draws of the previous frame have read the commands before they are rewritten
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 0, nullptr);
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	if (_compact)
+	{
+		vkCmdFillBuffer(cmdBuf, _counts._buffer, _counts._offset + firstView * sizeof(uint32_t), numViews * sizeof(uint32_t), 0);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// The depth buffer holds a drawn frame from the second time the camera is culled
+	bool cullCamera = firstView <= CAMERA && CAMERA < firstView + numViews;
+	bool occlusion = cullCamera && _depthDrawn;
+	if (cullCamera)
+	{
+		_pyramid->build(cmdBuf);
+		_depthDrawn = true;
+	}
+
+	_technique->bind(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE);
+	_frustumBuffer->bind(cmdBuf, _layout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+	VkDescriptorSet sets[2] = { _storage, _pyramidSet };
+	vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, _layout._layout, 1, 2, sets, 0, nullptr);
+	_layout.push(cmdBuf, _params, { _numClusters, firstView, occlusion ? 1u : 0u });
+	// A row of groups per view
+	vkCmdDispatch(cmdBuf, (_numClusters + 63) / 64, numViews, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ClusterCullVulkan::draw(VkCommandBuffer cmdBuf, View view)
+{
+	VkDeviceSize offset = _draws._offset + view * _numClusters * _stride;
+	if (_compact)
+		_renderHandle->drawIndirectCount(cmdBuf, _indexed, _draws._buffer, offset, _counts._buffer, _counts._offset + view * sizeof(uint32_t), _numClusters, _stride);
+	else
+		drawRange(cmdBuf, offset, _numClusters);
+}
+
+void ClusterCullVulkan::draw(VkCommandBuffer cmdBuf, View view, uint32_t firstCluster, uint32_t numClusters)
+{
+	if (_compact)
+		throw std::runtime_error("Compacted cluster draws can't be split.");
+	drawRange(cmdBuf, _draws._offset + (view * _numClusters + firstCluster) * _stride, numClusters);
+}
+
+void ClusterCullVulkan::drawRange(VkCommandBuffer cmdBuf, VkDeviceSize offset, uint32_t count)
+{
+	// Culled slots have zero instances, without multi draw each slot is a draw call
+	uint32_t maxDraws = _renderHandle->hasMultiDrawIndirect() ? _renderHandle->getLimits().maxDrawIndirectCount : 1;
+	while (count > 0)
+	{
+		uint32_t num = std::min(count, maxDraws);
+		if (_indexed)
+			vkCmdDrawIndexedIndirect(cmdBuf, _draws._buffer, offset, num, _stride);
+		else
+			vkCmdDrawIndirect(cmdBuf, _draws._buffer, offset, num, _stride);
+		offset += num * _stride;
+		count -= num;
+	}
+}
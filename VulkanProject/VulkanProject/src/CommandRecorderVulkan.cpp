@@ -0,0 +1,92 @@
+#include "CommandRecorderVulkan.h"
+#include "VulkanConstruct.h"
+
+
+CommandRecorderVulkan::CommandRecorderVulkan(VulkanRenderer *renderer, QueueType queue)
+	: _renderHandle(renderer), _queue(queue), _frameNumber(UINT64_MAX), _inheritance({})
+{
+	VkDevice device = renderer->getDevice();
+	uint32_t family = (uint32_t)renderer->getQueueFamily(queue);
+	_pools.resize(renderer->getFrameCount());
+	for (std::vector<WorkerPool> &frame : _pools)
+	{
+		frame.resize(renderer->getWorkers().size());
+		for (WorkerPool &worker : frame)
+		{
+			worker._pool = createCommandPool(device, family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			worker._used = 0;
+		}
+	}
+}
+
+CommandRecorderVulkan::~CommandRecorderVulkan()
+{
+	// Command buffers are freed with the pool
+	for (std::vector<WorkerPool> &frame : _pools)
+	{
+		for (WorkerPool &worker : frame)
+			vkDestroyCommandPool(_renderHandle->getDevice(), worker._pool, nullptr);
+	}
+}
+
+VkCommandBuffer CommandRecorderVulkan::WorkerPool::acquire(VkDevice device)
+{
+	if (_used == _buffers.size())
+		_buffers.push_back(allocateCmdBuf(device, _pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+	return _buffers[_used++];
+}
+
+void CommandRecorderVulkan::begin(VkRenderPass renderPass, VkFramebuffer frameBuffer, uint32_t subpass)
+{
+	_jobs.clear();
+	// Recycle the buffers of the frame context the first time it is used this frame
+	uint64_t frame = _renderHandle->getFrameNumber();
+	if (frame != _frameNumber)
+	{
+		_frameNumber = frame;
+		for (WorkerPool &worker : _pools[_renderHandle->getFrameIndex()])
+		{
+			if (vkResetCommandPool(_renderHandle->getDevice(), worker._pool, 0) != VK_SUCCESS)
+				throw std::runtime_error("Failed to reset command pool.");
+			worker._used = 0;
+		}
+	}
+
+	_inheritance = {};
+	_inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	_inheritance.renderPass = renderPass;
+	_inheritance.subpass = subpass;
+	_inheritance.framebuffer = frameBuffer;
+}
+
+void CommandRecorderVulkan::addJob(const Job &job)
+{
+	_jobs.push_back(job);
+}
+
+void CommandRecorderVulkan::execute(VkCommandBuffer primary)
+{
+	if (_jobs.empty())
+		return;
+	VkDevice device = _renderHandle->getDevice();
+	std::vector<WorkerPool> &pools = _pools[_renderHandle->getFrameIndex()];
+	_recorded.resize(_jobs.size());
+
+	// Each worker only records from its own pool
+	_renderHandle->getWorkers().parallelFor(numJobs(), 1, [&](uint32_t begin, uint32_t end, uint32_t worker)
+	{
+		WorkerPool &pool = pools[worker];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			VkCommandBuffer cmdBuf = pool.acquire(device);
+			beginSecondaryCmdBuf(cmdBuf, _inheritance);
+			_jobs[i](cmdBuf);
+			if (vkEndCommandBuffer(cmdBuf) != VK_SUCCESS)
+				throw std::runtime_error("Failed to record secondary command buffer.");
+			_recorded[i] = cmdBuf;
+		}
+	});
+
+	vkCmdExecuteCommands(primary, (uint32_t)_recorded.size(), _recorded.data());
+	_jobs.clear();
+}
@@ -5,74 +5,52 @@
 #pragma region Single buffered
 
 ConstantBufferVulkan::ConstantBufferVulkan(VulkanRenderer *renderHandle)
-	: buffer(NULL), _renderHandle(renderHandle), location(location)
+	: view(), arena(BufferArenaVulkan::UNIFORM), _renderHandle(renderHandle), location(location)
 {
 }
 
 ConstantBufferVulkan::~ConstantBufferVulkan()
 {
-	vkDestroyBuffer(_renderHandle->getDevice(), buffer, nullptr);
+	if (view.valid())
+		_renderHandle->getBufferArena(arena).free(view);
 }
 
 void ConstantBufferVulkan::transferData(const void* data, size_t byteSize, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
 {
-	if (!buffer)
+	if (!view.valid())
 	{
 		memSize = 2 * byteSize;	//Technically allocated size might be larger due to the memory requirements.
-		buffer = createBuffer(_renderHandle->getDevice(), memSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage);
-		poolOffset = _renderHandle->bindPhysicalMemory(buffer, MemoryPool::UNIFORM_BUFFER);
+		arena = hasFlag(usage, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) ? BufferArenaVulkan::UNIFORM : BufferArenaVulkan::STORAGE;
+		view = _renderHandle->getBufferArena(arena).allocate(memSize);
 
 		// Set the descriptor info
 
 		if (!customDescriptor)
 		{
-			// Cyclic double buffer, generate two descriptors
-			VkWriteDescriptorSet writes[1];
-			VkDescriptorBufferInfo descriptorInfo[1];
-			descriptorInfo[0].buffer = buffer;
-			descriptorInfo[0].offset = 0;
-			descriptorInfo[0].range = byteSize;
-
-			if (hasFlag(usage, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT))
-				writeDescriptorStruct_BUFFER(writes[0], descriptor, 0, 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorInfo);
-			else
-				writeDescriptorStruct_BUFFER(writes[0], descriptor, 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorInfo);
-			vkUpdateDescriptorSets(_renderHandle->getDevice(), 1, writes, 0, nullptr);
+			// Descriptor shared through the cache
+			VkDescriptorType type = arena == BufferArenaVulkan::UNIFORM ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor = _renderHandle->getDescriptorCache().get(descLayout, DescriptorCacheVulkan::Binding::buffer(0, type, view._buffer, view._offset, byteSize));
 		}
 		// Set initial frame data
-		_renderHandle->transferBufferInitial(buffer, data, byteSize, 0);
+		_renderHandle->transferBufferInitial(view._buffer, data, byteSize, view._offset);
 	}
 	else if (memSize < byteSize)
 		throw std::runtime_error("Constant buffer cannot fit the data.");
 	else
-		_renderHandle->transferBufferData(buffer, data, byteSize, 0);
+		_renderHandle->transferBufferData(view._buffer, data, byteSize, view._offset);
 }
 
 void ConstantBufferVulkan::setData(const void * data, size_t byteSize, uint32_t setBindIndex, VkDescriptorSetLayout layout, VkBufferUsageFlags usage)
 {
 	location = setBindIndex;
-	if (!buffer && !customDescriptor)
-	{
-		// Gen the descriptor associated with the buffer
-		if(hasFlag(usage, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT))
-			descriptor = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &layout);
-		else
-			descriptor = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &layout);
-	}
+	descLayout = layout;
 	transferData(data, byteSize, usage);
 }
 
 void ConstantBufferVulkan::setData(const void * data, size_t byteSize, uint32_t setBindIndex, VkBufferUsageFlags usage)
 {
 	location = setBindIndex;
-	if (!buffer && !customDescriptor)
-	{
-		// Gen the descriptor associated with the buffer
-		if (hasFlag(usage, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT))
-			descriptor = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setBindIndex);
-		else
-			descriptor = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setBindIndex);
-	}
+	descLayout = _renderHandle->getDescriptorSetLayout(setBindIndex);
 	transferData(data, byteSize, usage);
 }
 
@@ -83,7 +61,7 @@ void ConstantBufferVulkan::bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout,
 
 VkBuffer ConstantBufferVulkan::getBuffer()
 {
-	return buffer;
+	return view._buffer;
 }
 
 void ConstantBufferVulkan::setUseCustomDescriptor(bool useCustomDescriptor)
@@ -99,58 +77,49 @@ void ConstantBufferVulkan::setUseCustomDescriptor(bool useCustomDescriptor)
 
 
 ConstantDoubleBufferVulkan::ConstantDoubleBufferVulkan(VulkanRenderer *renderHandle)
-	: _renderHandle(renderHandle)
+	: descriptor(VK_NULL_HANDLE), slot(), view(), stride(0), _renderHandle(renderHandle)
 {
-	buffer[0] = NULL;
-	buffer[1] = NULL;
 }
 
 ConstantDoubleBufferVulkan::~ConstantDoubleBufferVulkan()
 {
-	vkDestroyBuffer(_renderHandle->getDevice(), buffer[0], nullptr);
-	vkDestroyBuffer(_renderHandle->getDevice(), buffer[1], nullptr);
+	if (slot.valid())
+		_renderHandle->getUniformRing().free(slot);
+	if (view.valid())
+		_renderHandle->getBufferArena(BufferArenaVulkan::UNIFORM).free(view);
 }
 
 
 void ConstantDoubleBufferVulkan::setData(const void * data, size_t byteSize, uint32_t setBindIndex, VkDescriptorSetLayout layout, VkBufferUsageFlags usage)
 {
 	location = setBindIndex;
-	if (!buffer[0])
+	if (descriptor == VK_NULL_HANDLE)
 	{
-		// Two buffers
-		memSize = 2*byteSize;	//Technically allocated size might be larger due to the memory requirements.
 		bufSize = byteSize;
-		buffer[0] = createBuffer(_renderHandle->getDevice(), bufSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-		buffer[1] = createBuffer(_renderHandle->getDevice(), bufSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-		poolOffset = _renderHandle->bindPhysicalMemory(buffer[0], MemoryPool::UNIFORM_BUFFER);
-		_renderHandle->bindPhysicalMemory(buffer[1], MemoryPool::UNIFORM_BUFFER);
-
-		// Get & set the descriptor associated with the buffer
-		if (hasFlag(usage, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT))
+		UniformRingVulkan &ring = _renderHandle->getUniformRing();
+		if (byteSize <= UNIFORM_RING_MAX_UPDATE)
+			slot = ring.allocate(byteSize);
+		if (slot.valid())
 		{
-			descriptor[0] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &layout);
-			descriptor[1] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &layout);
-		}
-		else {
-			descriptor[0] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &layout);
-			descriptor[1] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &layout);
+			// Written in place, the descriptor covers the slot in the first region
+			memSize = (size_t)slot._size;
+			ring.writeAll(slot, data, byteSize);
+			descriptor = _renderHandle->getDescriptorCache().get(layout,
+				DescriptorCacheVulkan::Binding::buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, ring.getBuffer(), slot._offset, byteSize));
+			return;
 		}
-		// Cycled double buffers
-		VkWriteDescriptorSet writes[2];
-		VkDescriptorBufferInfo descriptorInfo[2];
-		descriptorInfo[0].buffer = buffer[0];
-		descriptorInfo[0].offset = 0;
-		descriptorInfo[0].range = byteSize;
-		writeDescriptorStruct_UNI_BUFFER(writes[0], descriptor[0], 0, 0, 1, descriptorInfo);
-		descriptorInfo[1].buffer = buffer[1];
-		descriptorInfo[1].offset = 0;
-		descriptorInfo[1].range = byteSize;
-		writeDescriptorStruct_UNI_BUFFER(writes[1], descriptor[1], 0, 0, 1, &descriptorInfo[1]);
-		vkUpdateDescriptorSets(_renderHandle->getDevice(), 2, writes, 0, nullptr);
 
+		// One aligned slice per frame in flight
+		uint32_t numFrames = _renderHandle->getFrameCount();
+		BufferArenaVulkan &arena = _renderHandle->getBufferArena(BufferArenaVulkan::UNIFORM);
+		stride = (byteSize + arena.getAlignment() - 1) / arena.getAlignment() * arena.getAlignment();
+		memSize = numFrames * stride;
+		view = arena.allocate(memSize);
+		descriptor = _renderHandle->getDescriptorCache().get(layout,
+			DescriptorCacheVulkan::Binding::buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, view._buffer, view._offset, byteSize));
 		// Set initial frame data
-		_renderHandle->transferBufferInitial(buffer[_renderHandle->getFrameIndex()], data, byteSize, 0);
-		_renderHandle->transferBufferInitial(buffer[_renderHandle->getTransferIndex()], data, byteSize, 0);
+		for (uint32_t i = 0; i < numFrames; i++)
+			_renderHandle->transferBufferInitial(view._buffer, data, byteSize, view._offset + i * stride);
 	}
 	else
 		transferData(data, byteSize, usage);
@@ -158,17 +127,21 @@ void ConstantDoubleBufferVulkan::setData(const void * data, size_t byteSize, uin
 
 void ConstantDoubleBufferVulkan::transferData(const void* data, size_t byteSize, VkBufferUsageFlags usage)
 {
-	if (!buffer[0])
+	if (descriptor == VK_NULL_HANDLE)
 		throw std::runtime_error("Constant buffer not initialized.");
-	else if (memSize < byteSize)
+	else if (bufSize < byteSize)
 		throw std::runtime_error("Constant buffer cannot fit the data.");
+	else if (slot.valid())
+		_renderHandle->getUniformRing().write(slot, data, byteSize);
 	else
-		_renderHandle->transferBufferData(buffer[_renderHandle->getTransferIndex()], data, byteSize, 0);
+		_renderHandle->transferBufferData(view._buffer, data, byteSize, view._offset + _renderHandle->getTransferIndex() * stride);
 }
 
 void ConstantDoubleBufferVulkan::bind(VkCommandBuffer cmdBuf, VkPipelineLayout layout, VkPipelineBindPoint bindPoint)
 {
-	vkCmdBindDescriptorSets(cmdBuf, bindPoint, layout, location, 1, &descriptor[_renderHandle->getFrameIndex()], 0, nullptr);
+	// Select the copy of the frame
+	uint32_t offset = slot.valid() ? _renderHandle->getUniformRing().getFrameOffset() : (uint32_t)(_renderHandle->getFrameIndex() * stride);
+	vkCmdBindDescriptorSets(cmdBuf, bindPoint, layout, location, 1, &descriptor, 1, &offset);
 }
 
 #pragma endregion
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "DepthPyramidVulkan.h"
+#include "VulkanRenderer.h"
+#include "ShaderVulkan.h"
+#include "TechniqueVulkan.h"
+#include "TechniqueBuilderVulkan.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	const VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+	uint32_t previousPow2(uint32_t v)
+	{
+		uint32_t p = 1;
+		while (p * 2 <= v)
+			p *= 2;
+		return p;
+	}
+}
+
+DepthPyramidVulkan::DepthPyramidVulkan(VulkanRenderer *renderer)
+	: _renderHandle(renderer), _shader(nullptr), _technique(nullptr), _image(VK_NULL_HANDLE), _poolOffset(0), _view(VK_NULL_HANDLE),
+	_sampler(VK_NULL_HANDLE), _levels()
+{
+}
+
+DepthPyramidVulkan::~DepthPyramidVulkan()
+{
+	delete _technique;
+	delete _shader;
+	if (_levels.empty())
+		return;
+	VkDevice device = _renderHandle->getDevice();
+	DescriptorCacheVulkan &cache = _renderHandle->getDescriptorCache();
+	for (Level &level : _levels)
+	{
+		cache.invalidate((uint64_t)level._view);
+		vkDestroyImageView(device, level._view, nullptr);
+	}
+	cache.invalidate((uint64_t)_view);
+	cache.invalidate((uint64_t)_sampler);
+	vkDestroyImageView(device, _view, nullptr);
+	vkDestroySampler(device, _sampler, nullptr);
+	vkDestroyImage(device, _image, nullptr);
+	_renderHandle->freePhysicalMemory(MemoryPool::IMAGE_RGBA8_BUFFER, _poolOffset);
+	_layout.destroy(device);
+}
+
+void DepthPyramidVulkan::init(TechniqueBuilderVulkan &builder)
+{
+	VkDevice device = _renderHandle->getDevice();
+	uint32_t width = previousPow2(_renderHandle->getWidth()), height = previousPow2(_renderHandle->getHeight());
+	uint32_t numLevels = 1;
+	while ((std::max(width, height) >> numLevels) > 0)
+		numLevels++;
+
+	// Image, written and sampled in the general layout
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = PYRAMID_FORMAT;
+	imageInfo.extent = { width, height, 1 };
+	imageInfo.mipLevels = numLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (vkCreateImage(device, &imageInfo, nullptr, &_image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the depth pyramid.");
+	_poolOffset = _renderHandle->bindPhysicalMemory(_image, MemoryPool::IMAGE_RGBA8_BUFFER);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = _image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = PYRAMID_FORMAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, numLevels, 0, 1 };
+	if (vkCreateImageView(device, &viewInfo, nullptr, &_view) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the depth pyramid view.");
+
+	// Nearest texel of a level, the tests pick the level explicitly
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.maxLod = (float)numLevels;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	if (vkCreateSampler(device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the depth pyramid sampler.");
+
+	// Layout
+	_layout = vk::LayoutConstruct(1);
+	VkDescriptorSetLayoutBinding bindings[2];
+	writeLayoutBinding(bindings[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+	writeLayoutBinding(bindings[1], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+	_layout[0] = createDescriptorLayout(device, bindings, 2);
+	_layout.construct(device);
+
+	// Levels, each reduces the previous one and the first reduces the depth buffer
+	_levels.resize(numLevels);
+	for (uint32_t i = 0; i < numLevels; i++)
+	{
+		Level &level = _levels[i];
+		level._width = std::max(width >> i, 1u);
+		level._height = std::max(height >> i, 1u);
+		viewInfo.subresourceRange.baseMipLevel = i;
+		viewInfo.subresourceRange.levelCount = 1;
+		if (vkCreateImageView(device, &viewInfo, nullptr, &level._view) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the depth pyramid view.");
+
+		DescriptorCacheVulkan::Binding levelBindings[2] =
+		{
+			i == 0 ?
+				DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _renderHandle->getDepthView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _sampler) :
+				DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _levels[i - 1]._view, VK_IMAGE_LAYOUT_GENERAL, _sampler),
+			DescriptorCacheVulkan::Binding::image(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, level._view, VK_IMAGE_LAYOUT_GENERAL)
+		};
+		level._set = _renderHandle->getDescriptorCache().get(_layout[0], levelBindings, 2);
+	}
+
+	// Technique, ships no SPIR-V and is always compiled from the GLSL
+	_shader = new ShaderVulkan("DepthPyramid", _renderHandle);
+	_shader->setShader("resource/Compute/DepthPyramid.glsl", ShaderVulkan::ShaderType::CS);
+	std::string err;
+	_shader->compileMaterial(err);
+	_technique = builder.compute(_shader, _layout._layout);
+}
+
+void DepthPyramidVulkan::build(VkCommandBuffer cmdBuf)
+{
+	// Depth written by the previous frame pass, the old levels only read by the culling of the previous frame
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (hasStencilComponent(_renderHandle->getDepthFormat()))
+		depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	VkImageMemoryBarrier barriers[2] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = _renderHandle->getDepthImage();
+	barriers[0].subresourceRange = { depthAspect, 0, 1, 0, 1 };
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = _image;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)_levels.size(), 0, 1 };
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	// A level is complete before the next reduces it
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	_technique->bind(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE);
+	for (size_t i = 0; i < _levels.size(); i++)
+	{
+		if (i > 0)
+			vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, _layout._layout, 0, 1, &_levels[i]._set, 0, nullptr);
+		vkCmdDispatch(cmdBuf, (_levels[i]._width + 7) / 8, (_levels[i]._height + 7) / 8, 1);
+	}
+
+	// Last level visible to the culling, the depth buffer returned to the frame pass
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		0, 1, &barrier, 0, nullptr, 1, barriers);
+}
@@ -0,0 +1,123 @@
+#include "DescriptorAllocatorVulkan.h"
+#include "VulkanConstruct.h"
+
+namespace
+{
+	// Descriptor types served by the pools, each pool holds setsPerPool descriptors of every type.
+	const VkDescriptorType POOL_TYPES[] =
+	{
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		VK_DESCRIPTOR_TYPE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+	};
+}
+
+DescriptorAllocatorVulkan::DescriptorAllocatorVulkan()
+	: _device(VK_NULL_HANDLE), _setsPerPool(0), _persistent()
+{
+}
+
+void DescriptorAllocatorVulkan::init(VkDevice device, uint32_t numFrames, uint32_t setsPerPool)
+{
+	_device = device;
+	_setsPerPool = setsPerPool;
+	_persistent = Arena();
+	_frames.assign(numFrames, Arena());
+}
+
+void DescriptorAllocatorVulkan::destroy()
+{
+	destroy(_persistent);
+	for (Arena &arena : _frames)
+		destroy(arena);
+	_frames.clear();
+}
+void DescriptorAllocatorVulkan::destroy(Arena &arena)
+{
+	for (VkDescriptorPool pool : arena._pools)
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	arena = Arena();
+}
+
+VkDescriptorSet DescriptorAllocatorVulkan::allocate(VkDescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return allocate(_persistent, layout);
+}
+
+VkDescriptorSet DescriptorAllocatorVulkan::allocateFrame(uint32_t frame, VkDescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return allocate(_frames[frame], layout);
+}
+
+void DescriptorAllocatorVulkan::resetFrame(uint32_t frame)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	Arena &arena = _frames[frame];
+	// Only the pools used since the last reset hold sets
+	for (uint32_t i = 0; i < arena._pools.size() && i <= arena._current; i++)
+		vkResetDescriptorPool(_device, arena._pools[i], 0);
+	arena._current = 0;
+	arena._stats._sets = 0;
+	arena._stats._resets++;
+}
+
+VkDescriptorSet DescriptorAllocatorVulkan::allocate(Arena &arena, VkDescriptorSetLayout layout)
+{
+	VkDescriptorSetAllocateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	info.descriptorSetCount = 1;
+	info.pSetLayouts = &layout;
+
+	// Allocate from the current pool, move down the chain (creating pools when needed) when it is exhausted.
+	for (;;)
+	{
+		bool created = arena._current == arena._pools.size();
+		if (created)
+		{
+			arena._pools.push_back(createPool());
+			arena._stats._pools++;
+		}
+		info.descriptorPool = arena._pools[arena._current];
+		VkDescriptorSet set;
+		VkResult err = vkAllocateDescriptorSets(_device, &info, &set);
+		if (err == VK_SUCCESS)
+		{
+			arena._stats._sets++;
+			return set;
+		}
+		// Exhausted pools report VK_ERROR_OUT_OF_POOL_MEMORY_KHR or VK_ERROR_FRAGMENTED_POOL (any error without maintenance1),
+		// a set that does not fit an empty pool never will.
+		if (created)
+			throw std::runtime_error("Failed to create descriptor set.");
+		arena._current++;
+	}
+}
+
+VkDescriptorPool DescriptorAllocatorVulkan::createPool()
+{
+	VkDescriptorPoolSize sizes[std::size(POOL_TYPES)];
+	for (size_t i = 0; i < std::size(POOL_TYPES); i++)
+	{
+		sizes[i].type = POOL_TYPES[i];
+		sizes[i].descriptorCount = _setsPerPool;
+	}
+	return createDescriptorPool(_device, sizes, (uint32_t)std::size(POOL_TYPES), _setsPerPool);
+}
+
+DescriptorAllocatorVulkan::Stats DescriptorAllocatorVulkan::getPersistentStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return _persistent._stats;
+}
+DescriptorAllocatorVulkan::Stats DescriptorAllocatorVulkan::getFrameStats(uint32_t frame)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return _frames[frame]._stats;
+}
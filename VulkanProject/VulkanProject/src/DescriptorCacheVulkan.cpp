@@ -0,0 +1,196 @@
+#include "DescriptorCacheVulkan.h"
+#include "DescriptorAllocatorVulkan.h"
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+
+namespace
+{
+	bool isImageType(VkDescriptorType type)
+	{
+		return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	}
+}
+
+DescriptorCacheVulkan::Binding DescriptorCacheVulkan::Binding::buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	Binding b;
+	memset(&b, 0, sizeof(Binding));
+	b._binding = binding;
+	b._type = type;
+	b._buffer.buffer = buffer;
+	b._buffer.offset = offset;
+	b._buffer.range = range;
+	return b;
+}
+DescriptorCacheVulkan::Binding DescriptorCacheVulkan::Binding::image(uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout, VkSampler sampler)
+{
+	Binding b;
+	memset(&b, 0, sizeof(Binding));
+	b._binding = binding;
+	b._type = type;
+	b._image.sampler = sampler;
+	b._image.imageView = view;
+	b._image.imageLayout = layout;
+	return b;
+}
+
+DescriptorCacheVulkan::DescriptorCacheVulkan()
+	: _device(VK_NULL_HANDLE), _allocator(nullptr), _stats(), _createTemplate(nullptr), _destroyTemplate(nullptr), _updateWithTemplate(nullptr)
+{
+}
+
+void DescriptorCacheVulkan::init(VkDevice device, DescriptorAllocatorVulkan *allocator, bool useTemplates)
+{
+	_device = device;
+	_allocator = allocator;
+	if (useTemplates)
+	{
+		_createTemplate = (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR");
+		_destroyTemplate = (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR");
+		_updateWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR");
+	}
+	// Fall back on vkUpdateDescriptorSets if any is missing
+	if (!_createTemplate || !_destroyTemplate || !_updateWithTemplate)
+		_createTemplate = nullptr, _destroyTemplate = nullptr, _updateWithTemplate = nullptr;
+}
+
+void DescriptorCacheVulkan::destroy()
+{
+	for (auto &entry : _templates)
+		_destroyTemplate(_device, entry.second, nullptr);
+	_templates.clear();
+	// Sets are released with the allocator pools
+	_sets.clear();
+	_free.clear();
+}
+
+VkDescriptorSet DescriptorCacheVulkan::get(VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings)
+{
+	// Key: layout followed by the binding contents
+	std::string key(sizeof(VkDescriptorSetLayout) + sizeof(Binding) * numBindings, '\0');
+	memcpy(&key[0], &layout, sizeof(VkDescriptorSetLayout));
+	memcpy(&key[sizeof(VkDescriptorSetLayout)], bindings, sizeof(Binding) * numBindings);
+
+	std::lock_guard<std::mutex> lock(_lock);
+	auto it = _sets.find(key);
+	if (it != _sets.end())
+	{
+		_stats._hits++;
+		return it->second;
+	}
+	_stats._misses++;
+	VkDescriptorSet set;
+	std::vector<VkDescriptorSet> &free = _free[layout];
+	if (free.empty())
+		set = _allocator->allocate(layout);
+	else
+	{
+		set = free.back();
+		free.pop_back();
+	}
+	write(set, layout, bindings, numBindings);
+	_sets[key] = set;
+	return set;
+}
+
+void DescriptorCacheVulkan::invalidate(uint64_t handle)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	for (auto it = _sets.begin(); it != _sets.end();)
+	{
+		// Bindings follow the layout in the key
+		const std::string &key = it->first;
+		VkDescriptorSetLayout layout;
+		memcpy(&layout, key.data(), sizeof(VkDescriptorSetLayout));
+		bool referenced = false;
+		for (size_t offset = sizeof(VkDescriptorSetLayout); offset < key.size() && !referenced; offset += sizeof(Binding))
+		{
+			Binding b;
+			memcpy(&b, key.data() + offset, sizeof(Binding));
+			if (isImageType(b._type))
+				referenced = (uint64_t)b._image.imageView == handle || (uint64_t)b._image.sampler == handle;
+			else
+				referenced = (uint64_t)b._buffer.buffer == handle;
+		}
+		if (referenced)
+		{
+			_free[layout].push_back(it->second);
+			it = _sets.erase(it);
+		}
+		else
+			it++;
+	}
+}
+
+void DescriptorCacheVulkan::write(VkDescriptorSet set, VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings)
+{
+	if (_updateWithTemplate)
+	{
+		// The binding array is the template data
+		_updateWithTemplate(_device, set, getTemplate(layout, bindings, numBindings), bindings);
+		return;
+	}
+	std::vector<VkWriteDescriptorSet> writes(numBindings);
+	for (uint32_t i = 0; i < numBindings; i++)
+	{
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = bindings[i]._binding;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = bindings[i]._type;
+		if (isImageType(bindings[i]._type))
+			writes[i].pImageInfo = &bindings[i]._image;
+		else
+			writes[i].pBufferInfo = &bindings[i]._buffer;
+	}
+	vkUpdateDescriptorSets(_device, numBindings, writes.data(), 0, nullptr);
+}
+
+VkDescriptorUpdateTemplateKHR DescriptorCacheVulkan::getTemplate(VkDescriptorSetLayout layout, const Binding *bindings, uint32_t numBindings)
+{
+	// Template key: layout followed by the binding signature
+	std::string key(sizeof(VkDescriptorSetLayout) + 2 * sizeof(uint32_t) * numBindings, '\0');
+	memcpy(&key[0], &layout, sizeof(VkDescriptorSetLayout));
+	for (uint32_t i = 0; i < numBindings; i++)
+	{
+		uint32_t signature[2] = { bindings[i]._binding, (uint32_t)bindings[i]._type };
+		memcpy(&key[sizeof(VkDescriptorSetLayout) + sizeof(signature) * i], signature, sizeof(signature));
+	}
+	auto it = _templates.find(key);
+	if (it != _templates.end())
+		return it->second;
+
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(numBindings);
+	for (uint32_t i = 0; i < numBindings; i++)
+	{
+		entries[i].dstBinding = bindings[i]._binding;
+		entries[i].dstArrayElement = 0;
+		entries[i].descriptorCount = 1;
+		entries[i].descriptorType = bindings[i]._type;
+		entries[i].offset = sizeof(Binding) * i + (isImageType(bindings[i]._type) ? offsetof(Binding, _image) : offsetof(Binding, _buffer));
+		entries[i].stride = sizeof(Binding);
+	}
+	VkDescriptorUpdateTemplateCreateInfoKHR info = {};
+	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+	info.descriptorUpdateEntryCount = numBindings;
+	info.pDescriptorUpdateEntries = entries.data();
+	info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+	info.descriptorSetLayout = layout;
+
+	VkDescriptorUpdateTemplateKHR updateTemplate;
+	if (_createTemplate(_device, &info, nullptr, &updateTemplate) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create descriptor update template.");
+	_templates[key] = updateTemplate;
+	_stats._templates++;
+	return updateTemplate;
+}
+
+DescriptorCacheVulkan::Stats DescriptorCacheVulkan::getStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return _stats;
+}
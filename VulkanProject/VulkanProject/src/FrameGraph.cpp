@@ -0,0 +1,710 @@
+#include "FrameGraph.h"
+#include "VulkanConstruct.h"
+#include <algorithm>
+
+namespace
+{
+	const VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	bool isCompute(QueueType queue)
+	{
+		return queue == QueueType::COMPUTE || queue == QueueType::COMPUTE2;
+	}
+
+	/* Resource state tracked while inferring the barriers.
+	*/
+	struct State
+	{
+		QueueType _queue;				// Queue of the last use
+		int _lastPass;					// Last pass using the resource this frame, -1 if unused so far
+		VkImageLayout _layout;
+		VkPipelineStageFlags _writeStage, _readStage, _visible;	// Stage of the last write, stages reading since, stages the write is visible to
+		VkAccessFlags _writeAccess;
+	};
+}
+
+#pragma region Access
+
+FrameGraph::Access::Access()
+	: _stage(0), _access(0), _layout(VK_IMAGE_LAYOUT_UNDEFINED), _finalLayout(VK_IMAGE_LAYOUT_UNDEFINED)
+{}
+FrameGraph::Access::Access(VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout)
+	: _stage(stage), _access(access), _layout(layout), _finalLayout(layout)
+{}
+FrameGraph::Access::Access(VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, VkImageLayout finalLayout)
+	: _stage(stage), _access(access), _layout(layout), _finalLayout(finalLayout)
+{}
+bool FrameGraph::Access::isWrite() const
+{
+	return (_access & WRITE_ACCESS) != 0;
+}
+
+FrameGraph::Access FrameGraph::colorAttachment(VkImageLayout finalLayout)
+{
+	// Cleared by the render pass, layout transitions are done by the pass.
+	return Access(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, finalLayout);
+}
+FrameGraph::Access FrameGraph::depthAttachment(VkImageLayout finalLayout)
+{
+	return Access(VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, finalLayout);
+}
+FrameGraph::Access FrameGraph::sampled(VkPipelineStageFlags stage)
+{
+	return Access(stage, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+FrameGraph::Access FrameGraph::storageImage(bool write, VkPipelineStageFlags stage)
+{
+	return Access(stage, write ? VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+}
+FrameGraph::Access FrameGraph::storageBuffer(bool write, VkPipelineStageFlags stage)
+{
+	return Access(stage, write ? VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT);
+}
+FrameGraph::Access FrameGraph::transferSrc()
+{
+	return Access(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+}
+FrameGraph::Access FrameGraph::transferDst()
+{
+	return Access(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+FrameGraph::Access FrameGraph::present(VkImageLayout layout)
+{
+	return Access(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, layout);
+}
+
+#pragma endregion
+
+#pragma region Declaration
+
+FrameGraph::Pass& FrameGraph::Pass::read(Resource resource, const Access &access)
+{
+	Use use = { resource, access };
+	use._access._access &= ~WRITE_ACCESS;
+	_uses.push_back(use);
+	return *this;
+}
+FrameGraph::Pass& FrameGraph::Pass::write(Resource resource, const Access &access)
+{
+	Use use = { resource, access };
+	_uses.push_back(use);
+	return *this;
+}
+
+FrameGraph::FrameGraph(VulkanRenderer *renderer)
+	: _renderHandle(renderer), _overlap(ASYNC), _compiled(false), _transientSize(0), _transientRequired(0)
+{
+}
+FrameGraph::~FrameGraph()
+{
+	destroyTransients();
+}
+
+FrameGraph::Resource FrameGraph::importImage(VkImageAspectFlags aspect, const Access &initial, QueueType initialQueue, const Access &final, QueueType finalQueue)
+{
+	ResourceInfo info = {};
+	info._type = IMPORTED_IMAGE;
+	info._aspect = aspect;
+	info._initial = initial;
+	info._initialQueue = initialQueue;
+	info._final = final;
+	info._finalQueue = finalQueue;
+	info._aliasPredecessor = -1;
+	_resources.push_back(info);
+	return (Resource)_resources.size() - 1;
+}
+FrameGraph::Resource FrameGraph::importBuffer(VkBuffer buffer, QueueType owner)
+{
+	ResourceInfo info = {};
+	info._type = IMPORTED_BUFFER;
+	info._buffer = buffer;
+	info._initialQueue = info._finalQueue = owner;
+	info._aliasPredecessor = -1;
+	_resources.push_back(info);
+	return (Resource)_resources.size() - 1;
+}
+FrameGraph::Resource FrameGraph::createImage(const ImageDesc &desc)
+{
+	ResourceInfo info = {};
+	info._type = TRANSIENT_IMAGE;
+	info._aspect = desc._aspect;
+	info._desc = desc;
+	info._initialQueue = info._finalQueue = QueueType::GRAPHIC;
+	info._aliasPredecessor = -1;
+	_resources.push_back(info);
+	return (Resource)_resources.size() - 1;
+}
+void FrameGraph::setImage(Resource resource, VkImage image, VkImageView view)
+{
+	assert(_resources[resource]._type == IMPORTED_IMAGE);
+	_resources[resource]._image = image;
+	_resources[resource]._view = view;
+}
+
+FrameGraph::Pass& FrameGraph::addPass(const char *name, QueueType queue, const PassFunc &func)
+{
+	_compiled = false;
+	_passes.push_back(Pass());
+	Pass &pass = _passes.back();
+	pass._name = name;
+	pass._queue = queue;
+	pass._func = func;
+	return pass;
+}
+void FrameGraph::setOverlap(Overlap overlap)
+{
+	_compiled = _compiled && _overlap == overlap;
+	_overlap = overlap;
+}
+
+VkImage FrameGraph::getImage(Resource resource)
+{
+	ResourceInfo &info = _resources[resource];
+	if (info._type == TRANSIENT_IMAGE)
+		return info._frameImages[_renderHandle->getFrameIndex()];
+	return info._image;
+}
+VkImageView FrameGraph::getView(Resource resource)
+{
+	ResourceInfo &info = _resources[resource];
+	if (info._type == TRANSIENT_IMAGE)
+		return info._frameViews[_renderHandle->getFrameIndex()];
+	return info._view;
+}
+void FrameGraph::getTransientMemory(VkDeviceSize &allocated, VkDeviceSize &required)
+{
+	allocated = _transientSize;
+	required = _transientRequired;
+}
+
+uint32_t FrameGraph::family(QueueType queue)
+{
+	return (uint32_t)_renderHandle->getQueueFamily(queue);
+}
+uint32_t FrameGraph::batchOf(QueueType queue)
+{
+	for (uint32_t i = 0; i < _batches.size(); i++)
+	{
+		if (_batches[i]._queue == queue)
+			return i;
+	}
+	throw std::runtime_error("Frame graph has no batch on the queue.");
+}
+
+#pragma endregion
+
+#pragma region Compile
+
+void FrameGraph::compile()
+{
+	destroyTransients();
+	assignQueues();
+	allocateTransients();
+	inferBarriers();
+	_compiled = true;
+}
+
+void FrameGraph::assignQueues()
+{
+	_passQueue.resize(_passes.size());
+	std::vector<int> lastUser(_resources.size(), -1);
+	uint32_t numCompute[2] = { 0, 0 };
+	for (uint32_t p = 0; p < _passes.size(); p++)
+	{
+		QueueType queue = _passes[p]._queue;
+		if (queue == QueueType::COMPUTE && _overlap == MULTI_QUEUE)
+		{
+			// Follow the latest compute pass it depends on, independent passes go to the least used compute queue.
+			int dependency = -1;
+			for (const Pass::Use &use : _passes[p]._uses)
+			{
+				int user = lastUser[use._resource];
+				if (user >= 0 && isCompute(_passQueue[user]))
+					dependency = std::max(dependency, user);
+			}
+			if (dependency >= 0)
+				queue = _passQueue[dependency];
+			else
+				queue = numCompute[1] < numCompute[0] ? QueueType::COMPUTE2 : QueueType::COMPUTE;
+		}
+		_passQueue[p] = queue;
+		if (isCompute(queue))
+			numCompute[queue - QueueType::COMPUTE]++;
+		for (const Pass::Use &use : _passes[p]._uses)
+			lastUser[use._resource] = (int)p;
+	}
+
+	// A batch per queue, submitted in the order of their first pass
+	_batches.clear();
+	bool hasGraphic = false;
+	for (uint32_t p = 0; p < _passes.size(); p++)
+	{
+		auto it = std::find_if(_batches.begin(), _batches.end(), [&](const Batch &b) { return b._queue == _passQueue[p]; });
+		if (it == _batches.end())
+		{
+			_batches.push_back(Batch());
+			_batches.back()._queue = _passQueue[p];
+			it = _batches.end() - 1;
+		}
+		it->_passes.push_back(p);
+		hasGraphic |= _passQueue[p] == QueueType::GRAPHIC;
+	}
+	if (!hasGraphic)
+		throw std::runtime_error("Frame graph requires a graphics pass.");
+}
+
+void FrameGraph::allocateTransients()
+{
+	VkDevice device = _renderHandle->getDevice();
+	uint32_t numFrames = _renderHandle->getFrameCount();
+
+	// Lifetime in passes, transients used on a single queue can be aliased
+	struct Transient
+	{
+		Resource _resource;
+		int _first, _last;
+		bool _singleQueue;
+		VkMemoryRequirements _req;
+	};
+	std::vector<Transient> transients;
+	for (Resource r = 0; r < _resources.size(); r++)
+	{
+		ResourceInfo &info = _resources[r];
+		if (info._type != TRANSIENT_IMAGE)
+			continue;
+		Transient t = { r, -1, -1, true, {} };
+		for (uint32_t p = 0; p < _passes.size(); p++)
+		{
+			for (const Pass::Use &use : _passes[p]._uses)
+			{
+				if (use._resource != r)
+					continue;
+				if (t._first < 0)
+					t._first = (int)p;
+				else if (_passQueue[p] != _passQueue[t._first])
+					t._singleQueue = false;
+				t._last = (int)p;
+			}
+		}
+		// Create the images for each frame in flight
+		info._frameImages.resize(numFrames);
+		info._frameViews.resize(numFrames);
+		for (uint32_t f = 0; f < numFrames; f++)
+		{
+			VkImageCreateInfo imageInfo = {};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent = { info._desc._width, info._desc._height, 1 };
+			imageInfo.format = info._desc._format;
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = info._desc._usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			if (vkCreateImage(device, &imageInfo, nullptr, &info._frameImages[f]) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create transient image.");
+		}
+		vkGetImageMemoryRequirements(device, info._frameImages[0], &t._req);
+		transients.push_back(t);
+	}
+	if (transients.empty())
+		return;
+
+	// Greedy first fit of the transients into memory slots, a slot is re-used when the lifetime of its last occupant has ended.
+	struct Slot
+	{
+		VkDeviceSize _size, _alignment, _offset;
+		uint32_t _typeBits;
+		int _lastEnd;
+		QueueType _queue;
+		int _lastOccupant;
+	};
+	std::vector<Slot> slots;
+	std::vector<uint32_t> slotOf(transients.size());
+	std::vector<uint32_t> order(transients.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return transients[a]._first < transients[b]._first; });
+
+	_transientRequired = 0;
+	for (uint32_t i : order)
+	{
+		Transient &t = transients[i];
+		_transientRequired += t._req.size;
+		int found = -1;
+		if (t._singleQueue && t._first >= 0)
+		{
+			for (uint32_t s = 0; s < slots.size(); s++)
+			{
+				Slot &slot = slots[s];
+				if (slot._lastOccupant >= 0 && slot._lastEnd < t._first && slot._queue == _passQueue[t._first] && (slot._typeBits & t._req.memoryTypeBits))
+				{
+					found = (int)s;
+					break;
+				}
+			}
+		}
+		if (found < 0)
+		{
+			Slot slot = { 0, 1, 0, ~0u, -1, QueueType::GRAPHIC, -1 };
+			slots.push_back(slot);
+			found = (int)slots.size() - 1;
+		}
+		Slot &slot = slots[found];
+		_resources[t._resource]._aliasPredecessor = slot._lastOccupant >= 0 ? (int)transients[slot._lastOccupant]._resource : -1;
+		slot._size = std::max(slot._size, t._req.size);
+		slot._alignment = std::max(slot._alignment, t._req.alignment);
+		slot._typeBits &= t._req.memoryTypeBits;
+		// Only transients on a single queue are aliased, others are given a slot of their own
+		slot._lastEnd = t._singleQueue ? t._last : INT32_MAX;
+		slot._lastOccupant = t._singleQueue ? (int)i : -1;
+		slot._queue = t._first >= 0 ? _passQueue[t._first] : QueueType::GRAPHIC;
+		slotOf[i] = (uint32_t)found;
+	}
+
+	// Place the slots in a single allocation per frame
+	VkMemoryRequirements frameReq = {};
+	frameReq.memoryTypeBits = ~0u;
+	frameReq.alignment = 1;
+	for (Slot &slot : slots)
+	{
+		frameReq.size = (frameReq.size + slot._alignment - 1) / slot._alignment * slot._alignment;
+		slot._offset = frameReq.size;
+		frameReq.size += slot._size;
+		frameReq.alignment = std::max(frameReq.alignment, slot._alignment);
+		frameReq.memoryTypeBits &= slot._typeBits;
+	}
+	if (frameReq.memoryTypeBits == 0)
+		throw std::runtime_error("Transient images have no common memory type.");
+	_transientSize = frameReq.size;
+
+	_transientMemory.resize(numFrames);
+	for (uint32_t f = 0; f < numFrames; f++)
+	{
+		_transientMemory[f] = allocPhysicalMemory(device, _renderHandle->getPhysical(), frameReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		for (uint32_t i = 0; i < transients.size(); i++)
+		{
+			ResourceInfo &info = _resources[transients[i]._resource];
+			info._memOffset = slots[slotOf[i]]._offset;
+			vkBindImageMemory(device, info._frameImages[f], _transientMemory[f], info._memOffset);
+			info._frameViews[f] = createImageView(device, info._frameImages[f], info._desc._format, info._aspect);
+		}
+	}
+}
+
+void FrameGraph::destroyTransients()
+{
+	VkDevice device = _renderHandle->getDevice();
+	for (ResourceInfo &info : _resources)
+	{
+		for (VkImageView view : info._frameViews)
+			vkDestroyImageView(device, view, nullptr);
+		for (VkImage image : info._frameImages)
+			vkDestroyImage(device, image, nullptr);
+		info._frameViews.clear();
+		info._frameImages.clear();
+	}
+	for (VkDeviceMemory mem : _transientMemory)
+		vkFreeMemory(device, mem, nullptr);
+	_transientMemory.clear();
+	_transientSize = _transientRequired = 0;
+}
+
+void FrameGraph::inferBarriers()
+{
+	_passBarriers.assign(_passes.size(), std::vector<Barrier>());
+
+	// Last use of each resource, resources without a final state continue into the next frame from their last use.
+	std::vector<int> lastUse(_resources.size(), -1);
+	for (uint32_t p = 0; p < _passes.size(); p++)
+	{
+		for (const Pass::Use &use : _passes[p]._uses)
+			lastUse[use._resource] = (int)p;
+	}
+
+	std::vector<State> state(_resources.size());
+	for (Resource r = 0; r < _resources.size(); r++)
+	{
+		ResourceInfo &info = _resources[r];
+		State &s = state[r];
+		s = { info._initialQueue, -1, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0 };
+		if (info._type == IMPORTED_IMAGE)
+			s._layout = info._initial._layout;
+	}
+
+	for (uint32_t p = 0; p < _passes.size(); p++)
+	{
+		QueueType queue = _passQueue[p];
+		uint32_t batch = batchOf(queue);
+		for (const Pass::Use &use : _passes[p]._uses)
+		{
+			ResourceInfo &info = _resources[use._resource];
+			State &s = state[use._resource];
+			const Access &a = use._access;
+			bool isImage = info._type != IMPORTED_BUFFER;
+
+			// First use of an aliased transient synchronizes with the previous occupant of the memory (same queue).
+			if (s._lastPass < 0 && info._aliasPredecessor >= 0)
+			{
+				State &prev = state[info._aliasPredecessor];
+				s._writeStage = prev._writeStage | prev._readStage;
+				s._writeAccess = prev._writeAccess;
+				s._queue = queue;
+			}
+			if (info._type == TRANSIENT_IMAGE && s._lastPass < 0)
+				s._queue = queue;
+
+			bool preserve = !isImage || a._layout != VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout newLayout = (isImage && a._layout != VK_IMAGE_LAYOUT_UNDEFINED) ? a._layout : s._layout;
+			bool layoutChange = isImage && newLayout != s._layout;
+
+			Barrier barrier = {};
+			barrier._resource = use._resource;
+			barrier._dstStage = a._stage;
+			barrier._dstAccess = a._access;
+			barrier._oldLayout = s._layout;
+			barrier._newLayout = newLayout;
+			barrier._srcFamily = barrier._dstFamily = VK_QUEUE_FAMILY_IGNORED;
+
+			if (s._queue != queue)
+			{
+				// Previous use on another queue, the submissions are ordered by a semaphore (within the frame).
+				// An imported buffer is first acquired from its owner, the owner submission must precede the pass.
+				bool fromOwner = s._lastPass < 0 && info._type == IMPORTED_BUFFER && family(s._queue) != family(queue);
+				if (s._lastPass >= 0 || fromOwner)
+				{
+					uint32_t srcBatch = batchOf(s._queue);
+					if (srcBatch > batch)
+						throw std::runtime_error("Frame graph pass '" + _passes[p]._name + "' depends on a later queue submission.");
+					if (std::find(_batches[batch]._waits.begin(), _batches[batch]._waits.end(), srcBatch) == _batches[batch]._waits.end())
+						_batches[batch]._waits.push_back(srcBatch);
+				}
+				if (preserve && family(s._queue) != family(queue))
+				{
+					// Ownership transfer, release at the end of the source submission and acquire before the pass.
+					Barrier release = barrier;
+					release._srcStage = (s._writeStage | s._readStage) ? (VkPipelineStageFlags)(s._writeStage | s._readStage) : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					release._srcAccess = s._writeAccess;
+					release._dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+					release._dstAccess = 0;
+					release._srcFamily = family(s._queue);
+					release._dstFamily = family(queue);
+					_batches[batchOf(s._queue)]._release.push_back(release);
+
+					barrier._srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+					barrier._srcAccess = 0;
+					barrier._srcFamily = release._srcFamily;
+					barrier._dstFamily = release._dstFamily;
+					_passBarriers[p].push_back(barrier);
+				}
+				else if (layoutChange)
+				{
+					barrier._srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+					barrier._srcAccess = 0;
+					_passBarriers[p].push_back(barrier);
+				}
+				s._writeStage = s._readStage = s._visible = 0;
+				s._writeAccess = 0;
+			}
+			else
+			{
+				// Same queue, barrier on read/write hazards and layout transitions.
+				bool hazard = a.isWrite() ?
+					(s._writeAccess != 0 || s._readStage != 0) :
+					(s._writeAccess != 0 && (s._visible & a._stage) != a._stage);
+				if (hazard || layoutChange)
+				{
+					VkPipelineStageFlags srcStage = a.isWrite() ? (s._writeStage | s._readStage) : s._writeStage;
+					barrier._srcStage = srcStage ? srcStage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					barrier._srcAccess = s._writeAccess;
+					_passBarriers[p].push_back(barrier);
+					s._visible |= a._stage;
+				}
+			}
+
+			if (a.isWrite())
+			{
+				s._writeStage = a._stage;
+				s._writeAccess = a._access & WRITE_ACCESS;
+				s._readStage = 0;
+				s._visible = 0;
+			}
+			else
+			{
+				s._readStage |= a._stage;
+				s._visible |= a._stage;
+			}
+			s._layout = isImage ? a._finalLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+			s._queue = queue;
+			s._lastPass = (int)p;
+		}
+	}
+
+	// Final states of the imported images, transitioned at the end of the submission last using them.
+	for (Resource r = 0; r < _resources.size(); r++)
+	{
+		ResourceInfo &info = _resources[r];
+		State &s = state[r];
+		if (info._type != IMPORTED_IMAGE || s._lastPass < 0)
+			continue;
+		bool transfer = family(s._queue) != family(info._finalQueue);
+		VkImageLayout finalLayout = info._final._layout != VK_IMAGE_LAYOUT_UNDEFINED ? info._final._layout : s._layout;
+		if (!transfer && finalLayout == s._layout)
+			continue;
+		// The acquire on the final queue is left out when presenting (as the scenes previously did).
+		Barrier release = {};
+		release._resource = r;
+		release._srcStage = (s._writeStage | s._readStage) ? (VkPipelineStageFlags)(s._writeStage | s._readStage) : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		release._srcAccess = s._writeAccess;
+		release._dstStage = info._final._stage ? (VkPipelineStageFlags)info._final._stage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		release._dstAccess = info._final._access;
+		release._oldLayout = s._layout;
+		release._newLayout = finalLayout;
+		release._srcFamily = transfer ? family(s._queue) : VK_QUEUE_FAMILY_IGNORED;
+		release._dstFamily = transfer ? family(info._finalQueue) : VK_QUEUE_FAMILY_IGNORED;
+		_batches[batchOf(s._queue)]._release.push_back(release);
+	}
+
+	// Imported buffers used on another queue family are returned to the owner, released at the end of the submission last using
+	// them and acquired at the end of the owner submission.
+	for (Resource r = 0; r < _resources.size(); r++)
+	{
+		ResourceInfo &info = _resources[r];
+		State &s = state[r];
+		if (info._type != IMPORTED_BUFFER || s._lastPass < 0 || family(s._queue) == family(info._finalQueue))
+			continue;
+		uint32_t srcBatch = batchOf(s._queue), dstBatch = batchOf(info._finalQueue);
+		if (dstBatch < srcBatch)
+			throw std::runtime_error("Frame graph buffer can't be returned to its owner, the owner queue is submitted before the last use.");
+		Barrier release = {};
+		release._resource = r;
+		release._srcStage = (s._writeStage | s._readStage) ? (VkPipelineStageFlags)(s._writeStage | s._readStage) : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		release._srcAccess = s._writeAccess;
+		release._dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		release._dstAccess = 0;
+		release._srcFamily = family(s._queue);
+		release._dstFamily = family(info._finalQueue);
+		_batches[srcBatch]._release.push_back(release);
+
+		Barrier acquire = release;
+		acquire._srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		acquire._srcAccess = 0;
+		acquire._dstStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		acquire._dstAccess = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		_batches[dstBatch]._release.push_back(acquire);
+		if (std::find(_batches[dstBatch]._waits.begin(), _batches[dstBatch]._waits.end(), srcBatch) == _batches[dstBatch]._waits.end())
+			_batches[dstBatch]._waits.push_back(srcBatch);
+	}
+
+	// Remove waits implied by other waits, a submission signal can only be waited on once.
+	std::vector<uint32_t> consumers(_batches.size(), 0);
+	for (uint32_t b = 0; b < _batches.size(); b++)
+	{
+		std::vector<uint32_t> &waits = _batches[b]._waits;
+		std::vector<uint32_t> reduced;
+		for (uint32_t w : waits)
+		{
+			bool implied = false;
+			for (uint32_t other : waits)
+			{
+				// Breadth first over the waits of other
+				std::vector<uint32_t> open(1, other);
+				while (!open.empty() && !implied && other != w)
+				{
+					uint32_t cur = open.back();
+					open.pop_back();
+					for (uint32_t next : _batches[cur]._waits)
+					{
+						implied |= next == w;
+						open.push_back(next);
+					}
+				}
+			}
+			if (!implied)
+				reduced.push_back(w);
+		}
+		waits = reduced;
+		for (uint32_t w : waits)
+		{
+			if (++consumers[w] > 1)
+				throw std::runtime_error("Frame graph submission on queue " + std::to_string(_batches[w]._queue) + " is waited on by multiple queues.");
+		}
+	}
+}
+
+#pragma endregion
+
+#pragma region Execute
+
+void FrameGraph::recordBarrier(VkCommandBuffer cmdBuf, const Barrier &barrier)
+{
+	ResourceInfo &info = _resources[barrier._resource];
+	if (info._type == IMPORTED_BUFFER)
+	{
+		VkBufferMemoryBarrier bufBarrier = {};
+		bufBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufBarrier.srcAccessMask = barrier._srcAccess;
+		bufBarrier.dstAccessMask = barrier._dstAccess;
+		bufBarrier.srcQueueFamilyIndex = barrier._srcFamily;
+		bufBarrier.dstQueueFamilyIndex = barrier._dstFamily;
+		bufBarrier.buffer = info._buffer;
+		bufBarrier.offset = 0;
+		bufBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmdBuf, barrier._srcStage, barrier._dstStage, 0, 0, nullptr, 1, &bufBarrier, 0, nullptr);
+		return;
+	}
+	VkImageMemoryBarrier imgBarrier = {};
+	imgBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imgBarrier.srcAccessMask = barrier._srcAccess;
+	imgBarrier.dstAccessMask = barrier._dstAccess;
+	imgBarrier.oldLayout = barrier._oldLayout;
+	imgBarrier.newLayout = barrier._newLayout;
+	imgBarrier.srcQueueFamilyIndex = barrier._srcFamily;
+	imgBarrier.dstQueueFamilyIndex = barrier._dstFamily;
+	imgBarrier.image = getImage(barrier._resource);
+	imgBarrier.subresourceRange.aspectMask = info._aspect;
+	imgBarrier.subresourceRange.baseMipLevel = 0;
+	imgBarrier.subresourceRange.levelCount = 1;
+	imgBarrier.subresourceRange.baseArrayLayer = 0;
+	imgBarrier.subresourceRange.layerCount = 1;
+	cmdImageTransition(cmdBuf, barrier._srcStage, barrier._dstStage, imgBarrier);
+}
+
+void FrameGraph::execute()
+{
+	if (!_compiled)
+		compile();
+
+	for (Batch &batch : _batches)
+	{
+		VulkanRenderer::FrameInfo info = batch._queue == QueueType::GRAPHIC ?
+			_renderHandle->beginFrameCommands() :
+			_renderHandle->beginCompute(batch._queue - QueueType::COMPUTE);
+
+		for (size_t i = 0; i < batch._passes.size(); i++)
+		{
+			uint32_t p = batch._passes[i];
+			if (_overlap == SEQUENTIAL && i > 0)
+				serializeCommandBuffer(info._buf);
+			for (const Barrier &barrier : _passBarriers[p])
+				recordBarrier(info._buf, barrier);
+			_passes[p]._func(info);
+		}
+		for (const Barrier &barrier : batch._release)
+			recordBarrier(info._buf, barrier);
+
+		std::vector<vk::Ticket> waits;
+		for (uint32_t w : batch._waits)
+			waits.push_back(_batches[w]._ticket);
+		if (batch._queue == QueueType::GRAPHIC)
+			batch._ticket = _renderHandle->submitFramePass(waits.data(), (uint32_t)waits.size());
+		else
+			batch._ticket = _renderHandle->submitCompute(batch._queue - QueueType::COMPUTE, waits.data(), (uint32_t)waits.size());
+	}
+}
+
+#pragma endregion
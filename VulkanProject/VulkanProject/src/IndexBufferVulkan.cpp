@@ -0,0 +1,66 @@
+#include "IndexBufferVulkan.h"
+#include "VulkanRenderer.h"
+#include <vector>
+
+IndexBufferVulkan::IndexBufferVulkan(VulkanRenderer *renderer, size_t size)
+	: _bufferHandle(NULL), _renderHandle(renderer), memSize(size)
+{
+	// Sub-range of the shared index buffer
+	_view = renderer->getBufferArena(BufferArenaVulkan::INDEX).allocate(size);
+	_bufferHandle = _view._buffer;
+}
+
+IndexBufferVulkan::~IndexBufferVulkan()
+{
+	_renderHandle->getBufferArena(BufferArenaVulkan::INDEX).free(_view);
+}
+
+void IndexBufferVulkan::setData(const void * data, size_t size, size_t offset)
+{
+	_renderHandle->transferBufferInitial(_bufferHandle, data, size, _view._offset + offset);
+}
+void IndexBufferVulkan::setData(const uint32_t* indices, Binding& binding)
+{
+	if (binding.type == VK_INDEX_TYPE_UINT32)
+	{
+		setData(indices, binding.byteSize(), binding.offset);
+		return;
+	}
+	std::vector<uint16_t> narrow(binding.numIndices);
+	for (uint32_t i = 0; i < binding.numIndices; i++)
+		narrow[i] = (uint16_t)indices[i];
+	setData(narrow.data(), binding.byteSize(), binding.offset);
+}
+
+void IndexBufferVulkan::bind(VkCommandBuffer cmdBuf, size_t offset, VkIndexType type)
+{
+	vkCmdBindIndexBuffer(cmdBuf, _bufferHandle, _view._offset + offset, type);
+}
+
+size_t IndexBufferVulkan::getSize()
+{
+	return memSize;
+}
+
+VkIndexType IndexBufferVulkan::fitIndexType(size_t numVertices)
+{
+	// 0xFFFF is left out, it restarts primitives when enabled
+	return numVertices < 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+#pragma region Binding implementation
+
+void IndexBufferVulkan::Binding::bind(VkCommandBuffer cmdBuf)
+{
+	buffer->bind(cmdBuf, offset, type);
+}
+IndexBufferVulkan::Binding::Binding()
+	: type(VK_INDEX_TYPE_UINT32), numIndices(0), offset(0), buffer(nullptr)
+{
+}
+IndexBufferVulkan::Binding::Binding(IndexBufferVulkan* buffer, VkIndexType type, uint32_t numIndices, uint32_t offset)
+	: type(type), numIndices(numIndices), offset(offset), buffer(buffer)
+{
+}
+
+#pragma endregion
@@ -0,0 +1,194 @@
+#include "PipelineCacheVulkan.h"
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <assert.h>
+
+namespace
+{
+	const uint32_t CACHE_MAGIC = 0x32504b56;	// 'VKP2', header with the cold baseline
+	/* A create call is estimated as cache hits when its time per pipeline is below this fraction of the cold baseline.
+	Compiling a pipeline from SPIR-V is typically an order of magnitude slower than fetching it from the cache. */
+	const double HIT_TIME_FRACTION = 0.25;
+	/* Size of the VkPipelineCacheHeaderVersionOne header leading the cache data. */
+	const size_t VK_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+	double msSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+PipelineCacheVulkan::PipelineCacheVulkan()
+	: _device(VK_NULL_HANDLE), _cache(VK_NULL_HANDLE), _properties(), _stats(), _missTime(0)
+{
+}
+PipelineCacheVulkan::~PipelineCacheVulkan()
+{
+	assert(_cache == VK_NULL_HANDLE);
+}
+
+void PipelineCacheVulkan::load(VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &path)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	_device = device;
+	_properties = properties;
+	_path = path;
+	_stats = Stats();
+	_missTime = 0;
+
+	// Read the file, invalid data is discarded
+	std::vector<char> data;
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (file.is_open())
+	{
+		data.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		if (!file || !validate(data.data(), data.size()))
+			data.clear();
+	}
+
+	VkPipelineCacheCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	if (!data.empty())
+	{
+		info.initialDataSize = data.size() - sizeof(FileHeader);
+		info.pInitialData = data.data() + sizeof(FileHeader);
+	}
+	VkResult err = vkCreatePipelineCache(device, &info, nullptr, &_cache);
+	if (err != VK_SUCCESS && !data.empty())
+	{
+		// Driver rejected the data, start empty
+		info.initialDataSize = 0;
+		info.pInitialData = nullptr;
+		err = vkCreatePipelineCache(device, &info, nullptr, &_cache);
+		data.clear();
+	}
+	if (err != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline cache.");
+
+	_stats._loaded = !data.empty();
+	if (_stats._loaded)
+	{
+		FileHeader header;
+		memcpy(&header, data.data(), sizeof(FileHeader));
+		_stats._baselineTime = header._baselineTime;
+	}
+	_stats._loadedBytes = data.empty() ? 0 : info.initialDataSize;
+	_stats._loadTime = msSince(start);
+}
+
+bool PipelineCacheVulkan::validate(const char *data, size_t size)
+{
+	if (size < sizeof(FileHeader) + VK_CACHE_HEADER_SIZE)
+		return false;
+	FileHeader header;
+	memcpy(&header, data, sizeof(FileHeader));
+	if (header._magic != CACHE_MAGIC || header._driverVersion != _properties.driverVersion || header._dataSize != size - sizeof(FileHeader))
+		return false;
+
+	// VkPipelineCacheHeaderVersionOne: length, version, vendorID, deviceID, pipelineCacheUUID
+	uint32_t fields[4];
+	const char *cacheData = data + sizeof(FileHeader);
+	memcpy(fields, cacheData, sizeof(fields));
+	return fields[0] >= VK_CACHE_HEADER_SIZE &&
+		fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		fields[2] == _properties.vendorID &&
+		fields[3] == _properties.deviceID &&
+		memcmp(cacheData + sizeof(fields), _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCacheVulkan::save()
+{
+	if (_cache == VK_NULL_HANDLE || _path.empty())
+		return;
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t size = dataSize();
+	std::vector<char> data(sizeof(FileHeader) + size);
+	if (vkGetPipelineCacheData(_device, _cache, &size, data.data() + sizeof(FileHeader)) != VK_SUCCESS)
+	{
+		std::cout << "Failed to fetch pipeline cache data.\n";
+		return;
+	}
+	// Keep the baseline of the run that filled the cache, a warm run mostly measures hits
+	double baseline = getStats()._baselineTime;
+	FileHeader header = { CACHE_MAGIC, _properties.driverVersion, size, baseline };
+	memcpy(data.data(), &header, sizeof(FileHeader));
+
+	// Write to a temporary file and replace, an interrupted write does not leave a corrupt cache
+	std::string tmpPath = _path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cout << "Failed to write pipeline cache: " << _path << "\n";
+			return;
+		}
+		file.write(data.data(), sizeof(FileHeader) + size);
+	}
+	std::remove(_path.c_str());
+	std::rename(tmpPath.c_str(), _path.c_str());
+	_stats._savedBytes = size;
+	_stats._saveTime = msSince(start);
+}
+
+void PipelineCacheVulkan::destroy()
+{
+	if (_cache)
+		vkDestroyPipelineCache(_device, _cache, nullptr);
+	_cache = VK_NULL_HANDLE;
+}
+
+VkResult PipelineCacheVulkan::createGraphicsPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo *info, VkPipeline *pipelines)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult err = vkCreateGraphicsPipelines(_device, _cache, count, info, nullptr, pipelines);
+	record(count, msSince(start));
+	return err;
+}
+VkResult PipelineCacheVulkan::createComputePipelines(uint32_t count, const VkComputePipelineCreateInfo *info, VkPipeline *pipelines)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult err = vkCreateComputePipelines(_device, _cache, count, info, nullptr, pipelines);
+	record(count, msSince(start));
+	return err;
+}
+
+size_t PipelineCacheVulkan::dataSize()
+{
+	size_t size = 0;
+	vkGetPipelineCacheData(_device, _cache, &size, nullptr);
+	return size;
+}
+
+void PipelineCacheVulkan::record(uint32_t count, double time)
+{
+	std::lock_guard<std::mutex> lock(_statLock);
+	_stats._created += count;
+	_stats._createTime += time;
+	if (count == 0)
+		return;
+
+	// Without a loaded baseline the misses of this run are the baseline, the first call is always a miss
+	double perPipeline = time / count;
+	if (_stats._baselineTime > 0 && perPipeline < _stats._baselineTime * HIT_TIME_FRACTION)
+		_stats._estimatedHits += count;
+	else
+	{
+		_stats._estimatedMisses += count;
+		_missTime += time;
+		if (!_stats._loaded)
+			_stats._baselineTime = _missTime / _stats._estimatedMisses;
+	}
+}
+
+PipelineCacheVulkan::Stats PipelineCacheVulkan::getStats()
+{
+	std::lock_guard<std::mutex> lock(_statLock);
+	return _stats;
+}
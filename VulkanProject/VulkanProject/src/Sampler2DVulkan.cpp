@@ -38,7 +38,10 @@ void Sampler2DVulkan::setWrap(VkSamplerAddressMode s, VkSamplerAddressMode t)
 void Sampler2DVulkan::destroySampler()
 {
 	if(_sampler)
+	{
+		_renderHandle->getDescriptorCache().invalidate((uint64_t)_sampler);
 		vkDestroySampler(_renderHandle->getDevice(), _sampler, nullptr);
+	}
 }
 
 void Sampler2DVulkan::reCreateSampler()
@@ -2,6 +2,7 @@
 #include "VulkanRenderer.h"
 #include "Stuff/RandomGenerator.h"
 #include "VulkanConstruct.h"
+#include "TechniqueBuilderVulkan.h"
 #include <iostream>
 
 ComputeExperiment::ComputeExperiment(Mode mode, uint32_t shader, uint32_t num_particles, float locality)
@@ -19,12 +20,15 @@ ComputeExperiment::~ComputeExperiment()
 	delete techniquePost, delete techniqueSmallOp;
 	delete compShader, delete compSmallOp;
 	delete smallOpBuf;
+	delete recorder;
+	delete graph;
 	smallOpLayout.destroy(_renderHandle->getDevice());
 	postLayout.destroy(_renderHandle->getDevice());
+	if (bindless)
+		vkDestroyPipelineLayout(_renderHandle->getDevice(), bindlessLayout._layout, nullptr);
 
 	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
 	{
-		delete postParams;
 		delete readImg;
 		delete readSampler;
 	}
@@ -36,6 +40,12 @@ void ComputeExperiment::initialize(VulkanRenderer *handle)
 	std::cout << "Initiating Compute Experiment\n";
 	std::cout << "Mode: " << mode << "\n";
 	Scene::initialize(handle);
+	if (hasFlag(shaderMode, ShaderModeBit::BINDLESS))
+	{
+		bindless = _renderHandle->getBindlessTable();
+		if (!bindless || !hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
+			throw std::runtime_error("BINDLESS shader mode requires MEM_LIMITED and the BINDLESS render flag.");
+	}
 
 	// Render pass initiation
 	std::string err;
@@ -65,16 +75,18 @@ void ComputeExperiment::initialize(VulkanRenderer *handle)
 
 	//Layout
 	VkDescriptorSetLayoutBinding binding;
-	postLayout = vk::LayoutConstruct(hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED) ? 3 : 1);
+	bool postSets = hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED) && !bindless;
+	postLayout = vk::LayoutConstruct(postSets ? 2 : 1);
 	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
 	postLayout[0] = createDescriptorLayout(_renderHandle->getDevice(), &binding, 1);
-	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
+	if (postSets)
 	{
-		writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
-		postLayout[1] = createDescriptorLayout(_renderHandle->getDevice(), &binding, 1);
 		writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
-		postLayout[2] = createDescriptorLayout(_renderHandle->getDevice(), &binding, 1);
+		postLayout[1] = createDescriptorLayout(_renderHandle->getDevice(), &binding, 1);
+		// Locality is pushed with the dispatch instead of staged into a uniform buffer
+		postParams = postLayout.definePushConstant<PostParams>(VK_SHADER_STAGE_COMPUTE_BIT);
 	}
+	postLocality = locality;
 	// Gen. layout
 	postLayout.construct(_renderHandle->getDevice());
 
@@ -83,28 +95,25 @@ void ComputeExperiment::initialize(VulkanRenderer *handle)
 	compSmallOp = new ShaderVulkan("SmallOp", _renderHandle);
 #ifdef COMPILE
 	compSmallOp->setShader("resource/Compute/ComputeSimple.glsl", ShaderVulkan::ShaderType::CS);
-	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
-		compShader->setShader("resource/Compute/ComputeMemLimited.glsl", ShaderVulkan::ShaderType::CS);
-	else
-		compShader->setShader("resource/Compute/ComputeRegLimited.glsl", ShaderVulkan::ShaderType::CS);
+	compShader->setShader("resource/Compute/ComputeRegLimited.glsl", ShaderVulkan::ShaderType::CS);
 #else
 	compSmallOp->setShader("resource/tmp/ComputeSimple.spv", ShaderVulkan::ShaderType::CS);
-	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
+	compShader->setShader("resource/tmp/ComputeRegLimited.spv", ShaderVulkan::ShaderType::CS);
+#endif
+	// The memory limited variants ship no SPIR-V and are always compiled from the GLSL, so the binaries cannot drift from it
+	if (bindless) // Only the MEM_50 variant
+		compShader->setShader("resource/Compute/ComputeMemLimitedBindless.glsl", ShaderVulkan::ShaderType::CS);
+	else if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
 	{
-
 		if (hasFlag(shaderMode, ShaderModeBit::MEM_100))
-			compShader->setShader("resource/tmp/ComputeMemLimited100.spv", ShaderVulkan::ShaderType::CS);
+			compShader->setShader("resource/Compute/ComputeMemLimited100.glsl", ShaderVulkan::ShaderType::CS);
 		else if (hasFlag(shaderMode, ShaderModeBit::MEM_75))
-			compShader->setShader("resource/tmp/ComputeMemLimited75.spv", ShaderVulkan::ShaderType::CS);
+			compShader->setShader("resource/Compute/ComputeMemLimited75.glsl", ShaderVulkan::ShaderType::CS);
 		else if (hasFlag(shaderMode, ShaderModeBit::MEM_25))
-			compShader->setShader("resource/tmp/ComputeMemLimited25.spv", ShaderVulkan::ShaderType::CS);
+			compShader->setShader("resource/Compute/ComputeMemLimited25.glsl", ShaderVulkan::ShaderType::CS);
 		else // MEM_50
-			compShader->setShader("resource/tmp/ComputeMemLimited.spv", ShaderVulkan::ShaderType::CS);
-
+			compShader->setShader("resource/Compute/ComputeMemLimited.glsl", ShaderVulkan::ShaderType::CS);
 	}
-	else
-		compShader->setShader("resource/tmp/ComputeRegLimited.spv", ShaderVulkan::ShaderType::CS);
-#endif
 	compShader->compileMaterial(err);
 	compSmallOp->compileMaterial(err);
 
@@ -117,30 +126,40 @@ void ComputeExperiment::initialize(VulkanRenderer *handle)
 		readSampler->setMinFilter(VkFilter::VK_FILTER_NEAREST);
 		readImg = new Texture2DVulkan(_renderHandle, readSampler);
 		readImg->loadFromFile("resource/fatboy.png");
-		readImg->attachBindPoint(2, postLayout[2]);
-	}
-	// Framebuf targets
-	swapChainImgDesc.resize(_renderHandle->getSwapChainLength());
-	VkDescriptorImageInfo imgInfo[5];
-	VkWriteDescriptorSet writeInfo[5];
-	for (size_t i = 0; i < swapChainImgDesc.size(); i++)
-	{
-		imgInfo[i].sampler = NULL;
-		imgInfo[i].imageView = _renderHandle->getSwapChainView(i);
-		imgInfo[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		swapChainImgDesc[i] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, postLayout._desc);
-		writeDescriptorStruct_IMG_STORAGE(writeInfo[i], swapChainImgDesc[i], 0, 0, 1, imgInfo + i);
+		if (!bindless)
+			readImg->attachBindPoint(1, postLayout[1]);
 	}
-	vkUpdateDescriptorSets(_renderHandle->getDevice(), (uint32_t)swapChainImgDesc.size(), writeInfo, 0, nullptr);
-
-
+	// Framebuf target sets are allocated each frame (see frame)
 
+	if (bindless)
+		makeBindless();
 	makeTechnique();
+	buildGraph();
+}
+
+void ComputeExperiment::makeBindless()
+{
+	BindlessTableVulkan *table = _renderHandle->getBindlessTable();
+	readImgIndex = table->addTexture(readImg->imageInfo.imageView, readSampler->_sampler);
+	for (uint32_t i = 0; i < (uint32_t)_renderHandle->getSwapChainLength(); i++)
+	{
+		uint32_t index = table->addStorageImage(_renderHandle->getSwapChainView(i));
+		if (i == 0)
+			swapChainImgIndex = index;
+	}
+	bindlessParams = bindlessLayout.definePushConstant<BindlessIndices>(VK_SHADER_STAGE_COMPUTE_BIT);
+	table->createPipelineLayout(bindlessLayout);
 }
 
 void ComputeExperiment::makeTechnique()
 {
-	techniquePost = new TechniqueVulkan(_renderHandle, compShader, postLayout._layout);
+	// Pipelines are compiled on the workers while the particle buffer is generated
+	TechniqueBuilderVulkan builder(_renderHandle);
+	if (bindless)
+		techniquePost = builder.compute(compShader, bindlessLayout._layout, bindless->getSpecialization());
+	else
+		techniquePost = builder.compute(compShader, postLayout._layout);
+	builder.build();
 	// Gen. particle layout
 	VkDescriptorSetLayoutBinding binding;
 	smallOpLayout = vk::LayoutConstruct(1);
@@ -148,23 +167,18 @@ void ComputeExperiment::makeTechnique()
 	smallOpLayout[0] = createDescriptorLayout(_renderHandle->getDevice(), &binding, 1);
 	smallOpLayout.construct(_renderHandle->getDevice());
 	// Gen. particle buffer
-	struct Particle
-	{
-		float x; glm::vec2 pos, vel;
-	};
 	std::unique_ptr<Particle> arr(new Particle[NUM_PARTICLE]);
 	for (size_t i = 0; i < NUM_PARTICLE; i++)
 		arr.get()[i] = { 0, glm::vec2(cos(i), sin(i)), glm::vec2(-cos(i), -sin(i)) };
 	smallOpBuf = new ConstantBufferVulkan(_renderHandle);
 	smallOpBuf->setData(arr.get(), sizeof(Particle) * NUM_PARTICLE, 0, smallOpLayout[0], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
-	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
-	{
-		postParams = new ConstantDoubleBufferVulkan(_renderHandle);
-		postParams->setData(&locality, sizeof(float), 1, postLayout[1], VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	}
 	// Gen. technique
-	techniqueSmallOp = new TechniqueVulkan(_renderHandle, compSmallOp, smallOpLayout._layout);
+	techniqueSmallOp = builder.compute(compSmallOp, smallOpLayout._layout);
+	builder.build();
+
+	if (mode == Mode::MULTI_THREAD)
+		recorder = new CommandRecorderVulkan(_renderHandle, QueueType::COMPUTE);
 
 
 	const uint32_t NUM_BUFFER = 1;
@@ -184,68 +198,70 @@ void ComputeExperiment::makeTechnique()
 	VkPipelineVertexInputStateCreateInfo vertexBindings =
 		defineVertexBufferBindings(vertexBufferBindings, NUM_BUFFER, vertexAttributes, NUM_ATTRI);
 	//techniqueA = new TechniqueVulkan(_renderHandle, triShader, _renderHandle->getFramePass(), _renderHandle->getFramePassLayout(), vertexBindings);
+	builder.wait();
 }
 void ComputeExperiment::transfer()
 {
+	// Parameters are pushed when the post pass is recorded, nothing is staged on the transfer queue
 	static float counter = 0;
 	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED_ANIMATED))
 	{
 		counter += 0.00025f;
-		float value = locality + std::pow(2.7, std::sin(counter) * 4);
-		postParams->transferData(&value, sizeof(float), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+		postLocality = locality + (float)std::pow(2.7, std::sin(counter) * 4);
 	}
 }
 
-void ComputeExperiment::frame(float dt)
+void ComputeExperiment::buildGraph()
 {
-	// Main render pass
-	VulkanRenderer::FrameInfo info = _renderHandle->beginFramePass();
-	vkCmdSetViewport(info._buf, 0, 1, &_renderHandle->getViewport());
-	/*
-	vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, techniqueA->pipeline);
-
-	VkDeviceSize offsets = 0;
-	triVertexBinding.bind(0);
-	vkCmdDraw(cmdBuf, (uint32_t)triVertexBinding.numElements, 1, 0, 0);
-	// Subpass...
-	//vkCmdNextSubpass(cmdBuf, VK_SUBPASS_CONTENTS_INLINE); // Subpass is inlined in primary command buffer
-
-	*/
-	// Finish
-	_renderHandle->endRenderPass();
-
-	if (hasFlag(shaderMode, ShaderModeBit::GRAPH_QUEUE))
+	graph = new FrameGraph(_renderHandle);
+	switch (mode)
 	{
-		transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE));
-		// Dispatch frame compute shader
-		techniquePost->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
-		// Bind resources
-		vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE, postLayout._layout, 0, 1, &swapChainImgDesc[info._swapChainIndex], 0, nullptr);
-		postParams->bind(info._buf, postLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
-		readImg->bind(info._buf, 2, postLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
-		vkCmdDispatch(info._buf, _renderHandle->getWidth() / 16, _renderHandle->getHeight() / 16, 1);
-		transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	case Mode::SEQUENTIAL:
+		graph->setOverlap(FrameGraph::SEQUENTIAL);
+		break;
+	case Mode::MULTI_QUEUE:
+		graph->setOverlap(FrameGraph::MULTI_QUEUE);
+		break;
+	default:
+		graph->setOverlap(FrameGraph::ASYNC);
+		break;
 	}
+	swapChainImg = graph->importImage(VK_IMAGE_ASPECT_COLOR_BIT, FrameGraph::Access(), QueueType::GRAPHIC, FrameGraph::present(_renderHandle->getPresentLayout()), QueueType::GRAPHIC);
+	particles = graph->importBuffer(smallOpBuf->getBuffer(), QueueType::COMPUTE);
 
-	_renderHandle->submitFramePass();
-
+	// Main render pass
+	graph->addPass("render", QueueType::GRAPHIC, [this](const VulkanRenderer::FrameInfo &info)
+	{
+		_renderHandle->beginRenderPass(info._buf);
+		vkCmdSetViewport(info._buf, 0, 1, &_renderHandle->getViewport());
+		_renderHandle->endRenderPass();
+	}).write(swapChainImg, FrameGraph::colorAttachment(_renderHandle->getPresentLayout()));
+	if (hasFlag(shaderMode, ShaderModeBit::BLIT_CHAIN))
+		addBlitChain();
 
 	// Post pass
-	info = _renderHandle->beginCompute();
-	if (!hasFlag(shaderMode, ShaderModeBit::GRAPH_QUEUE))
+	QueueType postQueue = hasFlag(shaderMode, ShaderModeBit::GRAPH_QUEUE) ? QueueType::GRAPHIC : QueueType::COMPUTE;
+	graph->addPass("post", postQueue, [this](const VulkanRenderer::FrameInfo &info)
 	{
-		transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE));
-
-		// Dispatch frame compute shader
-		techniquePost->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
-		// Bind resources
-		vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE, postLayout._layout, 0, 1, &swapChainImgDesc[info._swapChainIndex], 0, nullptr);
-		if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
+		if (mode == Mode::MULTI_THREAD)
 		{
-			postParams->bind(info._buf, postLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
-			readImg->bind(info._buf, 2, postLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+			// A row of tiles per job, each secondary buffer binds its own state
+			uint32_t swapChainIndex = info._swapChainIndex;
+			uint32_t tilesX = _renderHandle->getWidth() / (16 * 8);
+			recorder->begin();
+			for (uint32_t y = 0; y < _renderHandle->getHeight() / (16 * 8); y++)
+			{
+				recorder->addJob([this, swapChainIndex, tilesX](VkCommandBuffer cmdBuf)
+				{
+					bindPost(cmdBuf, swapChainIndex);
+					for (uint32_t x = 0; x < tilesX; x++)
+						vkCmdDispatch(cmdBuf, 8, 8, 1);
+				});
+			}
+			recorder->execute(info._buf);
+			return;
 		}
-		// Dispatch
+		bindPost(info._buf, info._swapChainIndex);
 		if (mode == Mode::MULTI_DISPATCH)
 		{
 			for (uint32_t y = 0; y < _renderHandle->getHeight() / (16 * 8); y++)
@@ -256,61 +272,141 @@ void ComputeExperiment::frame(float dt)
 		}
 		else
 			vkCmdDispatch(info._buf, _renderHandle->getWidth() / 16, _renderHandle->getHeight() / 16, 1);
-		if (mode == Mode::MULTI_QUEUE)
+	}).write(swapChainImg, FrameGraph::storageImage(true));
+
+	// Particle pass, independent of the frame passes
+	graph->addPass("smallOp", QueueType::COMPUTE, [this](const VulkanRenderer::FrameInfo &info)
+	{
+		if (mode == Mode::MULTI_THREAD)
 		{
-			transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
-			_renderHandle->submitCompute(0, true);
-			info = _renderHandle->beginCompute(1);
+			// Split the dispatches evenly over the workers
+			uint32_t numDispatch = NUM_PARTICLE / (256 * 64);
+			uint32_t numJobs = std::min(numDispatch, _renderHandle->getWorkers().size());
+			recorder->begin();
+			for (uint32_t job = 0; job < numJobs; job++)
+			{
+				uint32_t count = numDispatch / numJobs + (job < numDispatch % numJobs ? 1 : 0);
+				recorder->addJob([this, count](VkCommandBuffer cmdBuf)
+				{
+					techniqueSmallOp->bind(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE);
+					smallOpBuf->bind(cmdBuf, smallOpLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+					for (uint32_t i = 0; i < count; i++)
+						vkCmdDispatch(cmdBuf, 64, 1, 1);
+				});
+			}
+			recorder->execute(info._buf);
+			return;
 		}
-		else if (mode == Mode::SEQUENTIAL)
-			serializeCommandBuffer(info._buf);
-	}
+		techniqueSmallOp->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
+		smallOpBuf->bind(info._buf, smallOpLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+		if (mode == Mode::MULTI_DISPATCH)
+		{
+			for (uint32_t i = 0; i < NUM_PARTICLE / (256 * 64); i++)
+				vkCmdDispatch(info._buf, 64, 1, 1);
+		}
+		else
+			vkCmdDispatch(info._buf, NUM_PARTICLE / 256, 1, 1);
+	}).write(particles, FrameGraph::storageBuffer(true));
+
+	graph->compile();
+	VkDeviceSize allocated, required;
+	graph->getTransientMemory(allocated, required);
+	if (required > 0)
+		std::cout << "Frame graph transients: " << allocated / 1024 << " KB allocated, " << required / 1024 << " KB without aliasing\n";
+}
 
-	
-	// Dispatch compute operation
-	techniqueSmallOp->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
-	smallOpBuf->bind(info._buf, smallOpLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+void ComputeExperiment::addBlitChain()
+{
+	// The first half sized image is released after the quarter blit, the second one is placed in its memory.
+	uint32_t width = _renderHandle->getWidth(), height = _renderHandle->getHeight();
+	FrameGraph::ImageDesc desc = { width / 2, height / 2, _renderHandle->getSwapchainFormat().format,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+	FrameGraph::Resource half = graph->createImage(desc);
+	FrameGraph::Resource halfUp = graph->createImage(desc);
+	desc._width /= 2;
+	desc._height /= 2;
+	FrameGraph::Resource quarter = graph->createImage(desc);
+
+	auto blit = [this](FrameGraph::Resource src, FrameGraph::Resource dst, uint32_t srcDiv, uint32_t dstDiv)
+	{
+		return [this, src, dst, srcDiv, dstDiv](const VulkanRenderer::FrameInfo &info)
+		{
+			VkImageBlit region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.srcOffsets[1] = { (int32_t)(_renderHandle->getWidth() / srcDiv), (int32_t)(_renderHandle->getHeight() / srcDiv), 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.dstOffsets[1] = { (int32_t)(_renderHandle->getWidth() / dstDiv), (int32_t)(_renderHandle->getHeight() / dstDiv), 1 };
+			vkCmdBlitImage(info._buf, graph->getImage(src), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph->getImage(dst), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+		};
+	};
+	graph->addPass("blitHalf", QueueType::GRAPHIC, blit(swapChainImg, half, 1, 2))
+		.read(swapChainImg, FrameGraph::transferSrc()).write(half, FrameGraph::transferDst());
+	graph->addPass("blitQuarter", QueueType::GRAPHIC, blit(half, quarter, 2, 4))
+		.read(half, FrameGraph::transferSrc()).write(quarter, FrameGraph::transferDst());
+	graph->addPass("blitHalfUp", QueueType::GRAPHIC, blit(quarter, halfUp, 4, 2))
+		.read(quarter, FrameGraph::transferSrc()).write(halfUp, FrameGraph::transferDst());
+	graph->addPass("blitFrame", QueueType::GRAPHIC, blit(halfUp, swapChainImg, 2, 1))
+		.read(halfUp, FrameGraph::transferSrc()).write(swapChainImg, FrameGraph::transferDst());
+}
 
-	if (mode == Mode::MULTI_DISPATCH)
+void ComputeExperiment::frame(float dt)
+{
+	// Barriers, queue ownership transfers and submissions are inferred by the graph
+	uint32_t swapChainIndex = _renderHandle->getSwapChainIndex();
+	if (!bindless)
 	{
-		for (uint32_t i = 0; i < NUM_PARTICLE / (256 * 64); i++)
-			vkCmdDispatch(info._buf, 64, 1, 1);
+		// Frame image set from the frame arena, released with the arena when the frame context is re-used
+		frameImgDesc = _renderHandle->generateFrameDescriptor(postLayout[0]);
+		VkDescriptorImageInfo imageInfo = { VK_NULL_HANDLE, _renderHandle->getSwapChainView(swapChainIndex), VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet write = {};
+		writeDescriptorStruct_IMG_STORAGE(write, frameImgDesc, 0, 0, 1, &imageInfo);
+		vkUpdateDescriptorSets(_renderHandle->getDevice(), 1, &write, 0, nullptr);
 	}
-	else
-		vkCmdDispatch(info._buf, NUM_PARTICLE / 256, 1, 1);
+	graph->setImage(swapChainImg, _renderHandle->getSwapChainImg(swapChainIndex), _renderHandle->getSwapChainView(swapChainIndex));
+	graph->execute();
+
+	_renderHandle->present();
+}
 
-	//Transition frame buf back
-	if (!hasFlag(shaderMode, ShaderModeBit::GRAPH_QUEUE) && mode == Mode::MULTI_QUEUE)
+void ComputeExperiment::bindPost(VkCommandBuffer cmdBuf, uint32_t swapChainIndex)
+{
+	// Dispatch frame compute shader
+	techniquePost->bind(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE);
+	if (bindless)
 	{
-		_renderHandle->submitCompute(1, false);
+		// Single table bind, the resources are selected by index
+		bindless->bind(cmdBuf, bindlessLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+		techniquePost->push(cmdBuf, bindlessParams, { swapChainImgIndex + swapChainIndex, readImgIndex, postLocality });
+		return;
 	}
-	else
+	// Bind resources
+	vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, postLayout._layout, 0, 1, &frameImgDesc, 0, nullptr);
+	if (hasFlag(shaderMode, ShaderModeBit::MEM_LIMITED))
 	{
-
-		if (!hasFlag(shaderMode, ShaderModeBit::GRAPH_QUEUE))
-		{
-			transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
-			_renderHandle->submitCompute(0, true);
-		}
-		else
-			_renderHandle->submitCompute(0, false);
+		techniquePost->push(cmdBuf, postParams, { postLocality });
+		readImg->bind(cmdBuf, 1, postLayout._layout, VK_PIPELINE_BIND_POINT_COMPUTE);
 	}
-	
-	_renderHandle->present();
 }
 
-
 void ComputeExperiment::defineDescriptorLayout(VkDevice device, std::vector<VkDescriptorSetLayout> &layout)
 {
 	layout.resize(0);
 }
 
+void ComputeExperiment::defineMemoryPools(std::vector<size_t> &chunkSizes)
+{
+	// The particles are uploaded in a single transfer, the buffer reserves twice the data
+	size_t particleBytes = sizeof(Particle) * NUM_PARTICLE;
+	chunkSizes[MemoryPool::STAGING_BUFFER] = std::max(chunkSizes[MemoryPool::STAGING_BUFFER], particleBytes + 1024 * 1024);
+	chunkSizes[MemoryPool::UNIFORM_BUFFER] = std::max(chunkSizes[MemoryPool::UNIFORM_BUFFER], 2 * particleBytes + 1024 * 1024);
+}
+
 
 VkRenderPass ComputeExperiment::defineRenderPass(VkDevice device, VkFormat swapchainFormat, VkFormat depthFormat, std::vector<VkImageView>& additionalAttatchments)
 {
 	const int num_attach = 2;
 	VkAttachmentDescription attach[num_attach] = {
-		defineFramebufColor(swapchainFormat),
+		defineFramebufColor(swapchainFormat, _renderHandle->getPresentLayout()),
 		defineFramebufDepth(depthFormat)
 	};
 	// Referenced renderbuffer target
@@ -2,6 +2,7 @@
 #include "VulkanRenderer.h"
 #include "Stuff/RandomGenerator.h"
 #include "VulkanConstruct.h"
+#include "TechniqueBuilderVulkan.h"
 
 ComputeScene::ComputeScene(Mode mode)
 	: mode(mode)
@@ -11,6 +12,7 @@ ComputeScene::ComputeScene(Mode mode)
 
 ComputeScene::~ComputeScene()
 {
+	delete blurBuilder;
 	delete techniqueA;
 	delete triShader;
 	delete triBuffer;
@@ -81,22 +83,17 @@ void ComputeScene::initialize(VulkanRenderer *handle)
 	readSampler->setMagFilter(VkFilter::VK_FILTER_NEAREST);
 	readSampler->setMinFilter(VkFilter::VK_FILTER_NEAREST);
 	readImg = new Texture2DVulkan(_renderHandle, readSampler);
-	readImg->loadFromFile("resource/fatboy.png");
+	// Streamed in while rendering, the post pass starts once it is resident
+	readImg->loadFromFileAsync("resource/fatboy.png", QueueType::COMPUTE);
 	readImg->attachBindPoint(1, postLayout[1]);
 
 	// Frame buffer image bindings
 	swapChainImgDesc.resize(_renderHandle->getSwapChainLength());
-	VkDescriptorImageInfo imgInfo[5];
-	VkWriteDescriptorSet writeInfo[5];
 	for (size_t i = 0; i < swapChainImgDesc.size(); i++)
 	{
-		imgInfo[i].sampler = NULL;
-		imgInfo[i].imageView = _renderHandle->getSwapChainView(i);
-		imgInfo[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		swapChainImgDesc[i] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, postLayout._desc);
-		writeDescriptorStruct_IMG_STORAGE(writeInfo[i], swapChainImgDesc[i], 0, 0, 1, imgInfo + i);
+		swapChainImgDesc[i] = _renderHandle->getDescriptorCache().get(postLayout[0],
+			DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _renderHandle->getSwapChainView((uint32_t)i), VK_IMAGE_LAYOUT_GENERAL));
 	}
-	vkUpdateDescriptorSets(_renderHandle->getDevice(), (uint32_t)swapChainImgDesc.size(), writeInfo, 0, nullptr);
 
 	makeTechnique();
 }
@@ -104,9 +101,15 @@ void ComputeScene::initialize(VulkanRenderer *handle)
 void ComputeScene::makeTechnique()
 {
 
-	techniquePost = new TechniqueVulkan(_renderHandle, compShader, postLayout._layout);
-	techniqueBlurHorizontal = new TechniqueVulkan(_renderHandle, blurHorizontal, postLayout._layout);
-	techniqueBlurVertical = new TechniqueVulkan(_renderHandle, blurVertical, postLayout._layout);
+	TechniqueBuilderVulkan builder(_renderHandle);
+	techniquePost = builder.compute(compShader, postLayout._layout);
+	// Not waited on, the blur passes repeat the copy (unblurred frame) until their pipelines are ready
+	blurBuilder = new TechniqueBuilderVulkan(_renderHandle);
+	techniqueBlurHorizontal = blurBuilder->compute(blurHorizontal, postLayout._layout);
+	techniqueBlurVertical = blurBuilder->compute(blurVertical, postLayout._layout);
+	techniqueBlurHorizontal->setFallback(techniquePost);
+	techniqueBlurVertical->setFallback(techniquePost);
+	blurBuilder->build();
 
 	const uint32_t NUM_BUFFER = 1;
 	const uint32_t NUM_ATTRI = 1;
@@ -124,7 +127,8 @@ void ComputeScene::makeTechnique()
 	};
 	VkPipelineVertexInputStateCreateInfo vertexBindings =
 		defineVertexBufferBindings(vertexBufferBindings, NUM_BUFFER, vertexAttributes, NUM_ATTRI);
-	techniqueA = new TechniqueVulkan(_renderHandle, triShader, _renderHandle->getFramePass(), _renderHandle->getFramePassLayout(), vertexBindings);
+	techniqueA = builder.graphics(triShader, _renderHandle->getFramePass(), _renderHandle->getFramePassLayout(), vertexBindings);
+	builder.wait();
 }
 
 
@@ -155,8 +159,10 @@ void ComputeScene::mainPass()
 void ComputeScene::post(VulkanRenderer::FrameInfo info)
 {
 	// Post pass
-	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE));
+	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getPresentLayout());
 
+	if (!readImg->isResident())
+		return;
 	// Bind compute shader
 	techniquePost->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
 	// Bind resources
@@ -169,6 +175,9 @@ void ComputeScene::post(VulkanRenderer::FrameInfo info)
 
 void ComputeScene::postBlur(VulkanRenderer::FrameInfo info)
 {
+	// The copy fallback reads the streamed image
+	if (!readImg->isResident())
+		return;
 
 	// Bind compute shader
 	techniqueBlurHorizontal->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
@@ -198,7 +207,7 @@ void ComputeScene::frame(float dt)
 		postBlur(info);
 
 	// Finish
-	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getPresentLayout());
 	_renderHandle->submitCompute();
 	_renderHandle->present();
 }
@@ -215,7 +224,7 @@ VkRenderPass ComputeScene::defineRenderPass(VkDevice device, VkFormat swapchainF
 {
 	const int num_attach = 2;
 	VkAttachmentDescription attach[num_attach] = {
-		defineFramebufColor(swapchainFormat),
+		defineFramebufColor(swapchainFormat, _renderHandle->getPresentLayout()),
 		defineFramebufDepth(depthFormat)
 	};
 	// Referenced renderbuffer target
@@ -2,15 +2,27 @@
 #include "VulkanRenderer.h"
 #include "Stuff/RandomGenerator.h"
 #include "VertexBufferVulkan.h"
+#include "TechniqueBuilderVulkan.h"
+#include "Stuff/Clusters.h"
 
 #include "glm\gtc\matrix_transform.hpp"
+#include "glm\gtc\type_ptr.hpp"
 #define OBJ_READER_SIMPLE
 #include "Stuff/ObjReaderSimple.h"
 
-ShadowScene::ShadowScene(FrameType frameType)
+ShadowScene::ShadowScene(FrameType frameType, bool packedVertices)
+	: ShadowScene(frameType, packedVertices, NO_CULLING)
+{
+}
+
+ShadowScene::ShadowScene(FrameType frameType, bool packedVertices, Culling culling, Geometry geometry)
 {
 	this->frameType = frameType;
+	this->packedVertices = packedVertices;
+	this->culling = culling;
+	this->geometry = geometry;
 	firstFrame = true;
+	cameraTime = 0.0f;
 }
 
 ShadowScene::~ShadowScene()
@@ -21,6 +33,8 @@ ShadowScene::~ShadowScene()
 
 	delete positionBuffer;
 	delete normalBuffer;
+	delete indexBuffer;
+	delete culler;
 
 	delete shadowMapSampler;
 	delete shadowMap;
@@ -30,8 +44,11 @@ ShadowScene::~ShadowScene()
 
 	delete renderPassTechnique;
 	delete renderPassShaders;
+	delete recorder;
 	VkDevice dev = _renderHandle->getDevice();
 
+	for (size_t i = 0; i < depthFence.size(); i++)
+		vkDestroyFence(dev, depthFence[i], nullptr);
 	vkDestroyFramebuffer(dev, shadowFramebuffer, nullptr);
 	vkDestroyRenderPass(dev, shadowRenderPass, nullptr);
 	vkDestroyDescriptorPool(_renderHandle->getDevice(), desciptorPool, nullptr);
@@ -60,84 +77,67 @@ void ShadowScene::initialize(VulkanRenderer* handle)
 	shadowMappingMatrix = lightMatrix;
 	lightInfo.clipSpaceToShadowMapMatrix = lightMatrix;
 
-	// Create vertex buffer
-	if (true)
-	{
-		// Create triangles
-		const uint32_t TRIANGLE_COUNT = 1000000;
-		glm::vec4* vertexPositions = new glm::vec4[TRIANGLE_COUNT * 3];
-		glm::vec3* vertexNormals = new glm::vec3[TRIANGLE_COUNT * 3];
-
-		/*glm::vec4 vertexPositions[TRIANGLE_COUNT * 3];
-		glm::vec3 vertexNormals[TRIANGLE_COUNT * 3];*/
-
-		mf::RandomGenerator randomGenerator;
-		randomGenerator.seedGenerator();
-		//randomGenerator.setSeed({ 2 });
-		mf::distributeTriangles(randomGenerator, 2.0f, TRIANGLE_COUNT, glm::vec2(0.6f, 0.8f), vertexPositions, vertexNormals);
-
-		//Create buffers
-		positionBuffer = new VertexBufferVulkan(handle, TRIANGLE_COUNT * 3 * sizeof(glm::vec4), VertexBufferVulkan::DATA_USAGE::STATIC);
-		positionBufferBinding = VertexBufferVulkan::Binding(positionBuffer, sizeof(glm::vec4), TRIANGLE_COUNT * 3, 0);
-		normalBuffer = new VertexBufferVulkan(handle, TRIANGLE_COUNT * 3 * sizeof(glm::vec3), VertexBufferVulkan::DATA_USAGE::STATIC);
-		normalBufferBinding = VertexBufferVulkan::Binding(normalBuffer, sizeof(glm::vec3), TRIANGLE_COUNT * 3, 0);
-
-		positionBuffer->setData(vertexPositions, positionBufferBinding);
-		normalBuffer->setData(vertexNormals, normalBufferBinding);
-	}
-	else
-	{
-		SimpleMesh mesh, baked;
-		if (readObj("resource/cowparty.obj", mesh))
-			std::cout << "Obj read successfull\n";
-		mesh.bake(SimpleMesh::BitFlag::NORMAL_BIT | SimpleMesh::TRIANGLE_ARRAY | SimpleMesh::POS_4_COMPONENT, baked);
-
-		size_t num_tri = baked._position.size() / 4;
-		positionBuffer = new VertexBufferVulkan(handle, num_tri * sizeof(glm::vec4), VertexBufferVulkan::DATA_USAGE::STATIC);
-		positionBufferBinding = VertexBufferVulkan::Binding(positionBuffer, sizeof(glm::vec4), num_tri, 0);
-		normalBuffer = new VertexBufferVulkan(handle, num_tri * sizeof(glm::vec3), VertexBufferVulkan::DATA_USAGE::STATIC);
-		normalBufferBinding = VertexBufferVulkan::Binding(normalBuffer, sizeof(glm::vec3), num_tri, 0);
-
-		positionBuffer->setData(baked._position.data(), positionBufferBinding);
-		normalBuffer->setData(baked._normal.data(), normalBufferBinding);
-	}
+	createGeometry();
 
 	// Create shaders
 	depthPassShaders = new ShaderVulkan("depthPassShaders", handle);
 	renderPassShaders = new ShaderVulkan("renderPassShaders", handle);
+	// Packed vertices are decoded in the vertex shaders
+	std::string packed = packedVertices ? "Packed" : "";
+	// The depth pass and the packed vertex shader ship no SPIR-V, they are always compiled from the GLSL
+	depthPassShaders->setShader("resource/Shadow/depthPass/ShadowPassVertexShader" + packed + ".glsl", ShaderVulkan::ShaderType::VS);
 #ifdef COMPILE
-	depthPassShaders->setShader("resource/Shadow/depthPass/ShadowPassVertexShader.glsl", ShaderVulkan::ShaderType::VS);
 	renderPassShaders->setShader("resource/Shadow/renderPass/VertexShader.glsl", ShaderVulkan::ShaderType::VS);
 	renderPassShaders->setShader("resource/Shadow/renderPass/FragmentShader.glsl", ShaderVulkan::ShaderType::PS);
 #else
-	depthPassShaders->setShader("resource/tmp/ShadowPassVertexShader.spv", ShaderVulkan::ShaderType::VS);
 	renderPassShaders->setShader("resource/tmp/VertexShader.spv", ShaderVulkan::ShaderType::VS);
 	renderPassShaders->setShader("resource/tmp/FragmentShader.spv", ShaderVulkan::ShaderType::PS);
 #endif
+	if (packedVertices)
+		renderPassShaders->setShader("resource/Shadow/renderPass/VertexShaderPacked.glsl", ShaderVulkan::ShaderType::VS);
 	std::string err;
 	depthPassShaders->compileMaterial(err);
 	renderPassShaders->compileMaterial(err);
 
 	shadowMap->attachBindPoint(1, _renderHandle->getDescriptorSetLayout(1));
 
-	// Create techniques
-	const uint32_t BUFFER_COUNT = 2;
-	const uint32_t ATTRIBUTE_COUNT = 2;
-	VkVertexInputBindingDescription vertexBufferBindings[BUFFER_COUNT] =
-	{
-		defineVertexBinding(0, 16),
-		defineVertexBinding(1, 12)
-	};
-	VkVertexInputAttributeDescription vertexAttributes[ATTRIBUTE_COUNT] =
+	// Vertex streams
+	vertexLayout.setStream(VertexLayoutVulkan::POSITION, &positionBufferBinding,
+		{ { 0, packedVertices ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32A32_SFLOAT, 0 } });
+	vertexLayout.setStream(VertexLayoutVulkan::SHADING, &normalBufferBinding,
+		{ { 1, packedVertices ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT, 0 } });
+
+	// Create techniques, pipelines are compiled on the workers while the remaining resources are created
+	TechniqueBuilderVulkan builder(_renderHandle);
+	// Cone culled meshlets only skip back faces, the projections flip y so front faces stay counter clockwise
+	if (culling == MESHLET_CULLING)
+		builder.setCullMode(VK_CULL_MODE_BACK_BIT);
+	renderPassTechnique = builder.graphics(renderPassShaders, _renderHandle->getFramePass(), _renderHandle->getFramePassLayout(), vertexLayout, VertexLayoutVulkan::ALL_STREAMS);
+	depthPassTechnique = builder.graphics(depthPassShaders, shadowRenderPass, shadowPipeLayout._layout, vertexLayout, VertexLayoutVulkan::POSITION_BIT);
+	if (culling == GPU_CULLING || culling == MESHLET_CULLING)
 	{
-		defineVertexAttribute(0, 0, VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT, 0),
-		defineVertexAttribute(1, 1, VkFormat::VK_FORMAT_R32G32B32_SFLOAT, 0)
-	};
-	VkPipelineVertexInputStateCreateInfo vertexBindings =
-		defineVertexBufferBindings(vertexBufferBindings, BUFFER_COUNT, vertexAttributes, ATTRIBUTE_COUNT);
-
-	renderPassTechnique = new TechniqueVulkan(_renderHandle, renderPassShaders, _renderHandle->getFramePass(), _renderHandle->getFramePassLayout(), vertexBindings);
-	depthPassTechnique = new TechniqueVulkan(_renderHandle, depthPassShaders, shadowRenderPass, shadowPipeLayout._layout, vertexBindings);
+		// Recorder jobs draw ranges of the clusters, which requires a command slot per cluster
+		culler = new ClusterCullVulkan(_renderHandle);
+		culler->setFrustum(ClusterCullVulkan::CAMERA, transformMatrix);
+		culler->setFrustum(ClusterCullVulkan::LIGHT, shadowMappingMatrix);
+		culler->init(clusters, indexBuffer != nullptr, frameType != MULTI_THREADED, builder);
+		std::cout << "Cluster culling, " << culler->getClusterCount() << " clusters" << (culler->isCompact() ? " (compacted draws)" : "") << "\n";
+		// Triangles submitted from the initial views against the full draw
+		uint32_t submitted[ClusterCullVulkan::VIEW_COUNT] = {};
+		for (const ClusterCullVulkan::Cluster &cluster : clusters)
+		{
+			for (uint32_t view = 0; view < ClusterCullVulkan::VIEW_COUNT; view++)
+				if (culler->isVisible((ClusterCullVulkan::View)view, cluster))
+					submitted[view] += cluster._count / 3;
+		}
+		std::cout << "Triangles submitted, camera " << submitted[ClusterCullVulkan::CAMERA] << ", light " << submitted[ClusterCullVulkan::LIGHT]
+			<< " of " << geometrySize() / 3 << "\n";
+	}
+	else if (culling == CPU_CULLING)
+		std::cout << "CPU culling, " << cullBounds.size() << " boxes\n";
+	builder.build();
+	std::cout << "Vertex fetch, depth pass " << vertexLayout.vertexSize(VertexLayoutVulkan::POSITION_BIT) << " bytes, render pass "
+		<< vertexLayout.vertexSize(VertexLayoutVulkan::ALL_STREAMS) << " bytes\n";
 
 	// Define viewport
 	shadowMapViewport.x = 0;
@@ -176,29 +176,27 @@ void ShadowScene::initialize(VulkanRenderer* handle)
 	blurVertical->compileMaterial(err);
 
 	// Gen techniques
-	techniqueBlurHorizontal = new TechniqueVulkan(_renderHandle, blurHorizontal, postLayout._layout);
-	techniqueBlurVertical = new TechniqueVulkan(_renderHandle, blurVertical, postLayout._layout);
+	techniqueBlurHorizontal = builder.compute(blurHorizontal, postLayout._layout);
+	techniqueBlurVertical = builder.compute(blurVertical, postLayout._layout);
+	builder.build();
 
 	// Frame buffer image bindings
 	swapChainImgDesc.resize(_renderHandle->getSwapChainLength());
-	VkDescriptorImageInfo imgInfo[5];
-	VkWriteDescriptorSet writeInfo[5];
 	for (size_t i = 0; i < swapChainImgDesc.size(); i++)
 	{
-		imgInfo[i].sampler = NULL;
-		imgInfo[i].imageView = _renderHandle->getSwapChainView(i);
-		imgInfo[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		swapChainImgDesc[i] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, postLayout._desc);
-		writeDescriptorStruct_IMG_STORAGE(writeInfo[i], swapChainImgDesc[i], 0, 0, 1, imgInfo + i);
+		swapChainImgDesc[i] = _renderHandle->getDescriptorCache().get(postLayout[0],
+			DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _renderHandle->getSwapChainView((uint32_t)i), VK_IMAGE_LAYOUT_GENERAL));
 	}
-	vkUpdateDescriptorSets(_renderHandle->getDevice(), (uint32_t)swapChainImgDesc.size(), writeInfo, 0, nullptr);
 
 	VkDevice device = _renderHandle->getDevice();
 
-	depthCommandBuf[0] = allocateCmdBuf(device, _renderHandle->queues[QueueType::GRAPHIC].pool);
-	depthCommandBuf[1] = allocateCmdBuf(device, _renderHandle->queues[QueueType::GRAPHIC].pool);
-	depthFence[0] = createFence(device, true);
-	depthFence[1] = createFence(device, true);
+	depthCommandBuf.resize(_renderHandle->getFrameCount());
+	depthFence.resize(_renderHandle->getFrameCount());
+	for (size_t i = 0; i < depthCommandBuf.size(); i++)
+	{
+		depthCommandBuf[i] = allocateCmdBuf(device, _renderHandle->queues[QueueType::GRAPHIC].pool);
+		depthFence[i] = createFence(device, true);
+	}
 
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -206,13 +204,25 @@ void ShadowScene::initialize(VulkanRenderer* handle)
 	semaphoreCreateInfo.flags = 0;
 
 	vkCreateSemaphore(_renderHandle->getDevice(), &semaphoreCreateInfo, nullptr, &colorPassCompleteSemaphore);
+
+	if (frameType == MULTI_THREADED)
+		recorder = new CommandRecorderVulkan(_renderHandle, QueueType::GRAPHIC);
+
+	builder.wait();
 }
 
 void ShadowScene::transfer()
 {
 
 	lightInfoBuffer->transferData(&lightInfo, sizeof(lightInfo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	transformMatrixBuffer->transferData(&transformMatrix, sizeof(glm::mat4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	VertexTransform transform = vertexTransform(transformMatrix);
+	transformMatrixBuffer->transferData(&transform, sizeof(VertexTransform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	if (culler)
+	{
+		culler->setFrustum(ClusterCullVulkan::CAMERA, transformMatrix);
+		culler->setFrustum(ClusterCullVulkan::LIGHT, shadowMappingMatrix);
+		culler->transfer();
+	}
 }
 
 void ShadowScene::frame(float dt)
@@ -222,6 +232,9 @@ void ShadowScene::frame(float dt)
 	case STANDARD:
 		frame_standard(dt);
 		break;
+	case MULTI_THREADED:
+		frame_multithreaded(dt);
+		break;
 	case SINGLE_COMMAND_BUFFER:
 		frame_single_cmdbuf(dt);
 		break;
@@ -233,9 +246,8 @@ void ShadowScene::frame(float dt)
 
 void ShadowScene::frame_standard(float dt)
 {
-	static float counter = 0.0f;
-	counter += dt;
-	createCameraMatrix(counter);
+	cameraTime += dt;
+	createCameraMatrix(cameraTime);
 
 	VulkanRenderer::FrameInfo info = _renderHandle->beginCommandBuffer();
 
@@ -254,6 +266,7 @@ void ShadowScene::frame_standard(float dt)
 	renderPassInfo.pClearValues = &clearValue;
 	VkRect2D scissor;
 
+	cullViews(info._buf, 0, ClusterCullVulkan::VIEW_COUNT);
 	vkCmdBeginRenderPass(info._buf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 	vkCmdBindPipeline(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPassTechnique->pipeline);
@@ -261,12 +274,11 @@ void ShadowScene::frame_standard(float dt)
 	scissor.offset = { 0, 0 };
 	scissor.extent = { shadowMapSize, shadowMapSize };
 	vkCmdSetScissor(info._buf, 0, 1, &scissor);
-	shadowMappingMatrixBuffer->bind(info._buf, _renderHandle->getFramePassLayout());
+	shadowMappingMatrixBuffer->bind(info._buf, shadowPipeLayout._layout);
 	//vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeLayout._layout, 0, 1, &shadowPassDescriptorSet, 0, nullptr);
 
-	positionBufferBinding.bind(info._buf, 0);
-	normalBufferBinding.bind(info._buf, 1);
-	vkCmdDraw(info._buf, positionBufferBinding.numElements, 1, 0, 0);
+	bindVertexStreams(info._buf, depthPassTechnique);
+	drawView(info._buf, ClusterCullVulkan::LIGHT);
 	vkCmdEndRenderPass(info._buf);
 
 	// Image barrier transferring image layout
@@ -286,7 +298,8 @@ void ShadowScene::frame_standard(float dt)
 	transformMatrixBuffer->bind(info._buf, _renderHandle->getFramePassLayout());
 	//vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _renderHandle->getFramePassLayout(), 1, 1, &renderPassDescriptorSet, 0, nullptr);
 
-	vkCmdDraw(info._buf, positionBufferBinding.numElements, 1, 0, 0);
+	bindVertexStreams(info._buf, renderPassTechnique);
+	drawView(info._buf, ClusterCullVulkan::CAMERA);
 
 	_renderHandle->endRenderPass();
 	// Submit
@@ -295,13 +308,195 @@ void ShadowScene::frame_standard(float dt)
 	post_standard();
 
 	_renderHandle->present();
+}
+
+void ShadowScene::frame_multithreaded(float dt)
+{
+	cameraTime += dt;
+	createCameraMatrix(cameraTime);
+
+	VulkanRenderer::FrameInfo info = _renderHandle->beginCommandBuffer();
+
+	// Shadow map pass
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = shadowRenderPass;
+	renderPassInfo.framebuffer = shadowFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent.height = shadowMapSize;
+	renderPassInfo.renderArea.extent.width = shadowMapSize;
+	// Clear params
+	VkClearValue clearValue;
+	clearValue.depthStencil = { 1.0f, 0 };
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
+
+	cullViews(info._buf, 0, ClusterCullVulkan::VIEW_COUNT);
+	vkCmdBeginRenderPass(info._buf, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	recorder->begin(shadowRenderPass, shadowFramebuffer);
+	addDrawJobs(ClusterCullVulkan::LIGHT, depthPassTechnique, [this](VkCommandBuffer cmdBuf)
+	{
+		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPassTechnique->pipeline);
+		vkCmdSetViewport(cmdBuf, 0, 1, &shadowMapViewport);
+		VkRect2D scissor;
+		scissor.offset = { 0, 0 };
+		scissor.extent = { shadowMapSize, shadowMapSize };
+		vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+		shadowMappingMatrixBuffer->bind(cmdBuf, shadowPipeLayout._layout);
+	});
+	recorder->execute(info._buf);
+	vkCmdEndRenderPass(info._buf);
+
+	// Image barrier transferring image layout
+	transition_DepthRead(info._buf, shadowMap->_imageHandle);
+
+	// Rendering pass
+	_renderHandle->beginRenderPass(info._buf, NULL, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	recorder->begin(_renderHandle->getFramePass());
+	addDrawJobs(ClusterCullVulkan::CAMERA, renderPassTechnique, [this](VkCommandBuffer cmdBuf)
+	{
+		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, renderPassTechnique->pipeline);
+		vkCmdSetViewport(cmdBuf, 0, 1, &_renderHandle->getViewport());
+		VkRect2D scissor;
+		scissor.offset = { 0, 0 };
+		scissor.extent = { _renderHandle->getWidth(), _renderHandle->getHeight() };
+		vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+		lightInfoBuffer->bind(cmdBuf, _renderHandle->getFramePassLayout(), VK_PIPELINE_BIND_POINT_GRAPHICS);
+		shadowMap->bind(cmdBuf, 1, _renderHandle->getFramePassLayout());
+		transformMatrixBuffer->bind(cmdBuf, _renderHandle->getFramePassLayout());
+	});
+	recorder->execute(info._buf);
+	_renderHandle->endRenderPass();
+	// Submit
+	_renderHandle->submitFramePass();
+
+	post_standard();
+
+	_renderHandle->present();
+}
+
+void ShadowScene::bindVertexStreams(VkCommandBuffer cmdBuf, TechniqueVulkan *technique)
+{
+	vertexLayout.bind(cmdBuf, technique->getVertexStreams());
+	if (indexBuffer)
+		indexBufferBinding.bind(cmdBuf);
+}
+
+void ShadowScene::drawGeometry(VkCommandBuffer cmdBuf, uint32_t first, uint32_t count)
+{
+	if (indexBuffer)
+		vkCmdDrawIndexed(cmdBuf, count, 1, first, 0, 0);
+	else
+		vkCmdDraw(cmdBuf, count, 1, first, 0);
+}
+
+uint32_t ShadowScene::geometrySize()
+{
+	return indexBuffer ? indexBufferBinding.numIndices : positionBufferBinding.numElements;
+}
+
+void ShadowScene::addDrawJobs(ClusterCullVulkan::View view, TechniqueVulkan *technique, const std::function<void(VkCommandBuffer)> &bindState)
+{
+	// Split the triangles (or the clusters, or the visible ranges) evenly over the workers
+	uint32_t numItems = culler ? culler->getClusterCount() : culling == CPU_CULLING ? (uint32_t)drawList[view].size() : geometrySize() / 3;
+	uint32_t numJobs = std::max(1u, std::min(numItems, _renderHandle->getWorkers().size()));
+	for (uint32_t job = 0; job < numJobs; job++)
+	{
+		uint32_t first = numItems * job / numJobs;
+		uint32_t last = numItems * (job + 1) / numJobs;
+		recorder->addJob([this, view, technique, bindState, first, last](VkCommandBuffer cmdBuf)
+		{
+			bindState(cmdBuf);
+			bindVertexStreams(cmdBuf, technique);
+			if (culler)
+				culler->draw(cmdBuf, view, first, last - first);
+			else if (culling == CPU_CULLING)
+			{
+				for (uint32_t i = first; i < last; i++)
+					drawGeometry(cmdBuf, drawList[view][i]._first, drawList[view][i]._count);
+			}
+			else
+				drawGeometry(cmdBuf, first * 3, (last - first) * 3);
+		});
+	}
+}
+
+void ShadowScene::drawView(VkCommandBuffer cmdBuf, ClusterCullVulkan::View view)
+{
+	if (culler)
+		culler->draw(cmdBuf, view);
+	else if (culling == CPU_CULLING)
+	{
+		for (const DrawRange &range : drawList[view])
+			drawGeometry(cmdBuf, range._first, range._count);
+	}
+	else
+		drawGeometry(cmdBuf, 0, geometrySize());
+}
+
+void ShadowScene::cullViews(VkCommandBuffer cmdBuf, uint32_t firstView, uint32_t numViews)
+{
+	if (culler)
+		culler->cull(cmdBuf, firstView, numViews);
+	if (culling != CPU_CULLING)
+		return;
+	const glm::mat4 *objectToClip[ClusterCullVulkan::VIEW_COUNT] = { &transformMatrix, &shadowMappingMatrix };
+	for (uint32_t view = firstView; view < firstView + numViews; view++)
+	{
+		mf::Frustum frustum = mf::Frustum::fromMatrix(glm::value_ptr(*objectToClip[view]));
+		mf::cullBoxesParallel(_renderHandle->getWorkers(), cullBounds, frustum, visibleRanges);
+		// Merge the visible ranges following each other into a single draw
+		std::vector<DrawRange> &list = drawList[view];
+		list.clear();
+		for (uint32_t i : visibleRanges)
+		{
+			const DrawRange &range = cullRanges[i];
+			if (!list.empty() && list.back()._first + list.back()._count == range._first)
+				list.back()._count += range._count;
+			else
+				list.push_back(range);
+		}
+	}
+}
+
+void ShadowScene::createClusters(uint32_t numDrawn, const std::function<glm::vec3(uint32_t)> &position)
+{
+	clusters.clear();
+	cullRanges.clear();
+	cullBounds.clear();
+	for (uint32_t first = 0; first < numDrawn; first += CLUSTER_TRIANGLES * 3)
+	{
+		uint32_t count = std::min(CLUSTER_TRIANGLES * 3, numDrawn - first);
+		clusters.push_back({ mf::boundingSphere(first, count, position), glm::vec4(0.f, 0.f, 0.f, 1.f), first, count, 0, 0 });
+		// Box for the CPU culling
+		glm::vec3 lo = position(first), hi = lo;
+		for (uint32_t i = first + 1; i < first + count; i++)
+		{
+			glm::vec3 p = position(i);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		cullRanges.push_back({ first, count });
+		cullBounds.push(lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
+	}
+}
+
+void ShadowScene::createClusters(const std::vector<mf::Meshlet> &meshlets)
+{
+	clusters.clear();
+	for (const mf::Meshlet &meshlet : meshlets)
+		clusters.push_back({ meshlet._sphere, meshlet._cone, meshlet._first, meshlet._count, 0, 0 });
+	uint32_t numTris = 0;
+	for (const mf::Meshlet &meshlet : meshlets)
+		numTris += meshlet._count / 3;
+	std::cout << "Meshlets built, " << meshlets.size() << " meshlets, " << (float)numTris / std::max<size_t>(meshlets.size(), 1) << " triangles per meshlet\n";
 }
 
 void ShadowScene::post_standard()
 {
 	VulkanRenderer::FrameInfo info = _renderHandle->beginCompute();
 	transition_DepthWrite(info._buf, shadowMap->_imageHandle);
-	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE));
+	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getPresentLayout());
 	
 	// Bind compute shader
 	techniqueBlurHorizontal->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
@@ -317,15 +512,14 @@ void ShadowScene::post_standard()
 	vkCmdDispatch(info._buf, 1, _renderHandle->getWidth(), 1);
 	
 	// Finish
-	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getPresentLayout());
 	_renderHandle->submitCompute(0, true);
 }
 
 void ShadowScene::frame_single_cmdbuf(float dt)
 {
-	static float counter = 0.0f;
-	counter += dt;
-	createCameraMatrix(counter);
+	cameraTime += dt;
+	createCameraMatrix(cameraTime);
 
 	VulkanRenderer::FrameInfo info = _renderHandle->beginGraphicsAndComputeCommandBuffer();
 
@@ -344,6 +538,7 @@ void ShadowScene::frame_single_cmdbuf(float dt)
 	renderPassInfo.pClearValues = &clearValue;
 	VkRect2D scissor;
 
+	cullViews(info._buf, 0, ClusterCullVulkan::VIEW_COUNT);
 	vkCmdBeginRenderPass(info._buf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 	vkCmdBindPipeline(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPassTechnique->pipeline);
@@ -351,12 +546,11 @@ void ShadowScene::frame_single_cmdbuf(float dt)
 	scissor.offset = { 0, 0 };
 	scissor.extent = { shadowMapSize, shadowMapSize };
 	vkCmdSetScissor(info._buf, 0, 1, &scissor);
-	shadowMappingMatrixBuffer->bind(info._buf, _renderHandle->getFramePassLayout());
+	shadowMappingMatrixBuffer->bind(info._buf, shadowPipeLayout._layout);
 	//vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeLayout._layout, 0, 1, &shadowPassDescriptorSet, 0, nullptr);
 
-	positionBufferBinding.bind(info._buf, 0);
-	normalBufferBinding.bind(info._buf, 1);
-	vkCmdDraw(info._buf, positionBufferBinding.numElements, 1, 0, 0);
+	bindVertexStreams(info._buf, depthPassTechnique);
+	drawView(info._buf, ClusterCullVulkan::LIGHT);
 	vkCmdEndRenderPass(info._buf);
 
 	// Image barrier transferring image layout
@@ -376,13 +570,14 @@ void ShadowScene::frame_single_cmdbuf(float dt)
 	transformMatrixBuffer->bind(info._buf, _renderHandle->getFramePassLayout());
 	//vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _renderHandle->getFramePassLayout(), 1, 1, &renderPassDescriptorSet, 0, nullptr);
 
-	vkCmdDraw(info._buf, positionBufferBinding.numElements, 1, 0, 0);
+	bindVertexStreams(info._buf, renderPassTechnique);
+	drawView(info._buf, ClusterCullVulkan::CAMERA);
 
 	_renderHandle->endGraphicsAndComputeRenderPass();
 	// Submit
 
 	transition_DepthWrite(info._buf, shadowMap->_imageHandle);
-	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getPresentLayout());
 
 	// Bind compute shader
 	techniqueBlurHorizontal->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
@@ -398,7 +593,7 @@ void ShadowScene::frame_single_cmdbuf(float dt)
 	vkCmdDispatch(info._buf, 1, _renderHandle->getWidth(), 1);
 
 	// Finish
-	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getPresentLayout());
 	_renderHandle->submitGraphicsAndCompute();
 
 	_renderHandle->present();
@@ -414,6 +609,7 @@ void ShadowScene::frame_async(float dt)
 		transition_DepthRead(info._buf, shadowMap->_imageHandle);
 
 		// Rendering pass
+		cullViews(info._buf, ClusterCullVulkan::CAMERA, 1);
 		_renderHandle->beginRenderPass(info._buf);
 		vkCmdBindPipeline(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, renderPassTechnique->pipeline);
 		VkViewport normalViewport = _renderHandle->getViewport();
@@ -429,9 +625,8 @@ void ShadowScene::frame_async(float dt)
 		transformMatrixBuffer->bind(info._buf, _renderHandle->getFramePassLayout());
 		//vkCmdBindDescriptorSets(info._buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _renderHandle->getFramePassLayout(), 1, 1, &renderPassDescriptorSet, 0, nullptr);
 
-		positionBufferBinding.bind(info._buf, 0);
-		normalBufferBinding.bind(info._buf, 1);
-		vkCmdDraw(info._buf, positionBufferBinding.numElements, 1, 0, 0);
+		bindVertexStreams(info._buf, renderPassTechnique);
+		drawView(info._buf, ClusterCullVulkan::CAMERA);
 
 		_renderHandle->endRenderPass();
 		// Image barrier transferring image layout
@@ -439,9 +634,8 @@ void ShadowScene::frame_async(float dt)
 
 	}
 	// Depth pass
-	static float counter = 0.0f;
-	counter += dt;
-	createCameraMatrix(counter);
+	cameraTime += dt;
+	createCameraMatrix(cameraTime);
 
 	// Submit
 	if (!firstFrame)
@@ -463,7 +657,7 @@ void ShadowScene::post_async(float dt)
 {
 	// Post
 	VulkanRenderer::FrameInfo info = _renderHandle->beginCompute(0);
-	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE));
+	transition_RenderToPost(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getPresentLayout());
 
 	// Bind compute shader
 	techniqueBlurHorizontal->bind(info._buf, VK_PIPELINE_BIND_POINT_COMPUTE);
@@ -478,7 +672,7 @@ void ShadowScene::post_async(float dt)
 	vkCmdDispatch(info._buf, 1, _renderHandle->getWidth(), 1);
 
 	// Finish
-	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC));
+	transition_PostToPresent(info._buf, info._swapChainImage, _renderHandle->getQueueFamily(QueueType::COMPUTE), _renderHandle->getQueueFamily(QueueType::GRAPHIC), _renderHandle->getPresentLayout());
 	_renderHandle->submitCompute(0, true, colorPassCompleteSemaphore);
 }
 
@@ -505,6 +699,8 @@ void ShadowScene::async_depthBuffer(float dt)
 	renderPassInfo.clearValueCount = 1;
 	renderPassInfo.pClearValues = &clearValue;
 
+	// The camera view is culled with the rendering pass
+	cullViews(cmdBuf, ClusterCullVulkan::LIGHT, 1);
 	vkCmdBeginRenderPass(cmdBuf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 	vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPassTechnique->pipeline);
@@ -513,12 +709,11 @@ void ShadowScene::async_depthBuffer(float dt)
 	scissor.offset = { 0, 0 };
 	scissor.extent = { shadowMapSize, shadowMapSize };
 	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-	shadowMappingMatrixBuffer->bind(cmdBuf, _renderHandle->getFramePassLayout());
+	shadowMappingMatrixBuffer->bind(cmdBuf, shadowPipeLayout._layout);
 	//vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeLayout._layout, 0, 1, &shadowPassDescriptorSet, 0, nullptr);
 
-	positionBufferBinding.bind(cmdBuf, 0);
-	normalBufferBinding.bind(cmdBuf, 1);
-	vkCmdDraw(cmdBuf, positionBufferBinding.numElements, 1, 0, 0);
+	bindVertexStreams(cmdBuf, depthPassTechnique);
+	drawView(cmdBuf, ClusterCullVulkan::LIGHT);
 	vkCmdEndRenderPass(cmdBuf);
 
 	if (vkEndCommandBuffer(cmdBuf) != VK_SUCCESS) {
@@ -549,29 +744,29 @@ void ShadowScene::defineDescriptorLayout(VkDevice device, std::vector<VkDescript
 	// Shadow map
 	VkDescriptorSetLayoutBinding binding;
 
-	// transformMatrix
-	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+	// transformMatrix, written each frame through the uniform ring
+	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT);
 	layout[0] = createDescriptorLayout(device, &binding, 1);
 
 	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 	layout[1] = createDescriptorLayout(device, &binding, 1);
 	
-	// clipSpaceToShadowMapMatrix
-	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Light info, written each frame through the uniform ring
+	writeLayoutBinding(binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT);
 	layout[2] = createDescriptorLayout(device, &binding, 1);
 }
 
 
 VkRenderPass ShadowScene::defineRenderPass(VkDevice device, VkFormat swapchainFormat, VkFormat depthFormat, std::vector<VkImageView>& additionalAttatchments)
 {
-	return createRenderPass_SingleColorDepth(device, swapchainFormat, depthFormat);
+	return createRenderPass_SingleColorDepth(device, swapchainFormat, depthFormat, _renderHandle->getPresentLayout());
 	// Define the render pass
 	VkRenderPass renderPass;
 
 	const uint32_t ATTATCHMENT_COUNT = 2;
 	VkAttachmentDescription attatchments[ATTATCHMENT_COUNT] =
 	{
-		defineFramebufColor(swapchainFormat),
+		defineFramebufColor(swapchainFormat, _renderHandle->getPresentLayout()),
 		defineFramebufDepth(depthFormat)
 	};
 
@@ -707,13 +902,155 @@ void ShadowScene::defineShadowRenderPass(VkDevice device)
 void ShadowScene::createBuffers()
 {
 	shadowMappingMatrixBuffer = new ConstantBufferVulkan(_renderHandle);
-	shadowMappingMatrixBuffer->setData(&shadowMappingMatrix, sizeof(glm::mat4), 0);
+	// Static, bound with the shadow pass layout (set 0 of the frame pass layout is dynamic)
+	VertexTransform shadowTransform = vertexTransform(shadowMappingMatrix);
+	shadowMappingMatrixBuffer->setData(&shadowTransform, sizeof(VertexTransform), 0, shadowPipeLayout[0]);
 
 	transformMatrixBuffer = new ConstantDoubleBufferVulkan(_renderHandle);
-	transformMatrixBuffer->setData(&transformMatrix, sizeof(glm::mat4), 0, _renderHandle->getDescriptorSetLayout(0), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	VertexTransform transform = vertexTransform(transformMatrix);
+	transformMatrixBuffer->setData(&transform, sizeof(VertexTransform), 0, _renderHandle->getDescriptorSetLayout(0), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
 	lightInfoBuffer = new ConstantDoubleBufferVulkan(_renderHandle);
 	lightInfoBuffer->setData(&lightInfo, sizeof(lightInfo), 2, _renderHandle->getDescriptorSetLayout(2));
+}
+
+void ShadowScene::createGeometry()
+{
+	VulkanRenderer *handle = _renderHandle;
+	if (geometry == GENERATED)
+	{
+		// Create triangles
+		const uint32_t TRIANGLE_COUNT = 1000000;
+		mf::RandomGenerator randomGenerator;
+		randomGenerator.seedGenerator();
+		//randomGenerator.setSeed({ 2 });
+		if (packedVertices)
+		{
+			std::vector<uint16_t> vertexPositions(TRIANGLE_COUNT * 3 * 4);
+			std::vector<int16_t> vertexNormals(TRIANGLE_COUNT * 3 * 2);
+			float bb[6];
+			mf::distributeTriangles(randomGenerator, 2.0f, TRIANGLE_COUNT, glm::vec2(0.6f, 0.8f), vertexPositions.data(), vertexNormals.data(), bb, culling == MESHLET_CULLING);
+			mf::positionDecode(bb, &decodeScale.x, &decodeOffset.x);
+			if (culling != NO_CULLING)
+			{
+				// Spatially compact clusters of consecutive triangles
+				auto position = [&](uint32_t i)
+				{
+					const uint16_t *q = &vertexPositions[i * 4];
+					return glm::vec3(q[0], q[1], q[2]) / 65535.f * glm::vec3(decodeScale) + glm::vec3(decodeOffset);
+				};
+				std::vector<uint32_t> order = culling == MESHLET_CULLING ? mf::normalTriangleOrder(TRIANGLE_COUNT, position) : mf::mortonTriangleOrder(TRIANGLE_COUNT, position);
+				mf::permuteTriangles(vertexPositions.data(), 4, order);
+				mf::permuteTriangles(vertexNormals.data(), 2, order);
+				if (culling == MESHLET_CULLING)
+					createClusters(mf::buildMeshlets(TRIANGLE_COUNT, [](uint32_t i) { return i; }, position));
+				else
+					createClusters(TRIANGLE_COUNT * 3, position);
+			}
+
+			positionBuffer = new VertexBufferVulkan(handle, vertexPositions.size() * sizeof(uint16_t), VertexBufferVulkan::DATA_USAGE::STATIC);
+			positionBufferBinding = VertexBufferVulkan::Binding(positionBuffer, 4 * sizeof(uint16_t), TRIANGLE_COUNT * 3, 0);
+			normalBuffer = new VertexBufferVulkan(handle, vertexNormals.size() * sizeof(int16_t), VertexBufferVulkan::DATA_USAGE::STATIC);
+			normalBufferBinding = VertexBufferVulkan::Binding(normalBuffer, 2 * sizeof(int16_t), TRIANGLE_COUNT * 3, 0);
+
+			positionBuffer->setData(vertexPositions.data(), positionBufferBinding);
+			normalBuffer->setData(vertexNormals.data(), normalBufferBinding);
+			return;
+		}
+		glm::vec4* vertexPositions = new glm::vec4[TRIANGLE_COUNT * 3];
+		glm::vec3* vertexNormals = new glm::vec3[TRIANGLE_COUNT * 3];
+
+		/*glm::vec4 vertexPositions[TRIANGLE_COUNT * 3];
+		glm::vec3 vertexNormals[TRIANGLE_COUNT * 3];*/
+
+		mf::distributeTriangles(randomGenerator, 2.0f, TRIANGLE_COUNT, glm::vec2(0.6f, 0.8f), vertexPositions, vertexNormals, culling == MESHLET_CULLING);
+		if (culling != NO_CULLING)
+		{
+			// Spatially compact clusters of consecutive triangles
+			auto position = [vertexPositions](uint32_t i) { return glm::vec3(vertexPositions[i]); };
+			std::vector<uint32_t> order = culling == MESHLET_CULLING ? mf::normalTriangleOrder(TRIANGLE_COUNT, position) : mf::mortonTriangleOrder(TRIANGLE_COUNT, position);
+			mf::permuteTriangles(vertexPositions, 1, order);
+			mf::permuteTriangles(vertexNormals, 1, order);
+			if (culling == MESHLET_CULLING)
+				createClusters(mf::buildMeshlets(TRIANGLE_COUNT, [](uint32_t i) { return i; }, position));
+			else
+				createClusters(TRIANGLE_COUNT * 3, position);
+		}
+
+		//Create buffers
+		positionBuffer = new VertexBufferVulkan(handle, TRIANGLE_COUNT * 3 * sizeof(glm::vec4), VertexBufferVulkan::DATA_USAGE::STATIC);
+		positionBufferBinding = VertexBufferVulkan::Binding(positionBuffer, sizeof(glm::vec4), TRIANGLE_COUNT * 3, 0);
+		normalBuffer = new VertexBufferVulkan(handle, TRIANGLE_COUNT * 3 * sizeof(glm::vec3), VertexBufferVulkan::DATA_USAGE::STATIC);
+		normalBufferBinding = VertexBufferVulkan::Binding(normalBuffer, sizeof(glm::vec3), TRIANGLE_COUNT * 3, 0);
+
+		positionBuffer->setData(vertexPositions, positionBufferBinding);
+		normalBuffer->setData(vertexNormals, normalBufferBinding);
+		delete[] vertexPositions;
+		delete[] vertexNormals;
+	}
+	else
+	{
+		SimpleMesh mesh, baked;
+		if (readObj("resource/cowparty.obj", mesh))
+			std::cout << "Obj read successfull\n";
+		// Indexed, vertices shared by the faces are shaded once (post-transform cache)
+		uint32_t bakeFlags = SimpleMesh::BitFlag::NORMAL_BIT | SimpleMesh::POS_4_COMPONENT;
+		if (packedVertices)
+			bakeFlags |= SimpleMesh::BitFlag::COMPRESS_BIT;
+		mesh.bake(bakeFlags, baked);
+		SimpleMesh::OptimizeStats optStats = baked.optimize();
+		std::cout << "Mesh optimized, ACMR " << optStats._before._acmr << " -> " << optStats._after._acmr
+			<< ", ATVR " << optStats._before._atvr << " -> " << optStats._after._atvr << "\n";
+		// The faces share few vertices (ACMR near 3), sorting by facing costs no cache hits and narrows the cones
+		if (culling == MESHLET_CULLING)
+			baked.buildMeshlets(64, 124, 4);
+
+		uint32_t num_vert = (uint32_t)baked._position.size() / 4;
+		uint32_t posSize = packedVertices ? 4 * sizeof(uint16_t) : sizeof(glm::vec4);
+		uint32_t norSize = packedVertices ? 2 * sizeof(int16_t) : sizeof(glm::vec3);
+		positionBuffer = new VertexBufferVulkan(handle, num_vert * posSize, VertexBufferVulkan::DATA_USAGE::STATIC);
+		positionBufferBinding = VertexBufferVulkan::Binding(positionBuffer, posSize, num_vert, 0);
+		normalBuffer = new VertexBufferVulkan(handle, num_vert * norSize, VertexBufferVulkan::DATA_USAGE::STATIC);
+		normalBufferBinding = VertexBufferVulkan::Binding(normalBuffer, norSize, num_vert, 0);
+		VkIndexType indexType = IndexBufferVulkan::fitIndexType(num_vert);
+		indexBuffer = new IndexBufferVulkan(handle, baked._face_ind.size() * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4));
+		indexBufferBinding = IndexBufferVulkan::Binding(indexBuffer, indexType, (uint32_t)baked._face_ind.size(), 0);
+
+		if (packedVertices)
+		{
+			mf::positionDecode(baked._bb, &decodeScale.x, &decodeOffset.x);
+			positionBuffer->setData(baked._position_packed.data(), positionBufferBinding);
+			normalBuffer->setData(baked._normal_packed.data(), normalBufferBinding);
+		}
+		else
+		{
+			positionBuffer->setData(baked._position.data(), positionBufferBinding);
+			normalBuffer->setData(baked._normal.data(), normalBufferBinding);
+		}
+		indexBuffer->setData(baked._face_ind.data(), indexBufferBinding);
+		// The vertex cache order already keeps consecutive triangles close
+		if (culling == GPU_CULLING)
+			createClusters((uint32_t)baked._face_ind.size(), [&baked](uint32_t i)
+			{
+				const float *p = &baked._position[baked._face_ind[i] * 4];
+				return glm::vec3(p[0], p[1], p[2]);
+			});
+		else if (culling == MESHLET_CULLING)
+			createClusters(baked._meshlet);
+		else if (culling == CPU_CULLING)
+		{
+			// Objects of the obj file, bounds computed by the bake
+			cullRanges.resize(baked._part.size());
+			for (uint32_t i = 0; i < baked._part.size(); i++)
+				baked.partRange(i, cullRanges[i]._first, cullRanges[i]._count);
+			cullBounds = baked._part_bb;
+		}
+	}
+}
+
+ShadowScene::VertexTransform ShadowScene::vertexTransform(const glm::mat4 &transform)
+{
+	return { transform, decodeScale, decodeOffset };
 }
 
 glm::mat4 ShadowScene::rotationMatrix(float angle, glm::vec3 const& axis)
@@ -102,7 +102,14 @@ void TriangleScene::defineDescriptorLayout(VkDevice device, std::vector<VkDescri
 }
 
 
+void TriangleScene::defineMemoryPools(std::vector<size_t> &chunkSizes)
+{
+	// A handful of triangles, pools grow if the frame buffers need more
+	for (size_t &size : chunkSizes)
+		size = 1024 * 1024;
+}
+
 VkRenderPass TriangleScene::defineRenderPass(VkDevice device, VkFormat swapchainFormat, VkFormat depthFormat, std::vector<VkImageView>& additionalAttatchments)
 {
-	return createRenderPass_SingleColorDepth(device, swapchainFormat, depthFormat);
+	return createRenderPass_SingleColorDepth(device, swapchainFormat, depthFormat, _renderHandle->getPresentLayout());
 }
\ No newline at end of file
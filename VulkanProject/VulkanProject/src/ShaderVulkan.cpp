@@ -284,8 +284,13 @@ std::string ShaderVulkan::runCompiler(ShaderVulkan::ShaderType type, std::string
 	{
 		// Process exit message, should be zero
 		std::cout << "Process exited with msg: " << exitCode << "\n";
-		if(exitCode != 0)
-			std::cout << "\tWarning: Process error\n";
+		// A failed compile leaves a stale or missing .spv, never load it
+		if (exitCode != 0)
+		{
+			CloseHandle(processInfo.hProcess);
+			CloseHandle(processInfo.hThread);
+			throw std::runtime_error("Shader compilation failed: " + inputFileName);
+		}
 	}
 	CloseHandle(processInfo.hProcess);
 	CloseHandle(processInfo.hThread);
@@ -0,0 +1,136 @@
+#include "StagingRingVulkan.h"
+#include <algorithm>
+#include <stdexcept>
+
+StagingRingVulkan::StagingRingVulkan()
+	: _device(VK_NULL_HANDLE), _queues(nullptr), _buffer(VK_NULL_HANDLE), _memory(VK_NULL_HANDLE), _mapped(nullptr),
+	_size(0), _alignment(1), _head(0), _used(0), _open(0), _stats()
+{
+}
+
+void StagingRingVulkan::init(VkDevice device, vk::QueueConstruct *queues, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize size, VkDeviceSize alignment)
+{
+	_device = device;
+	_queues = queues;
+	_buffer = buffer;
+	_memory = memory;
+	_size = size;
+	_alignment = std::max<VkDeviceSize>(alignment, 1);
+	_head = _used = _open = 0;
+	_regions.clear();
+	_stats = Stats();
+
+	void *mapped;
+	if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+		throw std::runtime_error("Failed to map staging buffer to memory.");
+	_mapped = (uint8_t*)mapped;
+}
+
+void StagingRingVulkan::destroy()
+{
+	if (_mapped)
+		vkUnmapMemory(_device, _memory);
+	_mapped = nullptr;
+	_regions.clear();
+}
+
+StagingRingVulkan::Allocation StagingRingVulkan::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	alignment = std::max(alignment, _alignment);
+	if (size > _size)
+		throw std::runtime_error("The data requested does not fit in the staging buffer.");
+
+	std::lock_guard<std::mutex> lock(_lock);
+	retireLocked();
+	Allocation allocation;
+	while (!place(size, alignment, allocation))
+	{
+		// Space is held by uploads not yet submitted, waiting would never complete
+		if (_regions.empty())
+			throw std::runtime_error("Staging buffer is exhausted by uploads not yet submitted.");
+		// Block on the oldest region
+		_stats._waits++;
+		_queues->wait(_regions.front()._ticket);
+		retireLocked();
+	}
+	return allocation;
+}
+
+bool StagingRingVulkan::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, Allocation &allocation)
+{
+	alignment = std::max(alignment, _alignment);
+	if (size > _size)
+		throw std::runtime_error("The data requested does not fit in the staging buffer.");
+
+	std::lock_guard<std::mutex> lock(_lock);
+	retireLocked();
+	return place(size, alignment, allocation);
+}
+
+bool StagingRingVulkan::place(VkDeviceSize size, VkDeviceSize alignment, Allocation &allocation)
+{
+	// Place after the head, or wrap to the start of the ring wasting the tail end
+	VkDeviceSize offset = (_head + alignment - 1) / alignment * alignment;
+	bool wrap = offset + size > _size;
+	if (wrap)
+		offset = 0;
+	VkDeviceSize needed = (wrap ? _size - _head : offset - _head) + size;
+	if (_used + needed > _size)
+		return false;
+	_head = offset + size;
+	_used += needed;
+	_open += needed;
+	_stats._allocated += size;
+	_stats._allocations++;
+	if (wrap)
+		_stats._wraps++;
+	allocation = { _mapped + offset, _buffer, offset, size };
+	return true;
+}
+
+void StagingRingVulkan::close(const vk::Ticket &ticket)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	if (_open == 0)
+		return;
+	_regions.push_back({ _open, ticket });
+	_open = 0;
+}
+
+void StagingRingVulkan::release(const Allocation &allocation)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	// Allocations placed after it are still pending
+	if (_head != allocation._offset + allocation._size || _open < allocation._size)
+		return;
+	_head = allocation._offset;
+	_used -= allocation._size;
+	_open -= allocation._size;
+	if (_used == 0)
+		_head = 0;
+}
+
+void StagingRingVulkan::retire()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	retireLocked();
+}
+
+void StagingRingVulkan::retireLocked()
+{
+	// Regions complete in submission order (single transfer queue)
+	while (!_regions.empty() && _queues->isComplete(_regions.front()._ticket))
+	{
+		_used -= _regions.front()._bytes;
+		_regions.pop_front();
+	}
+	// Restart at the beginning of the ring when it is empty, avoids wrapping
+	if (_used == 0)
+		_head = 0;
+}
+
+StagingRingVulkan::Stats StagingRingVulkan::getStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	return _stats;
+}
@@ -10,6 +10,7 @@
 #include<memory>
 #include<cmath>
 #include<algorithm>
+#include"Stuff\VertexPacking.h"
 #include"glm\geometric.hpp"
 #pragma endregion
 
@@ -40,24 +41,35 @@ namespace mf{
 		return vec;
 	}
 
+	/* Generate a random triangle of the distribution, wound clockwise around the normal unless counterClockwise is set.
+	*/
+	static void randomTriangle(RandomGenerator &rnd, float sphereRad, glm::vec2 triSize, bool counterClockwise, glm::vec3 *tri, glm::vec3 &nor)
+	{
+		float off = rnd.randomFloat(-sphereRad, sphereRad);
+		nor = rnd.randomNormal();
+		glm::vec3 pos = nor * off;
+		glm::vec3 forw = glm::cross(nor, abs(nor.y) + abs(nor.z) > 0.01f ? glm::vec3(1, 0, 0) : glm::vec3(0, -1, 0));
+		glm::vec3 right = glm::cross(forw, nor);
+		float size = rnd.randomFloat(triSize.x, triSize.y);
+		right *= 0.5f * size;
+		forw *= 0.5f * size;
+		tri[0] = pos - right - forw;
+		tri[1] = counterClockwise ? pos + right - forw : pos + forw;
+		tri[2] = counterClockwise ? pos + forw : pos + right - forw;
+	}
+
 	/* Generate a set of separated triangles.
 	*/
-	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, glm::vec4 *posBuf, glm::vec3 *norBuf)
+	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, glm::vec4 *posBuf, glm::vec3 *norBuf, bool counterClockwise)
 	{
+		glm::vec3 tri[3], nor;
 		for (uint32_t i = 0; i < numTris; i++)
 		{
-			float off = rnd.randomFloat(-sphereRad, sphereRad);
-			glm::vec3 nor = rnd.randomNormal();
-			glm::vec3 pos = nor * off;
-			glm::vec3 forw = glm::cross(nor, abs(nor.y) + abs(nor.z) > 0.01f ? glm::vec3(1, 0, 0) : glm::vec3(0, -1, 0));
-			glm::vec3 right = glm::cross(forw, nor);
-			float size = rnd.randomFloat(triSize.x, triSize.y);
-			right *= 0.5f * size;
-			forw *= 0.5f * size;
+			randomTriangle(rnd, sphereRad, triSize, counterClockwise, tri, nor);
 			// Set params
-			posBuf[i * 3] = glm::vec4(pos - right - forw, 1.f);
-			posBuf[i * 3 + 1] = glm::vec4(pos + forw, 1.f);
-			posBuf[i * 3 + 2] = glm::vec4(pos + right - forw, 1.f);
+			posBuf[i * 3] = glm::vec4(tri[0], 1.f);
+			posBuf[i * 3 + 1] = glm::vec4(tri[1], 1.f);
+			posBuf[i * 3 + 2] = glm::vec4(tri[2], 1.f);
 			if (norBuf)
 			{
 				norBuf[i * 3] = nor;
@@ -67,6 +79,28 @@ namespace mf{
 		}
 	}
 
+	void distributeTriangles(RandomGenerator &rnd, float sphereRad, uint32_t numTris, glm::vec2 triSize, uint16_t *posBuf, int16_t *norBuf, float *bb, bool counterClockwise)
+	{
+		// Vertices are within the corner distance (size / sqrt(2)) of the triangle center on the sphere
+		float bound = sphereRad + triSize.y;
+		for (int i = 0; i < 3; i++)
+		{
+			bb[i * 2] = -bound;
+			bb[i * 2 + 1] = bound;
+		}
+		glm::vec3 tri[3], nor;
+		for (uint32_t i = 0; i < numTris; i++)
+		{
+			randomTriangle(rnd, sphereRad, triSize, counterClockwise, tri, nor);
+			for (int v = 0; v < 3; v++)
+			{
+				quantizePosition(&tri[v].x, bb, posBuf + (i * 3 + v) * 4);
+				if (norBuf)
+					octEncode(&nor.x, norBuf + (i * 3 + v) * 2);
+			}
+		}
+	}
+
 #pragma endregion
 
 #pragma region Implementation
@@ -0,0 +1,408 @@
+#pragma region HEADER
+//--------------------------------------------------------------------------------------
+// File: TLSFAllocator.cpp
+// Project: Function library
+//--------------------------------------------------------------------------------------
+
+#include"Stuff\TLSFAllocator.h"
+#include<algorithm>
+#include<chrono>
+#include<random>
+#include<stdexcept>
+#ifdef _MSC_VER
+#include<intrin.h>
+#endif
+#pragma endregion
+
+namespace mf{
+
+	namespace
+	{
+		/* Index of the most significant set bit, x != 0. */
+		uint32_t msb(uint64_t x)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse64(&index, x);
+			return (uint32_t)index;
+#else
+			return 63 - (uint32_t)__builtin_clzll(x);
+#endif
+		}
+		/* Index of the least significant set bit, x != 0. */
+		uint32_t lsb(uint64_t x)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward64(&index, x);
+			return (uint32_t)index;
+#else
+			return (uint32_t)__builtin_ctzll(x);
+#endif
+		}
+		uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	TLSFAllocator::TLSFAllocator()
+	{
+		init(0);
+	}
+	TLSFAllocator::TLSFAllocator(uint64_t size, uint64_t granularity)
+	{
+		init(size, granularity);
+	}
+
+	void TLSFAllocator::init(uint64_t size, uint64_t granularity)
+	{
+		if (granularity == 0 || (granularity & (granularity - 1)) != 0)
+			throw std::runtime_error("Allocator granularity must be a power of two.");
+		_size = size;
+		_granularity = granularity;
+		_blocks.clear();
+		_unusedBlocks.clear();
+		_allocated.clear();
+		_flBitmap = 0;
+		std::fill(_slBitmap, _slBitmap + FL_COUNT, 0u);
+		for (uint32_t fl = 0; fl < FL_COUNT; fl++)
+			std::fill(_heads[fl], _heads[fl] + SL_COUNT, NONE);
+		_kindCount[LINEAR] = _kindCount[OPTIMAL] = 0;
+		_used = _padding = 0;
+		_failed = 0;
+
+		if (size == 0)
+			return;
+		uint32_t block = newBlock();
+		_blocks[block] = { 0, size, 0, NONE, NONE, NONE, NONE, true, LINEAR };
+		insertFree(block);
+	}
+
+	uint64_t TLSFAllocator::allocate(uint64_t size, uint64_t alignment, Kind kind)
+	{
+		size = std::max<uint64_t>(size, 1);
+		alignment = std::max<uint64_t>(alignment, 1);
+		if ((alignment & (alignment - 1)) != 0)
+			throw std::runtime_error("Allocation alignment must be a power of two.");
+
+		// Worst case padding, the front is aligned and both ends are moved off the pages of conflicting neighbours
+		bool mixed = _granularity > 1 && _kindCount[kind == LINEAR ? OPTIMAL : LINEAR] > 0;
+		uint64_t worst = mixed ? std::max(alignment, _granularity) - 1 + _granularity - 1 : alignment - 1;
+		uint32_t block = size + worst <= _size ? findFree(size + worst) : NONE;
+		if (block == NONE)
+		{
+			_failed++;
+			return INVALID_OFFSET;
+		}
+		removeFree(block);
+
+		// Neighbours of a free block are allocated (free blocks are merged)
+		uint64_t offset = alignUp(_blocks[block]._offset, alignment);
+		uint32_t prev = _blocks[block]._prevPhys;
+		if (prev != NONE && conflict(prev, kind) &&
+			(_blocks[prev]._offset + _blocks[prev]._size - 1) / _granularity == offset / _granularity)
+			offset = alignUp(offset, _granularity);
+
+		// The padded size leaves at least the page gap to a conflicting next block, the gap stays free
+		uint64_t padding = offset - _blocks[block]._offset;
+		uint32_t tail = splitTail(block, padding + size);
+		if (tail != NONE)
+			insertFree(tail);
+
+		_blocks[block]._free = false;
+		_blocks[block]._kind = kind;
+		_blocks[block]._padding = padding;
+		_allocated[offset] = block;
+		_kindCount[kind]++;
+		_used += padding + size;
+		_padding += padding;
+		return offset;
+	}
+
+	void TLSFAllocator::free(uint64_t offset)
+	{
+		auto it = _allocated.find(offset);
+		if (it == _allocated.end())
+			throw std::runtime_error("Freeing an offset that is not allocated.");
+		uint32_t block = it->second;
+		_allocated.erase(it);
+		_kindCount[_blocks[block]._kind]--;
+		_used -= _blocks[block]._size;
+		_padding -= _blocks[block]._padding;
+		_blocks[block]._padding = 0;
+		_blocks[block]._free = true;
+		insertFree(merge(block));
+	}
+
+	uint64_t TLSFAllocator::allocationSize(uint64_t offset) const
+	{
+		auto it = _allocated.find(offset);
+		return it == _allocated.end() ? 0 : _blocks[it->second]._size - _blocks[it->second]._padding;
+	}
+
+	TLSFAllocator::Stats TLSFAllocator::getStats() const
+	{
+		Stats stats = {};
+		stats._size = _size;
+		stats._used = _used;
+		stats._padding = _padding;
+		stats._allocations = (uint32_t)_allocated.size();
+		stats._failed = _failed;
+		for (uint64_t flMap = _flBitmap; flMap; flMap &= flMap - 1)
+		{
+			uint32_t fl = lsb(flMap);
+			for (uint32_t slMap = _slBitmap[fl]; slMap; slMap &= slMap - 1)
+			{
+				for (uint32_t block = _heads[fl][lsb(slMap)]; block != NONE; block = _blocks[block]._nextFree)
+				{
+					stats._freeBlocks++;
+					stats._largestFree = std::max(stats._largestFree, _blocks[block]._size);
+				}
+			}
+		}
+		return stats;
+	}
+
+	void TLSFAllocator::mapping(uint64_t size, uint32_t &fl, uint32_t &sl)
+	{
+		if (size < (1ull << SMALL_BITS))
+		{
+			// Linear classes for the small sizes
+			fl = 0;
+			sl = (uint32_t)(size >> (SMALL_BITS - SL_BITS));
+		}
+		else
+		{
+			uint32_t bit = msb(size);
+			fl = bit - SMALL_BITS + 1;
+			sl = (uint32_t)(size >> (bit - SL_BITS)) & (SL_COUNT - 1);
+		}
+	}
+
+	uint32_t TLSFAllocator::findFree(uint64_t size) const
+	{
+		// Round up to the next size class, any block in the class found fits
+		if (size >= (1ull << SMALL_BITS))
+			size += (1ull << (msb(size) - SL_BITS)) - 1;
+		else
+			size += (1ull << (SMALL_BITS - SL_BITS)) - 1;
+		uint32_t fl, sl;
+		mapping(size, fl, sl);
+		if (fl >= FL_COUNT)
+			return NONE;
+
+		uint32_t slMap = _slBitmap[fl] & (~0u << sl);
+		if (slMap == 0)
+		{
+			// Smallest non-empty larger first level class
+			uint64_t flMap = fl + 1 < 64 ? _flBitmap & (~0ull << (fl + 1)) : 0;
+			if (flMap == 0)
+				return NONE;
+			fl = lsb(flMap);
+			slMap = _slBitmap[fl];
+		}
+		return _heads[fl][lsb(slMap)];
+	}
+
+	void TLSFAllocator::insertFree(uint32_t block)
+	{
+		uint32_t fl, sl;
+		mapping(_blocks[block]._size, fl, sl);
+		Block &b = _blocks[block];
+		b._free = true;
+		b._prevFree = NONE;
+		b._nextFree = _heads[fl][sl];
+		if (b._nextFree != NONE)
+			_blocks[b._nextFree]._prevFree = block;
+		_heads[fl][sl] = block;
+		_slBitmap[fl] |= 1u << sl;
+		_flBitmap |= 1ull << fl;
+	}
+
+	void TLSFAllocator::removeFree(uint32_t block)
+	{
+		uint32_t fl, sl;
+		mapping(_blocks[block]._size, fl, sl);
+		Block &b = _blocks[block];
+		if (b._prevFree != NONE)
+			_blocks[b._prevFree]._nextFree = b._nextFree;
+		else
+			_heads[fl][sl] = b._nextFree;
+		if (b._nextFree != NONE)
+			_blocks[b._nextFree]._prevFree = b._prevFree;
+		if (_heads[fl][sl] == NONE)
+		{
+			_slBitmap[fl] &= ~(1u << sl);
+			if (_slBitmap[fl] == 0)
+				_flBitmap &= ~(1ull << fl);
+		}
+		b._prevFree = b._nextFree = NONE;
+	}
+
+	uint32_t TLSFAllocator::newBlock()
+	{
+		if (!_unusedBlocks.empty())
+		{
+			uint32_t block = _unusedBlocks.back();
+			_unusedBlocks.pop_back();
+			return block;
+		}
+		_blocks.push_back(Block());
+		return (uint32_t)_blocks.size() - 1;
+	}
+
+	uint32_t TLSFAllocator::splitTail(uint32_t block, uint64_t size)
+	{
+		if (_blocks[block]._size <= size)
+			return NONE;
+		uint32_t tail = newBlock();	// Invalidates references into the blocks
+		Block &b = _blocks[block];
+		_blocks[tail] = { b._offset + size, b._size - size, 0, block, b._nextPhys, NONE, NONE, true, LINEAR };
+		if (b._nextPhys != NONE)
+			_blocks[b._nextPhys]._prevPhys = tail;
+		b._nextPhys = tail;
+		b._size = size;
+		return tail;
+	}
+
+	uint32_t TLSFAllocator::merge(uint32_t block)
+	{
+		uint32_t prev = _blocks[block]._prevPhys;
+		if (prev != NONE && _blocks[prev]._free)
+		{
+			removeFree(prev);
+			_blocks[prev]._size += _blocks[block]._size;
+			_blocks[prev]._nextPhys = _blocks[block]._nextPhys;
+			if (_blocks[block]._nextPhys != NONE)
+				_blocks[_blocks[block]._nextPhys]._prevPhys = prev;
+			_unusedBlocks.push_back(block);
+			block = prev;
+		}
+		uint32_t next = _blocks[block]._nextPhys;
+		if (next != NONE && _blocks[next]._free)
+		{
+			removeFree(next);
+			_blocks[block]._size += _blocks[next]._size;
+			_blocks[block]._nextPhys = _blocks[next]._nextPhys;
+			if (_blocks[next]._nextPhys != NONE)
+				_blocks[_blocks[next]._nextPhys]._prevPhys = block;
+			_unusedBlocks.push_back(next);
+		}
+		return block;
+	}
+
+	bool TLSFAllocator::conflict(uint32_t neighbour, Kind kind) const
+	{
+		return _granularity > 1 && _blocks[neighbour]._kind != kind;
+	}
+
+	namespace
+	{
+		struct BenchAllocation
+		{
+			uint64_t _offset, _size, _alignment;
+			TLSFAllocator::Kind _kind;
+		};
+
+		/* Allocations are sorted by offset. */
+		void checkAllocations(std::vector<BenchAllocation> live, const TLSFAllocator &allocator, uint64_t granularity)
+		{
+			std::sort(live.begin(), live.end(), [](const BenchAllocation &a, const BenchAllocation &b) { return a._offset < b._offset; });
+			for (size_t i = 0; i < live.size(); i++)
+			{
+				const BenchAllocation &a = live[i];
+				if (a._offset % a._alignment != 0 || a._offset + a._size > allocator.size())
+					throw std::runtime_error("TLSF allocation is misaligned or out of range.");
+				if (allocator.allocationSize(a._offset) != a._size)
+					throw std::runtime_error("TLSF allocation size does not match the request.");
+				if (i == 0)
+					continue;
+				const BenchAllocation &prev = live[i - 1];
+				if (prev._offset + prev._size > a._offset)
+					throw std::runtime_error("TLSF allocations overlap.");
+				if (prev._kind != a._kind && (prev._offset + prev._size - 1) / granularity == a._offset / granularity)
+					throw std::runtime_error("TLSF linear and optimal allocations share a page.");
+			}
+			if (allocator.getStats()._allocations != live.size())
+				throw std::runtime_error("TLSF allocation count does not match.");
+		}
+	}
+
+	void benchmarkTLSF(std::ostream &out, uint32_t operations)
+	{
+		const uint64_t SIZE = 1ull << 30, GRANULARITY = 1024;
+		TLSFAllocator allocator;
+		std::vector<BenchAllocation> live;
+		double allocMs = 0, freeMs = 0;
+		uint32_t allocs = 0, frees = 0;
+		TLSFAllocator::Stats peak = {};
+
+		// First run checks the allocator, the second run times the same workload
+		for (uint32_t run = 0; run < 2; run++)
+		{
+			bool check = run == 0;
+			allocator.init(SIZE, GRANULARITY);
+			live.clear();
+			uint64_t liveBytes = 0;
+			allocMs = freeMs = 0;
+			allocs = frees = 0;
+			// Sizes are log-uniform between 256 B and 4 MB, the range is kept around half full
+			std::mt19937 rng(1);
+			std::uniform_real_distribution<double> logSize(8.0, 22.0);
+			std::uniform_int_distribution<uint32_t> logAlign(4, 16), coin(0, 1);
+			std::uniform_real_distribution<double> chance(0.0, 1.0);
+			for (uint32_t op = 0; op < operations; op++)
+			{
+				bool alloc = live.empty() || chance(rng) < (liveBytes < SIZE / 2 ? 0.6 : 0.4);
+				if (alloc)
+				{
+					BenchAllocation a;
+					a._size = (uint64_t)std::exp2(logSize(rng));
+					a._alignment = 1ull << logAlign(rng);
+					a._kind = coin(rng) ? TLSFAllocator::LINEAR : TLSFAllocator::OPTIMAL;
+					auto begin = std::chrono::high_resolution_clock::now();
+					a._offset = allocator.allocate(a._size, a._alignment, a._kind);
+					allocMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+					allocs++;
+					if (a._offset != TLSFAllocator::INVALID_OFFSET)
+					{
+						live.push_back(a);
+						liveBytes += a._size;
+					}
+				}
+				else
+				{
+					size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+					auto begin = std::chrono::high_resolution_clock::now();
+					allocator.free(live[index]._offset);
+					freeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+					frees++;
+					liveBytes -= live[index]._size;
+					live[index] = live.back();
+					live.pop_back();
+				}
+				if (check && op % 4096 == 0)
+				{
+					checkAllocations(live, allocator, GRANULARITY);
+					TLSFAllocator::Stats stats = allocator.getStats();
+					if (stats._used > peak._used)
+						peak = stats;
+				}
+			}
+			if (check)
+				checkAllocations(live, allocator, GRANULARITY);
+			for (const BenchAllocation &a : live)
+				allocator.free(a._offset);
+			TLSFAllocator::Stats empty = allocator.getStats();
+			if (empty._used != 0 || empty._padding != 0 || empty._freeBlocks != 1 || empty._largestFree != SIZE)
+				throw std::runtime_error("TLSF free blocks were not merged back into the range.");
+		}
+
+		TLSFAllocator::Stats stats = allocator.getStats();
+		out << "TLSF allocator " << operations << " operations over " << (SIZE >> 20) << " MB, " << stats._failed << " allocations failed\n";
+		out << "allocate: " << allocMs * 1e6 / std::max(allocs, 1u) << " ns, free: " << freeMs * 1e6 / std::max(frees, 1u) << " ns\n";
+		out << "peak: " << (peak._used >> 20) << " MB used, " << peak._padding << " bytes padding, " << peak._freeBlocks << " free blocks, "
+			<< peak.fragmentation() << " fragmentation\n";
+	}
+}
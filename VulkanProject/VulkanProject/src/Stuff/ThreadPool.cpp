@@ -0,0 +1,80 @@
+#pragma region HEADER
+//--------------------------------------------------------------------------------------
+// File: ThreadPool.cpp
+// Project: Function library
+//--------------------------------------------------------------------------------------
+
+#include"Stuff\ThreadPool.h"
+#include<algorithm>
+#pragma endregion
+
+namespace mf{
+
+	ThreadPool::ThreadPool(uint32_t numThreads)
+		: _stop(false)
+	{
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		_workers.reserve(numThreads);
+		for (uint32_t i = 0; i < numThreads; i++)
+			_workers.emplace_back(&ThreadPool::run, this, i);
+	}
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_stop = true;
+		}
+		_signal.notify_all();
+		for (std::thread &t : _workers)
+			t.join();
+	}
+
+	void ThreadPool::enqueue(Task &&task)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_tasks.push_back(std::move(task));
+		}
+		_signal.notify_one();
+	}
+
+	void ThreadPool::run(uint32_t worker)
+	{
+		for (;;)
+		{
+			Task task;
+			{
+				std::unique_lock<std::mutex> guard(_lock);
+				_signal.wait(guard, [this] { return _stop || !_tasks.empty(); });
+				// Queue is drained before the worker exits
+				if (_tasks.empty())
+					return;
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task(worker);
+		}
+	}
+
+	void ThreadPool::parallelFor(uint32_t count, uint32_t grain, const RangeTask &func)
+	{
+		if (count == 0)
+			return;
+		if (grain == 0)
+			grain = (count + size() - 1) / size();
+
+		std::vector<std::future<void>> chunks;
+		chunks.reserve((count + grain - 1) / grain);
+		for (uint32_t begin = 0; begin < count; begin += grain)
+		{
+			uint32_t end = std::min(count, begin + grain);
+			chunks.push_back(submit([&func, begin, end](uint32_t worker) { func(begin, end, worker); }));
+		}
+		// Wait for all chunks, get() rethrows any exception raised in a chunk
+		for (std::future<void> &chunk : chunks)
+			chunk.wait();
+		for (std::future<void> &chunk : chunks)
+			chunk.get();
+	}
+}
@@ -0,0 +1,148 @@
+#include "TechniqueBuilderVulkan.h"
+#include "ShaderVulkan.h"
+#include "VulkanRenderer.h"
+#include "VulkanConstruct.h"
+#include <algorithm>
+
+TechniqueBuilderVulkan::TechniqueBuilderVulkan(VulkanRenderer *renderer)
+	: _renderHandle(renderer)
+{
+}
+
+TechniqueBuilderVulkan::~TechniqueBuilderVulkan()
+{
+	build();
+	for (std::future<void> &job : _jobs)
+		job.wait();
+}
+
+TechniqueVulkan* TechniqueBuilderVulkan::compute(ShaderVulkan* sHandle, VkPipelineLayout layout, const VkSpecializationInfo *specialization)
+{
+	assert(sHandle);
+	std::unique_ptr<Request> req(new Request());
+	req->_compute.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	req->_compute.pNext = NULL;
+	req->_compute.flags = 0;
+	req->_compute.stage = defineShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, sHandle->compShader);
+	req->_compute.stage.pSpecializationInfo = specialization;
+	req->_compute.layout = layout;
+	req->_compute.basePipelineHandle = NULL;
+	req->_compute.basePipelineIndex = 0;
+	return request(std::move(req), sHandle, layout);
+}
+
+TechniqueVulkan* TechniqueBuilderVulkan::graphics(ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, const VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex)
+{
+	std::unique_ptr<Request> req(new Request());
+	req->_graphics.reset(new GraphicsPipelineDesc(_renderHandle, sHandle, renderPass, layout, vertexInputState, subpassIndex));
+	req->_graphics->setCullMode(_cullMode, _frontFace);
+	return request(std::move(req), sHandle, layout);
+}
+
+TechniqueVulkan* TechniqueBuilderVulkan::graphics(ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VertexLayoutVulkan &vertexLayout, uint32_t streams, uint32_t subpassIndex)
+{
+	TechniqueVulkan *technique = graphics(sHandle, renderPass, layout, vertexLayout.vertexInput(streams), subpassIndex);
+	technique->setVertexStreams(streams);
+	return technique;
+}
+
+void TechniqueBuilderVulkan::setCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace)
+{
+	_cullMode = cullMode;
+	_frontFace = frontFace;
+}
+
+TechniqueVulkan* TechniqueBuilderVulkan::request(std::unique_ptr<Request> &&req, ShaderVulkan *sHandle, VkPipelineLayout layout)
+{
+	TechniqueVulkan *technique = new TechniqueVulkan(_renderHandle, sHandle, layout, req->_promise.get_future().share());
+	_requests.push_back(std::move(req));
+	_techniques.push_back(technique);
+	return technique;
+}
+
+void TechniqueBuilderVulkan::build()
+{
+	if (_requests.empty())
+		return;
+	// Split the requests evenly over the workers, the request list is shared by the jobs
+	std::shared_ptr<RequestList> requests = std::make_shared<RequestList>(std::move(_requests));
+	_requests.clear();
+	mf::ThreadPool &workers = _renderHandle->getWorkers();
+	size_t numJobs = std::min<size_t>(requests->size(), workers.size());
+	size_t begin = 0;
+	for (size_t job = 0; job < numJobs; job++)
+	{
+		size_t end = begin + requests->size() / numJobs + (job < requests->size() % numJobs ? 1 : 0);
+		VulkanRenderer *renderer = _renderHandle;
+		_jobs.push_back(workers.submit([renderer, requests, begin, end](uint32_t)
+		{
+			compile(renderer, *requests, begin, end);
+		}));
+		begin = end;
+	}
+}
+
+void TechniqueBuilderVulkan::wait()
+{
+	build();
+	for (std::future<void> &job : _jobs)
+		job.get();
+	_jobs.clear();
+	// Resolve the techniques, compilation errors are rethrown here
+	std::vector<TechniqueVulkan*> techniques;
+	techniques.swap(_techniques);
+	for (TechniqueVulkan *technique : techniques)
+		technique->wait();
+}
+
+void TechniqueBuilderVulkan::compile(VulkanRenderer *renderer, RequestList &requests, size_t begin, size_t end)
+{
+	// Batch the compute and graphics pipelines of the range
+	std::vector<Request*> computeReq, graphicsReq;
+	std::vector<VkComputePipelineCreateInfo> computeInfo;
+	std::vector<VkGraphicsPipelineCreateInfo> graphicsInfo;
+	for (size_t i = begin; i < end; i++)
+	{
+		Request *req = requests[i].get();
+		if (req->_graphics)
+		{
+			graphicsReq.push_back(req);
+			graphicsInfo.push_back(req->_graphics->_info);
+		}
+		else
+		{
+			computeReq.push_back(req);
+			computeInfo.push_back(req->_compute);
+		}
+	}
+
+	PipelineCacheVulkan &cache = renderer->getPipelineCache();
+	std::vector<VkPipeline> pipelines;
+	auto resolve = [&](std::vector<Request*> &reqs, VkResult err, const char *errMsg)
+	{
+		for (size_t i = 0; i < reqs.size(); i++)
+		{
+			if (err == VK_SUCCESS)
+				reqs[i]->_promise.set_value(pipelines[i]);
+			else
+			{
+				// Pipelines created before the failure are released
+				if (pipelines[i])
+					vkDestroyPipeline(renderer->getDevice(), pipelines[i], nullptr);
+				reqs[i]->_promise.set_exception(std::make_exception_ptr(std::runtime_error(errMsg)));
+			}
+		}
+	};
+	if (!computeReq.empty())
+	{
+		pipelines.assign(computeReq.size(), VK_NULL_HANDLE);
+		VkResult err = cache.createComputePipelines((uint32_t)computeInfo.size(), computeInfo.data(), pipelines.data());
+		resolve(computeReq, err, "Failed to create compute pipeline.");
+	}
+	if (!graphicsReq.empty())
+	{
+		pipelines.assign(graphicsReq.size(), VK_NULL_HANDLE);
+		VkResult err = cache.createGraphicsPipelines((uint32_t)graphicsInfo.size(), graphicsInfo.data(), pipelines.data());
+		resolve(graphicsReq, err, "Failed to create graphics pipeline.");
+	}
+}
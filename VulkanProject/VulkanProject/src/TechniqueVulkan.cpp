@@ -5,109 +5,170 @@
 #include "VulkanConstruct.h"
 
 
+GraphicsPipelineDesc::GraphicsPipelineDesc(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, const VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex)
+	: _vertexBindings(vertexInputState.pVertexBindingDescriptions, vertexInputState.pVertexBindingDescriptions + vertexInputState.vertexBindingDescriptionCount),
+	_vertexAttributes(vertexInputState.pVertexAttributeDescriptions, vertexInputState.pVertexAttributeDescriptions + vertexInputState.vertexAttributeDescriptionCount)
+{
+	assert(sHandle);
+	_stages[0] = defineShaderStage(VK_SHADER_STAGE_VERTEX_BIT, sHandle->vertexShader);
+	_stages[1] = defineShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, sHandle->fragmentShader);
+
+	// Vertex input copied from the caller
+	_vertexInputState = vertexInputState;
+	_vertexInputState.pVertexBindingDescriptions = _vertexBindings.data();
+	_vertexInputState.pVertexAttributeDescriptions = _vertexAttributes.data();
+
+	//
+	_inputAssembly = defineInputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+	// Viewport
+	_viewport = defineViewport((float)renderer->getWidth(), (float)renderer->getHeight());
+	_scissor = defineScissorRect(_viewport);
+	_viewportState = defineViewportState(&_viewport, &_scissor);
+
+	// Rasterization state
+	int rasterFlag = DEPTH_CLAMP_BIT;
+	//if (rState->getWireframe())
+	//	rasterFlag |= WIREFRAME_BIT;
+	_rasterization = defineRasterizationState(rasterFlag, /*VK_CULL_MODE_BACK_BIT*/ VK_CULL_MODE_NONE);
+
+	// Multisampling
+	_multisample = defineMultiSampling_OFF();
+
+	// Blend states
+	_blendAttachment = {};
+	_blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	_blendAttachment.blendEnable = VK_FALSE;
+
+	_blend = defineBlendState(&_blendAttachment, sHandle->hasFragmentShader() ? 1 : 0);
+
+	_depthStencil = defineDepthState();
+
+	_dynamicStates[0] = VkDynamicState::VK_DYNAMIC_STATE_VIEWPORT;
+	_dynamicStates[1] = VkDynamicState::VK_DYNAMIC_STATE_SCISSOR;
+
+	_dynamicState = {};
+	_dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	_dynamicState.pNext = nullptr;
+	_dynamicState.flags = 0;
+	_dynamicState.dynamicStateCount = 2;
+	_dynamicState.pDynamicStates = _dynamicStates;
+
+	_info = {};
+	_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	_info.pNext = nullptr;
+	_info.flags = 0;
+	_info.stageCount = sHandle->hasFragmentShader() ? 2 : 1;
+	_info.pStages = _stages;
+	_info.pVertexInputState = &_vertexInputState;
+	_info.pInputAssemblyState = &_inputAssembly;
+	_info.pTessellationState = nullptr;
+	_info.pViewportState = &_viewportState;
+	_info.pRasterizationState = &_rasterization;
+	_info.pMultisampleState = &_multisample;
+	_info.pDepthStencilState = &_depthStencil;
+	_info.pColorBlendState = &_blend;
+	_info.pDynamicState = &_dynamicState;
+	_info.layout = layout;
+	_info.renderPass = renderPass;
+	_info.subpass = subpassIndex;
+	_info.basePipelineHandle = VK_NULL_HANDLE;
+	_info.basePipelineIndex = 0;
+}
+
+void GraphicsPipelineDesc::setCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace)
+{
+	_rasterization.cullMode = cullMode;
+	_rasterization.frontFace = frontFace;
+}
+
 /* Generate a compute pipeline technique
 */
 TechniqueVulkan::TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkPipelineLayout layout)
-	: _sHandle(sHandle), _renderHandle(renderer)
+	: _renderHandle(renderer), _sHandle(sHandle), _layout(layout), _ready(false)
 {
 	createComputePipeline(layout);
+	_ready = true;
 }
 
 /* Generate a graphics pipeline technique
 */
 TechniqueVulkan::TechniqueVulkan( VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState)
-	: _sHandle(sHandle), _renderHandle(renderer), _passHandle(renderPass)
+	: _renderHandle(renderer), _sHandle(sHandle), _passHandle(renderPass), _layout(layout), _ready(false)
 {
 	createGraphicsPipeline(layout, vertexInputState, 0);
+	_ready = true;
 }
 
 TechniqueVulkan::TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkRenderPass renderPass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex)
-	: _sHandle(sHandle), _renderHandle(renderer), _passHandle(renderPass)
+	: _renderHandle(renderer), _sHandle(sHandle), _passHandle(renderPass), _layout(layout), _ready(false)
 {
 	createGraphicsPipeline(layout, vertexInputState, subpassIndex);
+	_ready = true;
+}
+
+TechniqueVulkan::TechniqueVulkan(VulkanRenderer* renderer, ShaderVulkan* sHandle, VkPipelineLayout layout, std::shared_future<VkPipeline> pending)
+	: pipeline(VK_NULL_HANDLE), _renderHandle(renderer), _sHandle(sHandle), _passHandle(VK_NULL_HANDLE), _layout(layout), _pending(pending), _ready(false)
+{
 }
 
 TechniqueVulkan::~TechniqueVulkan()
 {
-	vkDestroyPipeline(_renderHandle->getDevice(), pipeline, nullptr);
+	// Pipelines still compiling are waited on before destruction
+	try { wait(); }
+	catch (const std::exception&) {}
+	if (pipeline)
+		vkDestroyPipeline(_renderHandle->getDevice(), pipeline, nullptr);
 }
 
 void TechniqueVulkan::bind(VkCommandBuffer cmdBuf, VkPipelineBindPoint bindPoint)
 {
+	if (!isReady())
+	{
+		if (_fallback)
+		{
+			_fallback->bind(cmdBuf, bindPoint);
+			return;
+		}
+		wait();
+	}
 	vkCmdBindPipeline(cmdBuf, bindPoint, pipeline);
 }
 
-void TechniqueVulkan::createGraphicsPipeline(VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex)
+bool TechniqueVulkan::isReady()
 {
-	assert(_sHandle);
-	VkPipelineShaderStageCreateInfo stages[2];
-	stages[0] = defineShaderStage(VK_SHADER_STAGE_VERTEX_BIT, _sHandle->vertexShader);
-	stages[1] = defineShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, _sHandle->fragmentShader);
-
-	//
-	VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo =
-		defineInputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-	// Viewport
-	VkViewport viewport = defineViewport((float)_renderHandle->getWidth(), (float)_renderHandle->getHeight());
-	VkRect2D scissor = defineScissorRect(viewport);
-	VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo =
-		defineViewportState(&viewport, &scissor);
+	if (_ready.load(std::memory_order_acquire))
+		return true;
+	// Not ready while another thread holds the lock (it may be blocked in wait)
+	std::unique_lock<std::mutex> lock(_pendingLock, std::try_to_lock);
+	if (lock.owns_lock() && _pending.valid() && _pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		resolve();
+	return _ready.load(std::memory_order_acquire);
+}
 
-	// Rasterization state
-	int rasterFlag = DEPTH_CLAMP_BIT;
-	//if (rState->getWireframe())
-	//	rasterFlag |= WIREFRAME_BIT;
-	VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo =
-		defineRasterizationState(rasterFlag, /*VK_CULL_MODE_BACK_BIT*/ VK_CULL_MODE_NONE);
+void TechniqueVulkan::wait()
+{
+	if (_ready.load(std::memory_order_acquire))
+		return;
+	std::lock_guard<std::mutex> lock(_pendingLock);
+	resolve();
+}
 
-	// Multisampling
-	VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo =
-		defineMultiSampling_OFF();
+void TechniqueVulkan::resolve()
+{
+	if (!_pending.valid())
+		return;
+	// A failed compilation keeps the future, the error is rethrown on each wait
+	pipeline = _pending.get();
+	_pending = std::shared_future<VkPipeline>();
+	_ready.store(pipeline != VK_NULL_HANDLE, std::memory_order_release);
+}
 
-	// Blend states
-	VkPipelineColorBlendAttachmentState pipelineColorBlendAttachmentState = {};
-	pipelineColorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	pipelineColorBlendAttachmentState.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo =
-		defineBlendState(&pipelineColorBlendAttachmentState, _sHandle->hasFragmentShader() ? 1 : 0);
-
-	VkPipelineDepthStencilStateCreateInfo depthStencil =
-		defineDepthState();
-
-	const unsigned DYNAMIC_STATE_COUNT = 2;
-	VkDynamicState viewportDynamicState[DYNAMIC_STATE_COUNT] = { VkDynamicState::VK_DYNAMIC_STATE_VIEWPORT, VkDynamicState::VK_DYNAMIC_STATE_SCISSOR };
-
-	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicStateCreateInfo.pNext = nullptr;
-	dynamicStateCreateInfo.flags = 0;
-	dynamicStateCreateInfo.dynamicStateCount = DYNAMIC_STATE_COUNT;
-	dynamicStateCreateInfo.pDynamicStates = viewportDynamicState;
-
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.pNext = nullptr;
-	pipelineInfo.flags = 0;
-	pipelineInfo.stageCount = _sHandle->hasFragmentShader() ? 2 : 1;
-	pipelineInfo.pStages = stages;
-	pipelineInfo.pVertexInputState = &vertexInputState;
-	pipelineInfo.pInputAssemblyState = &pipelineInputAssemblyStateCreateInfo;
-	pipelineInfo.pTessellationState = nullptr;
-	pipelineInfo.pViewportState = &pipelineViewportStateCreateInfo;
-	pipelineInfo.pRasterizationState = &pipelineRasterizationStateCreateInfo;
-	pipelineInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pColorBlendState = &pipelineColorBlendStateCreateInfo;
-	pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
-	pipelineInfo.layout = layout;
-	pipelineInfo.renderPass = _passHandle;
-	pipelineInfo.subpass = subpassIndex;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	pipelineInfo.basePipelineIndex = 0;
-
-	VkResult err = vkCreateGraphicsPipelines(_renderHandle->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+void TechniqueVulkan::createGraphicsPipeline(VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo &vertexInputState, uint32_t subpassIndex)
+{
+	assert(_sHandle);
+	GraphicsPipelineDesc desc(_renderHandle, _sHandle, _passHandle, layout, vertexInputState, subpassIndex);
+	VkResult err = _renderHandle->getPipelineCache().createGraphicsPipelines(1, &desc._info, &pipeline);
 
 	if (err != VK_SUCCESS){
 		std::cout << "Failed to create graphics pipeline.\n";
@@ -127,7 +188,7 @@ void TechniqueVulkan::createComputePipeline(VkPipelineLayout layout)
 	info.basePipelineHandle = NULL;
 	info.basePipelineIndex = 0;
 
-	VkResult err = vkCreateComputePipelines(_renderHandle->getDevice(), VK_NULL_HANDLE, 1, &info, NULL, &pipeline);
+	VkResult err = _renderHandle->getPipelineCache().createComputePipelines(1, &info, &pipeline);
 	if (err != VK_SUCCESS)
 		throw std::runtime_error("Failed to create compute pipeline.");
 }
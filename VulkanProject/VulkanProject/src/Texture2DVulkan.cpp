@@ -7,7 +7,8 @@
 #include<assert.h>
 
 Texture2DVulkan::Texture2DVulkan(VulkanRenderer *renderer, Sampler2DVulkan *sampler)
-	: _renderHandle(renderer), _samplerHandle(sampler), _imageHandle(nullptr), imageInfo({NULL, NULL, VK_IMAGE_LAYOUT_UNDEFINED })
+	: resident(false), streaming(false), imagePool(0), poolOffset(0),
+	_renderHandle(renderer), _samplerHandle(sampler), _imageHandle(nullptr), imageInfo({NULL, NULL, VK_IMAGE_LAYOUT_UNDEFINED })
 {
 	for (int i = 0; i < MAX_TEX_BINDINGS; i++)
 		slotBindings[i] = NULL;
@@ -15,6 +16,9 @@ Texture2DVulkan::Texture2DVulkan(VulkanRenderer *renderer, Sampler2DVulkan *samp
 
 Texture2DVulkan::~Texture2DVulkan()
 {
+	// Uploads in flight take over the image
+	if (streaming && !resident)
+		_renderHandle->getTextureStreamer().cancel(this);
 	destroyImg();
 }
 
@@ -22,8 +26,11 @@ void Texture2DVulkan::destroyImg()
 {
 	if (_imageHandle)
 	{
+		_renderHandle->getDescriptorCache().invalidate((uint64_t)imageInfo.imageView);
 		vkDestroyImageView(_renderHandle->getDevice(), imageInfo.imageView, nullptr);
 		vkDestroyImage(_renderHandle->getDevice(), _imageHandle, nullptr);
+		_renderHandle->freePhysicalMemory((MemoryPool)imagePool, poolOffset);
+		_imageHandle = nullptr;
 	}
 }
 
@@ -56,19 +63,43 @@ int Texture2DVulkan::loadFromFile(std::string filename)
 	}
 	else
 		throw std::runtime_error("Image format not supported...");
-	_imageHandle = createTexture2D(_renderHandle->getDevice(), w, h, format);
-	_renderHandle->bindPhysicalMemory(_imageHandle, MemoryPool::IMAGE_RGBA8_BUFFER);
-	// Create and transfer image
+	createImage(w, h, format);
+	// Transfer image
 	_renderHandle->transitionImageLayout(_imageHandle, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 	_renderHandle->transferImageData(_imageHandle, rgb, glm::uvec3(w, h, 1), bytes);
 	stbi_image_free(rgb);
 	_renderHandle->transitionImageLayout(_imageHandle, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	resident = true;
 
+	return 0;
+}
+
+void Texture2DVulkan::loadFromFileAsync(std::string filename, uint32_t consumerQueue)
+{
+	if (streaming && !resident)
+		_renderHandle->getTextureStreamer().cancel(this);
+	destroyImg();
+	resident = false;
+	streaming = true;
+	_renderHandle->getTextureStreamer().request(this, filename, consumerQueue);
+}
+
+void Texture2DVulkan::createImage(uint32_t width, uint32_t height, VkFormat format)
+{
+	_imageHandle = createTexture2D(_renderHandle->getDevice(), width, height, format);
+	imagePool = MemoryPool::IMAGE_RGBA8_BUFFER;
+	poolOffset = _renderHandle->bindPhysicalMemory(_imageHandle, MemoryPool::IMAGE_RGBA8_BUFFER);
 	// Create image view
 	imageInfo.imageView = createImageView(_renderHandle->getDevice(), _imageHandle, format);
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
 
-	return 0;
+void Texture2DVulkan::setResident()
+{
+	resident = true;
+	for (auto &bindPoint : pendingBindPoints)
+		attachBindPoint(bindPoint.first, bindPoint.second);
+	pendingBindPoints.clear();
 }
 
 void Texture2DVulkan::createShadowMap(uint32_t height, uint32_t width, VkFormat shadowMapFormat)
@@ -90,7 +121,8 @@ void Texture2DVulkan::createShadowMap(uint32_t height, uint32_t width, VkFormat
 	if (vkCreateImage(_renderHandle->getDevice(), &imageCreateInfo, nullptr, &_imageHandle) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create shadow map");
 
-	_renderHandle->bindPhysicalMemory(_imageHandle, MemoryPool::IMAGE_D16_BUFFER);
+	imagePool = MemoryPool::IMAGE_D16_BUFFER;
+	poolOffset = _renderHandle->bindPhysicalMemory(_imageHandle, MemoryPool::IMAGE_D16_BUFFER);
 
 	// Create image view
 	VkImageViewCreateInfo depthStencilView = {};
@@ -110,20 +142,21 @@ void Texture2DVulkan::createShadowMap(uint32_t height, uint32_t width, VkFormat
 		throw std::runtime_error("Failed to create shadow map view");
 
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	resident = true;
 }
 
 
 void Texture2DVulkan::attachBindPoint(uint32_t attachmentIndex, VkDescriptorSetLayout layout)
 {
-	if (!slotBindings[attachmentIndex])
-		// Descriptor
-		slotBindings[attachmentIndex] = _renderHandle->generateDescriptor(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &layout);
-
+	if (streaming && !resident)
+	{
+		pendingBindPoints.push_back(std::make_pair(attachmentIndex, layout));
+		return;
+	}
+	// Descriptor shared with other objects binding the image and sampler
 	imageInfo.sampler = _samplerHandle->_sampler;
-	VkWriteDescriptorSet writes[1];
-	writeDescriptorStruct_IMG_COMBINED(writes[0], slotBindings[attachmentIndex], 0, 0, 1, &imageInfo);
-	vkUpdateDescriptorSets(_renderHandle->getDevice(), 1, writes, 0, nullptr);
-
+	slotBindings[attachmentIndex] = _renderHandle->getDescriptorCache().get(layout,
+		DescriptorCacheVulkan::Binding::image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo.imageView, imageInfo.imageLayout, imageInfo.sampler));
 }
 
 void Texture2DVulkan::bind(VkCommandBuffer cmdBuf, uint32_t indexCombined, VkPipelineLayout layout, VkPipelineBindPoint pipeBinding)
@@ -0,0 +1,253 @@
+#include "TextureStreamerVulkan.h"
+#include "Texture2DVulkan.h"
+#include "VulkanRenderer.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace
+{
+	const VkFormat STREAM_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;	// Decoded as RGBA
+	const uint32_t STREAM_TEXEL_BYTES = 4;
+
+	VkImageMemoryBarrier imageBarrier(VkImage image, VkImageLayout from, VkImageLayout to, VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+		uint32_t srcFamily, uint32_t dstFamily)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = from;
+		barrier.newLayout = to;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = srcFamily;
+		barrier.dstQueueFamilyIndex = dstFamily;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		return barrier;
+	}
+}
+
+TextureStreamerVulkan::TextureStreamerVulkan()
+	: _renderHandle(nullptr), _stats()
+{
+}
+
+void TextureStreamerVulkan::init(VulkanRenderer *renderer)
+{
+	_renderHandle = renderer;
+}
+
+void TextureStreamerVulkan::destroy()
+{
+	for (std::shared_ptr<Request> &req : _requests)
+	{
+		if (req->_decode.valid())
+			req->_decode.wait();
+		if (req->_pixels)
+			stbi_image_free(req->_pixels);
+		if (!req->_texture && req->_orphanImage)
+		{
+			_renderHandle->getDescriptorCache().invalidate((uint64_t)req->_orphanView);
+			vkDestroyImageView(_renderHandle->getDevice(), req->_orphanView, nullptr);
+			vkDestroyImage(_renderHandle->getDevice(), req->_orphanImage, nullptr);
+			_renderHandle->freePhysicalMemory(MemoryPool::IMAGE_RGBA8_BUFFER, req->_orphanOffset);
+		}
+	}
+	_requests.clear();
+	releaseAcquires(true);
+}
+
+void TextureStreamerVulkan::request(Texture2DVulkan *texture, const std::string &filename, uint32_t consumer)
+{
+	std::shared_ptr<Request> req = std::make_shared<Request>();
+	req->_texture = texture;
+	req->_file = filename;
+	req->_consumer = consumer;
+	req->_state = DECODING;
+	req->_pixels = nullptr;
+	req->_width = req->_height = 0;
+	req->_orphanImage = VK_NULL_HANDLE;
+	req->_orphanView = VK_NULL_HANDLE;
+	// The job owns a reference, the request outlives a cancel
+	req->_decode = _renderHandle->getWorkers().submit([req](uint32_t)
+	{
+		int bpp;
+		req->_pixels = stbi_load(req->_file.c_str(), &req->_width, &req->_height, &bpp, STBI_rgb_alpha);
+	});
+	_requests.push_back(req);
+	_stats._requested++;
+}
+
+void TextureStreamerVulkan::cancel(Texture2DVulkan *texture)
+{
+	for (auto it = _requests.begin(); it != _requests.end(); it++)
+	{
+		Request &req = **it;
+		if (req._texture != texture)
+			continue;
+		if (req._state == DECODING)
+		{
+			req._decode.wait();
+			if (req._pixels)
+				stbi_image_free(req._pixels);
+			_requests.erase(it);
+			return;
+		}
+		// The transfer referencing the image is recorded, the image is released when the upload completes
+		req._texture = nullptr;
+		req._orphanImage = texture->_imageHandle;
+		req._orphanView = texture->imageInfo.imageView;
+		req._orphanOffset = texture->poolOffset;
+		texture->_imageHandle = VK_NULL_HANDLE;
+		return;
+	}
+}
+
+void TextureStreamerVulkan::record(VkCommandBuffer transferCmd)
+{
+	uint32_t memFamily = _renderHandle->getQueueFamily(QueueType::MEM);
+	for (std::shared_ptr<Request> &req : _requests)
+	{
+		if (req->_state != DECODING || req->_decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			continue;
+		if (!req->_pixels)
+			continue;	// Failed requests are removed below
+		size_t size = (size_t)req->_width * req->_height * STREAM_TEXEL_BYTES;
+		StagingRingVulkan::Allocation src;
+		if (!_renderHandle->getStagingRing().tryAllocate(size, STREAM_TEXEL_BYTES, src))
+		{
+			// Retried next frame, the render loop never waits on the staging space
+			_stats._deferred++;
+			continue;
+		}
+		memcpy(src._data, req->_pixels, size);
+		stbi_image_free(req->_pixels);
+		req->_pixels = nullptr;
+
+		Texture2DVulkan *tex = req->_texture;
+		tex->createImage(req->_width, req->_height, STREAM_FORMAT);
+
+		// Copy into the image and release it to the consumer family
+		VkImageMemoryBarrier barrier = imageBarrier(tex->_imageHandle, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		vkCmdPipelineBarrier(transferCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = src._offset;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { (uint32_t)req->_width, (uint32_t)req->_height, 1 };
+		vkCmdCopyBufferToImage(transferCmd, src._buffer, tex->_imageHandle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		uint32_t consumerFamily = _renderHandle->getQueueFamily((QueueType)req->_consumer);
+		if (consumerFamily == memFamily)
+			barrier = imageBarrier(tex->_imageHandle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		else
+			barrier = imageBarrier(tex->_imageHandle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, 0, memFamily, consumerFamily);
+		vkCmdPipelineBarrier(transferCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		req->_state = RECORDED;
+		_stats._bytes += size;
+	}
+
+	// Drop the requests that failed decoding
+	for (auto it = _requests.begin(); it != _requests.end();)
+	{
+		Request &req = **it;
+		if (req._state == DECODING && !req._pixels && req._decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			fprintf(stderr, "Error loading texture file: %s\n", req._file.c_str());
+			_stats._failed++;
+			it = _requests.erase(it);
+		}
+		else
+			it++;
+	}
+}
+
+void TextureStreamerVulkan::submitted(const vk::Ticket &ticket)
+{
+	for (std::shared_ptr<Request> &req : _requests)
+	{
+		if (req->_state != RECORDED)
+			continue;
+		req->_state = UPLOADING;
+		req->_ticket = ticket;
+	}
+}
+
+void TextureStreamerVulkan::acquire()
+{
+	releaseAcquires(false);
+
+	VkDevice device = _renderHandle->getDevice();
+	uint32_t memFamily = _renderHandle->getQueueFamily(QueueType::MEM);
+	std::vector<VkImageMemoryBarrier> barriers[QueueType::COUNT];
+	for (auto it = _requests.begin(); it != _requests.end();)
+	{
+		Request &req = **it;
+		if (req._state != UPLOADING || !_renderHandle->queues.isComplete(req._ticket))
+		{
+			it++;
+			continue;
+		}
+		if (!req._texture)
+		{
+			// Cancelled while uploading
+			_renderHandle->getDescriptorCache().invalidate((uint64_t)req._orphanView);
+			vkDestroyImageView(device, req._orphanView, nullptr);
+			vkDestroyImage(device, req._orphanImage, nullptr);
+			_renderHandle->freePhysicalMemory(MemoryPool::IMAGE_RGBA8_BUFFER, req._orphanOffset);
+		}
+		else
+		{
+			uint32_t consumerFamily = _renderHandle->getQueueFamily((QueueType)req._consumer);
+			if (consumerFamily != memFamily)
+				barriers[req._consumer].push_back(imageBarrier(req._texture->_imageHandle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					0, VK_ACCESS_SHADER_READ_BIT, memFamily, consumerFamily));
+			// Commands recorded after this point are submitted after the acquire on the consumer queue
+			req._texture->setResident();
+			_stats._resident++;
+		}
+		it = _requests.erase(it);
+	}
+
+	// The transfers are complete (the release happened before), acquire without waiting on a semaphore
+	for (uint32_t queue = 0; queue < QueueType::COUNT; queue++)
+	{
+		if (barriers[queue].empty())
+			continue;
+		AcquireBatch batch;
+		batch._queue = queue;
+		batch._cmdBuf = allocateCmdBuf(device, _renderHandle->queues[queue].pool);
+		beginCmdBuf(batch._cmdBuf);
+		vkCmdPipelineBarrier(batch._cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr,
+			(uint32_t)barriers[queue].size(), barriers[queue].data());
+		if (vkEndCommandBuffer(batch._cmdBuf) != VK_SUCCESS)
+			throw std::runtime_error("Failed to record texture acquire commands.");
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch._cmdBuf;
+		batch._ticket = _renderHandle->queues.submit(queue, submitInfo);
+		_acquires.push_back(batch);
+	}
+}
+
+void TextureStreamerVulkan::releaseAcquires(bool wait)
+{
+	for (auto it = _acquires.begin(); it != _acquires.end();)
+	{
+		if (wait)
+			_renderHandle->queues.wait(it->_ticket);
+		else if (!_renderHandle->queues.isComplete(it->_ticket))
+		{
+			it++;
+			continue;
+		}
+		vkFreeCommandBuffers(_renderHandle->getDevice(), _renderHandle->queues[it->_queue].pool, 1, &it->_cmdBuf);
+		it = _acquires.erase(it);
+	}
+}
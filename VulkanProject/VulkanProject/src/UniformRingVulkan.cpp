@@ -0,0 +1,78 @@
+#include "UniformRingVulkan.h"
+#include <cstring>
+#include <stdexcept>
+
+UniformRingVulkan::UniformRingVulkan()
+	: _device(VK_NULL_HANDLE), _buffer(VK_NULL_HANDLE), _memory(VK_NULL_HANDLE), _mapped(nullptr), _regionSize(0), _alignment(1),
+	_numRegions(1), _frame(0), _slots(0), _writes(0)
+{
+}
+
+void UniformRingVulkan::init(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize regionSize, uint32_t numRegions, VkDeviceSize alignment)
+{
+	_device = device;
+	_buffer = buffer;
+	_memory = memory;
+	_regionSize = regionSize;
+	_numRegions = numRegions;
+	_alignment = alignment;
+	_frame = 0;
+	_allocator.init(regionSize);
+	void *mapped;
+	if (vkMapMemory(device, memory, 0, regionSize * numRegions, 0, &mapped) != VK_SUCCESS)
+		throw std::runtime_error("Failed to map the uniform ring.");
+	_mapped = (uint8_t*)mapped;
+}
+
+void UniformRingVulkan::destroy()
+{
+	if (_mapped)
+		vkUnmapMemory(_device, _memory);
+	_mapped = nullptr;
+}
+
+UniformRingVulkan::Slot UniformRingVulkan::allocate(VkDeviceSize size)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	uint64_t offset = _allocator.allocate(size, _alignment);
+	if (offset == mf::TLSFAllocator::INVALID_OFFSET)
+		return { 0, 0 };
+	_slots++;
+	return { offset, size };
+}
+
+void UniformRingVulkan::free(const Slot &slot)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	_allocator.free(slot._offset);
+	_slots--;
+}
+
+void UniformRingVulkan::write(const Slot &slot, const void *data, VkDeviceSize size)
+{
+	if (size > slot._size)
+		throw std::runtime_error("Uniform ring slot cannot fit the data.");
+	VkDeviceSize region = (_frame + 1) % _numRegions;
+	memcpy(_mapped + region * _regionSize + slot._offset, data, (size_t)size);
+	_writes++;
+}
+
+void UniformRingVulkan::writeAll(const Slot &slot, const void *data, VkDeviceSize size)
+{
+	if (size > slot._size)
+		throw std::runtime_error("Uniform ring slot cannot fit the data.");
+	for (uint32_t i = 0; i < _numRegions; i++)
+		memcpy(_mapped + i * _regionSize + slot._offset, data, (size_t)size);
+}
+
+UniformRingVulkan::Stats UniformRingVulkan::getStats()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+	Stats stats;
+	stats._regionSize = _regionSize;
+	stats._used = _allocator.getStats()._used;
+	stats._regions = _numRegions;
+	stats._slots = _slots;
+	stats._writes = _writes;
+	return stats;
+}
@@ -1,6 +1,7 @@
 #include "VertexBufferVulkan.h"
 #include <vulkan/vulkan.h>
 #include <stdexcept>
+#include <cassert>
 #define VULKAN_DEVICE_IMPLEMENTATION
 #include "VulkanConstruct.h"
 #include "VulkanRenderer.h"
@@ -8,20 +9,20 @@
 VertexBufferVulkan::VertexBufferVulkan(VulkanRenderer *renderer, size_t size, DATA_USAGE usage)
 	: _renderHandle(renderer), _bufferHandle(NULL), memSize(size)
 {
-	// Create buffer and allocater physical memory for it
-	_bufferHandle = createBuffer(_renderHandle->getDevice(), size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-	renderer->bindPhysicalMemory(_bufferHandle, MemoryPool::VERTEX_BUFFER);
+	// Sub-range of the shared vertex buffer
+	_view = renderer->getBufferArena(BufferArenaVulkan::VERTEX).allocate(size);
+	_bufferHandle = _view._buffer;
 }
 
 VertexBufferVulkan::~VertexBufferVulkan()
 {
 	//Clean-up
-	vkDestroyBuffer(_renderHandle->getDevice(), _bufferHandle, nullptr);
+	_renderHandle->getBufferArena(BufferArenaVulkan::VERTEX).free(_view);
 }
 
 void VertexBufferVulkan::setData(const void * data, size_t size, size_t offset)
 {
-	_renderHandle->transferBufferInitial(_bufferHandle, data, size, offset);
+	_renderHandle->transferBufferInitial(_bufferHandle, data, size, _view._offset + offset);
 }
 void VertexBufferVulkan::setData(const void* data, Binding& binding)
 {
@@ -30,7 +31,7 @@ void VertexBufferVulkan::setData(const void* data, Binding& binding)
 
 void VertexBufferVulkan::bind(VkCommandBuffer cmdBuf, size_t offset, size_t size, unsigned int location)
 {
-	VkDeviceSize offsets[] = { offset };
+	VkDeviceSize offsets[] = { _view._offset + offset };
 	vkCmdBindVertexBuffers(cmdBuf, location, 1, &_bufferHandle, offsets);
 }
 
@@ -49,6 +50,19 @@ void VertexBufferVulkan::Binding::bind(VkCommandBuffer cmdBuf, uint32_t location
 {
 	buffer->bind(cmdBuf, offset, sizeElement * numElements, location);
 }
+void VertexBufferVulkan::Binding::bind(VkCommandBuffer cmdBuf, Binding* const* bindings, uint32_t count, uint32_t firstLocation)
+{
+	const uint32_t MAX_BINDINGS = 16;
+	VkBuffer buffers[MAX_BINDINGS];
+	VkDeviceSize offsets[MAX_BINDINGS];
+	assert(count <= MAX_BINDINGS);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		buffers[i] = bindings[i]->buffer->_bufferHandle;
+		offsets[i] = bindings[i]->buffer->_view._offset + bindings[i]->offset;
+	}
+	vkCmdBindVertexBuffers(cmdBuf, firstLocation, count, buffers, offsets);
+}
 VertexBufferVulkan::Binding::Binding()
 	: buffer(nullptr), sizeElement(0), numElements(0), offset(0)
 {
@@ -0,0 +1,61 @@
+#include "VertexLayoutVulkan.h"
+#include "VulkanConstruct.h"
+#include <stdexcept>
+
+VertexLayoutVulkan::VertexLayoutVulkan()
+{
+	for (uint32_t i = 0; i < STREAM_COUNT; i++)
+		_bindings[i] = nullptr;
+}
+
+void VertexLayoutVulkan::setStream(Stream stream, VertexBufferVulkan::Binding *binding, std::initializer_list<Attribute> attributes)
+{
+	_bindings[stream] = binding;
+	_attributes[stream].assign(attributes);
+}
+
+VkPipelineVertexInputStateCreateInfo VertexLayoutVulkan::vertexInput(uint32_t streams)
+{
+	_inputBindings.clear();
+	_inputAttributes.clear();
+	for (uint32_t i = 0; i < STREAM_COUNT; i++)
+	{
+		if (!(streams & (1 << i)))
+			continue;
+		if (!_bindings[i])
+			throw std::runtime_error("Vertex stream consumed by the technique is not set.");
+		_inputBindings.push_back(defineVertexBinding(i, _bindings[i]->sizeElement));
+		for (const Attribute &attri : _attributes[i])
+			_inputAttributes.push_back(defineVertexAttribute(i, attri._location, attri._format, attri._offset));
+	}
+	return defineVertexBufferBindings(_inputBindings.data(), (uint32_t)_inputBindings.size(), _inputAttributes.data(), (uint32_t)_inputAttributes.size());
+}
+
+void VertexLayoutVulkan::bind(VkCommandBuffer cmdBuf, uint32_t streams)
+{
+	// Bind each run of consecutive slots together
+	uint32_t i = 0;
+	while (i < STREAM_COUNT)
+	{
+		if (!(streams & (1 << i)))
+		{
+			i++;
+			continue;
+		}
+		uint32_t first = i;
+		while (i < STREAM_COUNT && (streams & (1 << i)))
+			i++;
+		VertexBufferVulkan::Binding::bind(cmdBuf, _bindings + first, i - first, first);
+	}
+}
+
+uint32_t VertexLayoutVulkan::vertexSize(uint32_t streams)
+{
+	uint32_t size = 0;
+	for (uint32_t i = 0; i < STREAM_COUNT; i++)
+	{
+		if ((streams & (1 << i)) && _bindings[i])
+			size += _bindings[i]->sizeElement;
+	}
+	return size;
+}
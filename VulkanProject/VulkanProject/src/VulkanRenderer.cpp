@@ -8,10 +8,13 @@
 #include "ConstantBufferVulkan.h"
 #include "TechniqueVulkan.h"
 #include "Scene.h"
+#ifdef VK_USE_PLATFORM_WIN32_KHR
 #include <SDL/SDL_syswm.h>
+#endif
 #include <assert.h>
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 
 
 VulkanRenderer::VulkanRenderer()
@@ -26,6 +29,8 @@ VulkanRenderer::~VulkanRenderer() { }
 int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int height, uint32_t BIT_FLAGS)
 {
 	this->scene = scene;
+	headless = hasFlag(BIT_FLAGS, HEADLESS);
+	bindless = hasFlag(BIT_FLAGS, BINDLESS);
 
 	swapchainExtent.height = height;
 	swapchainExtent.width = width;
@@ -58,12 +63,17 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 
 	std::vector<const char*> enabledExtensions =
 	{
-		"VK_KHR_surface",
-		"VK_KHR_win32_surface",
 #ifdef _DEBUG
 		"VK_EXT_debug_report"
 #endif
 	};
+	if (!headless)
+	{
+		enabledExtensions.push_back("VK_KHR_surface");
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+		enabledExtensions.push_back("VK_KHR_win32_surface");
+#endif
+	}
 	VkInstanceCreateInfo instanceCreateInfo = {};
 	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceCreateInfo.pNext = nullptr;
@@ -82,34 +92,16 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 	/* Create window
 	*/
 
-	// Initiate SDL
-	if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+	// Initiate SDL, headless runs only need the timer & event subsystems
+	if (SDL_Init(headless ? (SDL_INIT_TIMER | SDL_INIT_EVENTS) : SDL_INIT_EVERYTHING) != 0)
 	{
 		fprintf(stderr, "%s", SDL_GetError());
 		exit(-1);
 	}
 
-	// Create window
-	window = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN);
-
-	/* Create window surface
-	Note* Surface 'must' be created before physical device creation as it influences the selection.
-	*/
-
-	// Get the window version
-	SDL_SysWMinfo info;
-	SDL_VERSION(&info.version);
-	if (SDL_GetWindowWMInfo(window, &info) != SDL_TRUE)
-		throw std::runtime_error("Window errror");
-
-	// Utilize version to create the window surface
-	VkWin32SurfaceCreateInfoKHR w32sci = {};
-	w32sci.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-	w32sci.pNext = NULL;
-	w32sci.hinstance = GetModuleHandle(NULL);
-	w32sci.hwnd = info.info.win.window;
-	VkResult err = vkCreateWin32SurfaceKHR(instance, &w32sci, nullptr, &windowSurface);
-	assert(err == VK_SUCCESS);
+	// Surface 'must' be created before physical device creation as it influences the selection.
+	if (!headless)
+		createWindow(width, height);
 
 
 	/* Create physical device
@@ -151,7 +143,18 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 	queues.define(queueInfo, num_queue_families, prioArr);
 	// Info on device
 	const char* deviceLayers[] = { "VK_LAYER_LUNARG_standard_validation" };
-	const char* deviceExtensions[] = { "VK_KHR_swapchain" };
+	// Headless frames never reach a presentation engine, scenes leave them in getPresentLayout() instead of PRESENT_SRC.
+	std::vector<const char*> deviceExtensions;
+	if (!headless)
+		deviceExtensions.push_back("VK_KHR_swapchain");
+	// Descriptor cache writes sets through update templates when available
+	bool descriptorTemplates = checkDeviceExtensionSupport(physicalDevice, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	if (descriptorTemplates)
+		deviceExtensions.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	// GPU culled draws read their count from a buffer when available
+	bool drawIndirectCount = checkDeviceExtensionSupport(physicalDevice, VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (drawIndirectCount)
+		deviceExtensions.push_back(VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -168,38 +171,201 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 	deviceCreateInfo.ppEnabledLayerNames = nullptr;
 #endif
 
-	deviceCreateInfo.enabledExtensionCount = 1;
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
+	deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
+	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	// Features
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.fillModeNonSolid = true;
 	deviceFeatures.depthClamp = true;
 	deviceFeatures.depthBiasClamp = true;
+	{
+		VkPhysicalDeviceFeatures supported;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
+		multiDrawIndirect = supported.multiDrawIndirect == VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supported.multiDrawIndirect;
+	}
+	if (bindless)
+	{
+		// Table arrays are indexed by push constant values
+		VkPhysicalDeviceFeatures supported;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
+		if (!supported.shaderSampledImageArrayDynamicIndexing || !supported.shaderStorageImageArrayDynamicIndexing)
+			throw std::runtime_error("Device does not support dynamic indexing of descriptor arrays, required by BINDLESS.");
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = true;
+		deviceFeatures.shaderStorageImageArrayDynamicIndexing = true;
+	}
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
 	// Create (vulkan) device
-	err = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
+	VkResult err = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
 	if (err)
 		throw std::runtime_error("Failed to create device...");
-	VkSurfaceCapabilitiesKHR surfaceCapabilities;
-	err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, windowSurface, &surfaceCapabilities);
-	if (err)
-		throw std::runtime_error("Failed to acquire surface capabilities...");
-	if (!hasFlag(surfaceCapabilities.supportedUsageFlags, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
-		throw std::runtime_error("Swapchain images does not support storage...");
-	else
-		std::cout << "Swapchain storage supported!\n";
-
 	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
 	queues.fetchDeviceQueues(device);
+	if (drawIndirectCount)
+	{
+		drawIndirectCountFn = (PFN_vkCmdDrawIndirectCountAMD)vkGetDeviceProcAddr(device, "vkCmdDrawIndirectCountAMD");
+		drawIndexedIndirectCountFn = (PFN_vkCmdDrawIndexedIndirectCountAMD)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountAMD");
+	}
+	// Pipelines compiled by previous runs
+	pipelineCache.load(device, deviceProperties, PIPELINE_CACHE_FILE);
 #
 #ifdef _DEBUG
 	checkValidImageFormats(physicalDevice);
 #endif
 
-	/* Create swap chain
+	/* Create swap chain (or the offscreen images replacing it)
 	*/
+	if (headless)
+		createOffscreenTargets(BIT_FLAGS);
+	else
+		createSwapchain(BIT_FLAGS);
+
+	// Pools allocate device memory when first used, the scene sizes the first allocations
+	std::vector<size_t> chunkSizes(POOL_CHUNK_SIZE, POOL_CHUNK_SIZE + MemoryPool::Count);
+	scene->defineMemoryPools(chunkSizes);
+	for (uint32_t i = 0; i < memPool.size(); i++)
+		memPool[i].chunkSize = chunkSizes[i];
+	createStagingBuffer();
+	// Create command pools
+	queues.createCommandPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+	createDepthComponents();
+	for (uint32_t i = 0; i < BufferArenaVulkan::COUNT; i++)
+		arenas[i].init(this, (BufferArenaVulkan::Usage)i, ARENA_BLOCK_SIZE);
+
+	// Create render pass
+	scene->_renderHandle = this;	// Required for creation of shadow map
+	std::vector<VkImageView> additionalAttatchments;
+	frameBufferPass = scene->defineRenderPass(device, swapchainFormat.format, depthFormat, additionalAttatchments);
+	
+	// Create frame buffers.
+	NUM_FRAME_ATTACH = 2 + (uint32_t)additionalAttatchments.size();
+	swapChainFramebuffers.resize(swapchainImages.size());
+	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+	{
+		std::vector<VkImageView> attachments;
+		attachments.push_back(swapchainImageViews[i]);
+		attachments.push_back(depthImageView);
+		for (auto att : additionalAttatchments)
+			attachments.push_back(att);
+
+		swapChainFramebuffers[i] = createFramebuffer(device, frameBufferPass, swapchainExtent, &attachments[0], NUM_FRAME_ATTACH);
+	}
+
+
+	// Frames in flight, one frame context per swapchain image
+	uint32_t numFrames = std::max(2u, (uint32_t)getSwapChainLength());
+	createFrameContexts(numFrames);
+	createUniformRing(numFrames);
+
+	// Worker threads used for parallel command recording
+	workers.reset(new mf::ThreadPool());
+	// Textures are decoded on the workers
+	streamer.init(this);
+
+
+	// Descriptor pools grow on demand, a transient arena per frame in flight
+	descriptors.init(device, numFrames);
+	descriptorCache.init(device, &descriptors, descriptorTemplates);
+	if (bindless)
+		bindlessTable.init(device, deviceProperties.limits);
+
+	// Timestamps: graphic, compute & compute2 begin/end pairs for each frame in flight.
+	_queries = vk::QueryPool(device, deviceProperties, VkQueryType::VK_QUERY_TYPE_TIMESTAMP, 6 * numFrames, 0);
+	VkCommandBuffer cmdBuf = beginSingleCommand(device, queues[QueueType::GRAPHIC].pool);
+	_queries.init(cmdBuf);
+	endSingleCommand_Wait(device, queues[QueueType::GRAPHIC].queue, queues[QueueType::GRAPHIC].pool, cmdBuf);
+	// Our scene implementation
+	scene->defineDescriptorLayout(device, descriptorLayouts);
+	pipelineLayout = createPipelineLayout(device, descriptorLayouts.data(), (uint32_t)descriptorLayouts.size());
+	int a = 0;
+	this->scene->initialize(this);
+	// Scene resources are registered, the table can not be written once bound
+	if (bindless)
+		bindlessTable.seal();
+
+	//Begin initial transfer command
+	beginCmdBuf(_frames[getTransferIndex()]._transferCmd);
+
+
+	return 0;
+}
+
+void VulkanRenderer::createFrameContexts(uint32_t numFrames)
+{
+	frameCycle = 0;
+	_frames.resize(numFrames);
+	for (uint32_t i = 0; i < numFrames; i++)
+	{
+		FrameContext &ctx = _frames[i];
+		ctx._imageAvailable = createSemaphore(device);
+		ctx._renderFinished = createSemaphore(device);
+		ctx._computeFinished[0] = createSemaphore(device);
+		ctx._computeFinished[1] = createSemaphore(device);
+		// Tickets start at value 0 (complete)
+		ctx._transferTicket = ctx._renderTicket = vk::Ticket();
+		ctx._computeTicket[0] = ctx._computeTicket[1] = vk::Ticket();
+
+		ctx._transferCmd = allocateCmdBuf(device, queues[QueueType::MEM].pool);
+		ctx._frameCmdBuf = allocateCmdBuf(device, queues[QueueType::GRAPHIC].pool);
+		ctx._computeCmdBuf[0] = allocateCmdBuf(device, queues[QueueType::COMPUTE].pool);
+		ctx._computeCmdBuf[1] = allocateCmdBuf(device, queues[QueueType::COMPUTE2].pool);
+	}
+}
+
+void VulkanRenderer::destroyFrameContexts()
+{
+	for (size_t i = 0; i < _frames.size(); i++)
+	{
+		FrameContext &ctx = _frames[i];
+		vkDestroySemaphore(device, ctx._imageAvailable, nullptr);
+		vkDestroySemaphore(device, ctx._renderFinished, nullptr);
+		vkDestroySemaphore(device, ctx._computeFinished[0], nullptr);
+		vkDestroySemaphore(device, ctx._computeFinished[1], nullptr);
+	}
+	_frames.clear();
+}
+
+
+void VulkanRenderer::createWindow(unsigned int width, unsigned int height)
+{
+	window = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN);
+	if (!window)
+		throw std::runtime_error(SDL_GetError());
+
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	// Get the window version
+	SDL_SysWMinfo info;
+	SDL_VERSION(&info.version);
+	if (SDL_GetWindowWMInfo(window, &info) != SDL_TRUE)
+		throw std::runtime_error("Window errror");
+
+	// Utilize version to create the window surface
+	VkWin32SurfaceCreateInfoKHR w32sci = {};
+	w32sci.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+	w32sci.pNext = NULL;
+	w32sci.hinstance = GetModuleHandle(NULL);
+	w32sci.hwnd = info.info.win.window;
+	if (vkCreateWin32SurfaceKHR(instance, &w32sci, nullptr, &windowSurface) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the window surface");
+#else
+	throw std::runtime_error("No window surface for this platform, run headless");
+#endif
+}
+
+void VulkanRenderer::createSwapchain(uint32_t BIT_FLAGS)
+{
+	VkSurfaceCapabilitiesKHR surfaceCapabilities;
+	VkResult err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, windowSurface, &surfaceCapabilities);
+	if (err)
+		throw std::runtime_error("Failed to acquire surface capabilities...");
+	if (!hasFlag(surfaceCapabilities.supportedUsageFlags, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+		throw std::runtime_error("Swapchain images does not support storage...");
+	else
+		std::cout << "Swapchain storage supported!\n";
 
 	// Check that queue supports presenting
 	VkBool32 presentingSupported;
@@ -213,6 +379,7 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 
 	// Get supported formats
 	std::vector<VkSurfaceFormatKHR> formats;
+	VkResult result;
 	ALLOC_QUERY_ASSERT(result, vkGetPhysicalDeviceSurfaceFormatsKHR, formats, physicalDevice, windowSurface);
 	swapchainFormat = formats[0]; // Just select the first available format
 #define NO_VSYNC
@@ -237,7 +404,9 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 	swapchainCreateInfo.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
 	swapchainCreateInfo.imageExtent = swapchainExtent;
 	swapchainCreateInfo.imageArrayLayers = 1;
-	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	// Blits to and from the frame image where supported
+	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+		(surfaceCapabilities.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT));
 	swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swapchainCreateInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
 	swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
@@ -258,95 +427,42 @@ int VulkanRenderer::initialize(Scene *scene, unsigned int width, unsigned int he
 	swapchainImageViews.resize(swapchainImages.size());
 	for (int i = 0; i < swapchainImages.size(); ++i)
 		swapchainImageViews[i] = createImageView(device, swapchainImages[i], swapchainCreateInfo.imageFormat);
+}
 
-	// Allocate device memory
-	createStagingBuffer();
-	// Create command pools
-	queues.createCommandPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-
-	// Allocate device memory
-	allocateImageMemory(MemoryPool::IMAGE_RGBA8_BUFFER, STORAGE_SIZE[MemoryPool::IMAGE_RGBA8_BUFFER], VK_FORMAT_R8G8B8A8_UNORM);
-	allocateImageMemory(MemoryPool::IMAGE_D16_BUFFER, STORAGE_SIZE[MemoryPool::IMAGE_D16_BUFFER], VK_FORMAT_D16_UNORM);
-	allocateBufferMemory(MemoryPool::UNIFORM_BUFFER, STORAGE_SIZE[MemoryPool::UNIFORM_BUFFER], VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	allocateBufferMemory(MemoryPool::VERTEX_BUFFER, STORAGE_SIZE[MemoryPool::VERTEX_BUFFER], VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-	allocateBufferMemory(MemoryPool::INDEX_BUFFER, STORAGE_SIZE[MemoryPool::INDEX_BUFFER], VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-	createDepthComponents();
-
-	// Create render pass
-	scene->_renderHandle = this;	// Required for creation of shadow map
-	std::vector<VkImageView> additionalAttatchments;
-	frameBufferPass = scene->defineRenderPass(device, swapchainCreateInfo.imageFormat, depthFormat, additionalAttatchments);
-	
-	// Create frame buffers.
-	NUM_FRAME_ATTACH = 2 + (uint32_t)additionalAttatchments.size();
-	swapChainFramebuffers.resize(swapchainImages.size());
-	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+void VulkanRenderer::createOffscreenTargets(uint32_t BIT_FLAGS)
+{
+	// Format matching the storage image declarations in the compute shaders
+	swapchainFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	swapchainFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+
+	// Ring of images cycled in place of the swapchain images, each image owns its allocation.
+	size_t numImages = hasFlag(BIT_FLAGS, TRIPLE_BUFFERED) ? 3 : 2;
+	swapchainImages.resize(numImages);
+	swapchainImageViews.resize(numImages);
+	offscreenMemory.resize(numImages);
+	for (size_t i = 0; i < numImages; ++i)
 	{
-		std::vector<VkImageView> attachments;
-		attachments.push_back(swapchainImageViews[i]);
-		attachments.push_back(depthImageView);
-		for (auto att : additionalAttatchments)
-			attachments.push_back(att);
-
-		swapChainFramebuffers[i] = createFramebuffer(device, frameBufferPass, swapchainExtent, &attachments[0], NUM_FRAME_ATTACH);
+		swapchainImages[i] = createColorBuffer(device, swapchainExtent.width, swapchainExtent.height, swapchainFormat.format);
+		offscreenMemory[i] = allocPhysicalMemory(device, physicalDevice, swapchainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+		VkMemoryRequirements memReq;
+		vkGetImageMemoryRequirements(device, swapchainImages[i], &memReq);
+		trackDeviceAllocation(findMemoryType(physicalDevice, memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), memReq.size);
+		swapchainImageViews[i] = createImageView(device, swapchainImages[i], swapchainFormat.format);
 	}
-
-
-	// Stuff
-	imageAvailable = createSemaphore(device);
-	renderFinished[0] = createSemaphore(device);
-	renderFinished[1] = createSemaphore(device);
-	computeFinished[0] = createSemaphore(device);
-	computeFinished[1] = createSemaphore(device);
-	_transferFences[0] = createFence(device, true);
-	_transferFences[1] = createFence(device, false);
-	computeFence[0] = createFence(device, true);
-	computeFence[1] = createFence(device, true);
-	renderFence[0] = createFence(device, true);
-	renderFence[1] = createFence(device, true);
-
-
-	for (uint32_t i = 0; i < MAX_DESCRIPTOR_POOLS; i++)
-		descriptorPools[i] = NULL;
-	descriptorPools[VkDescriptorType::VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER]
-		= createDescriptorPoolSingle(device, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2000);
-	descriptorPools[VkDescriptorType::VK_DESCRIPTOR_TYPE_STORAGE_BUFFER]
-		= createDescriptorPoolSingle(device, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2000);
-	descriptorPools[VkDescriptorType::VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER]
-		= createDescriptorPoolSingle(device, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2000);
-	descriptorPools[VkDescriptorType::VK_DESCRIPTOR_TYPE_STORAGE_IMAGE]
-		= createDescriptorPoolSingle(device, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2000);
-
-	//Begin initial transfer command
-	_transferCmd[0] = allocateCmdBuf(device, queues[QueueType::MEM].pool);
-	_transferCmd[1] = allocateCmdBuf(device, queues[QueueType::MEM].pool);
-	_frameCmdBuf[0] = allocateCmdBuf(device, queues[QueueType::GRAPHIC].pool);
-	_frameCmdBuf[1] = allocateCmdBuf(device, queues[QueueType::GRAPHIC].pool);
-	_computeCmdBuf[0] = allocateCmdBuf(device, queues[QueueType::COMPUTE].pool);
-	_computeCmdBuf[1] = allocateCmdBuf(device, queues[QueueType::COMPUTE2].pool);
-
-	_queries = vk::QueryPool(device, deviceProperties, VkQueryType::VK_QUERY_TYPE_TIMESTAMP, 12, 0);
-	VkCommandBuffer cmdBuf = beginSingleCommand(device, queues[QueueType::GRAPHIC].pool);
-	_queries.init(cmdBuf);
-	endSingleCommand_Wait(device, queues[QueueType::GRAPHIC].queue, queues[QueueType::GRAPHIC].pool, cmdBuf);
-	// Our scene implementation
-	scene->defineDescriptorLayout(device, descriptorLayouts);
-	pipelineLayout = createPipelineLayout(device, descriptorLayouts.data(), (uint32_t)descriptorLayouts.size());
-	int a = 0;
-	this->scene->initialize(this);
-
-	beginCmdBuf(_transferCmd[getTransferIndex()]);
-
-
-	return 0;
+	// First acquire cycles to image 0
+	swapChainImgIndex = (uint32_t)numImages - 1;
 }
 
-
 int VulkanRenderer::beginShutdown()
 {
-	endSingleCommand_Wait(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, _transferCmd[getTransferIndex()]);
-	releaseCommandBuffer(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, _transferCmd[getFrameIndex()]);
-	releaseCommandBuffer(device, queues[QueueType::GRAPHIC].queue, queues[QueueType::GRAPHIC].pool, _frameCmdBuf, 2);
+	// Flush the transfer commands currently recorded, release the remaining frame commands.
+	endSingleCommand_Wait(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, _frames[getTransferIndex()]._transferCmd);
+	for (uint32_t i = 0; i < getFrameCount(); i++)
+	{
+		if (i != getTransferIndex())
+			releaseCommandBuffer(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, _frames[i]._transferCmd);
+		releaseCommandBuffer(device, queues[QueueType::GRAPHIC].queue, queues[QueueType::GRAPHIC].pool, _frames[i]._frameCmdBuf);
+	}
 	// Wait for device to finish before shuting down..
 	vkDeviceWaitIdle(device);
 	return 0;
@@ -354,14 +470,45 @@ int VulkanRenderer::beginShutdown()
 
 int VulkanRenderer::shutdown()
 {
+	// Memory in use by the scene
+	printMemoryStats(std::cout);
 	delete scene;
+	TextureStreamerVulkan::Stats streamStats = streamer.getStats();
+	std::cout << "Texture streaming: " << streamStats._resident << "/" << streamStats._requested << " resident, " << streamStats._failed << " failed, "
+		<< streamStats._bytes << " bytes, " << streamStats._deferred << " deferred\n";
+	streamer.destroy();
+	workers.reset();
+	for (uint32_t i = 0; i < BufferArenaVulkan::COUNT; i++)
+	{
+		BufferArenaVulkan::Stats arenaStats = arenas[i].getStats();
+		if (arenaStats._blocks > 0)
+			std::cout << "Buffer arena " << i << ": " << arenaStats._views << " views, " << arenaStats._used << "/" << arenaStats._reserved << " bytes in "
+				<< arenaStats._blocks << " buffers (" << arenaStats._dedicated << " dedicated)\n";
+		arenas[i].destroy();
+	}
+
+	// Persist the compiled pipelines
+	pipelineCache.save();
+	PipelineCacheVulkan::Stats cacheStats = pipelineCache.getStats();
+	std::cout << "Pipeline cache (" << (cacheStats._loaded ? "warm" : "cold") << "): " << cacheStats._created << " pipelines in " << cacheStats._createTime << " ms, "
+		<< "estimated " << cacheStats._estimatedHits << " hits / " << cacheStats._estimatedMisses << " misses (baseline " << cacheStats._baselineTime << " ms/pipeline), "
+		<< "loaded " << cacheStats._loadedBytes << " bytes in " << cacheStats._loadTime << " ms\n";
+	pipelineCache.destroy();
 
 	// Clean up Vulkan
-	for (unsigned int i = 0; i < MAX_DESCRIPTOR_POOLS; i++)
+	DescriptorAllocatorVulkan::Stats descStats = descriptors.getPersistentStats();
+	std::cout << "Descriptors: " << descStats._sets << " persistent sets in " << descStats._pools << " pools";
+	for (uint32_t i = 0; i < getFrameCount(); i++)
 	{
-		if(descriptorPools[i])
-			vkDestroyDescriptorPool(device, descriptorPools[i], nullptr);
+		descStats = descriptors.getFrameStats(i);
+		std::cout << ", frame " << i << ": " << descStats._sets << " sets in " << descStats._pools << " pools";
 	}
+	std::cout << "\n";
+	DescriptorCacheVulkan::Stats cacheSetStats = descriptorCache.getStats();
+	std::cout << "Descriptor cache: " << cacheSetStats._hits << " hits, " << cacheSetStats._misses << " misses, " << cacheSetStats._templates << " templates\n";
+	descriptorCache.destroy();
+	descriptors.destroy();
+	bindlessTable.destroy();
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	for (size_t i = 0; i < descriptorLayouts.size(); i++)
 			vkDestroyDescriptorSetLayout(device, descriptorLayouts[i], nullptr);
@@ -370,18 +517,19 @@ int VulkanRenderer::shutdown()
 	// Destroy command pools
 	queues.destroy(device);
 
-	vkDestroySemaphore(device, renderFinished[0], nullptr);
-	vkDestroySemaphore(device, renderFinished[1], nullptr);
-	vkDestroySemaphore(device, computeFinished[0], nullptr);
-	vkDestroySemaphore(device, computeFinished[1], nullptr);
-	vkDestroySemaphore(device, imageAvailable, nullptr);
-	vkDestroyFence(device, _transferFences[0], nullptr);
-	vkDestroyFence(device, _transferFences[1], nullptr);
-	vkDestroyFence(device, computeFence[0], nullptr);
-	vkDestroyFence(device, computeFence[1], nullptr);
-	vkDestroyFence(device, renderFence[0], nullptr);
-	vkDestroyFence(device, renderFence[1], nullptr);
+	destroyFrameContexts();
+	StagingRingVulkan::Stats stagingStats = staging.getStats();
+	std::cout << "Staging: " << stagingStats._allocated << " bytes in " << stagingStats._allocations << " allocations, "
+		<< stagingStats._wraps << " wraps, " << stagingStats._waits << " waits\n";
+	staging.destroy();
 	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingMemory, nullptr);
+	UniformRingVulkan::Stats ringStats = uniformRing.getStats();
+	std::cout << "Uniform ring: " << ringStats._slots << " slots, " << ringStats._used << "/" << ringStats._regionSize << " bytes per region, "
+		<< ringStats._writes << " writes\n";
+	uniformRing.destroy();
+	vkDestroyBuffer(device, uniformRingBuffer, nullptr);
+	vkFreeMemory(device, uniformRingMemory, nullptr);
 
 	// Destroy frame buffer
 	vkDestroyImageView(device, depthImageView, nullptr);
@@ -390,20 +538,36 @@ int VulkanRenderer::shutdown()
 		vkDestroyFramebuffer(device, framebuffer, nullptr);
 	for (int i = 0; i < swapchainImageViews.size(); ++i)
 		vkDestroyImageView(device, swapchainImageViews[i], nullptr);
+	// Offscreen images are owned by the renderer (swapchain images are not)
+	for (size_t i = 0; i < offscreenMemory.size(); ++i)
+	{
+		vkDestroyImage(device, swapchainImages[i], nullptr);
+		vkFreeMemory(device, offscreenMemory[i], nullptr);
+	}
 
 	// Clear memory
-	for(uint32_t i = 0; i < memPool.size(); i++)
-		vkFreeMemory(device, memPool[i].handle, nullptr);
+	for (uint32_t i = 0; i < memPool.size(); i++)
+	{
+		for (DevMemoryChunk &chunk : memPool[i].chunks)
+			vkFreeMemory(device, chunk.handle, nullptr);
+		memPool[i].chunks.clear();
+		memPool[i].size = 0;
+	}
+	deviceAllocations = 0;
+	std::fill(heapUsage, heapUsage + VK_MAX_MEMORY_HEAPS, 0);
 
 
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
+	if (swapchain)
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
 	vkDestroyRenderPass(device, frameBufferPass, nullptr);
-	vkDestroySurfaceKHR(instance, windowSurface, nullptr);
+	if (windowSurface)
+		vkDestroySurfaceKHR(instance, windowSurface, nullptr);
 	vkDestroyDevice(device, nullptr);
 	vkDestroyInstance(instance, nullptr);
 
 	//Clean up SDL
-	SDL_DestroyWindow(window);
+	if (window)
+		SDL_DestroyWindow(window);
 	SDL_Quit();
 	return 0;	// temp
 }
@@ -421,14 +585,29 @@ void VulkanRenderer::clearBuffer(unsigned int flag)
 void VulkanRenderer::present(bool skipPresenting)
 {
 	// Present
-	if (!skipPresenting)
+	if (headless)
+	{
+		// No presentation engine, consume the frame signals on the graphic queue instead.
+		std::vector<VkSemaphore> waitSemaphores = getFrameSignals();
+		std::vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		if (vkQueueSubmit(queues[QueueType::GRAPHIC].queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit offscreen present!");
+	}
+	else if (!skipPresenting)
 	{
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 		// Synchronization:
-		presentInfo.waitSemaphoreCount = waitQueueLen;
-		presentInfo.pWaitSemaphores = waitQueue;
+		std::vector<VkSemaphore> waitSemaphores = getFrameSignals();
+		presentInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+		presentInfo.pWaitSemaphores = waitSemaphores.data();
 
 		VkSwapchainKHR swapChains[] = { swapchain };
 		presentInfo.swapchainCount = 1;
@@ -443,36 +622,46 @@ void VulkanRenderer::present(bool skipPresenting)
 
 void VulkanRenderer::nextFrame()
 {
-	// Cancel wait index
-	waitQueueLen = 0;
+	// Signals were consumed by the present
+	frameSignals.clear();
 	// Cycle frame index
-	frameCycle = !frameCycle;
-	// Reset the command buffer
-	VkResult err = vkResetCommandBuffer(_transferCmd[getTransferIndex()], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+	frameCycle = (frameCycle + 1) % getFrameCount();
+	frameNumber++;
+	uniformRing.nextFrame();
+	// Reset the command buffer (its last submission was waited on when the previous frame started)
+	VkCommandBuffer transferCmd = _frames[getTransferIndex()]._transferCmd;
+	VkResult err = vkResetCommandBuffer(transferCmd, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 	if (err)
 		std::cout << "Command buff reset err\n";
 	// Start recording new transfer commands
-	beginCmdBuf(_transferCmd[getTransferIndex()]);
+	beginCmdBuf(transferCmd);
 }
 
 VulkanRenderer::FrameInfo VulkanRenderer::beginFramePass(VkFramebuffer* frameBuffer)
 {	
-
-	_timeStamps[getTransferIndex()].fetchQuery(device, true);
-	FrameInfo info = beginCommandBuffer();
-	_timeStamps[getTransferIndex()].reset(info._buf);
-	_timeStamps[getFrameIndex()] = _queries.newFrame(device);
-	_timeStamps[getFrameIndex()].timeStamp(info._buf, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
-	//_timeStamps[getFrameIndex()].timeStamp(info._buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	FrameInfo info = beginFrameCommands();
 	beginRenderPass(info._buf, frameBuffer);
 
 	return info;
 }
 
+VulkanRenderer::FrameInfo VulkanRenderer::beginFrameCommands()
+{
+	FrameInfo info = beginCommandBuffer();
+	// Fetch the timestamps from the last time the frame context was used (fence is passed), then reset for re-use.
+	FrameContext &ctx = _frames[getFrameIndex()];
+	ctx._timeStamps.fetchQuery(device, true);
+	ctx._timeStamps.reset(info._buf);
+	ctx._timeStamps = _queries.newFrame(device);
+	ctx._timeStamps.timeStamp(info._buf, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+	//ctx._timeStamps.timeStamp(info._buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	return info;
+}
+
 VulkanRenderer::FrameInfo VulkanRenderer::beginCommandBuffer()
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
-	waitFence(device, renderFence[getFrameIndex()]);
+	VkCommandBuffer cmdBuf = _frames[getFrameIndex()]._frameCmdBuf;
+	queues.wait(_frames[getFrameIndex()]._renderTicket);
 	VkResult err = vkResetCommandBuffer(cmdBuf, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 	if (err)
 		std::cout << "Command buff reset err\n";
@@ -487,7 +676,7 @@ VulkanRenderer::FrameInfo VulkanRenderer::beginCommandBuffer()
 	return info;
 }
 
-void VulkanRenderer::beginRenderPass(VkCommandBuffer cmdBuf, VkFramebuffer* frameBuffer)
+void VulkanRenderer::beginRenderPass(VkCommandBuffer cmdBuf, VkFramebuffer* frameBuffer, VkSubpassContents contents)
 {
 	//Render pass
 	VkRenderPassBeginInfo renderPassInfo = {};
@@ -509,27 +698,27 @@ void VulkanRenderer::beginRenderPass(VkCommandBuffer cmdBuf, VkFramebuffer* fram
 	renderPassInfo.clearValueCount = NUM_FRAME_ATTACH;
 	renderPassInfo.pClearValues = clearValues;
 
-	vkCmdBeginRenderPass(cmdBuf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(cmdBuf, &renderPassInfo, contents);
 
 	delete clearValues;
 }
 
 void VulkanRenderer::endRenderPass()
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
+	VkCommandBuffer cmdBuf = _frames[getFrameIndex()]._frameCmdBuf;
 	vkCmdEndRenderPass(cmdBuf);
 }
 
 void VulkanRenderer::endGraphicsAndComputeRenderPass()
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
+	VkCommandBuffer cmdBuf = _frames[getFrameIndex()]._frameCmdBuf;
 	vkCmdEndRenderPass(cmdBuf);
 }
 
 VulkanRenderer::FrameInfo VulkanRenderer::beginGraphicsAndComputeCommandBuffer()
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
-	waitFence(device, renderFence[getFrameIndex()]);
+	VkCommandBuffer cmdBuf = _frames[getFrameIndex()]._frameCmdBuf;
+	queues.wait(_frames[getFrameIndex()]._renderTicket);
 	VkResult err = vkResetCommandBuffer(cmdBuf, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 	if (err)
 		std::cout << "Command buff reset err\n";
@@ -544,46 +733,55 @@ VulkanRenderer::FrameInfo VulkanRenderer::beginGraphicsAndComputeCommandBuffer()
 	return info;
 }
 
-void VulkanRenderer::submitFramePass(VkSemaphore additionalSignalSemaphore)
+vk::Ticket VulkanRenderer::submitFramePass(VkSemaphore additionalSignalSemaphore)
+{
+	return submitFramePass(nullptr, 0, additionalSignalSemaphore);
+}
+vk::Ticket VulkanRenderer::submitFramePass(const vk::Ticket *waitTickets, uint32_t numWaitTickets, VkSemaphore additionalSignalSemaphore)
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
-	_timeStamps[getFrameIndex()].timeStamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	FrameContext &ctx = _frames[getFrameIndex()];
+	VkCommandBuffer cmdBuf = ctx._frameCmdBuf;
+	ctx._timeStamps.timeStamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 	if (vkEndCommandBuffer(cmdBuf) != VK_SUCCESS) {
 		throw std::runtime_error("failed to record command buffer!");
 	}
-	// Submit
-	VkSemaphore waitSemaphores[] = { imageAvailable };
-	VkSemaphore signalSemaphores[] = { renderFinished[getFrameIndex()], additionalSignalSemaphore };
+	// Submit, waited signals are consumed from the frame
+	std::vector<VkSemaphore> waitSemaphores = { ctx._imageAvailable };
+	std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	for (uint32_t i = 0; i < numWaitTickets; i++)
+	{
+		waitSemaphores.push_back(consumeFrameSignal(waitTickets[i]));
+		waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+	}
+	VkSemaphore signalSemaphores[] = { ctx._renderFinished, additionalSignalSemaphore };
 	int signalSemaphoreCount = (additionalSignalSemaphore == VK_NULL_HANDLE) ? 1 : 2;
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;	// Mask stage where related semaphore is waited for.
+	submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();	// Mask stage where related semaphore is waited for.
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &cmdBuf;
 	submitInfo.signalSemaphoreCount = signalSemaphoreCount;
 	submitInfo.pSignalSemaphores = signalSemaphores;
-	VkResult err = vkQueueSubmit(queues[QueueType::GRAPHIC].queue, 1, &submitInfo, renderFence[getFrameIndex()]);
-	if (err != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit draw command buffer!");
-	}
+	ctx._renderTicket = queues.submit(QueueType::GRAPHIC, submitInfo, ctx._renderFinished);
 	// Sync.
-	waitQueue[waitQueueLen++] = signalSemaphores[0];
+	frameSignals.push_back(ctx._renderTicket);
+	return ctx._renderTicket;
 }
 
 VulkanRenderer::FrameInfo VulkanRenderer::beginCompute(uint32_t computeQueueIndex)
 {
-	VkCommandBuffer compBuf = _computeCmdBuf[computeQueueIndex];
-	waitFence(device, computeFence[computeQueueIndex]);
+	FrameContext &ctx = _frames[getFrameIndex()];
+	VkCommandBuffer compBuf = ctx._computeCmdBuf[computeQueueIndex];
+	queues.wait(ctx._computeTicket[computeQueueIndex]);
 	VkResult err = vkResetCommandBuffer(compBuf, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 	if (err)
 		std::cout << "Command buff reset err\n";
 	// Begin recording frame commands
 	beginCmdBuf(compBuf,  VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-	_timeStamps[getFrameIndex()].timeStamp(compBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	ctx._timeStamps.timeStamp(compBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
 
 	FrameInfo info;
 	info._buf = compBuf;
@@ -591,53 +789,58 @@ VulkanRenderer::FrameInfo VulkanRenderer::beginCompute(uint32_t computeQueueInde
 	info._swapChainImage = swapchainImages[swapChainImgIndex];
 	return info;
 }
-void VulkanRenderer::submitCompute(uint32_t computeQueueIndex, bool syncPrevious, VkSemaphore additionalWaitSemaphore)
+vk::Ticket VulkanRenderer::submitCompute(uint32_t computeQueueIndex, bool syncPrevious, VkSemaphore additionalWaitSemaphore)
+{
+	// Wait on the latest submission of the frame
+	if (syncPrevious && !frameSignals.empty())
+	{
+		vk::Ticket previous = frameSignals.back();
+		return submitCompute(computeQueueIndex, &previous, 1, additionalWaitSemaphore);
+	}
+	return submitCompute(computeQueueIndex, nullptr, 0, additionalWaitSemaphore);
+}
+vk::Ticket VulkanRenderer::submitCompute(uint32_t computeQueueIndex, const vk::Ticket *waitTickets, uint32_t numWaitTickets, VkSemaphore additionalWaitSemaphore)
 {
-	VkCommandBuffer compBuf = _computeCmdBuf[computeQueueIndex];
-	_timeStamps[getFrameIndex()].timeStamp(compBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	FrameContext &ctx = _frames[getFrameIndex()];
+	VkCommandBuffer compBuf = ctx._computeCmdBuf[computeQueueIndex];
+	ctx._timeStamps.timeStamp(compBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 	if (vkEndCommandBuffer(compBuf) != VK_SUCCESS) {
 		throw std::runtime_error("failed to record command buffer!");
 	}
 
-	// Submit
-	uint32_t waitLen = 0;
-	VkSemaphore waitSemaphores[2];
-	if (syncPrevious && waitQueueLen > 0)
-	{
-		waitSemaphores[waitLen++] = waitQueue[waitQueueLen - 1];
-		waitQueue[waitQueueLen - 1] = computeFinished[computeQueueIndex]; // Wait prev. compute queue
-	}
-	else
-		waitQueue[waitQueueLen++] = computeFinished[computeQueueIndex];
-	VkSemaphore signalSemaphores[] = { computeFinished[computeQueueIndex] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
-	waitSemaphores[1] = additionalWaitSemaphore;
-	int additionalWaitSemaphoreCount = (additionalWaitSemaphore == VK_NULL_HANDLE) ? 0 : 1;
+	// Submit, waited signals are consumed from the frame
+	std::vector<VkSemaphore> waitSemaphores;
+	for (uint32_t i = 0; i < numWaitTickets; i++)
+		waitSemaphores.push_back(consumeFrameSignal(waitTickets[i]));
+	if (additionalWaitSemaphore != VK_NULL_HANDLE)
+		waitSemaphores.push_back(additionalWaitSemaphore);
+	std::vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	VkSemaphore signalSemaphores[] = { ctx._computeFinished[computeQueueIndex] };
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = waitLen + additionalWaitSemaphoreCount;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;		// Mask stage where related semaphore is waited for.
+	submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();		// Mask stage where related semaphore is waited for.
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &compBuf;
 	submitInfo.signalSemaphoreCount = (uint32_t)std::size(signalSemaphores);
 	submitInfo.pSignalSemaphores = signalSemaphores;
-	VkResult err = vkQueueSubmit(queues[QueueType::COMPUTE + computeQueueIndex].queue, 1, &submitInfo, computeFence[computeQueueIndex]);
-	if (err != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit draw command buffer!");
-	}
+	ctx._computeTicket[computeQueueIndex] = queues.submit(QueueType::COMPUTE + computeQueueIndex, submitInfo, signalSemaphores[0]);
+	frameSignals.push_back(ctx._computeTicket[computeQueueIndex]);
+	return ctx._computeTicket[computeQueueIndex];
 }
 
-void VulkanRenderer::submitGraphicsAndCompute()
+vk::Ticket VulkanRenderer::submitGraphicsAndCompute()
 {
-	VkCommandBuffer cmdBuf = _frameCmdBuf[getFrameIndex()];
+	FrameContext &ctx = _frames[getFrameIndex()];
+	VkCommandBuffer cmdBuf = ctx._frameCmdBuf;
 	if (vkEndCommandBuffer(cmdBuf) != VK_SUCCESS) {
 		throw std::runtime_error("failed to record command buffer!");
 	}
 	// Submit
-	VkSemaphore waitSemaphores[] = { imageAvailable };
-	VkSemaphore signalSemaphores[] = { renderFinished[getFrameIndex()] };
+	VkSemaphore waitSemaphores[] = { ctx._imageAvailable };
+	VkSemaphore signalSemaphores[] = { ctx._renderFinished };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
 	VkSubmitInfo submitInfo = {};
@@ -649,28 +852,82 @@ void VulkanRenderer::submitGraphicsAndCompute()
 	submitInfo.pCommandBuffers = &cmdBuf;
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
-	VkResult err = vkQueueSubmit(queues[QueueType::GRAPHIC].queue, 1, &submitInfo, renderFence[getFrameIndex()]);
-	if (err != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit draw command buffer!");
-	}
+	ctx._renderTicket = queues.submit(QueueType::GRAPHIC, submitInfo, ctx._renderFinished);
 	// Sync.
-	waitQueue[waitQueueLen++] = signalSemaphores[0];
+	frameSignals.push_back(ctx._renderTicket);
+	return ctx._renderTicket;
+}
+
+VkSemaphore VulkanRenderer::consumeFrameSignal(const vk::Ticket &ticket)
+{
+	for (auto it = frameSignals.begin(); it != frameSignals.end(); it++)
+	{
+		if (it->queue == ticket.queue && it->value == ticket.value)
+		{
+			frameSignals.erase(it);
+			return ticket.signal;
+		}
+	}
+	throw std::runtime_error("Ticket signal is not pending in the frame (already waited on).");
+}
+
+std::vector<VkSemaphore> VulkanRenderer::getFrameSignals()
+{
+	std::vector<VkSemaphore> signals;
+	for (const vk::Ticket &ticket : frameSignals)
+		signals.push_back(ticket.signal);
+	return signals;
 }
 
 void VulkanRenderer::frame(float dt)
 {
 	scene->transfer();
 	// Submit new transfer commands
-	endSingleCommand(device, queues[QueueType::MEM].queue, _transferCmd[getTransferIndex()], _transferFences[getTransferIndex()]);
-	// Wait for previous transfer frame to complete before using it for rendering! 
-	waitFence(device, _transferFences[getFrameIndex()]);
+	FrameContext &transferCtx = _frames[getTransferIndex()];
+	streamer.record(transferCtx._transferCmd);
+	if (vkEndCommandBuffer(transferCtx._transferCmd) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record transfer commands.");
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &transferCtx._transferCmd;
+	transferCtx._transferTicket = queues.submit(QueueType::MEM, submitInfo);
+	// Staging space written for the transfer is reclaimed when the submission completes
+	staging.close(transferCtx._transferTicket);
+	streamer.submitted(transferCtx._transferTicket);
+
+	// Wait for the previous use of the frame context and its transfers to complete before rendering, single wait for all queues.
+	FrameContext &ctx = _frames[getFrameIndex()];
+	vk::Ticket frameTickets[] = { ctx._transferTicket, ctx._renderTicket, ctx._computeTicket[0], ctx._computeTicket[1] };
+	queues.wait(frameTickets, (uint32_t)std::size(frameTickets));
+	// Descriptor sets of the previous use of the frame context are released
+	descriptors.resetFrame(getFrameIndex());
+	// Streamed textures with completed uploads are acquired by their consumer queues
+	streamer.acquire();
 
 	// Start rendering
-	vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable, VK_NULL_HANDLE, &swapChainImgIndex);
+	if (headless)
+		acquireOffscreenImage();
+	else
+		vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), ctx._imageAvailable, VK_NULL_HANDLE, &swapChainImgIndex);
 
 	// Draw stuff..?:)
 	scene->frame(dt);
 }
+
+void VulkanRenderer::acquireOffscreenImage()
+{
+	// Cycle the offscreen ring
+	swapChainImgIndex = (swapChainImgIndex + 1) % (uint32_t)swapchainImages.size();
+
+	// Signal image availability as the acquire would, keeps the frame pass submission identical.
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &_frames[getFrameIndex()]._imageAvailable;
+	if (vkQueueSubmit(queues[QueueType::GRAPHIC].queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Failed to signal offscreen image!");
+}
 #pragma endregion
 
 
@@ -678,7 +935,9 @@ void VulkanRenderer::frame(float dt)
 void VulkanRenderer::createDepthComponents()
 {
 	depthFormat = findDepthFormat(physicalDevice);
-	depthImage = createDepthBuffer(device, swapchainExtent.width, swapchainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL);
+	// Sampled by the depth pyramid of the occlusion culling (ClusterCullVulkan)
+	depthImage = createDepthBuffer(device, swapchainExtent.width, swapchainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 	bindPhysicalMemory(depthImage, MemoryPool::IMAGE_RGBA8_BUFFER);
 	depthImageView = createImageView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 	transitionImageLayout(depthImage, depthFormat, 
@@ -689,106 +948,272 @@ void VulkanRenderer::createDepthComponents()
 #pragma region Memory
 
 
-void padAlignment(size_t &allocOffset, VkMemoryRequirements &memReq)
+size_t VulkanRenderer::allocatePhysicalMemory(MemoryPool pool, const VkMemoryRequirements &memReq, mf::TLSFAllocator::Kind kind, VkDeviceMemory &memory, VkDeviceSize &memOffset)
 {
-	if ((allocOffset % memReq.alignment) != 0)
-		allocOffset += memReq.alignment - (allocOffset % memReq.alignment);
+	std::lock_guard<std::mutex> lock(memPoolLock);
+	// First chunk of a compatible memory type with space
+	for (DevMemoryChunk &chunk : memPool[pool].chunks)
+	{
+		if ((memReq.memoryTypeBits & (1u << chunk.memoryType)) == 0)
+			continue;
+		uint64_t offset = chunk.allocator.allocate(memReq.size, memReq.alignment, kind);
+		if (offset == mf::TLSFAllocator::INVALID_OFFSET)
+			continue;
+		memory = chunk.handle;
+		memOffset = offset;
+		return chunk.base + (size_t)offset;
+	}
+	DevMemoryChunk &chunk = growMemoryPool(pool, memReq);
+	uint64_t offset = chunk.allocator.allocate(memReq.size, memReq.alignment, kind);
+	if (offset == mf::TLSFAllocator::INVALID_OFFSET)
+		throw std::runtime_error("Memory pool is exhausted.");
+	memory = chunk.handle;
+	memOffset = offset;
+	return chunk.base + (size_t)offset;
 }
-void padAlignment(size_t &allocOffset, size_t alignment)
+DevMemoryChunk& VulkanRenderer::growMemoryPool(MemoryPool pool, const VkMemoryRequirements &memReq)
 {
-	if ((allocOffset % alignment) != 0)
-		allocOffset += alignment - (allocOffset % alignment);
+	if (deviceAllocations >= deviceProperties.limits.maxMemoryAllocationCount)
+		throw std::runtime_error("Growing the memory pool exceeds maxMemoryAllocationCount.");
+	DevMemoryAllocation &mem = memPool[pool];
+
+	// Double the pool, the chunk must also fit the request through the size classes of the allocator
+	VkDeviceSize required = memReq.size + memReq.alignment;
+	required += required / 8;
+	VkDeviceSize size = mem.chunks.empty() ? mem.chunkSize : mem.chunks.back().allocator.size() * 2;
+	while (size < required)
+		size *= 2;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VkDeviceMemory handle;
+	VkResult result;
+	// Fall back to smaller chunks if the heap cannot fit the doubled size
+	while ((result = vkAllocateMemory(device, &allocInfo, nullptr, &handle)) != VK_SUCCESS && allocInfo.allocationSize / 2 >= required)
+		allocInfo.allocationSize /= 2;
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to grow the memory pool.");
+	trackDeviceAllocation(allocInfo.memoryTypeIndex, allocInfo.allocationSize);
+
+	DevMemoryChunk chunk;
+	chunk.handle = handle;
+	chunk.memoryType = allocInfo.memoryTypeIndex;
+	chunk.base = mem.size;
+	chunk.allocator.init(allocInfo.allocationSize, deviceProperties.limits.bufferImageGranularity);
+	mem.size += (size_t)allocInfo.allocationSize;
+	mem.chunks.push_back(std::move(chunk));
+	return mem.chunks.back();
 }
 size_t VulkanRenderer::bindPhysicalMemory(VkBuffer buffer, MemoryPool pool)
 {
-	// Adjust the memory offset to achieve proper alignment
 	VkMemoryRequirements memReq;
 	vkGetBufferMemoryRequirements(device, buffer, &memReq);
+	VkDeviceMemory memory;
+	VkDeviceSize memOffset;
+	size_t offset = allocatePhysicalMemory(pool, memReq, mf::TLSFAllocator::LINEAR, memory, memOffset);
 
-	size_t freeOffset = memPool[pool].freeOffset;
-	padAlignment(freeOffset, memReq);
-
-	VkResult result = vkBindBufferMemory(device, buffer, memPool[pool].handle, freeOffset);
+	VkResult result = vkBindBufferMemory(device, buffer, memory, memOffset);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to bind buffer to memory.");
-
-	// Update offset
-	memPool[pool].freeOffset = freeOffset + memReq.size;
-	return freeOffset;
+	return offset;
 }
 size_t VulkanRenderer::bindPhysicalMemory(VkImage img, MemoryPool pool)
 {
-	// Adjust the memory offset to achieve proper alignment
 	VkMemoryRequirements memReq;
 	vkGetImageMemoryRequirements(device, img, &memReq);
+	VkDeviceMemory memory;
+	VkDeviceSize memOffset;
+	size_t offset = allocatePhysicalMemory(pool, memReq, mf::TLSFAllocator::OPTIMAL, memory, memOffset);
 
-	size_t freeOffset = memPool[pool].freeOffset;
-	padAlignment(freeOffset, memReq);
-
-	VkResult result = vkBindImageMemory(device, img, memPool[pool].handle, freeOffset);
+	VkResult result = vkBindImageMemory(device, img, memory, memOffset);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to bind buffer to memory.");
+	return offset;
+}
+void VulkanRenderer::trackDeviceAllocation(uint32_t memoryType, VkDeviceSize size)
+{
+	deviceAllocations++;
+	heapUsage[memProperties.memoryTypes[memoryType].heapIndex] += size;
+}
+void VulkanRenderer::freePhysicalMemory(MemoryPool pool, size_t offset)
+{
+	std::lock_guard<std::mutex> lock(memPoolLock);
+	for (DevMemoryChunk &chunk : memPool[pool].chunks)
+	{
+		if (offset >= chunk.base && offset - chunk.base < chunk.allocator.size())
+		{
+			chunk.allocator.free(offset - chunk.base);
+			return;
+		}
+	}
+	throw std::runtime_error("Freeing memory outside of the pool.");
+}
+
+const char* const MEMORY_POOL_NAMES[MemoryPool::Count] = { "STAGING", "UNIFORM", "IMAGE_RGBA8", "VERTEX", "INDEX", "IMAGE_D16" };
+
+MemoryStats VulkanRenderer::getMemoryStats()
+{
+	std::lock_guard<std::mutex> lock(memPoolLock);
+	MemoryStats stats = {};
+	for (uint32_t i = 0; i < memPool.size(); i++)
+	{
+		MemoryPoolStats &pool = stats._pools[i];
+		pool._allocated = memPool[i].size;
+		pool._chunks = (uint32_t)memPool[i].chunks.size();
+		for (DevMemoryChunk &chunk : memPool[i].chunks)
+		{
+			mf::TLSFAllocator::Stats chunkStats = chunk.allocator.getStats();
+			pool._used += (size_t)chunkStats._used;
+			pool._padding += (size_t)chunkStats._padding;
+			pool._allocations += chunkStats._allocations;
+			pool._freeBlocks += chunkStats._freeBlocks;
+			pool._largestFree = std::max(pool._largestFree, (size_t)chunkStats._largestFree);
+		}
+		size_t free = pool._allocated - pool._used;
+		pool._fragmentation = pool._chunks == 0 || free == 0 ? 0.f : 1.f - (float)pool._largestFree / (float)free;
+	}
+	// Staging is a ring, its memory is not partitioned
+	stats._pools[MemoryPool::STAGING_BUFFER]._chunks = stagingMemory ? 1 : 0;
+
+	stats._heaps.resize(memProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++)
+	{
+		stats._heaps[i]._size = memProperties.memoryHeaps[i].size;
+		stats._heaps[i]._budget = memProperties.memoryHeaps[i].size;
+		stats._heaps[i]._usage = heapUsage[i];
+		stats._heaps[i]._deviceLocal = hasFlag(memProperties.memoryHeaps[i].flags, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+	}
+	stats._deviceAllocations = deviceAllocations;
+	stats._maxDeviceAllocations = deviceProperties.limits.maxMemoryAllocationCount;
+	return stats;
+}
+
+void VulkanRenderer::printMemoryStats(std::ostream &stream)
+{
+	MemoryStats stats = getMemoryStats();
+	stream << "Memory: " << stats._deviceAllocations << "/" << stats._maxDeviceAllocations << " device allocations\n";
+	for (uint32_t i = 0; i < MemoryPool::Count; i++)
+	{
+		const MemoryPoolStats &pool = stats._pools[i];
+		if (pool._chunks == 0)
+			continue;
+		stream << "  Pool " << MEMORY_POOL_NAMES[i] << ": " << pool._used << "/" << pool._allocated << " bytes in " << pool._chunks << " chunks, "
+			<< pool._allocations << " allocations, " << pool._padding << " bytes padding, " << pool._freeBlocks << " free blocks, largest "
+			<< pool._largestFree << ", fragmentation " << pool._fragmentation << "\n";
+	}
+	for (size_t i = 0; i < stats._heaps.size(); i++)
+	{
+		const MemoryHeapStats &heap = stats._heaps[i];
+		stream << "  Heap " << i << (heap._deviceLocal ? " (device local)" : "") << ": " << heap._usage << "/" << heap._budget << " bytes\n";
+	}
+}
 
-	// Update offset
-	memPool[pool].freeOffset = freeOffset + memReq.size;
-	return freeOffset;
+void VulkanRenderer::writeMemoryStatsJSON(std::ostream &stream, const std::string &run)
+{
+	MemoryStats stats = getMemoryStats();
+	std::string label;
+	for (char c : run)
+	{
+		if (c == '"' || c == '\\')
+			label += '\\';
+		label += c;
+	}
+	stream << "{\"run\": \"" << label << "\", \"deviceAllocations\": " << stats._deviceAllocations
+		<< ", \"maxDeviceAllocations\": " << stats._maxDeviceAllocations << ", \"pools\": {";
+	for (uint32_t i = 0; i < MemoryPool::Count; i++)
+	{
+		const MemoryPoolStats &pool = stats._pools[i];
+		stream << (i > 0 ? ", " : "") << "\"" << MEMORY_POOL_NAMES[i] << "\": {\"allocated\": " << pool._allocated << ", \"used\": " << pool._used
+			<< ", \"padding\": " << pool._padding << ", \"chunks\": " << pool._chunks << ", \"allocations\": " << pool._allocations
+			<< ", \"freeBlocks\": " << pool._freeBlocks << ", \"largestFree\": " << pool._largestFree << ", \"fragmentation\": " << pool._fragmentation << "}";
+	}
+	stream << "}, \"heaps\": [";
+	for (size_t i = 0; i < stats._heaps.size(); i++)
+	{
+		const MemoryHeapStats &heap = stats._heaps[i];
+		stream << (i > 0 ? ", " : "") << "{\"size\": " << heap._size << ", \"budget\": " << heap._budget << ", \"usage\": " << heap._usage
+			<< ", \"deviceLocal\": " << (heap._deviceLocal ? "true" : "false") << "}";
+	}
+	stream << "]}" << std::endl;
+}
+
+VkDescriptorSet VulkanRenderer::generateDescriptor(uint32_t set_binding)
+{
+	return descriptors.allocate(descriptorLayouts[set_binding]);
 }
 
-VkDescriptorSet VulkanRenderer::generateDescriptor(VkDescriptorType type, uint32_t set_binding)
+VkDescriptorSet VulkanRenderer::generateDescriptor(VkDescriptorSetLayout *layout)
 {
-	return createDescriptorSet(device, descriptorPools[type], &descriptorLayouts[set_binding]);
+	return descriptors.allocate(*layout);
 }
 
-VkDescriptorSet VulkanRenderer::generateDescriptor(VkDescriptorType type, VkDescriptorSetLayout *layout)
+VkDescriptorSet VulkanRenderer::generateFrameDescriptor(VkDescriptorSetLayout layout)
 {
-	return createDescriptorSet(device, descriptorPools[type], layout);
+	return descriptors.allocateFrame(getFrameIndex(), layout);
 }
 
 void VulkanRenderer::transferBufferData(VkBuffer buffer, const void* data, size_t size, size_t offset)
 {
-	uint32_t src_offset = updateStagingBuffer(data, size);
+	StagingRingVulkan::Allocation src = staging.allocate(size);
+	memcpy(src._data, data, size);
+	transferBufferStaged(buffer, src, offset);
+}
 
+void VulkanRenderer::transferBufferStaged(VkBuffer buffer, const StagingRingVulkan::Allocation &src, size_t offset)
+{
 	// Record the copying command
 	VkBufferCopy bufferCopyRegion = {};
-	bufferCopyRegion.srcOffset = src_offset;
+	bufferCopyRegion.srcOffset = src._offset;
 	bufferCopyRegion.dstOffset = offset;
-	bufferCopyRegion.size = size;
+	bufferCopyRegion.size = src._size;
 
-	vkCmdCopyBuffer(_transferCmd[getTransferIndex()], stagingBuffer, buffer, 1, &bufferCopyRegion);
+	vkCmdCopyBuffer(_frames[getTransferIndex()]._transferCmd, stagingBuffer, buffer, 1, &bufferCopyRegion);
 }
 
+void VulkanRenderer::drawIndirectCount(VkCommandBuffer cmdBuf, bool indexed, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+	if (!drawIndirectCountFn)
+		throw std::runtime_error("Draw indirect count is not supported by the device.");
+	if (indexed)
+		drawIndexedIndirectCountFn(cmdBuf, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+	else
+		drawIndirectCountFn(cmdBuf, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+}
+
+/* The single command transfers below are waited on, their staging space is released as soon as the copy completed.
+*/
 void VulkanRenderer::transferBufferInitial(VkBuffer buffer, const void* data, size_t size, size_t offset)
 {
-	stagingCycleOffset = 0;
-	updateStagingBuffer(data, size);
+	StagingRingVulkan::Allocation src = staging.allocate(size);
+	memcpy(src._data, data, size);
 
 	VkCommandBuffer cmdBuffer = beginSingleCommand(device, queues[QueueType::MEM].pool);
 
 	// Record the copying command
 	VkBufferCopy bufferCopyRegion = {};
-	bufferCopyRegion.srcOffset = 0;
+	bufferCopyRegion.srcOffset = src._offset;
 	bufferCopyRegion.dstOffset = offset;
 	bufferCopyRegion.size = size;
 
 	vkCmdCopyBuffer(cmdBuffer, stagingBuffer, buffer, 1, &bufferCopyRegion);
 	endSingleCommand_Wait(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, cmdBuffer);
-	stagingCycleOffset = 0;
+	staging.release(src);
 }
 
 void VulkanRenderer::transferImageData(VkImage image, const void* data, glm::uvec3 img_size, uint32_t pixel_bytes, glm::ivec3 offset)
 {
-	// Currently no img transfer in loop
-	vkQueueWaitIdle(queues[QueueType::MEM].queue);
-	stagingCycleOffset = 0;
-
 	uint32_t size = img_size.x * img_size.y * img_size.z * pixel_bytes;
-	updateStagingBuffer(data, size);
+	// Buffer offset must be a multiple of 4 and of the texel size
+	StagingRingVulkan::Allocation src = staging.allocate(size, 4 * pixel_bytes);
+	memcpy(src._data, data, size);
 
 	VkCommandBuffer cmdBuffer = beginSingleCommand(device, queues[QueueType::MEM].pool);
 
 	// Record the copying command
 	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;		// Initial padding
+	region.bufferOffset = src._offset;	// Initial padding
 	region.bufferRowLength = 0;		// Row padding
 	region.bufferImageHeight = 0;	// Column padding
 
@@ -810,7 +1235,7 @@ void VulkanRenderer::transferImageData(VkImage image, const void* data, glm::uve
 	);
 
 	endSingleCommand_Wait(device, queues[QueueType::MEM].queue, queues[QueueType::MEM].pool, cmdBuffer);
-	stagingCycleOffset = 0;
+	staging.release(src);
 }
 
 
@@ -890,56 +1315,32 @@ void VulkanRenderer::transitionImageLayout(VkImage image, VkFormat format, VkIma
 	endSingleCommand_Wait(device, queues[QueueType::GRAPHIC].queue, queues[QueueType::GRAPHIC].pool, cmdBuffer);
 }
 
-uint32_t VulkanRenderer::updateStagingBuffer(const void* data, size_t size)
-{
-	if (size > STORAGE_SIZE[MemoryPool::STAGING_BUFFER])
-		throw std::runtime_error("The data requested does not fit in the staging buffer.");
-	
-	size_t offset = stagingCycleOffset;
-	padAlignment(offset, (size_t)deviceProperties.limits.minMemoryMapAlignment);
-	// Cycle staging buffer
-	if (offset + std::max(deviceProperties.limits.minMemoryMapAlignment, size) > STORAGE_SIZE[MemoryPool::STAGING_BUFFER])
-	{
-		stagingCycleOffset = 0;
-		offset = 0;
-	}
-	stagingCycleOffset = (uint32_t)(offset + size);
-
-	void* bufferContents = nullptr;
-	VkResult result = vkMapMemory(device, memPool[MemoryPool::STAGING_BUFFER].handle, offset, size, 0, &bufferContents);
-	
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to map staging buffer to memory.");
-
-	memcpy(bufferContents, data, size);
-
-	vkUnmapMemory(device, memPool[MemoryPool::STAGING_BUFFER].handle);
-	return (uint32_t)offset;
-}
-
 void VulkanRenderer::createStagingBuffer()
 {
-	stagingBuffer = createBuffer(device, STORAGE_SIZE[MemoryPool::STAGING_BUFFER], VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	memPool[MemoryPool::STAGING_BUFFER].handle = allocPhysicalMemory(device, physicalDevice, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	size_t size = memPool[MemoryPool::STAGING_BUFFER].chunkSize;
+	stagingBuffer = createBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	stagingMemory = allocPhysicalMemory(device, physicalDevice, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	VkMemoryRequirements memReq;
+	vkGetBufferMemoryRequirements(device, stagingBuffer, &memReq);
+	trackDeviceAllocation(findMemoryType(physicalDevice, memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), memReq.size);
+	memPool[MemoryPool::STAGING_BUFFER].size = size;
+	// Mapped once, uploads are written in place
+	staging.init(device, &queues, stagingBuffer, stagingMemory, size, std::max<VkDeviceSize>(deviceProperties.limits.optimalBufferCopyOffsetAlignment, 4));
 }
 
-void VulkanRenderer::allocateBufferMemory(MemoryPool type, size_t size, VkFlags usage)
-{
-	VkBuffer dummy = createBuffer(device, size, usage);
-	memPool[type].handle = allocPhysicalMemory(device, physicalDevice, dummy, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	vkDestroyBuffer(device, dummy, nullptr);
-}
-void VulkanRenderer::allocateImageMemory(MemoryPool type, size_t size, VkFormat imgFormat)
-{
-	// Might be a bad way to set size...
-	uint32_t size_dim = (uint32_t)sqrt(size);
-	VkImage dummy = createTexture2D(device, size_dim, size_dim, imgFormat);
-	memPool[type].handle = allocPhysicalMemory(device, physicalDevice, dummy, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	vkDestroyImage(device, dummy, nullptr);
-}
-void VulkanRenderer::allocateImageMemory(MemoryPool type, VkImage &image, VkFormat imgFormat)
+void VulkanRenderer::createUniformRing(uint32_t numFrames)
 {
-	memPool[type].handle = allocPhysicalMemory(device, physicalDevice, image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+	// Regions are cycled by frame number, the region written for the next frame is not read by a frame in flight
+	uint32_t numRegions = numFrames + 2;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(deviceProperties.limits.minUniformBufferOffsetAlignment, 4);
+	VkDeviceSize regionSize = (UNIFORM_RING_REGION_SIZE + alignment - 1) / alignment * alignment;
+	uniformRingBuffer = createBuffer(device, (size_t)(regionSize * numRegions), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	uniformRingMemory = allocPhysicalMemory(device, physicalDevice, uniformRingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	VkMemoryRequirements memReq;
+	vkGetBufferMemoryRequirements(device, uniformRingBuffer, &memReq);
+	trackDeviceAllocation(findMemoryType(physicalDevice, memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), memReq.size);
+	// Mapped once, uniforms are written in place
+	uniformRing.init(device, uniformRingBuffer, uniformRingMemory, regionSize, numRegions, alignment);
 }
 
 #pragma endregion
@@ -1001,7 +1402,8 @@ VkDescriptorSetLayout VulkanRenderer::getDescriptorSetLayout(uint32_t index)
 
 void VulkanRenderer::setWinTitle(const char* title)
 {
-	SDL_SetWindowTitle(window, title);
+	if (window)
+		SDL_SetWindowTitle(window, title);
 }
 void VulkanRenderer::setClearColor(float r, float g, float b, float a)
 {